@@ -17,6 +17,336 @@ extern "C"
 #include "crc/crctbl.h"
 }
 
+#include <atomic>
+#include <thread>
+#include <vector>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define CRC_HAVE_CLMUL
+#include <emmintrin.h>
+#include <wmmintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define CRC_TARGET_CLMUL
+#else
+#include <cpuid.h>
+#define CRC_TARGET_CLMUL __attribute__((target("sse2,pclmul")))
+#endif
+#endif
+
+namespace
+{
+    // Signature of an update implementation
+    typedef uint32 (*UpdateFunc)(uint32 aCrc, const uint8 *apBuffer, size_t aLength);
+
+    // Slicing tables. Table 0 is crctbl, table N gives the CRC contribution
+    // of a byte followed by N zero bytes.
+    class SliceTables
+    {
+    public:
+        static const size_t NUM_TABLES = 16;
+
+        SliceTables()
+        {
+            for (size_t n = 0; n < 256; ++n)
+            {
+                mTable[0][n] = crctbl[n];
+            }
+            for (size_t n = 0; n < 256; ++n)
+            {
+                uint32 crc = mTable[0][n];
+                for (size_t k = 1; k < NUM_TABLES; ++k)
+                {
+                    crc = crctbl[crc & 0xff] ^ (crc >> 8);
+                    mTable[k][n] = crc;
+                }
+            }
+        }
+
+        uint32 mTable[NUM_TABLES][256];
+    };
+
+    const SliceTables &GetSliceTables()
+    {
+        static const SliceTables tables;
+        return tables;
+    }
+
+    // Reference implementation, one byte at a time
+    uint32 UpdateBytewise(uint32 aCrc, const uint8 *apBuffer, size_t aLength)
+    {
+        for (size_t index = 0; index < aLength; ++index)
+        {
+            aCrc = crctbl[(aCrc ^ apBuffer[index]) & 0xff] ^ (aCrc >> 8);
+        }
+        return aCrc;
+    }
+
+    // Gather four bytes as a little-endian word (independent of host order)
+    inline uint32 LoadLe32(const uint8 *apBuffer)
+    {
+        return (uint32)apBuffer[0] | ((uint32)apBuffer[1] << 8) |
+            ((uint32)apBuffer[2] << 16) | ((uint32)apBuffer[3] << 24);
+    }
+
+    uint32 UpdateSliceBy8(uint32 aCrc, const uint8 *apBuffer, size_t aLength)
+    {
+        const uint32 (*t)[256] = GetSliceTables().mTable;
+        while (aLength >= 8)
+        {
+            const uint32 lo = aCrc ^ LoadLe32(apBuffer);
+            const uint32 hi = LoadLe32(apBuffer + 4);
+            aCrc = t[7][lo & 0xff] ^ t[6][(lo >> 8) & 0xff] ^
+                   t[5][(lo >> 16) & 0xff] ^ t[4][lo >> 24] ^
+                   t[3][hi & 0xff] ^ t[2][(hi >> 8) & 0xff] ^
+                   t[1][(hi >> 16) & 0xff] ^ t[0][hi >> 24];
+            apBuffer += 8;
+            aLength -= 8;
+        }
+        return UpdateBytewise(aCrc, apBuffer, aLength);
+    }
+
+    uint32 UpdateSliceBy16(uint32 aCrc, const uint8 *apBuffer, size_t aLength)
+    {
+        const uint32 (*t)[256] = GetSliceTables().mTable;
+        while (aLength >= 16)
+        {
+            const uint32 w0 = aCrc ^ LoadLe32(apBuffer);
+            const uint32 w1 = LoadLe32(apBuffer + 4);
+            const uint32 w2 = LoadLe32(apBuffer + 8);
+            const uint32 w3 = LoadLe32(apBuffer + 12);
+            aCrc = t[15][w0 & 0xff] ^ t[14][(w0 >> 8) & 0xff] ^
+                   t[13][(w0 >> 16) & 0xff] ^ t[12][w0 >> 24] ^
+                   t[11][w1 & 0xff] ^ t[10][(w1 >> 8) & 0xff] ^
+                   t[9][(w1 >> 16) & 0xff] ^ t[8][w1 >> 24] ^
+                   t[7][w2 & 0xff] ^ t[6][(w2 >> 8) & 0xff] ^
+                   t[5][(w2 >> 16) & 0xff] ^ t[4][w2 >> 24] ^
+                   t[3][w3 & 0xff] ^ t[2][(w3 >> 8) & 0xff] ^
+                   t[1][(w3 >> 16) & 0xff] ^ t[0][w3 >> 24];
+            apBuffer += 16;
+            aLength -= 16;
+        }
+        return UpdateBytewise(aCrc, apBuffer, aLength);
+    }
+
+#ifdef CRC_HAVE_CLMUL
+    bool HostHasClmul()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 1);
+        return (info[2] & (1 << 1)) != 0;
+#else
+        unsigned int eax, ebx, ecx, edx;
+        return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & bit_PCLMUL) != 0;
+#endif
+    }
+
+    // Fold 64-byte blocks with carry-less multiplication, then reduce to
+    // 32 bits (Gopal et al, "Fast CRC Computation for Generic Polynomials
+    // Using PCLMULQDQ Instruction", Intel 2009). The constants are for the
+    // bit-reflected polynomial 0xedb88320. Requires aLength >= 64 and a
+    // multiple of 16.
+    CRC_TARGET_CLMUL
+    uint32 FoldClmul(uint32 aCrc, const uint8 *apBuffer, size_t aLength)
+    {
+        const __m128i k1k2 = _mm_set_epi64x(0x01c6e41596LL, 0x0154442bd4LL);
+        const __m128i k3k4 = _mm_set_epi64x(0x00ccaa009eLL, 0x01751997d0LL);
+        const __m128i k5k0 = _mm_set_epi64x(0x0000000000LL, 0x0163cd6124LL);
+        const __m128i poly = _mm_set_epi64x(0x01f7011641LL, 0x01db710641LL);
+        const __m128i mask32 = _mm_setr_epi32(~0, 0, ~0, 0);
+
+        __m128i x1 = _mm_loadu_si128((const __m128i *)(apBuffer + 0x00));
+        __m128i x2 = _mm_loadu_si128((const __m128i *)(apBuffer + 0x10));
+        __m128i x3 = _mm_loadu_si128((const __m128i *)(apBuffer + 0x20));
+        __m128i x4 = _mm_loadu_si128((const __m128i *)(apBuffer + 0x30));
+        __m128i x5, x6, x7, x8;
+
+        x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)aCrc));
+        apBuffer += 64;
+        aLength -= 64;
+
+        // Four independent 128-bit lanes
+        while (aLength >= 64)
+        {
+            x5 = _mm_clmulepi64_si128(x1, k1k2, 0x00);
+            x6 = _mm_clmulepi64_si128(x2, k1k2, 0x00);
+            x7 = _mm_clmulepi64_si128(x3, k1k2, 0x00);
+            x8 = _mm_clmulepi64_si128(x4, k1k2, 0x00);
+
+            x1 = _mm_clmulepi64_si128(x1, k1k2, 0x11);
+            x2 = _mm_clmulepi64_si128(x2, k1k2, 0x11);
+            x3 = _mm_clmulepi64_si128(x3, k1k2, 0x11);
+            x4 = _mm_clmulepi64_si128(x4, k1k2, 0x11);
+
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i *)(apBuffer + 0x00)));
+            x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i *)(apBuffer + 0x10)));
+            x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i *)(apBuffer + 0x20)));
+            x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i *)(apBuffer + 0x30)));
+
+            apBuffer += 64;
+            aLength -= 64;
+        }
+
+        // Fold the four lanes into one
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+
+        x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+        x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+        x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+        // Remaining 16-byte blocks
+        while (aLength >= 16)
+        {
+            x5 = _mm_clmulepi64_si128(x1, k3k4, 0x00);
+            x1 = _mm_clmulepi64_si128(x1, k3k4, 0x11);
+            x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i *)apBuffer)), x5);
+            apBuffer += 16;
+            aLength -= 16;
+        }
+
+        // 128 to 64 bits
+        x2 = _mm_clmulepi64_si128(x1, k3k4, 0x10);
+        x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+
+        x2 = _mm_srli_si128(x1, 4);
+        x1 = _mm_and_si128(x1, mask32);
+        x1 = _mm_clmulepi64_si128(x1, k5k0, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        // Barrett reduction to 32 bits
+        x2 = _mm_and_si128(x1, mask32);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x10);
+        x2 = _mm_and_si128(x2, mask32);
+        x2 = _mm_clmulepi64_si128(x2, poly, 0x00);
+        x1 = _mm_xor_si128(x1, x2);
+
+        return (uint32)(unsigned int)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+    }
+
+    uint32 UpdateClmul(uint32 aCrc, const uint8 *apBuffer, size_t aLength)
+    {
+        if (aLength >= 64)
+        {
+            const size_t foldLength = aLength & ~(size_t)15;
+            aCrc = FoldClmul(aCrc, apBuffer, foldLength);
+            apBuffer += foldLength;
+            aLength -= foldLength;
+        }
+        return UpdateSliceBy16(aCrc, apBuffer, aLength);
+    }
+#endif
+
+    UpdateFunc GetUpdateFunc(CRC::Implementation aImpl)
+    {
+        switch (aImpl)
+        {
+        case CRC::IMPL_BYTEWISE:
+            return UpdateBytewise;
+        case CRC::IMPL_SLICE_BY_8:
+            return UpdateSliceBy8;
+        case CRC::IMPL_SLICE_BY_16:
+            return UpdateSliceBy16;
+#ifdef CRC_HAVE_CLMUL
+        case CRC::IMPL_CLMUL:
+            return HostHasClmul() ? UpdateClmul : 0;
+#endif
+        default:
+            return 0;
+        }
+    }
+
+    CRC::Implementation GetAutoImplementation()
+    {
+        return GetUpdateFunc(CRC::IMPL_CLMUL) != 0 ? CRC::IMPL_CLMUL : CRC::IMPL_SLICE_BY_16;
+    }
+
+    // The selected implementation, shared by all CRC objects. It may be
+    // changed while other threads are updating; each update loads the
+    // function once, and all of them give the same result.
+    struct Selection
+    {
+        Selection()
+            : mImpl(GetAutoImplementation()),
+              mpUpdate(GetUpdateFunc(mImpl.load()))
+        {
+        }
+
+        std::atomic<CRC::Implementation> mImpl;
+        std::atomic<UpdateFunc> mpUpdate;
+    };
+
+    Selection &GetSelection()
+    {
+        static Selection selection;
+        return selection;
+    }
+
+    // Smallest block given to each thread by CRC::UpdateParallel
+    const size_t PARALLEL_MIN_BLOCK = 4 * 1024 * 1024;
+
+    // Multiply a and b modulo the (bit-reflected) CRC polynomial
+    uint32 MultModP(uint32 a, uint32 b)
+    {
+        uint32 m = 0x80000000;
+        uint32 p = 0;
+        for (;;)
+        {
+            if (a & m)
+            {
+                p ^= b;
+                if ((a & (m - 1)) == 0)
+                {
+                    break;
+                }
+            }
+            m >>= 1;
+            b = (b & 1) ? (b >> 1) ^ 0xedb88320 : b >> 1;
+        }
+        return p;
+    }
+
+    // Table of x^(2^n) modulo the CRC polynomial, for n = 0..31
+    struct PowerTable
+    {
+        PowerTable()
+        {
+            uint32 p = 0x40000000;  // x^1
+            mX2n[0] = p;
+            for (size_t n = 1; n < 32; ++n)
+            {
+                p = MultModP(p, p);
+                mX2n[n] = p;
+            }
+        }
+
+        uint32 mX2n[32];
+    };
+
+    // Shift a CRC register past aLength zero bytes, i.e. multiply by
+    // x^(8 * aLength) modulo the CRC polynomial
+    uint32 ShiftZeros(uint32 aCrc, uint64 aLength)
+    {
+        static const PowerTable table;
+
+        uint32 p = 0x80000000;      // x^0
+        for (unsigned k = 3; aLength != 0; aLength >>= 1, ++k)
+        {
+            if (aLength & 1)
+            {
+                p = MultModP(table.mX2n[k & 31], p);
+            }
+        }
+        return MultModP(p, aCrc);
+    }
+}
+
 // Constructor
 CRC::CRC(uint32 aInitCRC)
 {
@@ -27,12 +357,108 @@ CRC::CRC(uint32 aInitCRC)
 uint32 CRC::operator()(const void *apBuffer, size_t aBufferLength)
 {
     // Include the new data within the CRC
-    const uint8 * const pBuffer = (uint8 *)apBuffer;
-    for (size_t index = 0; index < aBufferLength; ++index)
+    if (aBufferLength > 0)
     {
-        mCrc = crctbl[(mCrc ^ pBuffer[index]) & 0xff] ^ (mCrc >> 8);
+        mCrc = GetSelection().mpUpdate.load()(mCrc, (const uint8 *)apBuffer, aBufferLength);
     }
 
     // Return the current value
     return mCrc;
 }
+
+// Update the CRC using several threads and return the current value
+uint32 CRC::UpdateParallel(const void *apBuffer, size_t aBufferLength, unsigned aMaxThreads)
+{
+    size_t numBlocks = (aMaxThreads != 0 ? aMaxThreads : std::thread::hardware_concurrency());
+    if (numBlocks > aBufferLength / PARALLEL_MIN_BLOCK)
+    {
+        numBlocks = aBufferLength / PARALLEL_MIN_BLOCK;
+    }
+
+    if (numBlocks <= 1)
+    {
+        return (*this)(apBuffer, aBufferLength);
+    }
+
+    // The first block continues from the current value on this thread, the
+    // others are calculated from zero and then shifted into place (the CRC
+    // is linear, so the contribution of a block does not depend on the
+    // value it starts from other than through that shift)
+    const uint8 *pData = (const uint8 *)apBuffer;
+    const size_t blockLength = aBufferLength / numBlocks;
+    const UpdateFunc pUpdate = GetSelection().mpUpdate.load();
+    std::vector<uint32> blockCrcs(numBlocks, 0);
+    std::vector<std::thread> threads;
+
+    for (size_t n = 1; n < numBlocks; ++n)
+    {
+        const uint8 *pBlock = pData + n * blockLength;
+        const size_t length = (n == numBlocks - 1 ? aBufferLength - n * blockLength : blockLength);
+        uint32 *pBlockCrc = &blockCrcs[n];
+        threads.push_back(std::thread([=]() { *pBlockCrc = pUpdate(0, pBlock, length); }));
+    }
+
+    mCrc = pUpdate(mCrc, pData, blockLength);
+
+    for (size_t n = 1; n < numBlocks; ++n)
+    {
+        threads[n - 1].join();
+        const size_t length = (n == numBlocks - 1 ? aBufferLength - n * blockLength : blockLength);
+        mCrc = ShiftZeros(mCrc, length) ^ blockCrcs[n];
+    }
+
+    return mCrc;
+}
+
+// Combine the CRCs of two adjacent blocks
+uint32 CRC::Combine(uint32 aCrc1, uint32 aCrc2, uint64 aLength2, uint32 aInitCRC)
+{
+    // aCrc2 includes the initialisation value shifted through the second
+    // block; replacing it with aCrc1 gives the CRC of both blocks
+    return ShiftZeros(aCrc1 ^ aInitCRC, aLength2) ^ aCrc2;
+}
+
+// Select the implementation used by all CRC objects
+bool CRC::SetImplementation(Implementation aImpl)
+{
+    if (aImpl == IMPL_AUTO)
+    {
+        aImpl = GetAutoImplementation();
+    }
+
+    UpdateFunc pUpdate = GetUpdateFunc(aImpl);
+    if (pUpdate != 0)
+    {
+        Selection &selection = GetSelection();
+        selection.mpUpdate.store(pUpdate);
+        selection.mImpl.store(aImpl);
+    }
+
+    return pUpdate != 0;
+}
+
+// Get the implementation currently in use
+CRC::Implementation CRC::GetImplementation()
+{
+    return GetSelection().mImpl.load();
+}
+
+// Get a printable name for an implementation
+const char *CRC::GetImplementationName(Implementation aImpl)
+{
+    switch (aImpl)
+    {
+    case IMPL_AUTO:
+        return "auto";
+    case IMPL_BYTEWISE:
+        return "bytewise";
+    case IMPL_SLICE_BY_8:
+        return "slice-by-8";
+    case IMPL_SLICE_BY_16:
+        return "slice-by-16";
+    case IMPL_CLMUL:
+        return "clmul";
+    default:
+        return "unknown";
+    }
+}
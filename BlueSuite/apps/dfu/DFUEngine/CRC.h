@@ -16,6 +16,13 @@
 //  CRC. It returns the result up to that point. To just read the current value 
 //  without affecting the CRC use operator () without any parameters.
 //
+//  The CRCs of adjacent blocks can be combined, which allows a large buffer 
+//  to be processed in parallel (UpdateParallel).
+//
+//  The update is performed by one of several equivalent implementations, the
+//  fastest supported by the host CPU being selected on first use. All produce
+//  identical results; the selection can be overridden (e.g. for benchmarking).
+//
 //*******************************************************************************
 
 #ifndef CRC_H
@@ -28,6 +35,16 @@ class CRC
 {
 public:
 
+    // Update implementations
+    enum Implementation
+    {
+        IMPL_AUTO,          // Fastest supported by the host CPU
+        IMPL_BYTEWISE,      // One table lookup per byte
+        IMPL_SLICE_BY_8,    // Eight table lookups per 8 bytes
+        IMPL_SLICE_BY_16,   // Sixteen table lookups per 16 bytes
+        IMPL_CLMUL          // x86 carry-less multiply (PCLMULQDQ) folding
+    };
+
     // Constructor
     CRC(uint32 aInitCRC = 0xFFFFFFFF);
 
@@ -35,6 +52,29 @@ public:
     uint32 operator()(const void *apBuffer = 0, 
                       size_t aBufferLength = 0);
 
+    // Update the CRC as operator() but split the data across up to
+    // aMaxThreads threads (0 for one per hardware thread), combining the
+    // partial results. Small buffers are processed on the calling thread.
+    uint32 UpdateParallel(const void *apBuffer, size_t aBufferLength,
+                          unsigned aMaxThreads = 0);
+
+    // Combine the CRCs of two adjacent blocks of data, aCrc1 of the first
+    // and aCrc2 of the second (aLength2 bytes long), both calculated from
+    // aInitCRC. Returns the CRC of the two blocks together.
+    static uint32 Combine(uint32 aCrc1, uint32 aCrc2, uint64 aLength2,
+                          uint32 aInitCRC = 0xFFFFFFFF);
+
+    // Select the implementation used by all CRC objects. Returns false (and
+    // leaves the selection unchanged) if not supported by the host CPU. It
+    // may be called while other threads are updating CRCs.
+    static bool SetImplementation(Implementation aImpl);
+
+    // Get the implementation currently in use (never IMPL_AUTO)
+    static Implementation GetImplementation();
+
+    // Get a printable name for an implementation
+    static const char *GetImplementationName(Implementation aImpl);
+
 private:
     // The accumulator
     uint32 mCrc;
@@ -0,0 +1,378 @@
+//*******************************************************************************
+//
+//  HidDfuBench.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Benchmark of upgrade time and host CPU use against simulated HID DFU
+//  devices (see CHidTransportSim)
+//
+//*******************************************************************************
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <chrono>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/resource.h>
+#endif
+
+#include "HidDfuDll/HidDfu.h"
+#include "time/hi_res_clock.h"
+
+//////////////////////////////////////////////////////////////////////////////
+
+static bool ParseNumber(const char *apValueStr, unsigned long aMax, unsigned long &aValue);
+static bool WriteImage(const std::string &aFileName, uint32 aSize);
+static void SetEnv(const char *apName, const char *apValue);
+static double GetCpuMilliSec();
+static int32 RunUpgrade(uint32 aDevices, uint8 aWindow, const std::string &aFileName);
+static void ShowUsageMessage(const char *apFormat, ...);
+static void Usage();
+
+//////////////////////////////////////////////////////////////////////////////
+
+static const char *gpExeName = "HidDfuBench";
+
+// Define leading character for options
+static const char OPTION_MARKER_CH        = '-';
+
+// Size of the generated image in KB, followed by the size
+static const char *OPTION_SIZE_STR        = "-size";
+
+// Number of upgrade data reports to keep in flight, followed by the number
+static const char *OPTION_WINDOW_STR      = "-window";
+
+// Comma separated numbers of simulated devices to upgrade
+static const char *OPTION_DEVICES_STR     = "-devices";
+
+// Ask for help
+static const char *OPTION_HELP1_STR       = "-help";
+static const char *OPTION_HELP2_STR       = "-?";
+
+static const int HIDDFUBENCH_SUCCESS = 0;
+static const int HIDDFUBENCH_ERROR   = 1;
+
+// Simulated devices match any VID and PID, these are only passed through
+static const uint16 BENCH_VID = 0x0A12;
+static const uint16 BENCH_PID = 0x4007;
+static const uint16 USAGE_PAGE_APP = 0xFF00;
+
+static const uint32 DEFAULT_SIZE_KB = 256;
+static const uint8 DEFAULT_WINDOW = 16;
+static const uint32 DEFAULT_DEVICES[] = { 1, 8, 16, 32 };
+
+// Largest number of devices the library upgrades at once
+static const unsigned long MAX_DEVICES = 32;
+
+// Length of the signature in the footer of the generated image
+static const uint32 SIGNATURE_SIZE = 256;
+
+// Generated image, removed on exit
+static const char *IMAGE_FILE_NAME = "HidDfuBench.bin";
+
+//////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[])
+{
+    int retVal = HIDDFUBENCH_SUCCESS;
+
+    gpExeName = argv[0];
+
+    unsigned long sizeKb = DEFAULT_SIZE_KB;
+    unsigned long window = DEFAULT_WINDOW;
+    std::vector<uint32> devices;
+
+    for (int argIndex = 1; argIndex < argc; ++argIndex)
+    {
+        const std::string arg = argv[argIndex];
+        const char *pValue = (argIndex + 1 < argc) ? argv[argIndex + 1] : "";
+
+        if (arg.compare(OPTION_SIZE_STR) == 0)
+        {
+            if (!ParseNumber(pValue, 0xFFFF, sizeKb) || sizeKb == 0)
+            {
+                ShowUsageMessage("\"%s\" must be followed by a size from 1 to 65535", OPTION_SIZE_STR);
+            }
+            ++argIndex;
+        }
+        else if (arg.compare(OPTION_WINDOW_STR) == 0)
+        {
+            if (!ParseNumber(pValue, 16, window))
+            {
+                ShowUsageMessage("\"%s\" must be followed by a number from 0 to 16", OPTION_WINDOW_STR);
+            }
+            ++argIndex;
+        }
+        else if (arg.compare(OPTION_DEVICES_STR) == 0)
+        {
+            std::string list = pValue;
+            size_t start = 0;
+            do
+            {
+                const size_t end = list.find(',', start);
+                const std::string item = list.substr(start, end - start);
+                unsigned long count = 0;
+                if (!ParseNumber(item.c_str(), MAX_DEVICES, count) || count == 0)
+                {
+                    ShowUsageMessage("\"%s\" must be followed by numbers from 1 to %lu, separated by commas",
+                        OPTION_DEVICES_STR, MAX_DEVICES);
+                }
+                devices.push_back(static_cast<uint32>(count));
+                start = (end == std::string::npos) ? end : end + 1;
+            } while (start != std::string::npos);
+            ++argIndex;
+        }
+        else if (arg.compare(OPTION_HELP1_STR) == 0 ||
+                 arg.compare(OPTION_HELP2_STR) == 0)
+        {
+            Usage();
+        }
+        else if (arg[0] == OPTION_MARKER_CH)
+        {
+            ShowUsageMessage("\"%s\" invalid option", argv[argIndex]);
+        }
+        else
+        {
+            ShowUsageMessage("\"%s\" unexpected argument", argv[argIndex]);
+        }
+    }
+
+    if (devices.empty())
+    {
+        devices.assign(DEFAULT_DEVICES, DEFAULT_DEVICES + sizeof(DEFAULT_DEVICES) / sizeof(DEFAULT_DEVICES[0]));
+    }
+
+    // The library treats a zero restart delay as unset, so wait the least it allows
+    if (getenv("HID_RESTART_DELAY_SEC") == NULL)
+    {
+        SetEnv("HID_RESTART_DELAY_SEC", "1");
+    }
+
+    const std::string fileName = IMAGE_FILE_NAME;
+    if (!WriteImage(fileName, sizeKb * 1024))
+    {
+        std::cout << "Error: failed to write \"" << fileName << "\"" << std::endl;
+        retVal = HIDDFUBENCH_ERROR;
+    }
+    else
+    {
+        std::cout << "Image " << sizeKb << " KB, window " << window << std::endl;
+        std::cout << std::setw(8) << "Devices" << std::setw(10) << "Result"
+                  << std::setw(12) << "Time (ms)" << std::setw(12) << "KB/s"
+                  << std::setw(12) << "CPU (ms)" << std::setw(16) << "CPU/device (ms)" << std::endl;
+
+        for (std::vector<uint32>::const_iterator it = devices.begin(); it != devices.end(); ++it)
+        {
+            const double cpuStartMs = GetCpuMilliSec();
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+            const int32 result = RunUpgrade(*it, static_cast<uint8>(window), fileName);
+
+            const double wallMs = std::chrono::duration<double, std::milli>(
+                std::chrono::steady_clock::now() - start).count();
+            const double cpuMs = GetCpuMilliSec() - cpuStartMs;
+            const double kbPerSec = (wallMs > 0) ? (static_cast<double>(sizeKb) * *it * 1000.0 / wallMs) : 0;
+
+            std::cout << std::fixed << std::setprecision(1)
+                      << std::setw(8) << *it << std::setw(10) << result
+                      << std::setw(12) << wallMs << std::setw(12) << kbPerSec
+                      << std::setw(12) << cpuMs << std::setw(16) << (cpuMs / *it) << std::endl;
+
+            if (result != HIDDFU_ERROR_NONE)
+            {
+                std::cout << "    " << hidDfuGetLastError() << std::endl;
+                retVal = HIDDFUBENCH_ERROR;
+            }
+        }
+
+        remove(fileName.c_str());
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Upgrades the given number of simulated devices, waiting for completion
+//////////////////////////////////////////////////////////////////////////////
+static int32 RunUpgrade(uint32 aDevices, uint8 aWindow, const std::string &aFileName)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+
+    char devicesStr[16];
+    snprintf(devicesStr, sizeof(devicesStr), "%lu", static_cast<unsigned long>(aDevices));
+    SetEnv("HID_SIM_DEVICES", devicesStr);
+
+    hidDfuSetDataWindow(aWindow);
+
+    uint16 count = 0;
+    retVal = hidDfuConnect(BENCH_VID, BENCH_PID, 0, USAGE_PAGE_APP, &count);
+
+    if (retVal == HIDDFU_ERROR_NONE)
+    {
+        retVal = hidDfuUpgradeBin(aFileName.c_str());
+
+        if (retVal == HIDDFU_ERROR_NONE)
+        {
+            // Poll often, the wait is part of the measured time
+            while (hidDfuGetProgress() != 100)
+            {
+                HiResClockSleepMilliSec(10);
+            }
+            retVal = hidDfuGetResult();
+        }
+
+        const int32 disconnectResult = hidDfuDisconnect();
+        if (retVal == HIDDFU_ERROR_NONE)
+        {
+            retVal = disconnectResult;
+        }
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Writes an upgrade file with a header, one partition and a footer
+//////////////////////////////////////////////////////////////////////////////
+static bool WriteImage(const std::string &aFileName, uint32 aSize)
+{
+    std::ofstream file(aFileName.c_str(), std::ios::binary | std::ios::trunc);
+
+    // Each chunk is an 8 byte identifier and a 32 bit big-endian length
+    struct Chunk
+    {
+        const char *mpId;
+        uint32 mLength;
+    };
+    const Chunk chunks[] =
+    {
+        { "APPUHDR5", 16 },
+        { "PARTDATA", aSize },
+        { "APPUPFTR", SIGNATURE_SIZE }
+    };
+
+    std::vector<uint8> data;
+    for (size_t i = 0; i < sizeof(chunks) / sizeof(chunks[0]); ++i)
+    {
+        data.assign(chunks[i].mpId, chunks[i].mpId + 8);
+        for (int shift = 24; shift >= 0; shift -= 8)
+        {
+            data.push_back(static_cast<uint8>(chunks[i].mLength >> shift));
+        }
+        for (uint32 n = 0; n < chunks[i].mLength; ++n)
+        {
+            data.push_back(static_cast<uint8>(n * 31 + i));
+        }
+        file.write(reinterpret_cast<const char *>(&data[0]), data.size());
+    }
+
+    return file.good();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Converts a decimal number, making sure it is in range
+//////////////////////////////////////////////////////////////////////////////
+static bool ParseNumber(const char *apValueStr, unsigned long aMax, unsigned long &aValue)
+{
+    char *pErr = NULL;
+    const unsigned long value = strtoul(apValueStr, &pErr, 10);
+    const bool valid = (pErr != apValueStr && *pErr == '\0' && value <= aMax);
+    if (valid)
+    {
+        aValue = value;
+    }
+    return valid;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Sets an environment variable read by the library
+//////////////////////////////////////////////////////////////////////////////
+static void SetEnv(const char *apName, const char *apValue)
+{
+#ifdef WIN32
+    _putenv_s(apName, apValue);
+#else
+    setenv(apName, apValue, 1);
+#endif
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Gets the user and kernel time used by all threads of the process
+//////////////////////////////////////////////////////////////////////////////
+static double GetCpuMilliSec()
+{
+    double retVal = 0;
+#ifdef WIN32
+    FILETIME creation, exit, kernel, user;
+    if (GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user))
+    {
+        ULARGE_INTEGER k, u;
+        k.LowPart = kernel.dwLowDateTime;
+        k.HighPart = kernel.dwHighDateTime;
+        u.LowPart = user.dwLowDateTime;
+        u.HighPart = user.dwHighDateTime;
+        // FILETIME is in 100ns units
+        retVal = static_cast<double>(k.QuadPart + u.QuadPart) / 10000.0;
+    }
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        retVal = (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1000.0
+            + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1000.0;
+    }
+#endif
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Display a message followed by the usage information
+//////////////////////////////////////////////////////////////////////////////
+static void ShowUsageMessage(const char *apFormat, ...)
+{
+    std::cout << "== Error: ";
+
+    va_list argptr;
+    va_start(argptr, apFormat);
+    vprintf(apFormat, argptr);
+    va_end(argptr);
+
+    std::cout << std::endl << std::endl;
+
+    Usage();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Output usage information
+//////////////////////////////////////////////////////////////////////////////
+static void Usage()
+{
+    std::cout << gpExeName << " [-size <KB>] [-window <n>] [-devices <n>[,<n>...]]" << std::endl;
+    std::cout << "Upgrades simulated devices with a generated image and reports the time taken" << std::endl;
+    std::cout << "and the CPU used by the host." << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "    -size - Size of the image partition in KB, default " << DEFAULT_SIZE_KB << "." << std::endl;
+    std::cout << "    -window - Data reports in flight (0 to 16), default " << static_cast<int>(DEFAULT_WINDOW)
+              << "." << std::endl;
+    std::cout << "              0 uses the fixed delay between data reports." << std::endl;
+    std::cout << "    -devices - Numbers of devices to upgrade at once, default 1,8,16,32." << std::endl;
+    std::cout << "Note:" << std::endl;
+    std::cout << "    The devices are set with the HID_SIM_* environment variables, for example" << std::endl;
+    std::cout << "    HID_SIM_LATENCY_MS, HID_SIM_REPORT_INTERVAL_US and HID_SIM_FAIL_AT." << std::endl;
+    std::cout << std::endl;
+
+    // Always exit program on usage
+    exit(HIDDFUBENCH_ERROR);
+}
@@ -0,0 +1,727 @@
+//*******************************************************************************
+//
+//  HidSimDevice.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CHidSimDevice class.
+//
+//*******************************************************************************
+
+#include "HidSimDevice.h"
+#include "UpgradeProtocol.h"
+
+#include "engine/enginefw_interface.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+namespace
+{
+    ///
+    /// Message view giving the device model access to the data field
+    ///
+    class CSimMsg : public CUpgradeProtocolMsg
+    {
+    public:
+        CSimMsg(uint8 *apReport, uint8 aReportLenBytes, uint8 aOpCode, const uint8 *apData, uint16 aLength)
+            : CUpgradeProtocolMsg(apReport, HID_REPORTID_RESPONSE, aReportLenBytes, aOpCode, aLength, apData, 0) {};
+        CSimMsg(const uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, aReportLenBytes) {};
+
+        using CUpgradeProtocolMsg::Get;
+
+        uint16 GetLength() const { return static_cast<uint16>((GetReport()[3] << 8) | GetReport()[4]); };
+    };
+
+    /// Names of the stages for HID_SIM_FAIL_AT, in FailStage order
+    const char * const FAIL_STAGE_NAMES[] =
+    {
+        "none", "connect", "sync", "start", "data", "validate", "reboot", "commit"
+    };
+
+    /// Chunk identifiers of an upgrade file checked by the device
+    const char PARTITION_DATA_ID[] = "PARTDATA";
+    const char FOOTER_ID[] = "APPUPFTR";
+
+    /// Shortest report which holds an UPGRADE_DATA_BYTES_REQ
+    const uint16 MIN_REPORT_LENGTH = HEADER_SIZE + 8;
+
+    /// Longest report, the size field of a message is 8 bits
+    const uint16 MAX_REPORT_LENGTH = 0xFF;
+
+    ///
+    /// Gets a value from an environment variable. Unlike the device
+    /// tunables, zero is a valid setting.
+    /// @param[in] apEnvVar Environment variable.
+    /// @param[in] aValue Value if the variable is not set or not a number.
+    /// @return The value.
+    ///
+    uint32 GetEnvValue(const char *apEnvVar, uint32 aValue)
+    {
+        uint32 retVal = aValue;
+
+        const char *pEnvVar = getenv(apEnvVar);
+        if ((pEnvVar != NULL) && (*pEnvVar != '\0'))
+        {
+            char *pEnd = NULL;
+            const unsigned long value = strtoul(pEnvVar, &pEnd, 0);
+            if (*pEnd == '\0')
+            {
+                retVal = static_cast<uint32>(value);
+            }
+        }
+
+        return retVal;
+    }
+
+    ///
+    /// Writes a 32 bit value, big-endian as in the upgrade protocol.
+    /// @param[out] apData Destination, 4 bytes.
+    /// @param[in] aValue The value.
+    ///
+    void PutUint32(uint8 *apData, uint32 aValue)
+    {
+        apData[0] = static_cast<uint8>(aValue >> 24);
+        apData[1] = static_cast<uint8>(aValue >> 16);
+        apData[2] = static_cast<uint8>(aValue >> 8);
+        apData[3] = static_cast<uint8>(aValue);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidSimDevice::CConfig::CConfig()
+    : mDevices(0),
+    mLatencyMs(1),
+    mReportIntervalUs(1000),
+    mReportLength(64),
+    mPartitionSize(0),
+    mRequestSize(0),
+    mValidationMs(0),
+    mRebootMs(0),
+    mFailAt(FAIL_NONE),
+    mFailDevice(-1)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidSimDevice::CConfig CHidSimDevice::CConfig::FromEnvironment()
+{
+    CConfig config;
+
+    config.mDevices = GetEnvValue("HID_SIM_DEVICES", config.mDevices);
+    config.mLatencyMs = GetEnvValue("HID_SIM_LATENCY_MS", config.mLatencyMs);
+    config.mReportIntervalUs = GetEnvValue("HID_SIM_REPORT_INTERVAL_US", config.mReportIntervalUs);
+    config.mReportLength = static_cast<uint16>(std::min<uint32>(std::max<uint32>(
+        GetEnvValue("HID_SIM_REPORT_SIZE", config.mReportLength), MIN_REPORT_LENGTH), MAX_REPORT_LENGTH));
+    config.mPartitionSize = GetEnvValue("HID_SIM_PARTITION_SIZE", config.mPartitionSize);
+    config.mRequestSize = GetEnvValue("HID_SIM_REQUEST_SIZE", config.mRequestSize);
+    config.mValidationMs = GetEnvValue("HID_SIM_VALIDATION_MS", config.mValidationMs);
+    config.mRebootMs = GetEnvValue("HID_SIM_REBOOT_MS", config.mRebootMs);
+    config.mFailDevice = static_cast<int32>(GetEnvValue("HID_SIM_FAIL_DEVICE", static_cast<uint32>(config.mFailDevice)));
+
+    const char *pFailAt = getenv("HID_SIM_FAIL_AT");
+    if (pFailAt != NULL)
+    {
+        for (size_t i = 0; i < sizeof(FAIL_STAGE_NAMES) / sizeof(FAIL_STAGE_NAMES[0]); ++i)
+        {
+            if (strcmp(pFailAt, FAIL_STAGE_NAMES[i]) == 0)
+            {
+                config.mFailAt = static_cast<FailStage>(i);
+            }
+        }
+    }
+
+    return config;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidSimDevice::CConfig::operator==(const CConfig &aOther) const
+{
+    return (mDevices == aOther.mDevices)
+        && (mLatencyMs == aOther.mLatencyMs)
+        && (mReportIntervalUs == aOther.mReportIntervalUs)
+        && (mReportLength == aOther.mReportLength)
+        && (mPartitionSize == aOther.mPartitionSize)
+        && (mRequestSize == aOther.mRequestSize)
+        && (mValidationMs == aOther.mValidationMs)
+        && (mRebootMs == aOther.mRebootMs)
+        && (mFailAt == aOther.mFailAt)
+        && (mFailDevice == aOther.mFailDevice);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidSimDevice::CHidSimDevice(const CConfig &aConfig, bool aFail, CRebootListener *apRebootListener)
+    : mConfig(aConfig),
+    mFail(aFail && (aConfig.mFailAt != FAIL_NONE)),
+    mpRebootListener(apRebootListener),
+    mGeneration(0),
+    mPresentTime(Clock::now()),
+    mAcceptTime(Clock::now()),
+    mConnected(false),
+    mResumePoint(UPGRADE_RESUME_POINT_START),
+    mVersionMinor(0),
+    mChunkHeaderBytes(0),
+    mChunkRemaining(0),
+    mFooter(false),
+    mRequestRemaining(0),
+    mTransferError(UPGRADE_HOST_SUCCESS),
+    mDataReceived(0)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    memset(mChunkHeader, 0, sizeof(mChunkHeader));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidSimDevice::~CHidSimDevice()
+{
+    FUNCTION_DEBUG_SENTRY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidSimDevice::Attach(uint32 &aGeneration)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (Clock::now() >= mPresentTime)
+    {
+        aGeneration = mGeneration;
+        retVal = true;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidSimDevice::IsAttached(uint32 aGeneration)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return (aGeneration == mGeneration);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidSimDevice::Clock::time_point CHidSimDevice::AcceptReport()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // Reports are accepted one after another, each taking the report interval
+    mAcceptTime = std::max(mAcceptTime, Clock::now()) + std::chrono::microseconds(mConfig.mReportIntervalUs);
+
+    return mAcceptTime;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidSimDevice::SetFeature(const uint8 *apReport, size_t aLength)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    // Only the connection commands of the application are modelled
+    if ((aLength >= 3) && (apReport[0] == HID_REPORTID_COMMAND) && (apReport[1] == 1))
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        if (apReport[2] == HID_CMD_CONNECTION_REQ)
+        {
+            uint8 status = UPGRADE_STATUS_SUCCESS;
+            if (mFail && (mConfig.mFailAt == FAIL_CONNECT))
+            {
+                status = UPGRADE_STATUS_UNEXPECTED_ERROR;
+            }
+            else if (mConnected)
+            {
+                status = UPGRADE_STATUS_ALREADY_CONNECTED_WARNING;
+            }
+            else
+            {
+                mConnected = true;
+            }
+
+            // The status is the third byte of the response
+            CPendingReport response;
+            response.mReadyTime = Clock::now() + std::chrono::milliseconds(mConfig.mLatencyMs);
+            response.mReport.assign(mConfig.mReportLength, 0);
+            response.mReport[0] = HID_REPORTID_RESPONSE;
+            response.mReport[1] = 1;
+            response.mReport[2] = status;
+            mReports.push_back(response);
+            mReportQueued.notify_all();
+
+            retVal = true;
+        }
+        else if (apReport[2] == HID_CMD_DISCONNECT_REQ)
+        {
+            mConnected = false;
+            retVal = true;
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidSimDevice::WriteReport(const uint8 *apReport, size_t aLength, Clock::time_point aAcceptTime)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    // The device only handles upgrade messages while the host is connected
+    if ((aLength >= HEADER_SIZE) && (apReport[0] == HID_REPORTID_DATA_TRANSFER) && mConnected)
+    {
+        HandleMessage(apReport, aLength, aAcceptTime + std::chrono::milliseconds(mConfig.mLatencyMs));
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidSimDevice::ClearReports()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mReports.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidSimDevice::ReadReport(uint32 aGeneration, uint8 *apReport, size_t aLength,
+    uint32 aTimeoutMs, uint32 &aBytesRead)
+{
+    CHidTransport::Result retVal = CHidTransport::RESULT_TIMEOUT;
+
+    aBytesRead = 0;
+
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    const Clock::time_point deadline = Clock::now() + std::chrono::milliseconds(aTimeoutMs);
+    bool waiting = true;
+    while (waiting)
+    {
+        const Clock::time_point now = Clock::now();
+
+        if (aGeneration != mGeneration)
+        {
+            retVal = CHidTransport::RESULT_FAILED;
+            waiting = false;
+        }
+        else if (!mReports.empty() && (mReports.front().mReadyTime <= now))
+        {
+            const std::vector<uint8> &report = mReports.front().mReport;
+            const size_t length = std::min(aLength, report.size());
+            memcpy(apReport, report.data(), length);
+            aBytesRead = static_cast<uint32>(length);
+            retVal = (length < aLength ? CHidTransport::RESULT_SHORT : CHidTransport::RESULT_OK);
+            mReports.pop_front();
+            waiting = false;
+        }
+        else if (now >= deadline)
+        {
+            waiting = false;
+        }
+        else
+        {
+            // Wake when the next response becomes readable, a new one is
+            // queued or the wait times out
+            Clock::time_point wakeTime = deadline;
+            if (!mReports.empty() && (mReports.front().mReadyTime < wakeTime))
+            {
+                wakeTime = mReports.front().mReadyTime;
+            }
+            mReportQueued.wait_until(lock, wakeTime);
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidSimDevice::Clock::time_point CHidSimDevice::GetReadyTime(uint32 aGeneration)
+{
+    Clock::time_point retVal = Clock::time_point::max();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (aGeneration != mGeneration)
+    {
+        retVal = Clock::now();
+    }
+    else if (!mReports.empty())
+    {
+        retVal = mReports.front().mReadyTime;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidSimDevice::HandleMessage(const uint8 *apReport, size_t aLength, Clock::time_point aReadyTime)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    const uint8 reportLength = static_cast<uint8>(std::min<size_t>(aLength, MAX_REPORT_LENGTH));
+    CSimMsg msg(apReport, reportLength);
+    uint8 data[6];
+
+    switch (msg.GetOpCode())
+    {
+    case UPGRADE_ABORT_REQ:
+        mResumePoint = UPGRADE_RESUME_POINT_START;
+        ResetTransfer();
+        QueueResponse(UPGRADE_ABORT_CFM, NULL, 0, aReadyTime);
+        break;
+
+    case UPGRADE_SYNC_REQ:
+        if (mFail && (mConfig.mFailAt == FAIL_SYNC))
+        {
+            QueueError(UPGRADE_HOST_ERROR_INVALID_SYNC_ID, aReadyTime);
+        }
+        else
+        {
+            // Resume point, the file identifier given by the host, protocol version
+            data[0] = mResumePoint;
+            PutUint32(&data[1], msg.Get<CUpgradeSyncReq::FileIdentifier>());
+            data[5] = PROTOCOL_VERSION;
+            QueueResponse(UPGRADE_SYNC_CFM, data, 6, aReadyTime);
+        }
+        break;
+
+    case UPGRADE_START_REQ:
+        // Status, battery level (not reported)
+        data[0] = ((mFail && (mConfig.mFailAt == FAIL_START)) ? 1 : 0);
+        data[1] = 0;
+        data[2] = 0;
+        QueueResponse(UPGRADE_START_CFM, data, 3, aReadyTime);
+        break;
+
+    case UPGRADE_START_DATA_REQ:
+        // Data received before a disconnection is kept, and the host is asked to skip it
+        if (mTransferError != UPGRADE_HOST_SUCCESS)
+        {
+            ResetTransfer();
+        }
+        if (mDataReceived > 0)
+        {
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Simulated device resuming at offset %u", mDataReceived);
+        }
+        QueueDataBytesReq(GetNextRequestSize(), mDataReceived, aReadyTime);
+        break;
+
+    case UPGRADE_DATA:
+        {
+            // More data flag, then the image data
+            const size_t maxLength = reportLength - HEADER_SIZE;
+            const size_t length = std::min<size_t>(msg.GetLength(), maxLength);
+            const uint8 moreData = msg.Get<CUpgradeDataReq::MoreData>();
+            const size_t dataLength = (length > 0 ? length - 1 : 0);
+
+            if (!ConsumeData(apReport + HEADER_SIZE + 1, dataLength) && (mTransferError == UPGRADE_HOST_SUCCESS))
+            {
+                mTransferError = UPGRADE_HOST_ERROR_FILE_TOO_BIG;
+            }
+            mRequestRemaining -= static_cast<uint32>(std::min<size_t>(dataLength, mRequestRemaining));
+            mDataReceived += static_cast<uint32>(dataLength);
+
+            if (moreData != 0)
+            {
+                // Last packet of the file, the host moves on to validation
+                if ((mTransferError == UPGRADE_HOST_SUCCESS) && (GetNextRequestSize() != 0))
+                {
+                    mTransferError = UPGRADE_HOST_ERROR_FILE_TOO_SMALL;
+                }
+                mResumePoint = UPGRADE_RESUME_POINT_PRE_VALIDATE;
+                mValidatedTime = aReadyTime + std::chrono::milliseconds(mConfig.mValidationMs);
+            }
+            else if (mRequestRemaining == 0)
+            {
+                const uint32 nextRequest = GetNextRequestSize();
+                if (mTransferError != UPGRADE_HOST_SUCCESS)
+                {
+                    QueueError(mTransferError, aReadyTime);
+                }
+                else if (mFail && (mConfig.mFailAt == FAIL_DATA))
+                {
+                    QueueError(UPGRADE_HOST_ERROR_PARTITION_WRITE_FAILED_DATA, aReadyTime);
+                }
+                else if (nextRequest == 0)
+                {
+                    // The footer has been received but the host has more data
+                    QueueError(UPGRADE_HOST_ERROR_FILE_TOO_BIG, aReadyTime);
+                }
+                else
+                {
+                    QueueDataBytesReq(nextRequest, 0, aReadyTime);
+                }
+            }
+        }
+        break;
+
+    case UPGRADE_IS_VALIDATION_DONE_REQ:
+        if (mTransferError != UPGRADE_HOST_SUCCESS)
+        {
+            QueueError(mTransferError, aReadyTime);
+        }
+        else if (mFail && (mConfig.mFailAt == FAIL_VALIDATE))
+        {
+            QueueError(UPGRADE_HOST_ERROR_SFS_VALIDATION_FAILED, aReadyTime);
+        }
+        else if (aReadyTime < mValidatedTime)
+        {
+            // Time for the host to wait before asking again
+            const int64 remainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                mValidatedTime - aReadyTime).count();
+            data[0] = static_cast<uint8>(std::min<int64>(std::max<int64>(remainingMs, 1), 0xFF));
+            QueueResponse(UPGRADE_IS_VALIDATION_DONE_CFM, data, 1, aReadyTime);
+        }
+        else
+        {
+            mResumePoint = UPGRADE_RESUME_POINT_PRE_REBOOT;
+            QueueResponse(UPGRADE_TRANSFER_COMPLETE_IND, NULL, 0, aReadyTime);
+        }
+        break;
+
+    case UPGRADE_TRANSFER_COMPLETE_RES:
+        if ((msg.Get<CUpgradeTransferCompleteRes::Action>() == 0) && (mResumePoint == UPGRADE_RESUME_POINT_PRE_REBOOT))
+        {
+            Reboot();
+        }
+        else
+        {
+            mResumePoint = UPGRADE_RESUME_POINT_START;
+            ResetTransfer();
+        }
+        break;
+
+    case UPGRADE_PROCEED_TO_COMMIT:
+        if (mResumePoint == UPGRADE_RESUME_POINT_POST_REBOOT)
+        {
+            QueueResponse(UPGRADE_COMMIT_REQ, NULL, 0, aReadyTime);
+        }
+        else
+        {
+            QueueError(UPGRADE_HOST_ERROR_IN_ERROR_STATE, aReadyTime);
+        }
+        break;
+
+    case UPGRADE_COMMIT_CFM:
+        if (mFail && (mConfig.mFailAt == FAIL_COMMIT))
+        {
+            QueueError(UPGRADE_HOST_ERROR_UPDATE_FAILED, aReadyTime);
+        }
+        else
+        {
+            // The new image is kept unless the host asks for a rollback
+            if (msg.Get<CUpgradeCommitCfm::Action>() == 0)
+            {
+                ++mVersionMinor;
+            }
+            mResumePoint = UPGRADE_RESUME_POINT_START;
+            QueueResponse(UPGRADE_COMPLETE_IND, NULL, 0, aReadyTime);
+        }
+        break;
+
+    case UPGRADE_ERROR_RES:
+        mResumePoint = UPGRADE_RESUME_POINT_START;
+        ResetTransfer();
+        break;
+
+    case UPGRADE_HOST_VERSION_REQ:
+        // Major, minor and config versions
+        data[0] = 0;
+        data[1] = 1;
+        data[2] = static_cast<uint8>(mVersionMinor >> 8);
+        data[3] = static_cast<uint8>(mVersionMinor);
+        data[4] = 0;
+        data[5] = 0;
+        QueueResponse(UPGRADE_HOST_VERSION_CFM, data, 6, aReadyTime);
+        break;
+
+    default:
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Simulated device ignored opcode 0x%x", msg.GetOpCode());
+        break;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidSimDevice::ConsumeData(const uint8 *apData, size_t aLength)
+{
+    bool retVal = true;
+
+    while ((aLength > 0) && retVal)
+    {
+        size_t length = 0;
+
+        if (mChunkHeaderBytes < CHUNK_HEADER_SIZE)
+        {
+            length = std::min(aLength, CHUNK_HEADER_SIZE - mChunkHeaderBytes);
+            memcpy(mChunkHeader + mChunkHeaderBytes, apData, length);
+            mChunkHeaderBytes += length;
+
+            if (mChunkHeaderBytes == CHUNK_HEADER_SIZE)
+            {
+                // Identifier, then the big-endian length of the chunk data
+                mChunkRemaining = (static_cast<uint32>(mChunkHeader[8]) << 24)
+                    | (static_cast<uint32>(mChunkHeader[9]) << 16)
+                    | (static_cast<uint32>(mChunkHeader[10]) << 8)
+                    | mChunkHeader[11];
+                mFooter = (memcmp(mChunkHeader, FOOTER_ID, 8) == 0);
+
+                if ((memcmp(mChunkHeader, PARTITION_DATA_ID, 8) == 0) && (mConfig.mPartitionSize != 0)
+                    && (mChunkRemaining > mConfig.mPartitionSize) && (mTransferError == UPGRADE_HOST_SUCCESS))
+                {
+                    mTransferError = UPGRADE_HOST_ERROR_PARTITION_SIZE_MISMATCH;
+                }
+            }
+        }
+        else if (mChunkRemaining > 0)
+        {
+            length = std::min<size_t>(aLength, mChunkRemaining);
+            mChunkRemaining -= static_cast<uint32>(length);
+        }
+        else if (mFooter)
+        {
+            // Nothing follows the footer
+            retVal = false;
+        }
+        else
+        {
+            // Start of the next chunk
+            mChunkHeaderBytes = 0;
+        }
+
+        apData += length;
+        aLength -= length;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidSimDevice::GetNextRequestSize() const
+{
+    uint32 retVal = 0;
+
+    if (mChunkHeaderBytes < CHUNK_HEADER_SIZE)
+    {
+        retVal = static_cast<uint32>(CHUNK_HEADER_SIZE - mChunkHeaderBytes);
+    }
+    else if (mChunkRemaining > 0)
+    {
+        retVal = mChunkRemaining;
+        if ((mConfig.mRequestSize != 0) && (retVal > mConfig.mRequestSize))
+        {
+            retVal = mConfig.mRequestSize;
+        }
+    }
+    else if (!mFooter)
+    {
+        retVal = CHUNK_HEADER_SIZE;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidSimDevice::QueueResponse(uint8 aOpCode, const uint8 *apData, uint16 aLength, Clock::time_point aReadyTime)
+{
+    CPendingReport response;
+    response.mReadyTime = aReadyTime;
+    response.mReport.assign(mConfig.mReportLength, 0);
+
+    CSimMsg msg(response.mReport.data(), static_cast<uint8>(mConfig.mReportLength), aOpCode, apData, aLength);
+
+    mReports.push_back(response);
+    mReportQueued.notify_all();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidSimDevice::QueueError(uint16 aErrorCode, Clock::time_point aReadyTime)
+{
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Simulated device error 0x%x", aErrorCode);
+
+    uint8 data[2];
+    data[0] = static_cast<uint8>(aErrorCode >> 8);
+    data[1] = static_cast<uint8>(aErrorCode);
+    QueueResponse(UPGRADE_ERROR_IND, data, sizeof(data), aReadyTime);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidSimDevice::QueueDataBytesReq(uint32 aBytes, uint32 aOffset, Clock::time_point aReadyTime)
+{
+    // Number of bytes, offset from the end of the last data
+    uint8 data[8];
+    PutUint32(&data[0], aBytes);
+    PutUint32(&data[4], aOffset);
+    mRequestRemaining = aBytes;
+
+    QueueResponse(UPGRADE_DATA_BYTES_REQ, data, sizeof(data), aReadyTime);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidSimDevice::ResetTransfer()
+{
+    mChunkHeaderBytes = 0;
+    mChunkRemaining = 0;
+    mFooter = false;
+    mRequestRemaining = 0;
+    mTransferError = UPGRADE_HOST_SUCCESS;
+    mDataReceived = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidSimDevice::Reboot()
+{
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Simulated device rebooting");
+
+    // Handles opened before the reboot stop working, and the device cannot
+    // be opened until it is back
+    ++mGeneration;
+    mConnected = false;
+    mReports.clear();
+    mResumePoint = UPGRADE_RESUME_POINT_POST_REBOOT;
+    ResetTransfer();
+
+    if (mFail && (mConfig.mFailAt == FAIL_REBOOT))
+    {
+        mPresentTime = Clock::time_point::max();
+    }
+    else
+    {
+        mPresentTime = Clock::now() + std::chrono::milliseconds(mConfig.mRebootMs);
+
+        if (mpRebootListener != NULL)
+        {
+            mpRebootListener->OnReboot(this, mPresentTime);
+        }
+    }
+
+    mReportQueued.notify_all();
+}
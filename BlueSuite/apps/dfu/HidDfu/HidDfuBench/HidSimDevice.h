@@ -0,0 +1,299 @@
+//*******************************************************************************
+//
+//  HidSimDevice.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CHidSimDevice class, a software model of a device running the upgrade
+//  protocol, used to exercise the host without hardware.
+//
+//*******************************************************************************
+
+#ifndef HID_SIM_DEVICE_H
+#define HID_SIM_DEVICE_H
+
+#include "HidTransport.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+///
+/// Model of an application-mode device, answering the upgrade protocol
+/// messages (connection, sync, start, data bytes requests, validation and
+/// commit) as the device firmware does, including the reboot between
+/// validation and commit. Responses become readable a configurable latency
+/// after the request is accepted, and output reports are accepted at a
+/// configurable interval, so that the host can be timed against a device
+/// with known behaviour.
+///
+/// The device requests the upgrade file one chunk at a time, reading the
+/// 8 byte identifier and 4 byte length that start each chunk (APPUHDR,
+/// PARTDATA, APPUPFTR), until the footer has been received. The data
+/// received is kept across a disconnection, and a transfer started again
+/// without an abort continues from the end of it, as the device firmware
+/// resumes an interrupted upgrade.
+///
+/// The model is thread safe. Transports opened on it hold its generation,
+/// which changes when the device reboots, so that a handle opened before
+/// the reboot fails as it would on a real device.
+///
+class CHidSimDevice
+{
+public:
+
+    typedef std::chrono::steady_clock Clock;
+
+    /// Stage of the upgrade at which the device reports a failure
+    typedef enum
+    {
+        FAIL_NONE,          ///< No failure
+        FAIL_CONNECT,       ///< Connection request is refused
+        FAIL_SYNC,          ///< UPGRADE_ERROR_IND in place of UPGRADE_SYNC_CFM
+        FAIL_START,         ///< UPGRADE_START_CFM with a failure status
+        FAIL_DATA,          ///< UPGRADE_ERROR_IND after the first data bytes request
+        FAIL_VALIDATE,      ///< UPGRADE_ERROR_IND in place of validation
+        FAIL_REBOOT,        ///< Device does not return after the reboot
+        FAIL_COMMIT         ///< UPGRADE_ERROR_IND in place of UPGRADE_COMPLETE_IND
+    } FailStage;
+
+    ///
+    /// Behaviour of a simulated device
+    ///
+    class CConfig
+    {
+    public:
+        uint32 mDevices;            //< Number of devices
+        uint32 mLatencyMs;          //< Delay before a response can be read
+        uint32 mReportIntervalUs;   //< Time the device takes to accept an output report
+        uint16 mReportLength;       //< Input, output and feature report length, including the report ID
+        uint32 mPartitionSize;      //< Largest partition the device can hold, 0 for no limit
+        uint32 mRequestSize;        //< Largest data bytes request, 0 to request whole chunks
+        uint32 mValidationMs;       //< Time taken to validate the image
+        uint32 mRebootMs;           //< Time the device is absent while rebooting
+        FailStage mFailAt;          //< Stage at which to fail
+        int32 mFailDevice;          //< Device which fails, -1 for all devices
+
+        CConfig();
+
+        ///
+        /// Reads the configuration from the HID_SIM_* environment variables,
+        /// with the defaults for any not set.
+        /// @return The configuration.
+        ///
+        static CConfig FromEnvironment();
+
+        bool operator==(const CConfig &aOther) const;
+        bool operator!=(const CConfig &aOther) const { return !(*this == aOther); };
+    };
+
+    ///
+    /// Interface through which the device tells that it is rebooting, as
+    /// the host tells of a device being removed and added again
+    ///
+    class CRebootListener
+    {
+    public:
+        virtual ~CRebootListener() {};
+
+        ///
+        /// Called, with the device's lock held, when the device starts
+        /// rebooting. It must not call the device.
+        /// @param[in] apDevice The device.
+        /// @param[in] aPresentTime Time the device can be opened again.
+        ///
+        virtual void OnReboot(const CHidSimDevice *apDevice, Clock::time_point aPresentTime) = 0;
+    };
+
+    ///
+    /// Constructor.
+    /// @param[in] aConfig Device behaviour.
+    /// @param[in] aFail Whether this device fails at aConfig.mFailAt.
+    /// @param[in] apRebootListener Told when the device reboots, NULL for none.
+    ///
+    CHidSimDevice(const CConfig &aConfig, bool aFail, CRebootListener *apRebootListener);
+    ~CHidSimDevice();
+
+    ///
+    /// Gets the device behaviour.
+    /// @return The configuration.
+    ///
+    const CConfig &GetConfig() const { return mConfig; };
+
+    ///
+    /// Opens the device, unless it is rebooting.
+    /// @param[out] aGeneration Identifies this boot of the device.
+    /// @return true if the device is present.
+    ///
+    bool Attach(uint32 &aGeneration);
+
+    ///
+    /// Queries whether the device has not rebooted since it was opened.
+    /// @param[in] aGeneration Value from Attach.
+    /// @return true if the device has not rebooted.
+    ///
+    bool IsAttached(uint32 aGeneration);
+
+    ///
+    /// Reserves the time at which the device accepts the next output report.
+    /// @return The time the report is accepted.
+    ///
+    Clock::time_point AcceptReport();
+
+    ///
+    /// Handles a feature report sent by the host.
+    /// @param[in] apReport Report, starting with the report ID.
+    /// @param[in] aLength Report length.
+    /// @return false if the report is not supported.
+    ///
+    bool SetFeature(const uint8 *apReport, size_t aLength);
+
+    ///
+    /// Handles an output report sent by the host.
+    /// @param[in] apReport Report, starting with the report ID.
+    /// @param[in] aLength Report length.
+    /// @param[in] aAcceptTime Time the device accepted the report, from AcceptReport.
+    ///
+    void WriteReport(const uint8 *apReport, size_t aLength, Clock::time_point aAcceptTime);
+
+    ///
+    /// Discards any responses not yet read.
+    ///
+    void ClearReports();
+
+    ///
+    /// Reads the oldest response, waiting for it to become readable.
+    /// @param[in] aGeneration Value from Attach.
+    /// @param[out] apReport Buffer for the report.
+    /// @param[in] aLength Length of the buffer.
+    /// @param[in] aTimeoutMs Maximum time to wait in milliseconds.
+    /// @param[out] aBytesRead Number of bytes in the report.
+    /// @return The result, RESULT_FAILED if the device has rebooted.
+    ///
+    CHidTransport::Result ReadReport(uint32 aGeneration, uint8 *apReport, size_t aLength,
+        uint32 aTimeoutMs, uint32 &aBytesRead);
+
+    ///
+    /// Gets the time the oldest response can be read. Responses are only
+    /// queued by reports from the host, so none can arrive while the host
+    /// waits with nothing queued.
+    /// @param[in] aGeneration Value from Attach.
+    /// @return The time, now if the device has rebooted, or
+    /// Clock::time_point::max() if no response is queued.
+    ///
+    Clock::time_point GetReadyTime(uint32 aGeneration);
+
+private:
+
+    CHidSimDevice(const CHidSimDevice &);
+    CHidSimDevice &operator=(const CHidSimDevice &);
+
+    /// Length of the identifier and length field at the start of each chunk
+    static const size_t CHUNK_HEADER_SIZE = 12;
+
+    /// Protocol version reported in UPGRADE_SYNC_CFM
+    static const uint8 PROTOCOL_VERSION = 3;
+
+    ///
+    /// A response waiting to be read
+    ///
+    class CPendingReport
+    {
+    public:
+        Clock::time_point mReadyTime;   //< Time the report can be read
+        std::vector<uint8> mReport;     //< The report
+    };
+
+    ///
+    /// Handles an upgrade protocol message, with mMutex held.
+    /// @param[in] apReport Report holding the message.
+    /// @param[in] aLength Report length.
+    /// @param[in] aReadyTime Time any response can be read.
+    ///
+    void HandleMessage(const uint8 *apReport, size_t aLength, Clock::time_point aReadyTime);
+
+    ///
+    /// Consumes image data from an UPGRADE_DATA message, with mMutex held.
+    /// @param[in] apData Image data.
+    /// @param[in] aLength Number of bytes.
+    /// @return false if the data is inconsistent with the chunk headers.
+    ///
+    bool ConsumeData(const uint8 *apData, size_t aLength);
+
+    ///
+    /// Gets the number of bytes to request next, with mMutex held.
+    /// @return The number of bytes, 0 once the footer has been received.
+    ///
+    uint32 GetNextRequestSize() const;
+
+    ///
+    /// Queues a response, with mMutex held.
+    /// @param[in] aOpCode Upgrade protocol opcode.
+    /// @param[in] apData Data field.
+    /// @param[in] aLength Length of the data field.
+    /// @param[in] aReadyTime Time the response can be read.
+    ///
+    void QueueResponse(uint8 aOpCode, const uint8 *apData, uint16 aLength, Clock::time_point aReadyTime);
+
+    ///
+    /// Queues an UPGRADE_ERROR_IND, with mMutex held.
+    /// @param[in] aErrorCode Error code.
+    /// @param[in] aReadyTime Time the response can be read.
+    ///
+    void QueueError(uint16 aErrorCode, Clock::time_point aReadyTime);
+
+    ///
+    /// Queues an UPGRADE_DATA_BYTES_REQ, with mMutex held.
+    /// @param[in] aBytes Number of bytes requested.
+    /// @param[in] aOffset Offset of the data from the end of the data last sent.
+    /// @param[in] aReadyTime Time the response can be read.
+    ///
+    void QueueDataBytesReq(uint32 aBytes, uint32 aOffset, Clock::time_point aReadyTime);
+
+    ///
+    /// Discards the data received, with mMutex held.
+    ///
+    void ResetTransfer();
+
+    ///
+    /// Reboots the device into the new image, with mMutex held.
+    ///
+    void Reboot();
+
+    /// Device behaviour
+    const CConfig mConfig;
+
+    /// Whether this device fails at mConfig.mFailAt
+    const bool mFail;
+
+    /// Told when the device reboots, NULL for none
+    CRebootListener *const mpRebootListener;
+
+    /// Device state, protected by mMutex
+    std::mutex mMutex;
+    std::condition_variable mReportQueued;
+    std::deque<CPendingReport> mReports;
+    uint32 mGeneration;
+    Clock::time_point mPresentTime;     //< Time the device returns from a reboot
+    Clock::time_point mAcceptTime;      //< Time the last output report is accepted
+    bool mConnected;
+    uint8 mResumePoint;                 //< UpgradeResumePoint
+    uint16 mVersionMinor;               //< Incremented on each committed upgrade
+
+    /// Data transfer state, protected by mMutex
+    uint8 mChunkHeader[CHUNK_HEADER_SIZE];
+    size_t mChunkHeaderBytes;           //< Bytes of the current chunk header received
+    uint32 mChunkRemaining;             //< Bytes of the current chunk still to be received
+    bool mFooter;                       //< Whether the current chunk is the footer
+    uint32 mRequestRemaining;           //< Bytes of the last request still to be received
+    uint16 mTransferError;              //< Error found in the data, reported at validation
+    uint32 mDataReceived;               //< Bytes of the image received
+    Clock::time_point mValidatedTime;   //< Time validation of the image completes
+};
+
+#endif // #ifndef HID_SIM_DEVICE_H
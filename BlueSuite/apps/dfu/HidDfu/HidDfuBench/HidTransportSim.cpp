@@ -0,0 +1,894 @@
+//*******************************************************************************
+//
+//  HidTransportSim.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CHidTransportSim class.
+//
+//*******************************************************************************
+
+#include "HidTransportSim.h"
+
+#include "engine/enginefw_interface.h"
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+#include <stdlib.h>
+
+#ifdef WIN32
+#define WIN32_LEAN_AND_MEAN  // Exclude rarely-used stuff from Windows headers
+#include <windows.h>
+#else
+#include <errno.h>
+#endif
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+namespace
+{
+    // Error codes of the host, so that GetErrorText describes them
+#ifdef WIN32
+    const uint32 SIM_ERROR_NOT_CONNECTED = ERROR_DEVICE_NOT_CONNECTED;
+    const uint32 SIM_ERROR_NOT_SUPPORTED = ERROR_NOT_SUPPORTED;
+    const uint32 SIM_ERROR_INVALID = ERROR_INVALID_PARAMETER;
+#else
+    const uint32 SIM_ERROR_NOT_CONNECTED = ENODEV;
+    const uint32 SIM_ERROR_NOT_SUPPORTED = EOPNOTSUPP;
+    const uint32 SIM_ERROR_INVALID = EINVAL;
+#endif
+
+    /// Prefixes of the device path and parent ID, followed by the device number
+    const char DEVICE_PATH_PREFIX[] = "sim:";
+    const char PARENT_ID_PREFIX[] = "simusb:";
+
+    ///
+    /// The simulated devices, created by EnumerateDevices
+    ///
+    class CSimDevices
+    {
+    public:
+        std::mutex mMutex;
+        CHidSimDevice::CConfig mConfig;
+        std::vector<std::shared_ptr<CHidSimDevice> > mDevices;
+    };
+
+    CSimDevices &GetSimDevices()
+    {
+        static CSimDevices simDevices;
+        return simDevices;
+    }
+
+    ///
+    /// Calls transport listeners at the time a simulated device becomes
+    /// ready, from one thread for all devices, as the host transports do
+    /// from their completion threads
+    ///
+    class CSimNotifier
+    {
+    public:
+        CSimNotifier()
+            : mpNotifying(NULL),
+            mStopping(false)
+        {
+        }
+
+        ~CSimNotifier()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStopping = true;
+                mChanged.notify_all();
+            }
+
+            if (mThread.joinable())
+            {
+                mThread.join();
+            }
+        }
+
+        ///
+        /// Calls a listener once a time has passed.
+        /// @param[in] apListener The listener.
+        /// @param[in] aTime Time to call it.
+        ///
+        void NotifyAt(CHidTransport::CListener *apListener, CHidSimDevice::Clock::time_point aTime)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            // Started on first use, so that no thread runs unless devices are simulated
+            if (!mThread.joinable())
+            {
+                mThread = std::thread(&CSimNotifier::ThreadFunc, this);
+            }
+
+            mPending.insert(std::make_pair(aTime, apListener));
+            mChanged.notify_all();
+        }
+
+        ///
+        /// Forgets the calls pending for a listener, waiting for any call in progress.
+        /// @param[in] apListener The listener.
+        ///
+        void Cancel(CHidTransport::CListener *apListener)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            for (PendingMap::iterator it = mPending.begin(); it != mPending.end(); )
+            {
+                it = (it->second == apListener ? mPending.erase(it) : ++it);
+            }
+
+            while (mpNotifying == apListener)
+            {
+                mChanged.wait(lock);
+            }
+        }
+
+    private:
+        typedef std::multimap<CHidSimDevice::Clock::time_point, CHidTransport::CListener *> PendingMap;
+
+        void ThreadFunc()
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            while (!mStopping)
+            {
+                if (mPending.empty())
+                {
+                    mChanged.wait(lock);
+                }
+                else if (mPending.begin()->first > CHidSimDevice::Clock::now())
+                {
+                    mChanged.wait_until(lock, mPending.begin()->first);
+                }
+                else
+                {
+                    mpNotifying = mPending.begin()->second;
+                    mPending.erase(mPending.begin());
+
+                    lock.unlock();
+                    mpNotifying->OnTransportReady();
+                    lock.lock();
+
+                    mpNotifying = NULL;
+                    mChanged.notify_all();
+                }
+            }
+        }
+
+        std::mutex mMutex;
+        std::condition_variable mChanged;
+        PendingMap mPending;
+        CHidTransport::CListener *mpNotifying;
+        bool mStopping;
+        std::thread mThread;
+    };
+
+    CSimNotifier &GetSimNotifier()
+    {
+        static CSimNotifier simNotifier;
+        return simNotifier;
+    }
+
+    ///
+    /// Tells the arrival watchers when a simulated device returns from a
+    /// reboot, at the time it can be opened again, from one thread for all
+    /// devices, as the host tells of a device being added
+    ///
+    class CSimArrivals : public CHidSimDevice::CRebootListener
+    {
+    public:
+        CSimArrivals()
+            : mpNotifying(NULL),
+            mStopping(false)
+        {
+        }
+
+        ~CSimArrivals()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStopping = true;
+                mChanged.notify_all();
+            }
+
+            if (mThread.joinable())
+            {
+                mThread.join();
+            }
+        }
+
+        ///
+        /// Tells a listener of the devices returning from now on.
+        /// @param[in] apListener The listener.
+        ///
+        void AddListener(CHidTransport::CArrivalListener *apListener)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            // Started on first use, so that no thread runs unless arrivals are watched
+            if (!mThread.joinable())
+            {
+                mThread = std::thread(&CSimArrivals::ThreadFunc, this);
+            }
+
+            mListeners.insert(apListener);
+        }
+
+        ///
+        /// Stops telling a listener, waiting for any call in progress.
+        /// @param[in] apListener The listener.
+        ///
+        void RemoveListener(CHidTransport::CArrivalListener *apListener)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            mListeners.erase(apListener);
+
+            while (mpNotifying == apListener)
+            {
+                mChanged.wait(lock);
+            }
+        }
+
+        virtual void OnReboot(const CHidSimDevice *apDevice, CHidSimDevice::Clock::time_point aPresentTime)
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            if (!mListeners.empty())
+            {
+                mPending.insert(std::make_pair(aPresentTime, apDevice));
+                mChanged.notify_all();
+            }
+        }
+
+    private:
+        typedef std::multimap<CHidSimDevice::Clock::time_point, const CHidSimDevice *> PendingMap;
+        typedef std::set<CHidTransport::CArrivalListener *> ListenerSet;
+
+        void ThreadFunc()
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            while (!mStopping)
+            {
+                if (mPending.empty())
+                {
+                    mChanged.wait(lock);
+                }
+                else if (mPending.begin()->first > CHidSimDevice::Clock::now())
+                {
+                    mChanged.wait_until(lock, mPending.begin()->first);
+                }
+                else
+                {
+                    const CHidSimDevice *pDevice = mPending.begin()->second;
+                    mPending.erase(mPending.begin());
+
+                    lock.unlock();
+                    CHidTransport::CDeviceInfo info;
+                    const bool found = GetParentId(pDevice, info.mParentId);
+                    lock.lock();
+
+                    // A device replaced while it was rebooting is not reported.
+                    // Listeners removed while others are called are skipped.
+                    const ListenerSet listeners(mListeners);
+                    for (ListenerSet::const_iterator it = listeners.begin();
+                        found && (it != listeners.end()) && !mStopping; ++it)
+                    {
+                        if (mListeners.count(*it) > 0)
+                        {
+                            mpNotifying = *it;
+                            lock.unlock();
+                            mpNotifying->OnDeviceArrival(info);
+                            lock.lock();
+
+                            mpNotifying = NULL;
+                            mChanged.notify_all();
+                        }
+                    }
+                }
+            }
+        }
+
+        ///
+        /// Gets the parent ID of a simulated device.
+        /// @param[in] apDevice The device.
+        /// @param[out] aParentId Parent ID.
+        /// @return false if the device is no longer simulated.
+        ///
+        static bool GetParentId(const CHidSimDevice *apDevice, std::string &aParentId)
+        {
+            bool retVal = false;
+
+            CSimDevices &simDevices = GetSimDevices();
+            std::lock_guard<std::mutex> lock(simDevices.mMutex);
+
+            for (size_t index = 0; (index < simDevices.mDevices.size()) && !retVal; ++index)
+            {
+                if (simDevices.mDevices[index].get() == apDevice)
+                {
+                    std::ostringstream parentId;
+                    parentId << PARENT_ID_PREFIX << index;
+                    aParentId = parentId.str();
+                    retVal = true;
+                }
+            }
+
+            return retVal;
+        }
+
+        std::mutex mMutex;
+        std::condition_variable mChanged;
+        PendingMap mPending;
+        ListenerSet mListeners;
+        CHidTransport::CArrivalListener *mpNotifying;
+        bool mStopping;
+        std::thread mThread;
+    };
+
+    CSimArrivals &GetSimArrivals()
+    {
+        static CSimArrivals simArrivals;
+        return simArrivals;
+    }
+
+    ///
+    /// Watcher of simulated devices returning from a reboot
+    ///
+    class CSimArrivalWatcher : public CHidTransport::CArrivalWatcher
+    {
+    public:
+        CSimArrivalWatcher(CHidTransport::CArrivalListener *apListener)
+            : mpListener(apListener)
+        {
+            GetSimArrivals().AddListener(mpListener);
+        }
+
+        virtual ~CSimArrivalWatcher()
+        {
+            GetSimArrivals().RemoveListener(mpListener);
+        }
+
+    private:
+        CHidTransport::CArrivalListener *mpListener;
+    };
+
+    ///
+    /// Gets the device number from a device path or parent ID.
+    /// @param[in] aName Device path or parent ID.
+    /// @param[in] apPrefix Prefix of the name.
+    /// @param[out] aIndex Device number.
+    /// @return false if the name is not of a simulated device.
+    ///
+    bool GetDeviceIndex(const std::string &aName, const char *apPrefix, size_t &aIndex)
+    {
+        bool retVal = false;
+
+        const std::string prefix(apPrefix);
+        if ((aName.compare(0, prefix.size(), prefix) == 0) && (aName.size() > prefix.size()))
+        {
+            char *pEnd = NULL;
+            const unsigned long index = strtoul(aName.c_str() + prefix.size(), &pEnd, 10);
+            if (*pEnd == '\0')
+            {
+                aIndex = static_cast<size_t>(index);
+                retVal = true;
+            }
+        }
+
+        return retVal;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::EnumerateDevices(uint16 aVid, uint16 aPid, uint16 aUsage, uint16 aUsagePage,
+    std::vector<CDeviceInfo> &aDevices)
+{
+    bool retVal = true;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    const CHidSimDevice::CConfig config = CHidSimDevice::CConfig::FromEnvironment();
+
+    CSimDevices &simDevices = GetSimDevices();
+    std::lock_guard<std::mutex> lock(simDevices.mMutex);
+
+    // Devices keep their state (resume point, version) until the
+    // configuration changes
+    if (config != simDevices.mConfig)
+    {
+        simDevices.mDevices.clear();
+        simDevices.mConfig = config;
+
+        for (uint32 index = 0; index < config.mDevices; ++index)
+        {
+            const bool fail = ((config.mFailDevice < 0) || (static_cast<uint32>(config.mFailDevice) == index));
+            simDevices.mDevices.push_back(std::shared_ptr<CHidSimDevice>(new CHidSimDevice(config, fail, &GetSimArrivals())));
+        }
+    }
+
+    for (size_t index = 0; index < simDevices.mDevices.size(); ++index)
+    {
+        std::ostringstream path;
+        path << DEVICE_PATH_PREFIX << index;
+        std::ostringstream parentId;
+        parentId << PARENT_ID_PREFIX << index;
+
+        CDeviceInfo info;
+        info.mDevicePath = path.str();
+        info.mParentId = parentId.str();
+        info.mVid = aVid;
+        info.mPid = aPid;
+        info.mUsage = aUsage;
+        info.mUsagePage = aUsagePage;
+        info.mInputReportLength = config.mReportLength;
+        info.mOutputReportLength = config.mReportLength;
+        info.mFeatureReportLength = config.mReportLength;
+        aDevices.push_back(info);
+    }
+
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "%u simulated devices", static_cast<uint32>(aDevices.size()));
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::FindSimDevice(const std::string &aParentId, std::string &aDevicePath)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    aDevicePath.clear();
+
+    CSimDevices &simDevices = GetSimDevices();
+    std::lock_guard<std::mutex> lock(simDevices.mMutex);
+
+    // A rebooting device is listed, but cannot be opened until it is back
+    size_t index;
+    if (GetDeviceIndex(aParentId, PARENT_ID_PREFIX, index) && (index < simDevices.mDevices.size()))
+    {
+        std::ostringstream path;
+        path << DEVICE_PATH_PREFIX << index;
+        aDevicePath = path.str();
+        retVal = true;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::CArrivalWatcher *CHidTransportSim::WatchSimArrivals(CArrivalListener *apListener)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    return new CSimArrivalWatcher(apListener);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransportSim::CHidTransportSim()
+    : mGeneration(0),
+    mReadLength(0),
+    mWindowIndex(0),
+    mLastWaitMs(0),
+    mError(0),
+    mpListener(NULL)
+{
+    FUNCTION_DEBUG_SENTRY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransportSim::~CHidTransportSim()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::Open(const std::string &aDevicePath)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    Close();
+
+    std::shared_ptr<CHidSimDevice> pDevice;
+    {
+        CSimDevices &simDevices = GetSimDevices();
+        std::lock_guard<std::mutex> lock(simDevices.mMutex);
+
+        size_t index;
+        if (GetDeviceIndex(aDevicePath, DEVICE_PATH_PREFIX, index) && (index < simDevices.mDevices.size()))
+        {
+            pDevice = simDevices.mDevices[index];
+        }
+    }
+
+    if (pDevice && pDevice->Attach(mGeneration))
+    {
+        mpDevice = pDevice;
+        mError = 0;
+        retVal = true;
+    }
+    else
+    {
+        mError = SIM_ERROR_NOT_CONNECTED;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportSim::Close()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    CloseWindow();
+    StopReading();
+    mpDevice.reset();
+
+    if (mpListener != NULL)
+    {
+        GetSimNotifier().Cancel(mpListener);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::IsOpen() const
+{
+    return (mpDevice != NULL);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::GetReportLengths(uint16 &aInputLength, uint16 &aOutputLength, uint16 &aFeatureLength)
+{
+    bool retVal = CheckAttached();
+
+    if (retVal)
+    {
+        aInputLength = mpDevice->GetConfig().mReportLength;
+        aOutputLength = mpDevice->GetConfig().mReportLength;
+        aFeatureLength = mpDevice->GetConfig().mReportLength;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::SetFeature(const uint8 *apReport, size_t aLength)
+{
+    bool retVal = CheckAttached();
+
+    if (retVal && !mpDevice->SetFeature(apReport, aLength))
+    {
+        mError = SIM_ERROR_NOT_SUPPORTED;
+        retVal = false;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::GetFeature(uint8 * /*apReport*/, size_t /*aLength*/)
+{
+    // The loader protocol, which reads feature reports, is not modelled
+    mError = SIM_ERROR_NOT_SUPPORTED;
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::WriteReport(const uint8 *apReport, size_t aLength)
+{
+    bool retVal = CheckAttached();
+
+    if (retVal)
+    {
+        // Wait for the device to accept the report before returning, as
+        // the host transports do
+        const CHidSimDevice::Clock::time_point acceptTime = mpDevice->AcceptReport();
+        std::this_thread::sleep_until(acceptTime);
+        mpDevice->WriteReport(apReport, aLength, acceptTime);
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportSim::FlushOutput()
+{
+    // Reports are accepted before WriteReport returns
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::StartReading(size_t aReportLength)
+{
+    bool retVal = CheckAttached();
+
+    if (retVal)
+    {
+        mpDevice->ClearReports();
+        mReadLength = aReportLength;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportSim::StopReading()
+{
+    mReadLength = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportSim::ReadReport(uint8 *apReport, uint32 aTimeoutMs, uint32 &aBytesRead)
+{
+    Result retVal = RESULT_FAILED;
+
+    aBytesRead = 0;
+
+    if (!IsOpen() || (mReadLength == 0))
+    {
+        mError = SIM_ERROR_INVALID;
+    }
+    else
+    {
+        retVal = mpDevice->ReadReport(mGeneration, apReport, mReadLength, aTimeoutMs, aBytesRead);
+        if (retVal == RESULT_FAILED)
+        {
+            mError = SIM_ERROR_NOT_CONNECTED;
+        }
+        else if ((retVal == RESULT_TIMEOUT) && (aTimeoutMs == 0) && (mpListener != NULL))
+        {
+            // With nothing queued, no response can arrive until the host
+            // writes again, and it reads again after that
+            const CHidSimDevice::Clock::time_point readyTime = mpDevice->GetReadyTime(mGeneration);
+            if (readyTime != CHidSimDevice::Clock::time_point::max())
+            {
+                GetSimNotifier().NotifyAt(mpListener, readyTime);
+            }
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::OpenWindow(size_t aReportLength, uint8 aWindow)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    CloseWindow();
+
+    if ((aWindow == 0) || (aWindow > MAX_WINDOW) || (aReportLength == 0))
+    {
+        mError = SIM_ERROR_INVALID;
+    }
+    else if (CheckAttached())
+    {
+        mWindowReports.assign(aWindow, std::vector<uint8>(aReportLength, 0));
+        mWindowIndex = 0;
+        mInFlight.reserve(aWindow);
+        retVal = true;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportSim::CloseWindow()
+{
+    mWindowReports.clear();
+    mInFlight.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::IsWindowOpen() const
+{
+    return !mWindowReports.empty();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportSim::GetWindowReport(uint32 aTimeoutMs, uint8 *&appReport)
+{
+    Result retVal = RESULT_OK;
+
+    mLastWaitMs = 0;
+
+    if (!IsWindowOpen())
+    {
+        mError = SIM_ERROR_INVALID;
+        retVal = RESULT_FAILED;
+    }
+    else if (!CheckAttached())
+    {
+        retVal = RESULT_FAILED;
+    }
+    else
+    {
+        // When the window is full, wait for the oldest report to be accepted.
+        // The listener is told once half the window is free.
+        if ((mInFlight.size() == mWindowReports.size())
+            && !WaitForWindow(mInFlight.front(), aTimeoutMs, mInFlight[(mInFlight.size() - 1) / 2]))
+        {
+            retVal = RESULT_TIMEOUT;
+        }
+        else
+        {
+            // Forget the reports the device has accepted
+            const CHidSimDevice::Clock::time_point now = CHidSimDevice::Clock::now();
+            size_t accepted = 0;
+            while ((accepted < mInFlight.size()) && (mInFlight[accepted] <= now))
+            {
+                ++accepted;
+            }
+            mInFlight.erase(mInFlight.begin(), mInFlight.begin() + accepted);
+
+            appReport = mWindowReports[mWindowIndex].data();
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportSim::WriteWindowReport()
+{
+    Result retVal = RESULT_OK;
+
+    if (!IsWindowOpen())
+    {
+        mError = SIM_ERROR_INVALID;
+        retVal = RESULT_FAILED;
+    }
+    else if (!CheckAttached())
+    {
+        retVal = RESULT_FAILED;
+    }
+    else
+    {
+        // The device model handles the report now; any response is timed
+        // from when the device accepts it
+        const std::vector<uint8> &report = mWindowReports[mWindowIndex];
+        const CHidSimDevice::Clock::time_point acceptTime = mpDevice->AcceptReport();
+        mpDevice->WriteReport(report.data(), report.size(), acceptTime);
+        mInFlight.push_back(acceptTime);
+
+        mWindowIndex = (mWindowIndex + 1) % mWindowReports.size();
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportSim::FlushWindow(uint32 aTimeoutMs)
+{
+    Result retVal = RESULT_OK;
+
+    mLastWaitMs = 0;
+
+    if (!IsWindowOpen())
+    {
+        mError = SIM_ERROR_INVALID;
+        retVal = RESULT_FAILED;
+    }
+    else if (!mInFlight.empty())
+    {
+        if (WaitForWindow(mInFlight.back(), aTimeoutMs, mInFlight.back()))
+        {
+            mInFlight.clear();
+        }
+        else
+        {
+            retVal = RESULT_TIMEOUT;
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidTransportSim::GetLastWaitMs() const
+{
+    return mLastWaitMs;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidTransportSim::GetError() const
+{
+    return mError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportSim::SetListener(CListener *apListener)
+{
+    if (mpListener != NULL)
+    {
+        GetSimNotifier().Cancel(mpListener);
+    }
+
+    mpListener = apListener;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::CheckAttached()
+{
+    bool retVal = (IsOpen() && mpDevice->IsAttached(mGeneration));
+
+    if (!retVal)
+    {
+        mError = SIM_ERROR_NOT_CONNECTED;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportSim::WaitForWindow(CHidSimDevice::Clock::time_point aTime, uint32 aTimeoutMs,
+    CHidSimDevice::Clock::time_point aNotifyTime)
+{
+    bool retVal = true;
+
+    const CHidSimDevice::Clock::time_point start = CHidSimDevice::Clock::now();
+    const CHidSimDevice::Clock::time_point deadline = start + std::chrono::milliseconds(aTimeoutMs);
+
+    if (aTime <= start)
+    {
+        // Already accepted
+    }
+    else if (aTime <= deadline)
+    {
+        std::this_thread::sleep_until(aTime);
+    }
+    else
+    {
+        std::this_thread::sleep_until(deadline);
+        retVal = false;
+
+        if ((aTimeoutMs == 0) && (mpListener != NULL))
+        {
+            GetSimNotifier().NotifyAt(mpListener, aNotifyTime);
+        }
+    }
+
+    mLastWaitMs = static_cast<uint32>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        CHidSimDevice::Clock::now() - start).count());
+
+    return retVal;
+}
@@ -0,0 +1,141 @@
+//*******************************************************************************
+//
+//  HidTransportSim.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CHidTransportSim class, access to simulated HID DFU devices.
+//
+//*******************************************************************************
+
+#ifndef HID_TRANSPORT_SIM_H
+#define HID_TRANSPORT_SIM_H
+
+#include "HidTransport.h"
+#include "HidSimDevice.h"
+
+#include <memory>
+
+///
+/// HID transport connected to CHidSimDevice models instead of the host HID
+/// driver, so that upgrades can be run and timed without hardware. It is
+/// built into HidDfuBench with the library sources and HIDDFU_SIM_TRANSPORT
+/// defined, which makes CHidTransport use it in place of the host transport.
+/// The HID_SIM_* environment variables set the number of devices and their
+/// behaviour (see CHidSimDevice::CConfig::FromEnvironment).
+///
+/// Simulated devices match any VID, PID, usage and usage page. They are
+/// kept between connections, so that a device found again after its reboot
+/// is the one that was upgraded, and are replaced when the configuration
+/// changes. A device returning from a reboot is reported to the arrival
+/// watchers at the time it can be opened again.
+///
+class CHidTransportSim : public CHidTransport
+{
+public:
+    CHidTransportSim();
+    virtual ~CHidTransportSim();
+
+    ///
+    /// Lists the simulated devices, creating them on first use. They take
+    /// the VID, PID, usage and usage page asked for.
+    /// @param[in] aVid Vendor ID.
+    /// @param[in] aPid Product ID.
+    /// @param[in] aUsage Usage.
+    /// @param[in] aUsagePage Usage page.
+    /// @param[out] aDevices Details of the devices.
+    /// @return true.
+    ///
+    static bool EnumerateDevices(uint16 aVid, uint16 aPid, uint16 aUsage, uint16 aUsagePage,
+        std::vector<CDeviceInfo> &aDevices);
+
+    ///
+    /// Finds a simulated device again after it has rebooted.
+    /// @param[in] aParentId Parent ID, from CDeviceInfo.
+    /// @param[out] aDevicePath Path used to open the device.
+    /// @return true if the device was found.
+    ///
+    static bool FindSimDevice(const std::string &aParentId, std::string &aDevicePath);
+
+    ///
+    /// Starts watching for simulated devices returning from a reboot.
+    /// @param[in] apListener Listener told of each device returning.
+    /// @return The watcher, to be deleted by the caller.
+    ///
+    static CArrivalWatcher *WatchSimArrivals(CArrivalListener *apListener);
+
+    virtual bool Open(const std::string &aDevicePath);
+    virtual void Close();
+    virtual bool IsOpen() const;
+    virtual bool GetReportLengths(uint16 &aInputLength, uint16 &aOutputLength, uint16 &aFeatureLength);
+    virtual bool SetFeature(const uint8 *apReport, size_t aLength);
+    virtual bool GetFeature(uint8 *apReport, size_t aLength);
+    virtual bool WriteReport(const uint8 *apReport, size_t aLength);
+    virtual void FlushOutput();
+    virtual bool StartReading(size_t aReportLength);
+    virtual void StopReading();
+    virtual Result ReadReport(uint8 *apReport, uint32 aTimeoutMs, uint32 &aBytesRead);
+    virtual bool OpenWindow(size_t aReportLength, uint8 aWindow);
+    virtual void CloseWindow();
+    virtual bool IsWindowOpen() const;
+    virtual Result GetWindowReport(uint32 aTimeoutMs, uint8 *&appReport);
+    virtual Result WriteWindowReport();
+    virtual Result FlushWindow(uint32 aTimeoutMs);
+    virtual uint32 GetLastWaitMs() const;
+    virtual uint32 GetError() const;
+    virtual void SetListener(CListener *apListener);
+
+private:
+
+    CHidTransportSim(const CHidTransportSim &);
+    CHidTransportSim &operator=(const CHidTransportSim &);
+
+    ///
+    /// Checks that the device is open and has not rebooted, setting the
+    /// error code if not.
+    /// @return true if the device can be used.
+    ///
+    bool CheckAttached();
+
+    ///
+    /// Waits for the device to accept the reports in flight up to a time,
+    /// arranging for the listener to be told if the timeout is zero.
+    /// @param[in] aTime Time the last report to wait for is accepted.
+    /// @param[in] aTimeoutMs Maximum time to wait in milliseconds.
+    /// @param[in] aNotifyTime Time to tell the listener, no earlier than aTime.
+    /// @return false if the reports were not accepted in time.
+    ///
+    bool WaitForWindow(CHidSimDevice::Clock::time_point aTime, uint32 aTimeoutMs,
+        CHidSimDevice::Clock::time_point aNotifyTime);
+
+    /// The open device, NULL if not open
+    std::shared_ptr<CHidSimDevice> mpDevice;
+
+    /// Boot of the device which was opened
+    uint32 mGeneration;
+
+    /// Input report length, zero when not reading
+    size_t mReadLength;
+
+    /// Report buffers for windowed writing, empty when not open
+    std::vector<std::vector<uint8> > mWindowReports;
+
+    /// Index of the buffer last given by GetWindowReport
+    size_t mWindowIndex;
+
+    /// Times at which the reports in flight are accepted, oldest first
+    std::vector<CHidSimDevice::Clock::time_point> mInFlight;
+
+    /// Time the last windowed write waited
+    uint32 mLastWaitMs;
+
+    /// Error code of the last failure
+    uint32 mError;
+
+    /// Told when the device is ready, NULL for none
+    CListener *mpListener;
+};
+
+#endif // #ifndef HID_TRANSPORT_SIM_H
@@ -11,15 +11,17 @@
 //*******************************************************************************
 
 #include <stdarg.h>
+#include <string.h>
 #include <iostream>
 #include <algorithm>
 #include <string>
 #include <sstream>
 #include <iomanip>
+#include <vector>
 
 #include "HidDfuDll/HidDfu.h"
 #include "common/globalversioninfo.h"
-#include "time\hi_res_clock.h"
+#include "time/hi_res_clock.h"
 
 //////////////////////////////////////////////////////////////////////////////
 
@@ -32,10 +34,12 @@ typedef enum
     COMMAND_UPGRADEBIN
 } Command;
 
-static int32 RunCommand(Command aCommand, const std::string& aFilename, uint8 aResetAfter);
+static int32 RunCommand(Command aCommand, const std::string& aFilename, uint8 aResetAfter,
+                        bool aShowJson, uint16 aDeviceCount);
 static uint16 GetHexValue(const char *apCommandStr, const char *apValueStr);
 static void ShowUsageMessage(const char *apFormat, ...);
 static void ShowVersionMessage(const uint16 aDeviceCount, const char *apMessage, bool aCheckMatch);
+static void ShowDeviceStatusJson(const uint16 aDeviceCount);
 static void CheckNumArguments(int aArgc, int aArgIndex, int aExpectedArguments, const char *apCommandStr);
 static void ErrorInsufficientArguments(int aGivenArguments, int aExpectedArguments, const char *apCommandStr);
 static void CheckFirstOccurrence(bool aTooMany, const char *apOption);
@@ -59,6 +63,18 @@ static const char *OPTION_NO_RESET_STR    = "-noreset";
 // Update/Backup all devices
 static const char *OPTION_ALL_STR    = "-all";
 
+// Validate DFU files through a sidecar index file
+static const char *OPTION_INDEX_STR    = "-index";
+
+// Number of upgrade data reports to keep in flight, followed by the number
+static const char *OPTION_WINDOW_STR    = "-window";
+
+// Resume interrupted upgrades through a journal file
+static const char *OPTION_RESUME_STR    = "-resume";
+
+// Print the status of each device as JSON while the command runs
+static const char *OPTION_JSON_STR    = "-json";
+
 // Ask for help
 static const char *OPTION_HELP1_STR    = "-help";
 static const char *OPTION_HELP2_STR    = "-?";
@@ -92,6 +108,10 @@ int main(int argc, char* argv[])
     std::string commandStr;
     bool restartAfter = true; // Default behaviour is to reset after completing the operation
     bool operateAll = false; // Default behaviour is to query the user
+    bool useIndex = false; // Default behaviour is to validate the whole file
+    int dataWindow = -1; // Default behaviour is a fixed delay between data reports
+    bool useJournal = false; // Default behaviour is to start each upgrade again
+    bool showJson = false; // Default behaviour is to show the percentage completed
 
     int argIndex = 1; // First application argument
 
@@ -115,6 +135,42 @@ int main(int argc, char* argv[])
                 CheckFirstOccurrence(operateAll == true, OPTION_ALL_STR);
                 operateAll = true;
             }
+            else if (arg.compare(OPTION_INDEX_STR) == 0)
+            {
+                ++argIndex;
+                CheckFirstOccurrence(useIndex == true, OPTION_INDEX_STR);
+                useIndex = true;
+            }
+            else if (arg.compare(OPTION_WINDOW_STR) == 0)
+            {
+                ++argIndex;
+                CheckFirstOccurrence(dataWindow != -1, OPTION_WINDOW_STR);
+
+                char *pErr = NULL;
+                unsigned long window = 0;
+                if (argIndex < argc)
+                {
+                    window = strtoul(argv[argIndex], &pErr, 10);
+                }
+                if (pErr == NULL || *pErr != '\0' || pErr == argv[argIndex] || window > 16)
+                {
+                    ShowUsageMessage("\"%s\" must be followed by a number from 0 to 16", OPTION_WINDOW_STR);
+                }
+                dataWindow = static_cast<int>(window);
+                ++argIndex;
+            }
+            else if (arg.compare(OPTION_RESUME_STR) == 0)
+            {
+                ++argIndex;
+                CheckFirstOccurrence(useJournal == true, OPTION_RESUME_STR);
+                useJournal = true;
+            }
+            else if (arg.compare(OPTION_JSON_STR) == 0)
+            {
+                ++argIndex;
+                CheckFirstOccurrence(showJson == true, OPTION_JSON_STR);
+                showJson = true;
+            }
             else if (arg.compare(OPTION_HELP1_STR) == 0 ||
                      arg.compare(OPTION_HELP2_STR) == 0)
             {
@@ -188,6 +244,21 @@ int main(int argc, char* argv[])
         }
         else
         {
+            if (useIndex)
+            {
+                hidDfuSetValidationIndex(1);
+            }
+
+            if (dataWindow > 0)
+            {
+                hidDfuSetDataWindow(static_cast<uint8>(dataWindow));
+            }
+
+            if (useJournal)
+            {
+                hidDfuSetResumeJournal(1);
+            }
+
             // Connect to the HID Devices
             errVal = hidDfuConnect(vid, pid, usage, usagePage, &count);
 
@@ -224,7 +295,7 @@ int main(int argc, char* argv[])
             }
 
             // Run the command
-            errVal = RunCommand(command, fileName, restartAfter);
+            errVal = RunCommand(command, fileName, restartAfter, showJson, count);
 
             // Report command completion status
             if ((errVal == HIDDFU_ERROR_OPERATION_PARTIAL_SUCCESS)
@@ -254,6 +325,8 @@ int main(int argc, char* argv[])
                     std::cout << "Device reset succeeded" << std::endl;
                 }
 
+                std::cout << "Data throughput: " << std::dec << hidDfuGetThroughput() << " bytes/s" << std::endl;
+
                 if (command == COMMAND_UPGRADEBIN)
                 {
                     ShowVersionMessage(count, "after upgrade", true);
@@ -288,7 +361,8 @@ int main(int argc, char* argv[])
 //////////////////////////////////////////////////////////////////////////////
 // Runs and command, reports progress
 //////////////////////////////////////////////////////////////////////////////
-static int32 RunCommand(Command aCommand, const std::string& aFilename, uint8 aResetAfter)
+static int32 RunCommand(Command aCommand, const std::string& aFilename, uint8 aResetAfter,
+                        bool aShowJson, uint16 aDeviceCount)
 {
     int32 retVal = HIDDFU_ERROR_NONE;
 
@@ -315,7 +389,11 @@ static int32 RunCommand(Command aCommand, const std::string& aFilename, uint8 aR
 
         while((progress = hidDfuGetProgress()) != 100)
         {
-            if (isWaitMsgPrinted == false)
+            if (aShowJson)
+            {
+                ShowDeviceStatusJson(aDeviceCount);
+            }
+            else if (isWaitMsgPrinted == false)
             {
                 if ((progress == PROGRESS_REBOOT_VALUE) && (aCommand == COMMAND_UPGRADEBIN))
                 {   // The sequence of Upgrading CSRA681xx, QCC302x-8x and QCC512x-8x devices with binary image
@@ -333,6 +411,12 @@ static int32 RunCommand(Command aCommand, const std::string& aFilename, uint8 aR
             HiResClockSleepMilliSec(500);
             retVal = hidDfuGetResult();
         }
+
+        if (aShowJson)
+        {
+            // Final state and result of each device
+            ShowDeviceStatusJson(aDeviceCount);
+        }
     }
 
     // Check again for result incase the above while loop did not execute
@@ -384,25 +468,25 @@ static void ShowVersionMessage(const uint16 aDeviceCount, const char *apMessage,
 {
     static const size_t COL_SIZE = 20;
 
-    // Calculate length to allocate memory for -
-    //      uint16 versionMajor, uint16 versionMinor, uint16 configVersion, ...
-    // A uint16 will take maximum 5 characters, so for 3 uint16's allocate 15 character
-    // and each uint16 number is followed by a comma/semicolon so allocate another 3 for 3 uint16 numbers
-    // which makes it a total of 18 character for 1 device.
-    const uint16 multiplier = 18;
-    // Allocate an additional byte for NULL character.
-    uint16 length = (aDeviceCount * multiplier) + 1;
-
-    char *pVersionBuffer = new char[length];
-    memset(pVersionBuffer, 0, length);
+    std::vector<HidDfuDeviceVersion> versions(aDeviceCount > 0 ? aDeviceCount : 1);
+    uint16 count = aDeviceCount;
 
-    // Get the firmware version
-    int32 retVal = hidDfuGetFirmwareVersions(pVersionBuffer, &length, aCheckMatch);
+    // Get the firmware version (read again once the devices have been upgraded)
+    int32 retVal = hidDfuGetDeviceVersions(&versions[0], &count, 0);
 
     std::stringstream s;
 
     // Test if versions match
-    if (aCheckMatch == true && retVal == HIDDFU_ERROR_VERSION_MISMATCH)
+    bool sameVersion = true;
+    for (uint16 index = 1; (index < count) && (retVal == HIDDFU_ERROR_NONE); ++index)
+    {
+        sameVersion = sameVersion
+            && (versions[index].versionMajor == versions[0].versionMajor)
+            && (versions[index].versionMinor == versions[0].versionMinor)
+            && (versions[index].configVersion == versions[0].configVersion);
+    }
+
+    if (aCheckMatch == true && !sameVersion)
     {
         s << std::endl;
         s << "--------------------------------------------------------------------------";
@@ -413,8 +497,7 @@ static void ShowVersionMessage(const uint16 aDeviceCount, const char *apMessage,
         s << std::endl;
     }
 
-    if (((retVal == HIDDFU_ERROR_NONE) || (retVal == HIDDFU_ERROR_VERSION_MISMATCH)) 
-            && (pVersionBuffer != NULL))
+    if (retVal == HIDDFU_ERROR_NONE)
     {
         // Header row
         s << std::endl << std::endl;
@@ -430,35 +513,59 @@ static void ShowVersionMessage(const uint16 aDeviceCount, const char *apMessage,
         s << "--------------------------------------------------------------------------";
         s << std::endl;
 
-        int counter = 0;
-        char *pDevToken = strtok(pVersionBuffer, ",");
-
         // Print version
-        while (pDevToken != NULL)
+        for (uint16 index = 0; index < count; ++index)
         {
-            // Insert device number initially, and
-            // after printing set of 3 numbers reperesenting version information
-            if ((counter == 0) || (counter % 3 == 0))
-            {
-                s << std::setw(COL_SIZE) << std::left << (counter/3) + 1;
-            }
-
-            s << std::setw(COL_SIZE) << std::left << pDevToken;
-            pDevToken = strtok(NULL, ",;");
-
-            // After printing set of 3 numbers reperesenting version information,
-            // insert a new line
-            if ((counter + 1) % 3 == 0)
-            {
-                s << std::endl;
-            }
-            counter++;
+            s << std::setw(COL_SIZE) << std::left << index + 1;
+            s << std::setw(COL_SIZE) << std::left << versions[index].versionMajor;
+            s << std::setw(COL_SIZE) << std::left << versions[index].versionMinor;
+            s << std::setw(COL_SIZE) << std::left << versions[index].configVersion;
+            s << std::endl;
         }
 
         s << std::endl << std::endl;
         std::cout << s.str();
     }
-    delete[] pVersionBuffer;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Display the status of each device as a single line of JSON
+//////////////////////////////////////////////////////////////////////////////
+static void ShowDeviceStatusJson(const uint16 aDeviceCount)
+{
+    static const char *STATE_NAMES[] =
+    {
+        "idle", "connecting", "transferring", "validating", "rebooting",
+        "committing", "complete", "failed", "stopped"
+    };
+    static const uint32 NUM_STATE_NAMES = sizeof(STATE_NAMES) / sizeof(STATE_NAMES[0]);
+
+    std::vector<HidDfuDeviceStatus> status(aDeviceCount > 0 ? aDeviceCount : 1);
+    uint16 count = aDeviceCount;
+
+    if (hidDfuGetDeviceStatus(&status[0], &count) == HIDDFU_ERROR_NONE)
+    {
+        std::stringstream s;
+        s << "{\"progress\":" << static_cast<uint16>(hidDfuGetProgress())
+          << ",\"throughput\":" << hidDfuGetThroughput() << ",\"devices\":[";
+
+        for (uint16 i = 0; i < count; ++i)
+        {
+            const HidDfuDeviceStatus &dev = status[i];
+            s << (i > 0 ? "," : "")
+              << "{\"device\":" << (i + 1)
+              << ",\"state\":\"" << (dev.state < NUM_STATE_NAMES ? STATE_NAMES[dev.state] : "unknown") << "\""
+              << ",\"progress\":" << dev.progress
+              << ",\"bytesSent\":" << dev.bytesSent
+              << ",\"throughput\":" << dev.throughput
+              << ",\"retries\":" << dev.retries
+              << ",\"lastLatencyUs\":" << dev.lastLatencyUs
+              << ",\"errorCode\":" << dev.errorCode << "}";
+        }
+
+        s << "]}" << std::endl;
+        std::cout << s.str() << std::flush;
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -498,10 +605,19 @@ static void CheckFirstOccurrence(bool aTooMany, const char *apOption)
 //////////////////////////////////////////////////////////////////////////////
 static void Usage()
 {
-    std::cout << gpExeName << "  [-noreset] backup|upgrade|upgradebin <vid> <pid> <usage> <usagePage> " << std::endl;
-    std::cout << "                                     <fileName>" << std::endl;
+    std::cout << gpExeName << "  [-noreset] [-index] [-window <n>] [-resume] [-json] backup|upgrade|upgradebin <vid> <pid>" << std::endl;
+    std::cout << "                                     <usage> <usagePage> <fileName>" << std::endl;
     std::cout << "Options:" << std::endl;
     std::cout << "    -noreset - Prevents device reset before exit." << std::endl;
+    std::cout << "    -index - Saves a validation index (<fileName>.idx) for upgrade, so that" << std::endl;
+    std::cout << "             later upgrades with the unchanged file validate it quickly." << std::endl;
+    std::cout << "    -window - Keeps up to <n> (1 to 16) data reports in flight for upgradebin," << std::endl;
+    std::cout << "              paced by the device instead of a fixed delay." << std::endl;
+    std::cout << "    -resume - Records upgradebin progress in <fileName>.journal, so that an" << std::endl;
+    std::cout << "              interrupted upgrade continues where it stopped when run again." << std::endl;
+    std::cout << "    -json - Prints the state, data sent, throughput, retries, response time" << std::endl;
+    std::cout << "            and result of each device as a line of JSON every 500 ms," << std::endl;
+    std::cout << "            in place of the percentage completed." << std::endl;
     std::cout << "Commands:" << std::endl;
     std::cout << "    backup - Performs a backup." << std::endl;
     std::cout << "    upgrade - Performs an upgrade." << std::endl;
@@ -0,0 +1,198 @@
+//*******************************************************************************
+//
+//  BackupWriter.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CBackupWriter class.
+//
+//*******************************************************************************
+
+#include "BackupWriter.h"
+#include "DfuFile.h"
+
+#include "engine/enginefw_interface.h"
+
+#include <assert.h>
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+////////////////////////////////////////////////////////////////////////////////
+
+CBackupWriter::CBackupWriter()
+    : mpFile(NULL),
+    mFillIndex(0),
+    mStopping(false),
+    mFailed(false)
+{
+    for (size_t n = 0; n < 2; ++n)
+    {
+        mLengths[n] = 0;
+        mFull[n] = false;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CBackupWriter::~CBackupWriter()
+{
+    Close(false);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CBackupWriter::Open(const std::string &aFileName)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    assert(mpFile == NULL);
+
+    mpFile = fopen(aFileName.c_str(), "wb");
+    if (mpFile != NULL)
+    {
+        for (size_t n = 0; n < 2; ++n)
+        {
+            mBuffers[n].resize(BUFFER_SIZE);
+            mLengths[n] = 0;
+            mFull[n] = false;
+        }
+        mFillIndex = 0;
+        mStopping = false;
+        mFailed = false;
+        mCrc = CRC();
+
+        mWriter = std::thread(&CBackupWriter::WriterFunc, this);
+        retVal = true;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint8 *CBackupWriter::GetSpace(size_t aLength)
+{
+    assert(aLength <= BUFFER_SIZE);
+
+    uint8 *pSpace = NULL;
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    if (mLengths[mFillIndex] + aLength > BUFFER_SIZE)
+    {
+        SwapBuffers(lock);
+    }
+
+    if (!mFailed)
+    {
+        pSpace = &mBuffers[mFillIndex][mLengths[mFillIndex]];
+    }
+
+    return pSpace;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CBackupWriter::Commit(size_t aLength)
+{
+    assert(mLengths[mFillIndex] + aLength <= BUFFER_SIZE);
+
+    mLengths[mFillIndex] += aLength;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CBackupWriter::Close(bool aComplete)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    if (mWriter.joinable())
+    {
+        {
+            // Write what has been read, then stop the thread
+            std::unique_lock<std::mutex> lock(mMutex);
+            if (mLengths[mFillIndex] > 0)
+            {
+                SwapBuffers(lock);
+            }
+            mStopping = true;
+            mChanged.notify_all();
+        }
+        mWriter.join();
+    }
+
+    if (mpFile != NULL)
+    {
+        retVal = !mFailed;
+
+        if (retVal && aComplete)
+        {
+            CDfuFile::DfuFileSuffix dfuSuffix = CDfuFile::STANDARD_DFU_SUFFIX;
+            mCrc(&dfuSuffix, CDfuFile::DFU_SUFFIX_WITHOUT_CRC_LEN);
+            dfuSuffix.dwCrc = mCrc();
+
+            retVal = (fwrite(&dfuSuffix, sizeof(uint8), sizeof(CDfuFile::DfuFileSuffix), mpFile)
+                == sizeof(CDfuFile::DfuFileSuffix));
+        }
+
+        retVal = (fclose(mpFile) == 0) && retVal;
+        mpFile = NULL;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CBackupWriter::SwapBuffers(std::unique_lock<std::mutex> &aLock)
+{
+    mFull[mFillIndex] = true;
+    mChanged.notify_all();
+
+    // The other buffer must have been written before it is filled again
+    mFillIndex ^= 1;
+    mChanged.wait(aLock, [this] { return !mFull[mFillIndex] || mFailed; });
+    mLengths[mFillIndex] = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CBackupWriter::WriterFunc()
+{
+    size_t writeIndex = 0;
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (true)
+    {
+        mChanged.wait(lock, [this, writeIndex] { return mFull[writeIndex] || mStopping; });
+        if (!mFull[writeIndex])
+        {
+            break;
+        }
+
+        // The buffer is not touched by the reading thread until it is freed
+        bool written = true;
+        if (!mFailed)
+        {
+            lock.unlock();
+            const uint8 *pData = &mBuffers[writeIndex][0];
+            const size_t length = mLengths[writeIndex];
+            mCrc(pData, length);
+            written = (fwrite(pData, sizeof(uint8), length, mpFile) == length);
+            lock.lock();
+        }
+
+        if (!written)
+        {
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Backup file write failed");
+            mFailed = true;
+        }
+        mFull[writeIndex] = false;
+        mChanged.notify_all();
+        writeIndex ^= 1;
+    }
+}
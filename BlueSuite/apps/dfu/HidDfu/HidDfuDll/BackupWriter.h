@@ -0,0 +1,116 @@
+//*******************************************************************************
+//
+//  BackupWriter.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CBackupWriter class, writes a backup DFU file on its own thread.
+//
+//*******************************************************************************
+
+#ifndef BACKUP_WRITER_H
+#define BACKUP_WRITER_H
+
+#include "DFUEngine/CRC.h"
+#include "common/types.h"
+
+#include <stdio.h>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+///
+/// Writer of the DFU file made by a backup, which calculates the CRC of the
+/// data and writes it to disk on its own thread, so that the device is read
+/// while the data already read is written.
+///
+/// The data is passed through a pair of buffers: the reading thread fills
+/// one with reports while the writer thread writes the other, and the
+/// buffers are swapped when the one being filled is full. Reading only
+/// waits if the disk falls a whole buffer behind the device.
+///
+class CBackupWriter
+{
+public:
+
+    /// Size of each buffer
+    static const size_t BUFFER_SIZE = 64 * 1024;
+
+    CBackupWriter();
+    ~CBackupWriter();
+
+    ///
+    /// Creates the file and starts the writer thread.
+    /// @param[in] aFileName DFU file name.
+    /// @return false if the file cannot be created.
+    ///
+    bool Open(const std::string &aFileName);
+
+    ///
+    /// Gets space in the buffer being filled for the next report, passing
+    /// the buffer to the writer thread first if it does not have room.
+    /// @param[in] aLength Largest length of the report, no more than BUFFER_SIZE.
+    /// @return Where to read the report to, or NULL if writing has failed.
+    ///
+    uint8 *GetSpace(size_t aLength);
+
+    ///
+    /// Adds the report read to the space given by GetSpace to the data.
+    /// @param[in] aLength Length of the report.
+    ///
+    void Commit(size_t aLength);
+
+    ///
+    /// Waits for the data to be written, appends the DFU file suffix (with
+    /// the CRC of the data) if the backup completed, and closes the file.
+    /// @param[in] aComplete Whether all the data has been read.
+    /// @return false if writing the file failed.
+    ///
+    bool Close(bool aComplete);
+
+private:
+
+    CBackupWriter(const CBackupWriter &);
+    CBackupWriter &operator=(const CBackupWriter &);
+
+    ///
+    /// Passes the buffer being filled to the writer thread, waiting for the
+    /// other buffer to be written. Called with mMutex held.
+    /// @param[in] aLock The lock on mMutex.
+    ///
+    void SwapBuffers(std::unique_lock<std::mutex> &aLock);
+
+    ///
+    /// Writer thread, writes each buffer passed to it in turn.
+    ///
+    void WriterFunc();
+
+    /// The file, NULL when not open
+    FILE *mpFile;
+
+    /// CRC of the data written, updated by the writer thread
+    CRC mCrc;
+
+    /// The pair of buffers, and the length of the data in each
+    std::vector<uint8> mBuffers[2];
+    size_t mLengths[2];
+
+    /// Buffer being filled by the reading thread
+    size_t mFillIndex;
+
+    /// Writer state, protected by mMutex
+    std::mutex mMutex;
+    std::condition_variable mChanged;
+    bool mFull[2];          //< Whether each buffer is waiting to be written
+    bool mStopping;         //< The writer thread exits once the buffers are written
+    bool mFailed;           //< A write has failed
+
+    /// Writes the buffers to the file
+    std::thread mWriter;
+};
+
+#endif // #ifndef BACKUP_WRITER_H
@@ -0,0 +1,282 @@
+//*******************************************************************************
+//
+//  DfuFile.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CDfuFile class.
+//
+//*******************************************************************************
+
+#include "DfuFile.h"
+#include "DfuIndex.h"
+#include "HidDfu.h"
+#include "UpgradeImage.h"
+
+#include "engine/enginefw_interface.h"
+
+#include <sstream>
+#include <string.h>
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+////////////////////////////////////////////////////////////////////////////////
+
+const CDfuFile::DfuFileSuffix CDfuFile::STANDARD_DFU_SUFFIX =
+{
+    0x0001,         // bcdDevice
+    0xFFFE,         // idProduct
+    0x0A12,         // idVendor
+    0x0100,         // bcdDfu
+    {'U','F','D'},  // ucDfuSignature
+    0x10,           // bLength
+    0               // dwCrc - this value is ignored (CRC calculated)
+};
+
+////////////////////////////////////////////////////////////////////////////////
+
+CDfuFile::CDfuFile(CHidDfuErrorMsg &aLastError)
+    : mLastError(aLastError),
+    mpFile(NULL),
+    mFileSize(0),
+    mpIndex(NULL),
+    mReadOffset(0),
+    mChunkOffset(0)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    memset(&mSuffix, 0, sizeof(mSuffix));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CDfuFile::~CDfuFile()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CDfuFile::Open(const std::string &aFileName)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    Close();
+
+    mFileName = aFileName;
+    mReadOffset = 0;
+    mChunk.clear();
+    mChunkOffset = 0;
+    mpFile = fopen(aFileName.c_str(), "rb");
+    if (mpFile == NULL)
+    {
+        std::ostringstream msg;
+        msg << "Failed to open file \"" << aFileName << "\"";
+        retVal = mLastError.SetMsg(HIDDFU_ERROR_FILE_OPEN_FAILED, msg.str());
+    }
+    else
+    {
+        // Get file length
+        fseek(mpFile, 0, SEEK_END);
+        mFileSize = (size_t)ftell(mpFile);
+
+        if (mFileSize < sizeof(DfuFileSuffix))
+        {
+            retVal = mLastError.SetMsg(HIDDFU_ERROR_FILE_INVALID_FORMAT, "File too short");
+        }
+        else
+        {
+            // Move to start of suffix and read it
+            fseek(mpFile, -(long)sizeof(DfuFileSuffix), SEEK_END);
+            if (fread(&mSuffix, sizeof(uint8), sizeof(DfuFileSuffix), mpFile) != sizeof(DfuFileSuffix))
+            {
+                retVal = mLastError.SetMsg(HIDDFU_ERROR_FILE_READ_FAILED, "Failed to read file suffix");
+            }
+
+            // Validate suffix
+            if (retVal == HIDDFU_ERROR_NONE &&
+                (mSuffix.bLength < sizeof(DfuFileSuffix) ||
+                mFileSize < mSuffix.bLength ||
+                memcmp(mSuffix.ucDfuSignature, STANDARD_DFU_SUFFIX.ucDfuSignature, sizeof(mSuffix.ucDfuSignature)) != 0 ||
+                mSuffix.bcdDfu != STANDARD_DFU_SUFFIX.bcdDfu))
+            {
+                retVal = mLastError.SetMsg(HIDDFU_ERROR_FILE_INVALID_FORMAT, "File suffix is invalid for the connected device");
+            }
+
+            // Return to start of file
+            fseek(mpFile, 0, SEEK_SET);
+        }
+
+        if (retVal != HIDDFU_ERROR_NONE)
+        {
+            Close();
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CDfuFile::CheckCrc(CDfuIndex *apIndex)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    if (mpFile == NULL)
+    {
+        retVal = mLastError.SetDefaultMsg(HIDDFU_ERROR_SEQUENCE);
+    }
+    else
+    {
+        // Map the file so that the CRC can be calculated over the whole file
+        // at once, split across threads for a large file
+        CUpgradeImage image;
+        retVal = image.Open(mFileName, mLastError);
+
+        if (retVal == HIDDFU_ERROR_NONE && image.GetSize() != mFileSize)
+        {
+            retVal = mLastError.SetMsg(HIDDFU_ERROR_FILE_INVALID_FORMAT, "File changed during validation");
+        }
+
+        uint32 fileCrc = 0;
+        if (retVal == HIDDFU_ERROR_NONE)
+        {
+            // CRC covers everything except the final CRC (4 bytes)
+            const size_t dataLength = image.GetSize() - sizeof(mSuffix.dwCrc);
+            if (apIndex != NULL)
+            {
+                fileCrc = apIndex->Build(image.GetData(), dataLength, mSuffix);
+            }
+            else
+            {
+                CRC crc;
+                fileCrc = crc.UpdateParallel(image.GetData(), dataLength);
+            }
+        }
+
+        if (retVal == HIDDFU_ERROR_NONE && fileCrc != mSuffix.dwCrc)
+        {
+            retVal = mLastError.SetDefaultMsg(HIDDFU_ERROR_FILE_CRC_INCORRECT);
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CDfuFile::Read(uint8 *apBuffer, size_t aLength)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+
+    if (mpFile == NULL)
+    {
+        retVal = mLastError.SetDefaultMsg(HIDDFU_ERROR_SEQUENCE);
+    }
+    else if (mpIndex != NULL)
+    {
+        retVal = ReadChecked(apBuffer, aLength);
+    }
+    else
+    {
+        (void)fread(apBuffer, sizeof(apBuffer[0]), aLength, mpFile);
+
+        if (ferror(mpFile))
+        {
+            retVal = mLastError.SetDefaultMsg(HIDDFU_ERROR_FILE_READ_FAILED);
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CDfuFile::ReadChecked(uint8 *apBuffer, size_t aLength)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+
+    while (retVal == HIDDFU_ERROR_NONE && aLength > 0 && mReadOffset < mFileSize)
+    {
+        if (mReadOffset >= mChunkOffset + mChunk.size())
+        {
+            retVal = ReadChunk(mReadOffset / CDfuIndex::CHUNK_SIZE);
+        }
+
+        if (retVal == HIDDFU_ERROR_NONE)
+        {
+            const size_t start = mReadOffset - mChunkOffset;
+            const size_t length = (aLength < mChunk.size() - start ? aLength : mChunk.size() - start);
+            memcpy(apBuffer, &mChunk[start], length);
+            mReadOffset += length;
+            apBuffer += length;
+            aLength -= length;
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CDfuFile::ReadChunk(size_t aChunk)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+
+    // Only the data covered by the file CRC is in the index. The last chunk
+    // is read to the end of the file, taking in the file CRC after it.
+    const size_t dataLength = mFileSize - sizeof(mSuffix.dwCrc);
+    const size_t chunkStart = aChunk * CDfuIndex::CHUNK_SIZE;
+    size_t chunkEnd = chunkStart + CDfuIndex::CHUNK_SIZE;
+    size_t readEnd = chunkEnd;
+    if (chunkEnd >= dataLength)
+    {
+        chunkEnd = dataLength;
+        readEnd = mFileSize;
+    }
+
+    mChunk.resize(readEnd - chunkStart);
+    mChunkOffset = chunkStart;
+
+    if (aChunk >= mpIndex->GetNumChunks())
+    {
+        retVal = mLastError.SetDefaultMsg(HIDDFU_ERROR_SEQUENCE);
+    }
+    else if (fread(&mChunk[0], sizeof(mChunk[0]), mChunk.size(), mpFile) != mChunk.size())
+    {
+        retVal = mLastError.SetMsg(HIDDFU_ERROR_FILE_READ_FAILED, "File changed since validation");
+    }
+    else
+    {
+        CRC crc;
+        if (crc(&mChunk[0], chunkEnd - chunkStart) != mpIndex->GetChunkCrc(aChunk))
+        {
+            retVal = mLastError.SetMsg(HIDDFU_ERROR_FILE_CRC_INCORRECT, "File changed since validation");
+        }
+    }
+
+    if (retVal != HIDDFU_ERROR_NONE)
+    {
+        mChunk.clear();
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CDfuFile::Close()
+{
+    if (mpFile != NULL)
+    {
+        fclose(mpFile);
+        mpFile = NULL;
+    }
+}
@@ -0,0 +1,179 @@
+//*******************************************************************************
+//
+//  DfuFile.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CDfuFile class, streaming access to a DFU file with suffix and CRC
+//  validation.
+//
+//*******************************************************************************
+
+#ifndef DFU_FILE_H
+#define DFU_FILE_H
+
+#include "HidDfuErrorMsg.h"
+#include "DFUEngine/CRC.h"
+#include "common/types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+class CDfuIndex;
+
+///
+/// Class giving sequential access to a DFU file. The suffix is read and
+/// checked on opening, and the CRC is checked over a read-only mapping of
+/// the file, so memory use does not depend on the file size.
+///
+class CDfuFile
+{
+public:
+
+    // File suffix structure.
+    // The DFU suffix is defined as offsets from the end of the file, which
+    // is why the fields are listed in the opposite of expected order and
+    // why the "DFU" string for ucDfuSignature is reversed
+    //
+    // uint16 bcdDevice         0x0001      (not used) This can be used to hold the stack software build integer
+    // uint16 idProduct         0xFFFE      USB Product ID
+    // uint16 idVendor          0x0A12      USB Vendor ID
+    // uint16 bcdDfu            0x0100      DFU specification number (1.0)
+    // uint8 ucDfuSignature[3]  "UFD"       DFU Signature string
+    // uint8 bLength            0x10        DFU Suffix length
+    // uint32 dwCRC                         Added in code, not a constant
+    //
+    // The CRC is uint32_t, as uint32 is 8 bytes on 64-bit Linux
+    struct DfuFileSuffix
+    {
+        uint16  bcdDevice;
+        uint16  idProduct;
+        uint16  idVendor;
+        uint16  bcdDfu;
+        uint8   ucDfuSignature[3];
+        uint8   bLength;
+        uint32_t dwCrc;
+    };
+
+    /// Standard DFU file suffix data (that expected from a DFU file)
+    static const DfuFileSuffix STANDARD_DFU_SUFFIX;
+
+    /// Length of file suffix without CRC (because the CRC calculation doesn't include itself)
+    static const size_t DFU_SUFFIX_WITHOUT_CRC_LEN = offsetof(DfuFileSuffix, dwCrc);
+
+    ///
+    /// Constructor.
+    /// @param[in] aLastError Error message object to receive failure details.
+    ///
+    CDfuFile(CHidDfuErrorMsg &aLastError);
+    ~CDfuFile();
+
+    ///
+    /// Opens a DFU file and validates its suffix. The file is left
+    /// positioned at the start.
+    /// @param[in] aFileName File name.
+    /// @return The result.
+    ///
+    int32 Open(const std::string &aFileName);
+
+    ///
+    /// Checks the file CRC against the suffix. The CRC of a large file is
+    /// calculated in parallel blocks. The file position is unchanged.
+    /// @param[out] apIndex If not NULL, receives the chunk CRC table of the
+    /// file (built in the same pass as the CRC).
+    /// @return The result.
+    ///
+    int32 CheckCrc(CDfuIndex *apIndex = NULL);
+
+    ///
+    /// Sets an index whose chunk CRCs are checked as the file is read, so
+    /// that a file validated earlier from its index is still checked before
+    /// its data is used. Must be called before the first Read.
+    /// @param[in] apIndex The index, matching the open file, or NULL.
+    ///
+    void SetIndex(const CDfuIndex *apIndex) { mpIndex = apIndex; }
+
+    ///
+    /// Reads the next block of data from the file. Reading past the end
+    /// of the file is not an error, any bytes not read are left unchanged.
+    /// If an index is set, each chunk is read whole and checked when the
+    /// read first enters it, so no data is returned before it is checked.
+    /// The last chunk runs to the end of the file, so it is checked even if
+    /// the suffix is never read.
+    /// @param[out] apBuffer Buffer to receive the data.
+    /// @param[in] aLength Number of bytes to read.
+    /// @return The result.
+    ///
+    int32 Read(uint8 *apBuffer, size_t aLength);
+
+    ///
+    /// Closes the file, if open.
+    ///
+    void Close();
+
+    ///
+    /// Gets the size of the open file.
+    /// @return The file size in bytes (including the suffix).
+    ///
+    size_t GetFileSize() const { return mFileSize; }
+
+    ///
+    /// Gets the suffix read from the open file.
+    /// @return The suffix.
+    ///
+    const DfuFileSuffix &GetSuffix() const { return mSuffix; }
+
+private:
+    CDfuFile(const CDfuFile &);
+    CDfuFile &operator=(const CDfuFile &);
+
+    ///
+    /// Reads the next block of data from the checked chunks, reading and
+    /// checking the next chunk as needed.
+    /// @param[out] apBuffer Buffer to receive the data.
+    /// @param[in] aLength Number of bytes to read.
+    /// @return The result.
+    ///
+    int32 ReadChecked(uint8 *apBuffer, size_t aLength);
+
+    ///
+    /// Reads a whole chunk from the file and checks it against the index.
+    /// @param[in] aChunk Chunk number, that following the last read.
+    /// @return The result.
+    ///
+    int32 ReadChunk(size_t aChunk);
+
+    /// Error message object for failure details
+    CHidDfuErrorMsg &mLastError;
+
+    /// File name
+    std::string mFileName;
+
+    /// File handle, NULL if not open
+    FILE *mpFile;
+
+    /// File size in bytes
+    size_t mFileSize;
+
+    /// Suffix read from the file
+    DfuFileSuffix mSuffix;
+
+    /// Index for checking chunks as they are read, NULL if not checked
+    const CDfuIndex *mpIndex;
+
+    /// Offset of the next byte to read
+    size_t mReadOffset;
+
+    /// Last chunk read and checked, when an index is set
+    std::vector<uint8> mChunk;
+
+    /// Offset in the file of the first byte of mChunk
+    size_t mChunkOffset;
+};
+
+#endif // #ifndef DFU_FILE_H
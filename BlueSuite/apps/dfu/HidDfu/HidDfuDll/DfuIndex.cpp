@@ -0,0 +1,235 @@
+//*******************************************************************************
+//
+//  DfuIndex.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CDfuIndex class.
+//
+//*******************************************************************************
+
+#include "DfuIndex.h"
+#include "DFUEngine/CRC.h"
+
+#include "engine/enginefw_interface.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <thread>
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+namespace
+{
+    // Smallest number of chunks given to each thread by CDfuIndex::Build
+    const size_t MIN_CHUNKS_PER_THREAD = 64;
+
+    // Calculate the CRC of each of a range of chunks
+    void CalculateChunkCrcs(const uint8 *apData, size_t aLength, uint32_t *apCrcs)
+    {
+        for (; aLength > 0; apData += CDfuIndex::CHUNK_SIZE, ++apCrcs)
+        {
+            const size_t length = (aLength < CDfuIndex::CHUNK_SIZE ? aLength : CDfuIndex::CHUNK_SIZE);
+            CRC crc;
+            *apCrcs = crc(apData, length);
+            aLength -= length;
+        }
+    }
+}
+
+const char *const CDfuIndex::FILE_EXTENSION = ".idx";
+
+////////////////////////////////////////////////////////////////////////////////
+
+CDfuIndex::CDfuIndex()
+    : mDataLength(0)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    memset(&mSuffix, 0, sizeof(mSuffix));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CDfuIndex::Build(const uint8 *apData, size_t aLength, const CDfuFile::DfuFileSuffix &aSuffix)
+{
+    uint32 retVal = 0;
+    FUNCTION_DEBUG_SENTRY_RET(uint32, retVal);
+
+    mDataLength = aLength;
+    mSuffix = aSuffix;
+    mChunkCrcs.assign((aLength + CHUNK_SIZE - 1) / CHUNK_SIZE, 0);
+
+    size_t numThreads = std::thread::hardware_concurrency();
+    if (numThreads > mChunkCrcs.size() / MIN_CHUNKS_PER_THREAD)
+    {
+        numThreads = mChunkCrcs.size() / MIN_CHUNKS_PER_THREAD;
+    }
+
+    if (numThreads <= 1)
+    {
+        CalculateChunkCrcs(apData, aLength, &mChunkCrcs[0]);
+    }
+    else
+    {
+        // Each thread takes a whole number of chunks, the calling thread
+        // takes the first range
+        const size_t chunksPerThread = mChunkCrcs.size() / numThreads;
+        std::vector<std::thread> threads;
+        for (size_t n = 1; n < numThreads; ++n)
+        {
+            const size_t offset = n * chunksPerThread * CHUNK_SIZE;
+            const size_t length = (n == numThreads - 1 ? aLength - offset : chunksPerThread * CHUNK_SIZE);
+            threads.push_back(std::thread(CalculateChunkCrcs, apData + offset, length, &mChunkCrcs[n * chunksPerThread]));
+        }
+
+        CalculateChunkCrcs(apData, chunksPerThread * CHUNK_SIZE, &mChunkCrcs[0]);
+
+        for (size_t n = 0; n < threads.size(); ++n)
+        {
+            threads[n].join();
+        }
+    }
+
+    // The CRC of the whole data follows from the chunk CRCs
+    retVal = 0xFFFFFFFF;
+    for (size_t n = 0; n < mChunkCrcs.size(); ++n)
+    {
+        const size_t length = (n == mChunkCrcs.size() - 1 ? aLength - n * CHUNK_SIZE : CHUNK_SIZE);
+        retVal = (n == 0 ? mChunkCrcs[0] : CRC::Combine(retVal, mChunkCrcs[n], length));
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CDfuIndex::Load(const std::string &aFileName)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    CImageCache::FileIdentity identity;
+    FILE *pFile = NULL;
+
+    if (CImageCache::GetFileIdentity(aFileName, identity) && identity.size >= sizeof(CDfuFile::DfuFileSuffix))
+    {
+        pFile = fopen((aFileName + FILE_EXTENSION).c_str(), "rb");
+    }
+
+    if (pFile != NULL)
+    {
+        const uint64 dataLength = identity.size - sizeof(mSuffix.dwCrc);
+        const uint64 numChunks = (dataLength + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+        IndexHeader header;
+        if (fread(&header, sizeof(header), 1, pFile) == 1 &&
+            header.magic == INDEX_MAGIC &&
+            header.version == INDEX_VERSION &&
+            header.fileSize == identity.size &&
+            header.modifiedTime == identity.modifiedTime &&
+            header.fileId == identity.fileId &&
+            header.volumeId == identity.volumeId &&
+            header.chunkSize == CHUNK_SIZE &&
+            header.numChunks == numChunks)
+        {
+            mChunkCrcs.resize(header.numChunks);
+
+            uint32_t fileCrc = 0;
+            if (fread(&mChunkCrcs[0], sizeof(uint32_t), mChunkCrcs.size(), pFile) == mChunkCrcs.size() &&
+                fread(&fileCrc, sizeof(fileCrc), 1, pFile) == 1)
+            {
+                CRC crc;
+                crc(&header, sizeof(header));
+                retVal = (crc(&mChunkCrcs[0], mChunkCrcs.size() * sizeof(uint32_t)) == fileCrc);
+            }
+        }
+
+        fclose(pFile);
+
+        if (retVal)
+        {
+            mDataLength = static_cast<size_t>(dataLength);
+            mSuffix = header.suffix;
+        }
+    }
+
+    if (!retVal)
+    {
+        mChunkCrcs.clear();
+    }
+
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Validation index for \"%s\" %s",
+        aFileName.c_str(), (retVal ? "loaded" : "not usable"));
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CDfuIndex::Save(const std::string &aFileName, const CImageCache::FileIdentity &aIdentity)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    IndexHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = INDEX_MAGIC;
+    header.version = INDEX_VERSION;
+    header.fileSize = aIdentity.size;
+    header.modifiedTime = aIdentity.modifiedTime;
+    header.fileId = aIdentity.fileId;
+    header.volumeId = aIdentity.volumeId;
+    header.suffix = mSuffix;
+    header.chunkSize = CHUNK_SIZE;
+    header.numChunks = static_cast<uint32_t>(mChunkCrcs.size());
+
+    CRC crc;
+    crc(&header, sizeof(header));
+    const uint32_t fileCrc = crc(&mChunkCrcs[0], mChunkCrcs.size() * sizeof(uint32_t));
+
+    const std::string indexName = aFileName + FILE_EXTENSION;
+    const std::string tempName = indexName + ".tmp";
+
+    FILE *pFile = fopen(tempName.c_str(), "wb");
+    if (pFile != NULL && !mChunkCrcs.empty())
+    {
+        retVal = fwrite(&header, sizeof(header), 1, pFile) == 1 &&
+            fwrite(&mChunkCrcs[0], sizeof(uint32_t), mChunkCrcs.size(), pFile) == mChunkCrcs.size() &&
+            fwrite(&fileCrc, sizeof(fileCrc), 1, pFile) == 1;
+    }
+
+    if (pFile != NULL)
+    {
+        retVal = (fclose(pFile) == 0) && retVal;
+
+        // rename does not replace an existing file on all platforms
+        if (retVal)
+        {
+            remove(indexName.c_str());
+            retVal = (rename(tempName.c_str(), indexName.c_str()) == 0);
+        }
+
+        if (!retVal)
+        {
+            remove(tempName.c_str());
+        }
+    }
+
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Validation index for \"%s\" %s",
+        aFileName.c_str(), (retVal ? "saved" : "could not be saved"));
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CDfuIndex::Matches(size_t aFileSize, const CDfuFile::DfuFileSuffix &aSuffix) const
+{
+    return !mChunkCrcs.empty() &&
+        mDataLength + sizeof(aSuffix.dwCrc) == aFileSize &&
+        memcmp(&mSuffix, &aSuffix, sizeof(aSuffix)) == 0;
+}
@@ -0,0 +1,133 @@
+//*******************************************************************************
+//
+//  DfuIndex.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CDfuIndex class, validation sidecar file (<file>.idx) for a DFU file.
+//
+//*******************************************************************************
+
+#ifndef DFU_INDEX_H
+#define DFU_INDEX_H
+
+#include "DfuFile.h"
+#include "ImageCache.h"
+#include "common/types.h"
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+///
+/// Class holding the result of validating a DFU file: the suffix, the file
+/// identity when it was validated and the CRC of each chunk of the file.
+/// Saved next to the DFU file, it allows a later process to accept the file
+/// without calculating the CRC of the whole file (provided the file identity
+/// is unchanged), and to check each chunk as it is read.
+///
+class CDfuIndex
+{
+public:
+
+    /// Size of each chunk of the file with a CRC in the table
+    static const uint32 CHUNK_SIZE = 64 * 1024;
+
+    /// Extension appended to the DFU file name for the sidecar file
+    static const char *const FILE_EXTENSION;
+
+    CDfuIndex();
+    ~CDfuIndex() {};
+
+    ///
+    /// Calculates the chunk CRC table for a DFU file, using several threads
+    /// for a large file.
+    /// @param[in] apData The file data covered by the CRC (all but the final
+    /// CRC field of the suffix).
+    /// @param[in] aLength Length of the data in bytes.
+    /// @param[in] aSuffix Suffix read from the file.
+    /// @return The CRC of the whole data, for checking against the suffix.
+    ///
+    uint32 Build(const uint8 *apData, size_t aLength, const CDfuFile::DfuFileSuffix &aSuffix);
+
+    ///
+    /// Loads the sidecar file for a DFU file. Fails if the sidecar is
+    /// missing or corrupt, or was saved for a different version of the file.
+    /// @param[in] aFileName DFU file name.
+    /// @return true if successful.
+    ///
+    bool Load(const std::string &aFileName);
+
+    ///
+    /// Saves the sidecar file for a DFU file. The sidecar is written to a
+    /// temporary file then renamed, so readers never see a partial file.
+    /// @param[in] aFileName DFU file name.
+    /// @param[in] aIdentity Identity of the file before Build was called.
+    /// @return true if successful.
+    ///
+    bool Save(const std::string &aFileName, const CImageCache::FileIdentity &aIdentity);
+
+    ///
+    /// Checks whether the index describes an opened DFU file.
+    /// @param[in] aFileSize Size of the file.
+    /// @param[in] aSuffix Suffix read from the file.
+    /// @return true if the size and suffix match.
+    ///
+    bool Matches(size_t aFileSize, const CDfuFile::DfuFileSuffix &aSuffix) const;
+
+    ///
+    /// Gets the number of chunks in the table.
+    /// @return The number of chunks.
+    ///
+    size_t GetNumChunks() const { return mChunkCrcs.size(); }
+
+    ///
+    /// Gets the CRC of a chunk, calculated from an initial value of
+    /// 0xFFFFFFFF (as the file CRC).
+    /// @param[in] aChunk Chunk number.
+    /// @return The CRC.
+    ///
+    uint32 GetChunkCrc(size_t aChunk) const { return mChunkCrcs[aChunk]; }
+
+private:
+
+    /// Sidecar file header, followed by the chunk CRC table (uint32_t each)
+    /// and a uint32_t CRC of the header and table. The fields are fixed
+    /// width (uint32 is 8 bytes on 64-bit Linux) and laid out without
+    /// padding, so the file is the same on every platform.
+    struct IndexHeader
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t fileSize;
+        uint64_t modifiedTime;
+        uint64_t fileId;
+        uint64_t volumeId;
+        CDfuFile::DfuFileSuffix suffix;
+        uint32_t chunkSize;
+        uint32_t numChunks;
+    };
+    static_assert(sizeof(IndexHeader) == 64, "Index header is 64 bytes");
+
+    /// Magic number ("DIDX") and format version
+    static const uint32_t INDEX_MAGIC = 0x58444944;
+    static const uint32_t INDEX_VERSION = 1;
+
+    /// Length of data covered by the table
+    size_t mDataLength;
+
+    /// Suffix of the file
+    CDfuFile::DfuFileSuffix mSuffix;
+
+    /// CRC of each chunk
+    std::vector<uint32_t> mChunkCrcs;
+};
+
+/// Shared, read-only reference to a DFU index
+typedef std::shared_ptr<const CDfuIndex> DfuIndexPtr;
+
+#endif // #ifndef DFU_INDEX_H
@@ -0,0 +1,106 @@
+//*******************************************************************************
+//
+//  HidArrivalMonitor.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CHidArrivalMonitor class.
+//
+//*******************************************************************************
+
+#include "HidArrivalMonitor.h"
+
+#include "engine/enginefw_interface.h"
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidArrivalMonitor::CHidArrivalMonitor()
+    : mpWatcher(NULL)
+{
+    FUNCTION_DEBUG_SENTRY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidArrivalMonitor::~CHidArrivalMonitor()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    delete mpWatcher;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidArrivalMonitor::Watch(CListener *apListener, const std::string &aParentId, uint16 aVid, uint16 aPid)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    std::lock_guard<std::mutex> watcherLock(mWatcherMutex);
+
+    // Started on first use, so that nothing is watched while no device reboots
+    if (mpWatcher == NULL)
+    {
+        mpWatcher = CHidTransport::WatchArrivals(this);
+    }
+
+    if (mpWatcher != NULL)
+    {
+        CWatch watch;
+        watch.mParentId = aParentId;
+        watch.mVid = aVid;
+        watch.mPid = aPid;
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWatches[apListener] = watch;
+        retVal = true;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidArrivalMonitor::Unwatch(CListener *apListener)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    std::lock_guard<std::mutex> watcherLock(mWatcherMutex);
+
+    bool stop = false;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mWatches.erase(apListener);
+        stop = mWatches.empty();
+    }
+
+    // The watcher's thread may be waiting for mMutex, so it is stopped
+    // without holding it
+    if (stop)
+    {
+        delete mpWatcher;
+        mpWatcher = NULL;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidArrivalMonitor::OnDeviceArrival(const CHidTransport::CDeviceInfo &aInfo)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    for (WatchMap::const_iterator it = mWatches.begin(); it != mWatches.end(); ++it)
+    {
+        const CWatch &watch = it->second;
+        if ((aInfo.mParentId.empty() || (aInfo.mParentId == watch.mParentId))
+            && ((aInfo.mVid == 0) || ((aInfo.mVid == watch.mVid) && (aInfo.mPid == watch.mPid))))
+        {
+            it->first->OnDeviceArrival();
+        }
+    }
+}
@@ -0,0 +1,110 @@
+//*******************************************************************************
+//
+//  HidArrivalMonitor.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CHidArrivalMonitor class, tells devices waiting to be found again after
+//  a reboot when they are added back to the host.
+//
+//*******************************************************************************
+
+#ifndef HID_ARRIVAL_MONITOR_H
+#define HID_ARRIVAL_MONITOR_H
+
+#include "HidTransport.h"
+#include "common/types.h"
+
+#include <map>
+#include <mutex>
+#include <string>
+
+///
+/// Monitor of the HID devices added to the host, on behalf of devices which
+/// are rebooting. Each waiting device registers its parent ID, VID and PID,
+/// and is told as soon as a matching device is added, instead of waiting a
+/// fixed time for the reboot. A device added without details from the host
+/// matches every waiting device, which then looks for itself.
+///
+/// The host watcher (CHidTransport::WatchArrivals) is started by the first
+/// device to wait and stopped once none are waiting. May be used from any
+/// thread.
+///
+class CHidArrivalMonitor : private CHidTransport::CArrivalListener
+{
+public:
+
+    ///
+    /// Interface through which a waiting device is told it has been added
+    ///
+    class CListener
+    {
+    public:
+        virtual ~CListener() {};
+
+        ///
+        /// Called, on a thread of the host watcher, when a matching device
+        /// has been added. It must not call the monitor.
+        ///
+        virtual void OnDeviceArrival() = 0;
+    };
+
+    CHidArrivalMonitor();
+    ~CHidArrivalMonitor();
+
+    ///
+    /// Starts watching for a device to be added, replacing any earlier
+    /// watch for the listener.
+    /// @param[in] apListener Listener told when the device is added.
+    /// @param[in] aParentId Parent ID of the device, from CDeviceInfo.
+    /// @param[in] aVid Vendor ID.
+    /// @param[in] aPid Product ID.
+    /// @return false if the host cannot report devices being added.
+    ///
+    bool Watch(CListener *apListener, const std::string &aParentId, uint16 aVid, uint16 aPid);
+
+    ///
+    /// Stops watching for a device, waiting for any call to the listener
+    /// in progress.
+    /// @param[in] apListener Listener.
+    ///
+    void Unwatch(CListener *apListener);
+
+private:
+
+    CHidArrivalMonitor(const CHidArrivalMonitor &);
+    CHidArrivalMonitor &operator=(const CHidArrivalMonitor &);
+
+    ///
+    /// Tells the listeners watching for a device which has been added.
+    /// @see CHidTransport::CArrivalListener
+    ///
+    virtual void OnDeviceArrival(const CHidTransport::CDeviceInfo &aInfo);
+
+    ///
+    /// A device being watched for
+    ///
+    class CWatch
+    {
+    public:
+        std::string mParentId;
+        uint16 mVid;
+        uint16 mPid;
+    };
+
+    typedef std::map<CListener *, CWatch> WatchMap;
+
+    /// Serialises starting and stopping the host watcher
+    std::mutex mWatcherMutex;
+
+    /// Host watcher, NULL when no device is waiting, protected by mWatcherMutex
+    CHidTransport::CArrivalWatcher *mpWatcher;
+
+    /// Devices waiting, protected by mMutex, which is held while listeners are called
+    std::mutex mMutex;
+    WatchMap mWatches;
+};
+
+#endif // #ifndef HID_ARRIVAL_MONITOR_H
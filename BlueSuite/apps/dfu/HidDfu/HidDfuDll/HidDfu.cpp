@@ -25,6 +25,13 @@ HIDDFU_API(int32) hidDfuGetFirmwareVersions(char* versionString,
     return gHidDfuEngine.GetFirmwareVersion(versionString, maxLength, (checkMatch != 0));
 }
 
+////////////////////////////////////////////////////////////////////////////////
+
+HIDDFU_API(int32) hidDfuGetDeviceVersions(HidDfuDeviceVersion* versions, uint16* count, uint8 refresh)
+{
+    return gHidDfuEngine.GetDeviceVersions(versions, count, refresh);
+}
+
 //////////////////////////////////////////////////////////////////////////////
 
 HIDDFU_API(int32) hidDfuGetVersion(uint16* major, uint16* minor,
@@ -67,6 +74,48 @@ HIDDFU_API(uint8) hidDfuGetFailedDevicesCount(void)
 
 ////////////////////////////////////////////////////////////////////////////////
 
+HIDDFU_API(int32) hidDfuGetImageCacheStats(uint32* hits, uint32* misses)
+{
+    return gHidDfuEngine.GetImageCacheStats(hits, misses);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+HIDDFU_API(int32) hidDfuSetValidationIndex(uint8 enable)
+{
+    return gHidDfuEngine.SetValidationIndex(enable);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+HIDDFU_API(int32) hidDfuSetDataWindow(uint8 window)
+{
+    return gHidDfuEngine.SetDataWindow(window);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+HIDDFU_API(int32) hidDfuSetResumeJournal(uint8 enable)
+{
+    return gHidDfuEngine.SetResumeJournal(enable);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+HIDDFU_API(uint32) hidDfuGetThroughput(void)
+{
+    return gHidDfuEngine.GetThroughput();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+HIDDFU_API(int32) hidDfuGetDeviceStatus(HidDfuDeviceStatus* status, uint16* count)
+{
+    return gHidDfuEngine.GetDeviceStatus(status, count);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 HIDDFU_API(int32) hidDfuDisconnect(void)
 {
     return gHidDfuEngine.DisconnectDevice();
@@ -15,7 +15,11 @@
 #define HID_DFU_H
 
 /* This file used in conjunction with a def file gives us undecorated stdcall C exports from the DLL */
+#ifdef WIN32
 #define HIDDFU_API(T) T _stdcall
+#else
+#define HIDDFU_API(T) T
+#endif
 
 #include "common/types.h"
 
@@ -46,6 +50,39 @@
 #define HIDDFU_ERROR_NO_RESPONSE                           -23
 #define HIDDFU_ERROR_OP_PARTIAL_SUCCESS_NO_RESPONSE        -24
 
+/* Device operation states - see hidDfuGetDeviceStatus() */
+#define HIDDFU_DEVICE_STATE_IDLE                            0
+#define HIDDFU_DEVICE_STATE_CONNECTING                      1
+#define HIDDFU_DEVICE_STATE_TRANSFERRING                    2
+#define HIDDFU_DEVICE_STATE_VALIDATING                      3
+#define HIDDFU_DEVICE_STATE_REBOOTING                       4
+#define HIDDFU_DEVICE_STATE_COMMITTING                      5
+#define HIDDFU_DEVICE_STATE_COMPLETE                        6
+#define HIDDFU_DEVICE_STATE_FAILED                          7
+#define HIDDFU_DEVICE_STATE_STOPPED                         8
+
+/* Status of the current or last operation on a device - see hidDfuGetDeviceStatus() */
+typedef struct
+{
+    uint32 state;           /* One of the HIDDFU_DEVICE_STATE_ values */
+    uint32 progress;        /* Progress in percentage */
+    uint32 bytesSent;       /* Upgrade data sent, or backup data read */
+    uint32 throughput;      /* Data rate in bytes per second */
+    uint32 retries;         /* Requests repeated while the device was busy or not responding */
+    uint32 lastLatencyUs;   /* Time the device last took to respond, in microseconds */
+    int32 errorCode;        /* Result, once the operation has finished */
+} HidDfuDeviceStatus;
+
+/* Firmware version of a device - see hidDfuGetDeviceVersions() */
+typedef struct
+{
+    uint16 versionMajor;    /* Version major */
+    uint16 versionMinor;    /* Version minor */
+    uint16 configVersion;   /* PS config version */
+    uint16 reserved;        /* Set to zero */
+    int32 errorCode;        /* Result of reading the version, which is only valid if HIDDFU_ERROR_NONE */
+} HidDfuDeviceVersion;
+
 // The sequence of Upgrading CSRA681xx, QCC302x-8x and QCC512x-8x devices with binary image
 // necessitates restart after the image has been copied, we presume that this is 95% of
 // the upload process, at which point display a relevant message (for restart duration).
@@ -91,6 +128,47 @@ HIDDFU_API(int32) hidDfuGetFirmwareVersions(char* versionString,
                                             uint16* maxLength,
                                             uint8 checkMatch);
 
+/*******************************************************************************
+
+    Function :      int32 hidDfuGetDeviceVersions(HidDfuDeviceVersion* versions,
+                                                  uint16* count,
+                                                  uint8 refresh)
+
+    Parameters :    versions -
+                        Pointer to an array where the firmware version of each
+                        connected device will be written, in the order the
+                        devices were connected.
+
+                    count -
+                        Number of entries in the versions array, returns the
+                        number of connected devices. If there are more devices
+                        than entries, nothing is written and
+                        HIDDFU_ERROR_PARAM_TOO_SMALL is returned.
+
+                    refresh -
+                        Set to 1 to read the versions from the devices again,
+                        0 to use the versions already read.
+
+    Returns :       An error code, either HIDDFU_ERROR_NONE if the version of
+                    every device was read, or one of the other HIDDFU_ERROR_
+                    codes defined in this file (for a device which failed,
+                    the errorCode of its entry gives the reason).
+
+    Description :   This function gets the version information of the connected
+                    devices. The devices are queried at the same time, and
+                    each version read is kept until the devices are
+                    disconnected, upgraded or reset, so the function may be
+                    polled without querying the devices again. A device
+                    running an operation is not queried, and its entry has
+                    the errorCode HIDDFU_ERROR_BUSY unless its version has
+                    already been read. hidDfuGetFirmwareVersions uses the
+                    same versions. A device connection is required.
+
+*******************************************************************************/
+HIDDFU_API(int32) hidDfuGetDeviceVersions(HidDfuDeviceVersion* versions,
+                                          uint16* count,
+                                          uint8 refresh);
+
 /*******************************************************************************
 
     Function :      int32 hidDfuGetVersion(uint16* major, uint16* minor, 
@@ -370,6 +448,168 @@ HIDDFU_API(const char*) hidDfuGetLastError(void);
 *******************************************************************************/
 HIDDFU_API(uint8) hidDfuGetFailedDevicesCount(void);
 
+/*******************************************************************************
+
+    Function :      int32 hidDfuGetImageCacheStats(uint32* hits, uint32* misses)
+
+    Parameters :    hits -
+                        Location to store the number of upgrades which reused
+                        a file that had already been validated.
+
+                    misses -
+                        Location to store the number of upgrades which
+                        validated the file.
+
+    Returns :       An error code, either HIDDFU_ERROR_NONE if successful, or 
+                    one of the other HIDDFU_ERROR_ codes defined in this file.
+
+    Description :   Files which pass validation in hidDfuUpgrade or
+                    hidDfuUpgradeBin are remembered for the life of the DLL,
+                    and validation is skipped when the same file is used
+                    again, provided its size, modification time and file ID
+                    are unchanged. This function gets the counts of upgrades
+                    which did and did not find the file already validated.
+                    A device connection is not required.
+
+*******************************************************************************/
+HIDDFU_API(int32) hidDfuGetImageCacheStats(uint32* hits, uint32* misses);
+
+/*******************************************************************************
+
+    Function :      int32 hidDfuSetValidationIndex(uint8 enable)
+
+    Parameters :    enable -
+                        Non-zero to validate DFU files through a sidecar
+                        index file, zero (the default) to disable.
+
+    Returns :       An error code, either HIDDFU_ERROR_NONE if successful, or 
+                    one of the other HIDDFU_ERROR_ codes defined in this file.
+
+    Description :   When enabled, hidDfuUpgrade saves an index file next to
+                    each DFU file it validates, named as the DFU file with
+                    ".idx" appended. The index holds the file suffix, the
+                    size, modification time and file ID of the DFU file, and
+                    the CRC of each 64 KB chunk of the file.
+                    A later hidDfuUpgrade (in this or another process) with
+                    the unchanged file accepts it from the index without
+                    calculating the CRC of the whole file, and checks each
+                    chunk as it is sent to the devices instead.
+                    Failing to save the index (e.g. a read-only directory) is
+                    not an error. A device connection is not required.
+
+*******************************************************************************/
+HIDDFU_API(int32) hidDfuSetValidationIndex(uint8 enable);
+
+/*******************************************************************************
+
+    Function :      int32 hidDfuSetDataWindow(uint8 window)
+
+    Parameters :    window -
+                        Number of upgrade data reports hidDfuUpgradeBin
+                        keeps in flight to each device, from 1 to 16, or zero
+                        (the default) to wait for each report to be written
+                        followed by a fixed delay.
+
+    Returns :       An error code, either HIDDFU_ERROR_NONE if successful, or 
+                    one of the other HIDDFU_ERROR_ codes defined in this file.
+
+    Description :   With a window, upgrade data reports are written as fast as
+                    each device accepts them, instead of waiting for each
+                    report to be written and then for
+                    HID_DATA_SEND_WAIT_TIME_MS (2 ms by default). If a device
+                    does not accept a report within HID_DATA_STALL_TIME_MS
+                    (50 ms by default), the rest of the data it has requested
+                    is sent with the fixed delay. Does not apply to
+                    hidDfuUpgrade. A device connection is not required.
+
+*******************************************************************************/
+HIDDFU_API(int32) hidDfuSetDataWindow(uint8 window);
+
+/*******************************************************************************
+
+    Function :      int32 hidDfuSetResumeJournal(uint8 enable)
+
+    Parameters :    enable -
+                        Non-zero to resume upgrades through a journal file,
+                        zero (the default) to disable.
+
+    Returns :       An error code, either HIDDFU_ERROR_NONE if successful, or 
+                    one of the other HIDDFU_ERROR_ codes defined in this file.
+
+    Description :   When enabled, hidDfuUpgradeBin keeps a journal file next
+                    to the upgrade file, named as the upgrade file with
+                    ".journal" appended. For each device it records the
+                    size, modification time and file ID of the upgrade file,
+                    the resume point reached and the offset of the data the
+                    device has acknowledged (updated every 64 KB).
+                    If an upgrade is stopped or fails part way, a later
+                    hidDfuUpgradeBin (in this or another process) with the
+                    unchanged file continues from where the device stopped,
+                    sending only the data the device does not have, instead
+                    of aborting the upgrade and starting again. A device's
+                    record is removed once its upgrade has completed.
+                    Failing to save the journal (e.g. a read-only directory)
+                    is not an error. Does not apply to hidDfuUpgrade.
+                    A device connection is not required.
+
+*******************************************************************************/
+HIDDFU_API(int32) hidDfuSetResumeJournal(uint8 enable);
+
+/*******************************************************************************
+
+    Function :      uint32 hidDfuGetThroughput(void)
+
+    Parameters :    None
+
+    Returns :       The data throughput (bytes per second).
+
+    Description :   This function gets the rate at which upgrade data is being
+                    sent to the devices, or backup data read from them,
+                    summed for all devices. The rate is
+                    measured from the start of the data transfer, so includes
+                    the time the devices take between requests for data. If
+                    an operation has finished, the rate for that operation is
+                    returned.
+
+*******************************************************************************/
+HIDDFU_API(uint32) hidDfuGetThroughput(void);
+
+/*******************************************************************************
+
+    Function :      int32 hidDfuGetDeviceStatus(HidDfuDeviceStatus* status,
+                                                uint16* count)
+
+    Parameters :    status -
+                        Pointer to an array where the status of each connected
+                        device will be written, in the order the devices were
+                        connected.
+
+                    count -
+                        Number of entries in the status array, returns the
+                        number of connected devices. If there are more devices
+                        than entries, nothing is written and
+                        HIDDFU_ERROR_PARAM_TOO_SMALL is returned.
+
+    Returns :       An error code, either HIDDFU_ERROR_NONE if successful, or 
+                    one of the other HIDDFU_ERROR_ codes defined in this file.
+
+    Description :   This function gets the state of the current or last
+                    operation on each device, with the data sent so far, the
+                    current throughput, the number of requests repeated
+                    because the device was busy or did not respond, the time
+                    the device last took to respond to a request and, once
+                    the operation has finished, its result.
+                    The status is read without waiting for the operations, so
+                    the function may be polled frequently while an operation
+                    is running without slowing it down. errorCode is
+                    HIDDFU_ERROR_NONE until the state is
+                    HIDDFU_DEVICE_STATE_COMPLETE, HIDDFU_DEVICE_STATE_FAILED
+                    or HIDDFU_DEVICE_STATE_STOPPED. A device connection is
+                    required.
+
+*******************************************************************************/
+HIDDFU_API(int32) hidDfuGetDeviceStatus(HidDfuDeviceStatus* status, uint16* count);
+
 /*******************************************************************************
 
     Function :      int32 hidDfuSendCommand(const uint8* data, uint32 length)
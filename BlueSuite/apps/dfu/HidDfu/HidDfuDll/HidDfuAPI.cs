@@ -69,6 +69,22 @@ namespace HidDfuAPI
                 CharSet=charset, CallingConvention=calling_convention)]
         public static extern byte hidDfuGetFailedDevicesCount();
 
+        [DllImport("HidDfu.dll", EntryPoint="hidDfuGetImageCacheStats",
+                CharSet=charset, CallingConvention=calling_convention)]
+        public static extern int hidDfuGetImageCacheStats(out uint hits, out uint misses);
+
+        [DllImport("HidDfu.dll", EntryPoint="hidDfuSetValidationIndex",
+                CharSet=charset, CallingConvention=calling_convention)]
+        public static extern int hidDfuSetValidationIndex(byte enable);
+
+        [DllImport("HidDfu.dll", EntryPoint="hidDfuSetDataWindow",
+                CharSet=charset, CallingConvention=calling_convention)]
+        public static extern int hidDfuSetDataWindow(byte window);
+
+        [DllImport("HidDfu.dll", EntryPoint="hidDfuGetThroughput",
+                CharSet=charset, CallingConvention=calling_convention)]
+        public static extern uint hidDfuGetThroughput();
+
         [DllImport("HidDfu.dll", EntryPoint="hidDfuSendCommand",
                 CharSet=charset, CallingConvention=calling_convention)]
         public static extern int hidDfuSendCommand(ref byte data, uint length);
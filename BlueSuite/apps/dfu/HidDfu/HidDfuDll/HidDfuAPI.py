@@ -604,6 +604,160 @@ class HidDfu():
     # end of hidDfuGetFailedDevicesCount
 
 
+    def hidDfuGetImageCacheStats(self, hits: int=0, misses: int=0) -> Tuple[int, int, int]:
+        r"""Function HidDfu::hidDfuGetImageCacheStats() wrapper for hidDfuGetImageCacheStats in HidDfu DLL.
+
+        Python API:
+            hidDfuGetImageCacheStats(hits: int=0, misses: int=0) -> Tuple[int, int, int]
+
+        Python Example Call Syntax:
+            retval, hits, misses = myDll.hidDfuGetImageCacheStats()
+            print(retval, hits, misses)
+
+        Detail From Wrapped C API:
+            Function :      int32 hidDfuGetImageCacheStats(uint32* hits, uint32* misses)
+
+            Parameters :    hits -
+                                Location to store the number of upgrades which reused
+                                a file that had already been validated.
+
+                            misses -
+                                Location to store the number of upgrades which
+                                validated the file.
+
+            Returns :       An error code, either HIDDFU_ERROR_NONE if successful, or 
+                            one of the other HIDDFU_ERROR_ codes defined in this file.
+
+            Description :   Files which pass validation in hidDfuUpgrade or
+                            hidDfuUpgradeBin are remembered for the life of the DLL,
+                            and validation is skipped when the same file is used
+                            again, provided its size, modification time and file ID
+                            are unchanged. This function gets the counts of upgrades
+                            which did and did not find the file already validated.
+                            A device connection is not required.
+
+        """
+        self.HidDfuDLL.hidDfuGetImageCacheStats.restype = ct.c_int32
+        self.HidDfuDLL.hidDfuGetImageCacheStats.argtypes = [ct.c_void_p, ct.c_void_p]
+        local_hits = ct.c_uint32(hits)
+        local_misses = ct.c_uint32(misses)
+        retval = self.HidDfuDLL.hidDfuGetImageCacheStats(ct.byref(local_hits), ct.byref(local_misses))
+        hits = local_hits.value
+        misses = local_misses.value
+        return retval, hits, misses
+    # end of hidDfuGetImageCacheStats
+
+
+    def hidDfuSetValidationIndex(self, enable: int) -> int:
+        r"""Function HidDfu::hidDfuSetValidationIndex() wrapper for hidDfuSetValidationIndex in HidDfu DLL.
+
+        Python API:
+            hidDfuSetValidationIndex(enable: int) -> int
+
+        Python Example Call Syntax:
+            retval = myDll.hidDfuSetValidationIndex(enable=1)
+            print(retval)
+
+        Detail From Wrapped C API:
+            Function :      int32 hidDfuSetValidationIndex(uint8 enable)
+
+            Parameters :    enable -
+                                Non-zero to validate DFU files through a sidecar
+                                index file, zero (the default) to disable.
+
+            Returns :       An error code, either HIDDFU_ERROR_NONE if successful, or 
+                            one of the other HIDDFU_ERROR_ codes defined in this file.
+
+            Description :   When enabled, hidDfuUpgrade saves an index file next to
+                            each DFU file it validates, named as the DFU file with
+                            ".idx" appended. The index holds the file suffix, the
+                            size, modification time and file ID of the DFU file, and
+                            the CRC of each 64 KB chunk of the file.
+                            A later hidDfuUpgrade (in this or another process) with
+                            the unchanged file accepts it from the index without
+                            calculating the CRC of the whole file, and checks each
+                            chunk as it is sent to the devices instead.
+                            Failing to save the index (e.g. a read-only directory) is
+                            not an error. A device connection is not required.
+
+        """
+        self.HidDfuDLL.hidDfuSetValidationIndex.restype = ct.c_int32
+        self.HidDfuDLL.hidDfuSetValidationIndex.argtypes = [ct.c_uint8]
+        retval = self.HidDfuDLL.hidDfuSetValidationIndex(enable)
+        return retval
+    # end of hidDfuSetValidationIndex
+
+    def hidDfuSetDataWindow(self, window: int) -> int:
+        r"""Function HidDfu::hidDfuSetDataWindow() wrapper for hidDfuSetDataWindow in HidDfu DLL.
+
+        Python API:
+            hidDfuSetDataWindow(window: int) -> int
+
+        Python Example Call Syntax:
+            retval = myDll.hidDfuSetDataWindow(window=4)
+            print(retval)
+
+        Detail From Wrapped C API:
+            Function :      int32 hidDfuSetDataWindow(uint8 window)
+
+            Parameters :    window -
+                                Number of upgrade data reports hidDfuUpgradeBin
+                                keeps in flight to each device, from 1 to 16, or zero
+                                (the default) to wait for each report to be written
+                                followed by a fixed delay.
+
+            Returns :       An error code, either HIDDFU_ERROR_NONE if successful, or 
+                            one of the other HIDDFU_ERROR_ codes defined in this file.
+
+            Description :   With a window, upgrade data reports are written as fast as
+                            each device accepts them, instead of waiting for each
+                            report to be written and then for
+                            HID_DATA_SEND_WAIT_TIME_MS (2 ms by default). If a device
+                            does not accept a report within HID_DATA_STALL_TIME_MS
+                            (50 ms by default), the rest of the data it has requested
+                            is sent with the fixed delay. Does not apply to
+                            hidDfuUpgrade. A device connection is not required.
+
+        """
+        self.HidDfuDLL.hidDfuSetDataWindow.restype = ct.c_int32
+        self.HidDfuDLL.hidDfuSetDataWindow.argtypes = [ct.c_uint8]
+        retval = self.HidDfuDLL.hidDfuSetDataWindow(window)
+        return retval
+    # end of hidDfuSetDataWindow
+
+
+    def hidDfuGetThroughput(self) -> int:
+        r"""Function HidDfu::hidDfuGetThroughput() wrapper for hidDfuGetThroughput in HidDfu DLL.
+
+        Python API:
+            hidDfuGetThroughput() -> int
+
+        Python Example Call Syntax:
+            retval = myDll.hidDfuGetThroughput()
+            print(retval)
+
+        Detail From Wrapped C API:
+            Function :      uint32 hidDfuGetThroughput(void)
+
+            Parameters :    None
+
+            Returns :       The upgrade data throughput (bytes per second).
+
+            Description :   This function gets the rate at which upgrade data is being
+                            sent to the devices, summed for all devices. The rate is
+                            measured from the start of the data transfer, so includes
+                            the time the devices take between requests for data. If
+                            an operation has finished, the rate for that operation is
+                            returned.
+
+        """
+        self.HidDfuDLL.hidDfuGetThroughput.restype = ct.c_uint32
+        self.HidDfuDLL.hidDfuGetThroughput.argtypes = []
+        retval = self.HidDfuDLL.hidDfuGetThroughput()
+        return retval
+    # end of hidDfuGetThroughput
+
+
     def hidDfuSendCommand(self, data: int, length: int) -> int:
         r"""Function HidDfu::hidDfuSendCommand() wrapper for hidDfuSendCommand in HidDfu DLL.
 
@@ -15,30 +15,43 @@
 #include "HidDfuDevice.h"
 
 #include <assert.h>
+#include <limits>
+#include <sstream>
 
 ////////////////////////////////////////////////////////////////////////////////
 
 CHidDfuDevice::CHidDfuDevice()
     :
-    mDeviceHandle(INVALID_HANDLE_VALUE),
+    mpThreadFunc(NULL),
+    mpScheduler(NULL),
+    mScheduled(false),
+    mStopRequested(false),
+    mScheduledResult(HIDDFU_ERROR_NONE),
+    mpArrivalMonitor(NULL),
+    mArrived(false),
+    mpTransport(NULL),
     mResetAfter(false),
-    mProgress(0),
-    mpThreadFunc(NULL)
+    mDataWindow(0)
 {
     FUNCTION_DEBUG_SENTRY;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-CHidDfuDevice::CHidDfuDevice(HANDLE aDeviceHandle)
+CHidDfuDevice::CHidDfuDevice(CHidTransport *apTransport)
     :
-    mDeviceHandle(aDeviceHandle),
+    mpThreadFunc(NULL),
+    mpScheduler(NULL),
+    mScheduled(false),
+    mStopRequested(false),
+    mScheduledResult(HIDDFU_ERROR_NONE),
+    mpArrivalMonitor(NULL),
+    mArrived(false),
+    mpTransport(apTransport),
     mResetAfter(false),
-    mProgress(0),
-    mpThreadFunc(NULL)
+    mDataWindow(0)
 {
     FUNCTION_DEBUG_SENTRY;
-    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mDeviceHandle: %d", mDeviceHandle);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -54,7 +67,7 @@ CHidDfuDevice::~CHidDfuDevice()
 
 bool CHidDfuDevice::Connected() const
 {
-    return (mDeviceHandle != INVALID_HANDLE_VALUE);
+    return ((mpTransport != NULL) && mpTransport->IsOpen());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -64,7 +77,11 @@ bool CHidDfuDevice::CheckKeepGoing()
     bool retVal = true;
     FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
 
-    if (mpThreadFunc != NULL)
+    if (mScheduled)
+    {
+        retVal = !mStopRequested;
+    }
+    else if (mpThreadFunc != NULL)
     {
         retVal = KeepGoing();
     }
@@ -76,6 +93,7 @@ void CHidDfuDevice::ResetThreadFuncPointer()
 {
     FUNCTION_DEBUG_SENTRY;
     mpThreadFunc = NULL;
+    mScheduled = false;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -85,7 +103,7 @@ int32 CHidDfuDevice::DeviceBackup(uint8 aResetAfter)
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    if (IsActive())
+    if (IsOperationActive())
     {
         // An operation is currently running, can't start another one until it completes
         retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_BUSY);
@@ -93,13 +111,15 @@ int32 CHidDfuDevice::DeviceBackup(uint8 aResetAfter)
     else
     {
         mpThreadFunc = &CHidDfuDevice::DoDeviceBackup;
-        SetProgress(0);
+        mScheduled = false;
+        mStatus.Reset(HIDDFU_DEVICE_STATE_CONNECTING);
         mResetAfter = aResetAfter;
 
         // Start the backup thread
         if (!Start())
         {
             retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_OPERATION_FAILED_TO_START);
+            mStatus.Finish(HIDDFU_DEVICE_STATE_FAILED, retVal);
         }
     }
 
@@ -113,7 +133,18 @@ int32 CHidDfuDevice::DeviceStop(uint16 aWaitForStopMs)
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    if (IsActive())
+    if (mScheduled && mpScheduler->IsScheduled(this))
+    {
+        // Run the next step now, rather than when the device is next ready
+        mStopRequested = true;
+        mpScheduler->Wake(this);
+
+        if (!mpScheduler->WaitForTask(this, aWaitForStopMs))
+        {
+            retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Failed to stop the operation");
+        }
+    }
+    else if (IsActive())
     {
         Stop();
 
@@ -137,21 +168,42 @@ int32 CHidDfuDevice::DeviceUpgrade(uint8 aResetAfter)
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    if (IsActive())
+    if (IsOperationActive())
     {
         // An operation is currently running, can't start another one until it completes
         retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_BUSY);
     }
+    else if (mpScheduler != NULL)
+    {
+        mpThreadFunc = NULL;
+        mScheduled = true;
+        mStopRequested = false;
+        mScheduledResult = HIDDFU_ERROR_NONE;
+        mStatus.Reset(HIDDFU_DEVICE_STATE_CONNECTING);
+        mResetAfter = aResetAfter;
+
+        // Steps are run when the device is ready
+        mpTransport->SetListener(this);
+        if (!mpScheduler->Submit(this))
+        {
+            mpTransport->SetListener(NULL);
+            mScheduled = false;
+            retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_OPERATION_FAILED_TO_START);
+            mStatus.Finish(HIDDFU_DEVICE_STATE_FAILED, retVal);
+        }
+    }
     else
     {
         mpThreadFunc = &CHidDfuDevice::DoDeviceUpgrade;
-        SetProgress(0);
+        mScheduled = false;
+        mStatus.Reset(HIDDFU_DEVICE_STATE_CONNECTING);
         mResetAfter = aResetAfter;
 
         // Start the upgrade thread
         if (!Start())
         {
             retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_OPERATION_FAILED_TO_START);
+            mStatus.Finish(HIDDFU_DEVICE_STATE_FAILED, retVal);
         }
     }
 
@@ -165,14 +217,9 @@ int32 CHidDfuDevice::DisconnectDevice()
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mDeviceHandle: %d", mDeviceHandle);
-    if (mDeviceHandle != INVALID_HANDLE_VALUE)
+    if (mpTransport != NULL)
     {
-        if (mLastDevError.GetErrorCode() != HIDDFU_ERROR_NO_RESPONSE)
-        {
-            CloseHandle(mDeviceHandle);
-        }
-        mDeviceHandle = INVALID_HANDLE_VALUE;
+        mpTransport->Close();
     }
 
     return retVal;
@@ -185,12 +232,12 @@ int32 CHidDfuDevice::GetDevResult()
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    if (mpThreadFunc == NULL)
+    if ((mpThreadFunc == NULL) && !mScheduled)
     {
         // No operation has been run
         retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_SEQUENCE);
     }
-    else if (IsActive())
+    else if (IsOperationActive())
     {
         // Only set the error code to BUSY if there was previously no error,
         // otherwise do not over write any other error code with BUSY
@@ -200,6 +247,10 @@ int32 CHidDfuDevice::GetDevResult()
             retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_BUSY);
         }
     }
+    else if (mScheduled)
+    {
+        retVal = mScheduledResult;
+    }
     else
     {
         // Get the exit code of the operation thread
@@ -220,10 +271,21 @@ const char* CHidDfuDevice::GetLastError()
 
 uint8 CHidDfuDevice::GetProgress()
 {
-    CriticalSection::Lock here(mProgressLock);
+    HidDfuDeviceStatus status;
+    mStatus.Get(status);
 
     // 100% if not running an operation
-    return (IsActive() ? mProgress : 100);
+    return (CHidDfuDeviceStatus::IsRunning(status.state) ? static_cast<uint8>(status.progress) : 100);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidDfuDevice::GetThroughput()
+{
+    HidDfuDeviceStatus status;
+    mStatus.Get(status);
+
+    return status.throughput;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -231,7 +293,7 @@ uint8 CHidDfuDevice::GetProgress()
 int32 CHidDfuDevice::IsThreadActive()
 {
     int32 retVal = HIDDFU_ERROR_NONE;
-    if (IsActive())
+    if (IsOperationActive())
     {
         // An operation is currently running, don't want to reset while that's happening
         retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_BUSY);
@@ -241,55 +303,148 @@ int32 CHidDfuDevice::IsThreadActive()
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int32 CHidDfuDevice::SetLastErrorFromWinError(int32 aHidErrorCode, const std::string &aErrorStr, uint32 aWinErrorCode)
+bool CHidDfuDevice::IsOperationActive()
+{
+    return (mScheduled ? mpScheduler->IsScheduled(this) : IsActive());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuDevice::SetLastErrorFromOsError(int32 aHidErrorCode, const std::string &aErrorStr, uint32 aOsErrorCode)
 {
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    char *pError = "";
-    if (!FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM,
-        NULL,
-        aWinErrorCode,
-        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
-        (LPTSTR)&pError,
-        0,
-        NULL))
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "%s, error: 0x%x", aErrorStr.c_str(), aOsErrorCode);
+
+    std::ostringstream msg;
+    msg << aErrorStr << " - " << CHidTransport::GetErrorText(aOsErrorCode);
+    retVal = mLastDevError.SetMsg(aHidErrorCode, msg.str());
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDevice::SetProgress(uint8 aProgress)
+{
+    mStatus.SetProgress(aProgress);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDevice::SetThroughput(uint64 aBytesSent, uint64 aElapsedUs)
+{
+    mStatus.SetTransfer(static_cast<uint32>(aBytesSent),
+        (aElapsedUs > 0 ? static_cast<uint32>((aBytesSent * 1000000) / aElapsedUs) : 0));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDevice::SetLastLatency(uint64 aLatencyUs)
+{
+    const uint64 maxLatencyUs = std::numeric_limits<uint32>::max();
+    mStatus.SetLastLatency(static_cast<uint32>((aLatencyUs < maxLatencyUs) ? aLatencyUs : maxLatencyUs));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDevice::FinishOperation(int32 aResult)
+{
+    uint32 state = HIDDFU_DEVICE_STATE_COMPLETE;
+
+    if (aResult != HIDDFU_ERROR_NONE)
     {
-        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "%s, error: 0x%x", aErrorStr.c_str(), aWinErrorCode);
+        state = HIDDFU_DEVICE_STATE_FAILED;
     }
+    else if (!CheckKeepGoing())
+    {
+        state = HIDDFU_DEVICE_STATE_STOPPED;
+    }
+
+    mStatus.Finish(state, aResult);
+}
+
+////////////////////////////////////////////////////////////////////////////////
 
-    // Remove '\r' from end of string
-    char *pos = strchr(pError, '\r');
-    if (pos != NULL)
+int CHidDfuDevice::ThreadFunc()
+{
+    const int32 result = (this->*(mpThreadFunc))();
+
+    // Published before the thread is seen to have exited
+    FinishOperation(result);
+
+    return result;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidDfuDevice::StepDeviceUpgrade(uint32 &aWaitMs, int32 &aResult)
+{
+    aResult = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_UNSUPPORTED);
+
+    return false;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidDfuDevice::Step(uint32 &aWaitMs)
+{
+    int32 result = HIDDFU_ERROR_NONE;
+    const bool running = StepDeviceUpgrade(aWaitMs, result);
+
+    if (!running)
     {
-        *pos = '\0';
+        mpTransport->SetListener(NULL);
+        mScheduledResult = result;
+        FinishOperation(result);
     }
 
-    std::ostringstream msg;
-    msg << aErrorStr << " - " << pError;
-    retVal = mLastDevError.SetMsg(aHidErrorCode, msg.str());
+    return running;
+}
 
-    LocalFree(pError);
+////////////////////////////////////////////////////////////////////////////////
 
-    return retVal;
+void CHidDfuDevice::OnTransportReady()
+{
+    mpScheduler->Wake(this);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void CHidDfuDevice::SetProgress(uint8 aProgress)
+void CHidDfuDevice::OnDeviceArrival()
 {
-    CriticalSection::Lock here(mProgressLock);
+    mArrived = true;
+    mpScheduler->Wake(this);
+}
 
-    assert(aProgress <= 100);
+////////////////////////////////////////////////////////////////////////////////
 
-    mProgress = ((aProgress < 100) ? aProgress : 100);
+bool CHidDfuDevice::WatchArrival(const std::string &aParentId, uint16 aVid, uint16 aPid)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    mArrived = false;
+
+    if ((mpArrivalMonitor != NULL) && (mpScheduler != NULL))
+    {
+        retVal = mpArrivalMonitor->Watch(this, aParentId, aVid, aPid);
+    }
+
+    return retVal;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int CHidDfuDevice::ThreadFunc()
+void CHidDfuDevice::UnwatchArrival()
 {
-    return (this->*(mpThreadFunc))();
+    FUNCTION_DEBUG_SENTRY;
+
+    if (mpArrivalMonitor != NULL)
+    {
+        mpArrivalMonitor->Unwatch(this);
+    }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
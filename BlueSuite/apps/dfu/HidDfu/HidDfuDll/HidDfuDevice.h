@@ -14,28 +14,35 @@
 #ifndef HID_DFU_DEVICE_H
 #define HID_DFU_DEVICE_H
 
+#include "HidArrivalMonitor.h"
+#include "HidDfuDeviceStatus.h"
 #include "HidDfuErrorMsg.h"
+#include "HidDfuScheduler.h"
+#include "HidTransport.h"
+#include "DfuIndex.h"
+#include "UpgradeImage.h"
+#include "UpgradeJournal.h"
 #include "common/types.h"
 #include "thread/thread.h"
-#include "thread/critical_section.h"
 #include "engine/enginefw_interface.h"
 
 #undef  EF_GROUP
 #define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
 
-#define WIN32_LEAN_AND_MEAN  // Exclude rarely-used stuff from Windows headers
-
-#include <windows.h>
+#include <atomic>
 #include <string>
 
 ///
 /// Class API for HidDfu Device functions.
+/// Non-blocking operations run on a thread of their own, or, for devices
+/// given a scheduler, as steps on the scheduler's shared workers.
 ///
-class CHidDfuDevice : public Threadable
+class CHidDfuDevice : public Threadable, private CHidDfuScheduler::CTask, private CHidTransport::CListener,
+    private CHidArrivalMonitor::CListener
 {
 public:
     CHidDfuDevice();
-    CHidDfuDevice(HANDLE aDeviceHandle);
+    CHidDfuDevice(CHidTransport *apTransport);
     ~CHidDfuDevice();
 
     ///
@@ -75,6 +82,17 @@ public:
     ///
     virtual int32 DoDeviceUpgrade() = 0;
 
+    ///
+    /// Runs the next step of an upgrade on the scheduler. A step must not
+    /// wait for the device: it returns once the device has nothing ready,
+    /// and is run again when the transport is ready or aWaitMs has passed.
+    /// @param[out] aWaitMs Time until the next step, 0 to run it as soon as
+    /// other devices have had a step.
+    /// @param[out] aResult The result, once the upgrade has finished.
+    /// @return false once the upgrade has finished.
+    ///
+    virtual bool StepDeviceUpgrade(uint32 &aWaitMs, int32 &aResult);
+
     ///
     /// Gets the result of the last operation non-blocking operation.
     /// An error will be returned if an operation is ongoing, or if 
@@ -106,6 +124,21 @@ public:
     ///
     uint8 GetProgress();
 
+    ///
+    /// Get the rate at which upgrade data was sent to this device in the
+    /// current or last operation.
+    /// @return Throughput in bytes per second.
+    ///
+    uint32 GetThroughput();
+
+    ///
+    /// Get the status of the current or last operation for this device,
+    /// without waiting for the operation.
+    /// @param[out] aStatus The status.
+    /// @see hidDfuGetDeviceStatus.
+    ///
+    void GetStatus(HidDfuDeviceStatus &aStatus) const { mStatus.Get(aStatus); }
+
     ///
     /// Initialise.
     /// @return The result.
@@ -135,6 +168,45 @@ public:
     ///
     void SetFileName(std::string fileName) { mFileName = fileName; }
 
+    ///
+    /// Store a mapped upgrade image, shared with the other devices being
+    /// upgraded from the same file, to use instead of mapping the file again.
+    /// @param[in] apImage Upgrade image.
+    ///
+    void SetUpgradeImage(const UpgradeImagePtr &apImage) { mpUpgradeImage = apImage; }
+
+    ///
+    /// Store the validation index of the DFU file, used to check the file
+    /// data as it is sent.
+    /// @param[in] apIndex DFU file index (may be empty).
+    ///
+    void SetDfuIndex(const DfuIndexPtr &apIndex) { mpDfuIndex = apIndex; }
+
+    ///
+    /// Store the number of upgrade data reports to keep in flight.
+    /// @param[in] aWindow Number of reports, 0 for a fixed delay between reports.
+    ///
+    void SetDataWindow(uint8 aWindow) { mDataWindow = aWindow; }
+
+    ///
+    /// Store the resume journal in which the upgrade is recorded.
+    /// @param[in] apJournal Journal of the upgrade file (may be empty).
+    ///
+    void SetResumeJournal(const UpgradeJournalPtr &apJournal) { mpJournal = apJournal; }
+
+    ///
+    /// Store the scheduler on which upgrades are run, in place of a thread.
+    /// @param[in] apScheduler Scheduler, owned by the engine, NULL to use a thread.
+    ///
+    void SetScheduler(CHidDfuScheduler *apScheduler) { mpScheduler = apScheduler; }
+
+    ///
+    /// Store the monitor which tells the device when it is added back to the
+    /// host after a reboot.
+    /// @param[in] apMonitor Monitor, owned by the engine, NULL to wait a fixed time.
+    ///
+    void SetArrivalMonitor(CHidArrivalMonitor *apMonitor) { mpArrivalMonitor = apMonitor; }
+
     ///
     /// Writes to the connected device.
     /// @param[in] apBuffer Write buffer.
@@ -145,8 +217,8 @@ public:
 
 private:
 
-    /// Operation progress (for non-blocking operations)
-    uint8 mProgress;
+    /// State, progress and counters of the operation (for non-blocking operations)
+    CHidDfuDeviceStatus mStatus;
 
     /// Function pointer typedef for non-blocking operations
     typedef int32(CHidDfuDevice::* THREAD_FUNC)();
@@ -154,6 +226,24 @@ private:
     /// Function pointer for non-blocking operations
     THREAD_FUNC mpThreadFunc;
 
+    /// Scheduler for upgrades, NULL to run them on a thread
+    CHidDfuScheduler *mpScheduler;
+
+    /// Whether the last operation was run on the scheduler
+    bool mScheduled;
+
+    /// Stop requested for the operation on the scheduler
+    std::atomic<bool> mStopRequested;
+
+    /// Result of the last operation run on the scheduler
+    int32 mScheduledResult;
+
+    /// Monitor of devices added to the host, NULL to wait a fixed time for a reboot
+    CHidArrivalMonitor *mpArrivalMonitor;
+
+    /// Whether the device has been added since WatchArrival or TakeArrival
+    std::atomic<bool> mArrived;
+
     ///
     /// Runs non-blocking operations
     /// @return The result
@@ -161,23 +251,87 @@ private:
     ///
     virtual int ThreadFunc();
 
+    ///
+    /// Runs the next step of an operation on the scheduler
+    /// @param[out] aWaitMs Time until the next step.
+    /// @return false once the operation has finished.
+    /// @see CHidDfuScheduler::CTask
+    ///
+    virtual bool Step(uint32 &aWaitMs);
+
+    ///
+    /// Wakes the operation on the scheduler when the device is ready
+    /// @see CHidTransport::CListener
+    ///
+    virtual void OnTransportReady();
+
+    ///
+    /// Wakes the operation on the scheduler when the device is added back
+    /// @see CHidArrivalMonitor::CListener
+    ///
+    virtual void OnDeviceArrival();
+
+    ///
+    /// Publishes the final state of an operation once it has finished.
+    /// @param[in] aResult The result of the operation.
+    ///
+    void FinishOperation(int32 aResult);
+
+    ///
+    /// Checks if an operation is running, on a thread or on the scheduler.
+    /// @return true if an operation is running.
+    ///
+    bool IsOperationActive();
+
 protected:
 
-    /// Device Handle
-    HANDLE mDeviceHandle;
+    /// Transport to the device, owned by the engine
+    CHidTransport *mpTransport;
 
     /// DFU filename
     std::string mFileName;
 
+    /// Mapped upgrade image (shared read-only between devices)
+    UpgradeImagePtr mpUpgradeImage;
+
+    /// Validation index of the DFU file (shared read-only between devices)
+    DfuIndexPtr mpDfuIndex;
+
+    /// Resume journal of the upgrade file (shared between devices)
+    UpgradeJournalPtr mpJournal;
+
     /// Last error message for this device
     CHidDfuErrorMsg mLastDevError;
 
-    /// Thread lock for progress get & set
-    CriticalSection mProgressLock;
-
     /// Flag for  - Reset after backup/upgrade operation
     uint8 mResetAfter;
 
+    /// Number of upgrade data reports kept in flight (0 for a fixed delay)
+    uint8 mDataWindow;
+
+    ///
+    /// Starts watching for the device to be added back to the host after
+    /// its reboot, so that the operation is woken as soon as it is.
+    /// @param[in] aParentId Parent ID of the device, from CDeviceInfo.
+    /// @param[in] aVid Vendor ID.
+    /// @param[in] aPid Product ID.
+    /// @return false if there is no monitor, or the host cannot report
+    /// devices being added.
+    ///
+    bool WatchArrival(const std::string &aParentId, uint16 aVid, uint16 aPid);
+
+    ///
+    /// Stops watching for the device to be added back, if it is watched for.
+    ///
+    void UnwatchArrival();
+
+    ///
+    /// Queries, and clears, whether the device has been added back since
+    /// watching started, or since the last call.
+    /// @return true if the device has been added.
+    ///
+    bool TakeArrival() { return mArrived.exchange(false); }
+
     ///
     /// Gets the thread state.
     /// If the operation is threaded check if thread is running, else return true(default).
@@ -186,7 +340,7 @@ protected:
     bool CheckKeepGoing();
 
     ///
-    /// Close the device handle
+    /// Close the device
     /// @return The result.
     ///
     int32 DisconnectDevice();
@@ -201,10 +355,10 @@ protected:
     /// Get details of OS error message.
     /// @param[in] aHidErrorCode HidDfu application error code.
     /// @param[in] Caller details to add details to OS Error String
-    /// @param[in] Error Code as received from OS
+    /// @param[in] Error Code as received from OS, through the transport
     /// @return The result.
     ///
-    int32 SetLastErrorFromWinError(int32 aHidErrorCode, const std::string &aErrorStr, uint32 aWinErrorCode);
+    int32 SetLastErrorFromOsError(int32 aHidErrorCode, const std::string &aErrorStr, uint32 aOsErrorCode);
 
     ///
     /// Sets the progress value for the current non-blocking operation
@@ -212,6 +366,30 @@ protected:
     /// given is greater than 100, the value will be set to 100.
     ///
     void SetProgress(uint8 aProgress);
+
+    ///
+    /// Sets the upgrade data throughput for the current operation
+    /// @param[in] aBytesSent Upgrade data sent so far.
+    /// @param[in] aElapsedUs Time since the first data was sent, in microseconds.
+    ///
+    void SetThroughput(uint64 aBytesSent, uint64 aElapsedUs);
+
+    ///
+    /// Sets the state of the current operation, as it moves between stages
+    /// @param[in] aState One of the running HIDDFU_DEVICE_STATE_ values.
+    ///
+    void SetOperationState(uint32 aState) { mStatus.SetState(aState); }
+
+    ///
+    /// Counts a request repeated because the device was busy or did not respond
+    ///
+    void AddRetry() { mStatus.AddRetry(); }
+
+    ///
+    /// Records the time the device took to respond to a request
+    /// @param[in] aLatencyUs Response time in microseconds.
+    ///
+    void SetLastLatency(uint64 aLatencyUs);
 };
 
 #endif // #ifndef HID_DFU_DEVICE_H
\ No newline at end of file
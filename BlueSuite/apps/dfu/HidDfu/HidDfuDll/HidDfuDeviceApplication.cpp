@@ -13,57 +13,81 @@
 #include "HidDfu.h"
 #include "HidDfuDeviceApplication.h"
 
+#include <algorithm>
 #include <assert.h>
 #include <iomanip>
-#include <setupapi.h>
-#include "time/hi_res_clock.h"
 #include "time/stop_watch.h"
 #include "unicode/ichar.h"
-#include <thread>
-
-extern "C"
-{
-#include <hidsdi.h>
-}
 
 /// Use this to simplify the code populating the map
-typedef std::pair<UpgradeProtocolOpCode, std::string> OpCodeStringPair;
-typedef std::pair<UpgradeProtocolErrorCode, std::string> ErrCodeStringPair;
-typedef std::pair<UpgradeStatus, std::string> ConnectionStatusStringPair;
 
 ////////////////////////////////////////////////////////////////////////////////
 
 CHidDfuDeviceApplication::CHidDfuDeviceApplication()
-    : CHidDfuDevice(INVALID_HANDLE_VALUE),
+    : CHidDfuDevice(NULL),
     mHostState(STATE_UPGRADE_IDLE),
+    mUpgradeStep(STEP_BEGIN),
+    mDelayNextStep(STEP_BEGIN),
+    mDelayMs(0),
+    mRebooted(false),
+    mReconnecting(false),
+    mJournalResume(false),
+    mJournalOffset(0),
+    mReconnectAttempt(0),
+    mArrivalWatched(false),
+    mOctetsToSend(0),
+    mDataWindowed(false),
+    mWindowWaiting(false),
+    mWaitTimeMs(0),
+    mDataSendWaitMs(0),
+    mStallTimeMs(0),
+    mValidationTimeMs(0),
+    mRestartDelayMs(0),
     mResumePoint(UPGRADE_RESUME_POINT_START),
-    mCurrentDataOffset(0),
     mRequestedBytes(0),
     mRequestedDataOffset(0),
-    mpFileHandle(NULL)
+    mCurrentDataOffset(0),
+    mImageOffset(0)
 {
     FUNCTION_DEBUG_SENTRY;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-CHidDfuDeviceApplication::CHidDfuDeviceApplication(HANDLE aDeviceHandle,
-    const char *apDevicePath, DEVINST aUsbHubDevInst,
-    uint16 aVid, uint16 aPid, uint16 aUsage, uint16 aUsagePage)
-    : CHidDfuDevice(aDeviceHandle),
-    mDevicePath(apDevicePath),
-    mUsbHubDevInst(aUsbHubDevInst),
-    mVid(aVid), mPid(aPid), mUsage(aUsage), mUsagePage(aUsagePage),
+CHidDfuDeviceApplication::CHidDfuDeviceApplication(CHidTransport *apTransport,
+    const CHidTransport::CDeviceInfo &aDeviceInfo)
+    : CHidDfuDevice(apTransport),
+    mParentId(aDeviceInfo.mParentId),
+    mVid(aDeviceInfo.mVid), mPid(aDeviceInfo.mPid),
+    mUsage(aDeviceInfo.mUsage), mUsagePage(aDeviceInfo.mUsagePage),
+    mDevicePath(aDeviceInfo.mDevicePath),
     mHostState(STATE_UPGRADE_IDLE),
+    mUpgradeStep(STEP_BEGIN),
+    mDelayNextStep(STEP_BEGIN),
+    mDelayMs(0),
+    mRebooted(false),
+    mReconnecting(false),
+    mJournalResume(false),
+    mJournalOffset(0),
+    mReconnectAttempt(0),
+    mArrivalWatched(false),
+    mOctetsToSend(0),
+    mDataWindowed(false),
+    mWindowWaiting(false),
+    mWaitTimeMs(0),
+    mDataSendWaitMs(0),
+    mStallTimeMs(0),
+    mValidationTimeMs(0),
+    mRestartDelayMs(0),
     mResumePoint(UPGRADE_RESUME_POINT_START),
-    mCurrentDataOffset(0),
     mRequestedBytes(0),
     mRequestedDataOffset(0),
-    mpFileHandle(NULL)
+    mCurrentDataOffset(0),
+    mImageOffset(0)
 {
     FUNCTION_DEBUG_SENTRY;
-    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "DeviceHandle: %d", aDeviceHandle);
     MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "DevicePath: %s", mDevicePath.c_str());
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "ParentId: %s", mParentId.c_str());
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -74,97 +98,24 @@ int32 CHidDfuDeviceApplication::Initialise()
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
     // Flush transmit buffer
-    FlushFileBuffers(mDeviceHandle);
-
-    // Populate the map with opcode and readable string
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_START_REQ, "UPGRADE_START_REQ"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_START_CFM, "UPGRADE_START_CFM"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_DATA_BYTES_REQ, "UPGRADE_DATA_BYTES_REQ"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_DATA, "UPGRADE_DATA"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_ABORT_REQ, "UPGRADE_ABORT_REQ"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_ABORT_CFM, "UPGRADE_ABORT_CFM"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_TRANSFER_COMPLETE_IND, "UPGRADE_TRANSFER_COMPLETE_IND"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_TRANSFER_COMPLETE_RES, "UPGRADE_TRANSFER_COMPLETE_RES"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_PROCEED_TO_COMMIT, "UPGRADE_PROCEED_TO_COMMIT"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_COMMIT_REQ, "UPGRADE_COMMIT_REQ"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_COMMIT_CFM, "UPGRADE_COMMIT_CFM"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_ERROR_IND, "UPGRADE_ERROR_IND"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_COMPLETE_IND, "UPGRADE_COMPLETE_IND"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_SYNC_REQ, "UPGRADE_SYNC_REQ"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_SYNC_CFM, "UPGRADE_SYNC_CFM"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_START_DATA_REQ, "UPGRADE_START_DATA_REQ"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_IS_VALIDATION_DONE_REQ, "UPGRADE_IS_VALIDATION_DONE_REQ"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_IS_VALIDATION_DONE_CFM, "UPGRADE_IS_VALIDATION_DONE_CFM"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_HOST_VERSION_REQ, "UPGRADE_HOST_VERSION_REQ"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_HOST_VERSION_CFM, "UPGRADE_HOST_VERSION_CFM"));
-    mOpCodeMap.insert(OpCodeStringPair(UPGRADE_ERROR_RES, "UPGRADE_ERROR_RES"));
-
-    // Populate the map with Error Codes and readable string (for UPGRADE_ERROR_IND)
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_SUCCESS, "UPGRADE_HOST_SUCCESS"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_OEM_VALIDATION_SUCCESS, "UPGRADE_HOST_OEM_VALIDATION_SUCCESS"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_INTERNAL_ERROR_DEPRECATED, "UPGRADE_HOST_ERROR_INTERNAL_ERROR_DEPRECATED"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_UNKNOWN_ID, "UPGRADE_HOST_ERROR_UNKNOWN_ID"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_BAD_LENGTH_DEPRECATED, "UPGRADE_HOST_ERROR_BAD_LENGTH_DEPRECATED"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_WRONG_VARIANT, "UPGRADE_HOST_ERROR_WRONG_VARIANT"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_WRONG_PARTITION_NUMBER, "UPGRADE_HOST_ERROR_WRONG_PARTITION_NUMBER"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_SIZE_MISMATCH, "UPGRADE_HOST_ERROR_PARTITION_SIZE_MISMATCH"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_TYPE_NOT_FOUND_DEPRECATED, "UPGRADE_HOST_ERROR_PARTITION_TYPE_NOT_FOUND_DEPRECATED"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_OPEN_FAILED, "UPGRADE_HOST_ERROR_PARTITION_OPEN_FAILED"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_WRITE_FAILED_DEPRECATED, "UPGRADE_HOST_ERROR_PARTITION_WRITE_FAILED_DEPRECATED"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED_DEPRECATED, "UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED_DEPRECATED"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_SFS_VALIDATION_FAILED, "UPGRADE_HOST_ERROR_SFS_VALIDATION_FAILED"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_DEPRECATED, "UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_DEPRECATED"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_UPDATE_FAILED, "UPGRADE_HOST_ERROR_UPDATE_FAILED"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_APP_NOT_READY, "UPGRADE_HOST_ERROR_APP_NOT_READY"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_LOADER_ERROR, "UPGRADE_HOST_ERROR_LOADER_ERROR"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_UNEXPECTED_LOADER_MSG, "UPGRADE_HOST_ERROR_UNEXPECTED_LOADER_MSG"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_MISSING_LOADER_MSG, "UPGRADE_HOST_ERROR_MISSING_LOADER_MSG"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_BATTERY_LOW, "UPGRADE_HOST_ERROR_BATTERY_LOW"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_INVALID_SYNC_ID, "UPGRADE_HOST_ERROR_INVALID_SYNC_ID"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_IN_ERROR_STATE, "UPGRADE_HOST_ERROR_IN_ERROR_STATE"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_NO_MEMORY, "UPGRADE_HOST_ERROR_NO_MEMORY"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_SQIF_ERASE, "UPGRADE_HOST_ERROR_SQIF_ERASE"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_BAD_LENGTH_PARTITION_PARSE, "UPGRADE_HOST_ERROR_BAD_LENGTH_PARTITION_PARSE"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_BAD_LENGTH_TOO_SHORT, "UPGRADE_HOST_ERROR_BAD_LENGTH_TOO_SHORT"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_BAD_LENGTH_UPGRADE_HEADER, "UPGRADE_HOST_ERROR_BAD_LENGTH_UPGRADE_HEADER"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_BAD_LENGTH_PARTITION_HEADER, "UPGRADE_HOST_ERROR_BAD_LENGTH_PARTITION_HEADER"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_BAD_LENGTH_SIGNATURE, "UPGRADE_HOST_ERROR_BAD_LENGTH_SIGNATURE"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_BAD_LENGTH_DATAHDR_RESUME, "UPGRADE_HOST_ERROR_BAD_LENGTH_DATAHDR_RESUME"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_HEADERS, "UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_HEADERS"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_UPGRADE_HEADER, "UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_UPGRADE_HEADER"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_PARTITION_HEADER1, "UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_PARTITION_HEADER1"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_PARTITION_HEADER2, "UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_PARTITION_HEADER2"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_PARTITION_DATA, "UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_PARTITION_DATA"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_FOOTER, "UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_FOOTER"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_MEMORY, "UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_MEMORY"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED, "UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED_HEADER, "UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED_HEADER"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED_PS_SPACE, "UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED_PS_SPACE"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_TYPE_NOT_MATCHING, "UPGRADE_HOST_ERROR_PARTITION_TYPE_NOT_MATCHING"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_TYPE_TWO_DFU, "UPGRADE_HOST_ERROR_PARTITION_TYPE_TWO_DFU"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_WRITE_FAILED_HEADER, "UPGRADE_HOST_ERROR_PARTITION_WRITE_FAILED_HEADER"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_PARTITION_WRITE_FAILED_DATA, "UPGRADE_HOST_ERROR_PARTITION_WRITE_FAILED_DATA"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_FILE_TOO_SMALL, "UPGRADE_HOST_ERROR_FILE_TOO_SMALL"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_FILE_TOO_BIG, "UPGRADE_HOST_ERROR_FILE_TOO_BIG"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_INTERNAL_ERROR_1, "UPGRADE_HOST_ERROR_INTERNAL_ERROR_1"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_INTERNAL_ERROR_2, "UPGRADE_HOST_ERROR_INTERNAL_ERROR_2"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_INTERNAL_ERROR_3, "UPGRADE_HOST_ERROR_INTERNAL_ERROR_3"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_INTERNAL_ERROR_4, "UPGRADE_HOST_ERROR_INTERNAL_ERROR_4"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_INTERNAL_ERROR_5, "UPGRADE_HOST_ERROR_INTERNAL_ERROR_5"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_INTERNAL_ERROR_6, "UPGRADE_HOST_ERROR_INTERNAL_ERROR_6"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_ERROR_INTERNAL_ERROR_7, "UPGRADE_HOST_ERROR_INTERNAL_ERROR_7"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_WARN_APP_CONFIG_VERSION_INCOMPATIBLE, "UPGRADE_HOST_WARN_APP_CONFIG_VERSION_INCOMPATIBLE"));
-    mErrorCodeMap.insert(ErrCodeStringPair(UPGRADE_HOST_WARN_SYNC_ID_IS_DIFFERENT, "UPGRADE_HOST_WARN_SYNC_ID_IS_DIFFERENT"));
-
-    // Populate the map with Connection Status and readable string (for response to HID_CMD_CONNECTION_REQ)
-    mConnectionStatusMap.insert(ConnectionStatusStringPair(UPGRADE_STATUS_SUCCESS, "UPGRADE_STATUS_SUCCESS"));
-    mConnectionStatusMap.insert(ConnectionStatusStringPair(UPGRADE_STATUS_UNEXPECTED_ERROR, "UPGRADE_STATUS_UNEXPECTED_ERROR"));
-    mConnectionStatusMap.insert(ConnectionStatusStringPair(UPGRADE_STATUS_ALREADY_CONNECTED_WARNING, "UPGRADE_STATUS_ALREADY_CONNECTED_WARNING"));
-    mConnectionStatusMap.insert(ConnectionStatusStringPair(UPGRADE_STATUS_IN_PROGRESS, "UPGRADE_STATUS_IN_PROGRESS"));
-    mConnectionStatusMap.insert(ConnectionStatusStringPair(UPGRADE_STATUS_BUSY, "UPGRADE_STATUS_BUSY"));
-    mConnectionStatusMap.insert(ConnectionStatusStringPair(UPGRADE_STATUS_INVALID_POWER_STATE, "UPGRADE_STATUS_INVALID_POWER_STATE"));
+    mpTransport->FlushOutput();
 
     retVal = GetSizeOfHidReport();
+
+    if (retVal == HIDDFU_ERROR_NONE)
+    {
+        mInputReport.assign(mInputReportLenBytes, 0);
+        mOutputReport.assign(mOutputReportLenBytes, 0);
+        mFeatureReport.assign(mFeatureReportLenBytes, 0);
+
+        // Start reading before the first request, so that no response is missed
+        if (!mpTransport->StartReading(mInputReportLenBytes))
+        {
+            retVal = SetLastErrorFromOsError(HIDDFU_ERROR_CONNECTION, "Unable to open the device for reading",
+                mpTransport->GetError());
+        }
+    }
+
     return retVal;
 }
 
@@ -175,9 +126,9 @@ CHidDfuDeviceApplication::~CHidDfuDeviceApplication()
     FUNCTION_DEBUG_SENTRY;
 
     // Flush transmit buffer
-    if (mLastDevError.GetErrorCode() != HIDDFU_ERROR_NO_RESPONSE)
+    if (Connected() && (mLastDevError.GetErrorCode() != HIDDFU_ERROR_NO_RESPONSE))
     {
-        FlushFileBuffers(mDeviceHandle);
+        mpTransport->FlushOutput();
     }
 }
 
@@ -188,21 +139,13 @@ uint8 CHidDfuDeviceApplication::CalculateWriteProgress()
     uint8 writeProgress = 0;
     FUNCTION_DEBUG_SENTRY_RET(uint8, writeProgress);
 
-    // Get current position
-    long currentPos = ftell(mpFileHandle);
-
-    // Go to end, and get end position
-    int seekEnd = fseek(mpFileHandle, 0, SEEK_END);
-    long endPos = ftell(mpFileHandle);
+    const size_t imageSize = mpUpgradeImage->GetSize();
 
-    // Rewind
-    fseek(mpFileHandle, currentPos, SEEK_SET);
-
-    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_ENHANCED, "currentPos = %u endPos = %u seekEnd = %d",
-            currentPos, endPos, seekEnd);
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_ENHANCED, "imageOffset = %u imageSize = %u",
+            static_cast<uint32>(mImageOffset), static_cast<uint32>(imageSize));
 
     // Calculate Write progress
-    writeProgress = static_cast<uint8>((currentPos * 100) / endPos);
+    writeProgress = static_cast<uint8>((static_cast<uint64>(mImageOffset) * 100) / imageSize);
     MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Progress = %d%%", writeProgress);
 
     // Calculate overall progress and then set
@@ -227,234 +170,36 @@ int32 CHidDfuDeviceApplication::DoDeviceBackup()
 
 //////////////////////////////////////////////////////////////////////////////
 
-int32 CHidDfuDeviceApplication::DoDeviceUpgrade()
+int32 CHidDfuDeviceApplication::CheckWaitTime(uint32 &aWaitMs)
 {
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    retVal = RunInitialUpgradeSequence();
-
-    // Set reboot stopped flag
-    // Do not send 'Disconnect Request' if operation was stopped while reboot was in progress,
-    // because device will not be ready to receive the 'Disconnect Request'
-    bool rebootStopped = false;
-
-    if ((retVal == HIDDFU_ERROR_NONE) && (mResumePoint == UPGRADE_RESUME_POINT_START))
-    {
-        if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_DATA_READY))
-        {
-            retVal = SendUpgradeStartDataReq();
-        }
-
-        if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_DATA_TRANSFER))
-        {
-            retVal = ReadDataBytesReq();
-        }
-
-        if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_DATA_VALIDATION))
-        {
-            // Time duration during which host can send a data validation request(s)
-            const uint32 maxTimeForValidationMs = GetEnvVariable("HID_VALIDATION_TIME_MS", 60000);
-
-            StopWatch timeSinceStart;
-            retVal = SendUpgradeIsImageValidDoneReq();
-
-            while ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_DATA_VALIDATING)
-                && (timeSinceStart.duration() < maxTimeForValidationMs)
-                && CheckKeepGoing())
-            {
-                // Send the data validation request again
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Wait(%d milliseconds) for validation", mDelayInValidation);
-                HiResClockSleepMilliSec(mDelayInValidation);
-                retVal = SendUpgradeIsImageValidDoneReq();
-            }
-
-            if ((retVal == HIDDFU_ERROR_NONE) && (mHostState != STATE_UPGRADE_DATA_VALIDATED))
-            {
-                retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UPGRADE_FAILED, "Device failed to validate data");
-            }
-        }
-
-        if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_DATA_VALIDATED))
-        {
-            retVal = SendUpgradeTransferCompleteResp();
-        }
-
-        // Wait for reboot
-        if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_IDLE))
-        {
-            // Close Device Handle
-            retVal = DisconnectDevice();
-
-            // Wait (in milliseconds) time after data validation has completed and device is rebooting
-            // before attempting to reconnect
-            HiResClockMilliSec hidRestartDelayMs = (GetEnvVariable("HID_RESTART_DELAY_SEC", RESTART_DELAY_SEC)) * 1000;
-
-            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Wait(%d seconds) for device to reboot", hidRestartDelayMs/1000);
-            StopWatch restartTime;
-            while ((restartTime.duration() < hidRestartDelayMs)
-                && CheckKeepGoing())
-            {
-                // Wait for a second
-                HiResClockSleepMilliSec(1000);
-            }
-
-            if (!CheckKeepGoing())
-            {
-                // Thread is stopped, and device is rebooting, set flag to true
-                rebootStopped = true;
-            }
-        }
-    }
-
-    // Gets the sub nodes after restart, and sets Device Path
-    if (retVal == HIDDFU_ERROR_NONE)
-    {
-        // USB Hub - Top Level enumeration for the USB Device to connect
-        // Check if it is available
-        retVal = GetDeviceInstanceId((mUsbHubDevInst));
-
-        // Get the child (USB Composite Device)
-        DEVINST childDevInst;
-        if (retVal == HIDDFU_ERROR_NONE)
-        {
-            CONFIGRET status = CM_Get_Child(&childDevInst, mUsbHubDevInst, 0);
-            if (status == CR_SUCCESS)
-            {
-                // Check if the child is available
-                retVal = GetDeviceInstanceId((childDevInst));
-            }
-            else
-            {
-                std::ostringstream errorStr;
-                errorStr << "Failed to get Child Device Instance for " << mUsbHubDevInst << "(status = " << status << ")";
-                retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UPGRADE_FAILED, errorStr.str());
-            }
-        }
-
-        std::string oldDevicePath = mDevicePath;
-        mDevicePath.clear();
-
-        // Search the sub tree to get the new Device Path
-        if (retVal == HIDDFU_ERROR_NONE)
-        {
-            retVal = GetSubDevNodesAndDevPath(childDevInst);
-        }
-
-        if (retVal == HIDDFU_ERROR_NONE)
-        {
-            if (oldDevicePath.compare(mDevicePath))
-            {
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Device Path changed after restart");
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Old Device Path: %s", oldDevicePath.c_str());
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "New Device Path: %s", mDevicePath.c_str());
-            }
-
-            if (mDevicePath.empty())
-            {
-                retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Failed to find device after restart");
-            }
-        }
-    }
-
-    // After reboot, connect to use new image
-    if ((retVal == HIDDFU_ERROR_NONE) && CheckKeepGoing())
-    {
-        uint16 attempt = 1;
-        const uint16 MAX_ATTEMPTS = 10;
-
-        do {
-            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "[Attempt: %d], DevicePath: %s", attempt,
-                mDevicePath.c_str());
-            retVal = HidConnect();
-            if (retVal != HIDDFU_ERROR_NONE)
-            {
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Wait(2 seconds)");
-                HiResClockSleepMilliSec(2000);
-            }
-            attempt++;
-        } while (attempt <= MAX_ATTEMPTS && (retVal != HIDDFU_ERROR_NONE));
-    }
-
-    if ((retVal == HIDDFU_ERROR_NONE) && CheckKeepGoing())
+    const uint32 waitedMs = mWaitTime.duration();
+    if (waitedMs >= mWaitTimeMs)
     {
-        retVal = RunInitialUpgradeSequence();
-    }
-
-    if ((retVal == HIDDFU_ERROR_NONE) && (mResumePoint == UPGRADE_RESUME_POINT_POST_REBOOT) && CheckKeepGoing())
-    {
-        if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_COMMIT_HOST_CONTINUE))
-        {
-            retVal = SendUpgradeProceedToCommit();
-        }
-
-        if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_COMMIT_VERIFICATION))
-        {
-            retVal = SendUpgradeCommitCfm();
-        }
-
-        if ((retVal == HIDDFU_ERROR_NONE))
-        {
-            SendDisconnectionReq();
-        }
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "No response after %u ms", waitedMs);
+        retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_NO_RESPONSE);
     }
-
-    // If thread is stopped and device is not rebooting then send a 'Disconnect Request'
-    if (!CheckKeepGoing() && (!rebootStopped))
+    else
     {
-        SendDisconnectionReq();
+        aWaitMs = mWaitTimeMs - waitedMs;
     }
 
     return retVal;
 }
-
 ////////////////////////////////////////////////////////////////////////////////
 
-int32 CHidDfuDeviceApplication::GetDeviceInstanceId(DEVINST aDevInst, bool aCheck)
+int32 CHidDfuDeviceApplication::DoDeviceUpgrade()
 {
     int32 retVal = HIDDFU_ERROR_NONE;
-    FUNCTION_DEBUG_SENTRY_RET(uint32, retVal);
-    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "DevInst: %d", aDevInst);
-
-    //Get Device Instance ID
-    char *pDevInstID = new char[MAX_DEVICE_ID_LEN];
-    CONFIGRET status = CM_Get_Device_IDA(aDevInst, pDevInstID, MAX_PATH, 0);
-    if (status == CR_SUCCESS)
-    {
-        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Device: %s", pDevInstID);
-        if (aCheck)
-        {
-            // Test for matching VID, PID with USB Interface (MI_)
-
-            std::string str(pDevInstID, MAX_DEVICE_ID_LEN);
-
-            // USB Vendor and Product Identifier with USB Interface (MI_)
-            // e.g. VID_xxxx&PID_xxxx&MI_
-            std::ostringstream vidPidMi;
-            vidPidMi << std::uppercase << "VID_" << std::hex << std::setfill('0') << std::setw(4) << mVid 
-                << "&PID_" << std::setw(4) << mPid << "&MI_";
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-            if (str.find(vidPidMi.str()) != std::string::npos)
-            {
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Found matching device");
-            }
-            else
-            {
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Match failed for VID, PID and I/F");
-                retVal = HIDDFU_ERROR_UNKNOWN;
-            }
-        }
-    }
-    else
-    {
-        std::ostringstream errorStr;
-        errorStr << "Failed to get Device Instance ID for " << aDevInst << "(status = " << status << ")";
-        retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UPGRADE_FAILED, errorStr.str());
-    }
+    // Upgrades are run as steps on the engine's scheduler, see StepDeviceUpgrade
+    retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_UNSUPPORTED);
 
     return retVal;
 }
-
 ////////////////////////////////////////////////////////////////////////////////
 
 uint32 CHidDfuDeviceApplication::GetEnvVariable(const char *apEnvVar, uint32 aValue) const
@@ -486,229 +231,6 @@ uint32 CHidDfuDeviceApplication::GetEnvVariable(const char *apEnvVar, uint32 aVa
 
 ////////////////////////////////////////////////////////////////////////////////
 
-std::string CHidDfuDeviceApplication::GetConnectionStatusStr(const UpgradeStatus aConnectionStatus) const
-{
-    std::string connectionStatusStr;
-    FUNCTION_DEBUG_SENTRY_RET(std::string, connectionStatusStr);
-
-    std::map<UpgradeStatus, std::string>::const_iterator it = mConnectionStatusMap.find(aConnectionStatus);
-
-    if (it != mConnectionStatusMap.end())
-    {
-        connectionStatusStr = it->second;
-    }
-    else
-    {
-        connectionStatusStr = "Unknown Connection Status";
-    }
-
-    return connectionStatusStr;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-int32 CHidDfuDeviceApplication::GetDevicePath(DEVNODE aDevNode)
-{
-    int32 retVal = HIDDFU_ERROR_NONE;
-    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
-
-    char *pDevInstID = new char[MAX_DEVICE_ID_LEN];
-    CONFIGRET status = CM_Get_Device_IDA(aDevNode, pDevInstID, MAX_PATH, 0);
-    if (status == CR_SUCCESS)
-    {
-        GUID guid;
-        // Get device intereface GUID for HID Class devices.
-        HidD_GetHidGuid(&guid);
-        // Get a handle to the device information set (for HID Class devices)
-        // that contains requested device information elements
-        HDEVINFO deviceInfoSet = SetupDiGetClassDevs(&guid, pDevInstID, NULL,
-                                    DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
-
-        if (deviceInfoSet == INVALID_HANDLE_VALUE)
-        {
-            retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN,
-                "Failed to get Device Information Set");
-        }
-        else
-        {
-            // Iterate through the devices found - look for one that matches
-            // the VID, PID, usage and usage page
-            SP_INTERFACE_DEVICE_DATA interfaceDeviceData;
-            interfaceDeviceData.cbSize = sizeof(SP_INTERFACE_DEVICE_DATA);
-            for (uint32 index = 0;
-                SetupDiEnumDeviceInterfaces(deviceInfoSet, 0, &guid, index, &interfaceDeviceData);
-                ++index)
-            {
-                // Attempt to open the device
-
-                DWORD requiredSize;
-
-                // Get requiredSize to allocate the heap, to get details about the device interface,
-                // following function is expected to return false/failure, hence ignore the return value
-                (void)SetupDiGetDeviceInterfaceDetail(deviceInfoSet, &interfaceDeviceData,
-                    NULL, 0, &requiredSize, NULL);
-
-                PSP_DEVICE_INTERFACE_DETAIL_DATA deviceInterfaceDetailData =
-                    (PSP_DEVICE_INTERFACE_DETAIL_DATA)HeapAlloc(GetProcessHeap(),
-                        HEAP_GENERATE_EXCEPTIONS | HEAP_ZERO_MEMORY, requiredSize);
-
-                deviceInterfaceDetailData->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
-
-                // Get details about the device interface
-                if(!SetupDiGetDeviceInterfaceDetail(deviceInfoSet, &interfaceDeviceData,
-                    deviceInterfaceDetailData, requiredSize, NULL, NULL))
-                {
-                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to get Device Interface Detail");
-                }
-                else
-                {
-                    HANDLE deviceHandle = CreateFile(deviceInterfaceDetailData->DevicePath,
-                        GENERIC_READ | GENERIC_WRITE,
-                        FILE_SHARE_READ | FILE_SHARE_WRITE,
-                        NULL,
-                        OPEN_EXISTING,
-                        0,
-                        NULL);
-
-                    if (deviceHandle != INVALID_HANDLE_VALUE)
-                    {
-                        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Check capabilities, device: %s", deviceInterfaceDetailData->DevicePath);
-
-                        HIDD_ATTRIBUTES attributes;
-                        HidD_GetAttributes(deviceHandle, &attributes);
-
-                        if (attributes.VendorID == mVid && attributes.ProductID == mPid)
-                        {
-                            PHIDP_PREPARSED_DATA preparsedData;
-                            HidD_GetPreparsedData(deviceHandle, &preparsedData);
-
-                            HIDP_CAPS capabilities;
-                            HidP_GetCaps(preparsedData, &capabilities);
-
-                            // Check Usage and Usage Page match.
-                            // Usage and Usage Page check is optional (zero is reserved
-                            // value in both cases, so using zero as "don't check").
-                            if ((mUsage == 0 || capabilities.Usage == mUsage) &&
-                                (mUsagePage == 0 || capabilities.UsagePage == mUsagePage))
-                            {
-                                // Set the Device Path
-                                mDevicePath = deviceInterfaceDetailData->DevicePath;
-                                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Setting DevicePath: %s", mDevicePath.c_str());
-                            }
-                            else
-                            {
-                                // Opened wrong device (capabilities), close it.
-                                CloseHandle(deviceHandle);
-                                deviceHandle = INVALID_HANDLE_VALUE;
-                            }
-                        }
-                        else
-                        {
-                            // Opened wrong device (vid/pid), close it.
-                            CloseHandle(deviceHandle);
-                            deviceHandle = INVALID_HANDLE_VALUE;
-                        }
-                    }
-                    else
-                    {
-                        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to access the device");
-                    }
-                }
-                HeapFree(GetProcessHeap(), 0, deviceInterfaceDetailData);
-            }
-        }
-        SetupDiDestroyDeviceInfoList(deviceInfoSet);
-    }
-    else
-    {
-        retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN,
-            "Failed to get Device Instance ID");
-    }
-
-    return retVal;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-std::string CHidDfuDeviceApplication::GetErrCodeStr(const UpgradeProtocolErrorCode aErrCode) const
-{
-    std::string errCodeStr;
-    FUNCTION_DEBUG_SENTRY_RET(std::string, errCodeStr);
-
-    std::map<UpgradeProtocolErrorCode, std::string>::const_iterator it = mErrorCodeMap.find(aErrCode);
-
-    if (it != mErrorCodeMap.end())
-    {
-        errCodeStr = it->second;
-    }
-    else
-    {
-        errCodeStr = "Unknown Error Code";
-    }
-
-    return errCodeStr;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-int32 CHidDfuDeviceApplication::GetSubDevNodesAndDevPath(DEVNODE aDevNode)
-{
-    int32 retVal = HIDDFU_ERROR_NONE;
-    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
-
-    // If the Device Node has got same VID, PID with USB Interface,
-    // search for HID Device under it's sub nodes
-    if (GetDeviceInstanceId(aDevNode, true) == HIDDFU_ERROR_NONE)
-    {
-        retVal = GetDevicePath(aDevNode);
-    }
-
-    if (retVal == HIDDFU_ERROR_NONE)
-    {
-        // Traverse the USB Tree
-        do
-        {
-            // Get Device Instance handle to the first child node
-            DEVNODE devNodeChild;
-            CONFIGRET status = CM_Get_Child(&devNodeChild, aDevNode, 0);
-
-            // Get Device Instance ID for logging, ignore the return value
-            (void)GetDeviceInstanceId(devNodeChild);
-
-            if (status == CR_SUCCESS)
-            {
-                // Recurse (Ignore the return value and check for the sibling)
-                (void)GetSubDevNodesAndDevPath(devNodeChild);
-            }
-            else
-            {
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Get first child for DevNode %d failed, status = %d",
-                    aDevNode, status);
-            }
-
-            // Get Device Instance Handle to the next sibling node
-            DEVNODE devNodeSibling;
-            status = CM_Get_Sibling(&devNodeSibling, aDevNode, 0);
-
-            // Get Device Instance ID for logging, ignore the return value
-            (void)GetDeviceInstanceId(devNodeSibling);
-
-            if (status != CR_SUCCESS)
-            {
-                devNodeSibling = NULL;
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Get Sibling for DevNode %d failed, status = %d",
-                    aDevNode, status);
-            }
-
-            aDevNode = devNodeSibling;
-        } while (aDevNode != NULL && mDevicePath.empty());
-    }
-
-    return retVal;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
 int32 CHidDfuDeviceApplication::GetDevFirmwareVersion(
     uint16 &aVersionMajor, uint16 &aVersionMinor, uint16 &aConfigVersion)
 {
@@ -735,25 +257,62 @@ int32 CHidDfuDeviceApplication::GetDevFirmwareVersion(
 
 ////////////////////////////////////////////////////////////////////////////////
 
-std::string CHidDfuDeviceApplication::GetOpCodeStr(const UpgradeProtocolOpCode aOpCode) const
+int32 CHidDfuDeviceApplication::HandleConnectionRsp(bool aReconnecting, bool &aReconnect)
 {
-    std::string opCodeStr;
-    FUNCTION_DEBUG_SENTRY_RET(std::string, opCodeStr);
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    const uint8 *pResponseBuf = mInputReport.data();
+    aReconnect = false;
 
-    std::map<UpgradeProtocolOpCode, std::string>::const_iterator it = mOpCodeMap.find(aOpCode);
+    // Status is in third byte of the HID Connection Response
+    UpgradeStatus status = static_cast<UpgradeStatus>(pResponseBuf[2]);
 
-    if (it != mOpCodeMap.end())
+    if (status == UPGRADE_STATUS_SUCCESS)
     {
-        opCodeStr = it->second;
+        SetHostState(STATE_UPGRADE_CONNECT);
+    }
+    else if (status == UPGRADE_STATUS_ALREADY_CONNECTED_WARNING)
+    {
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC,
+            "Warning: Already connected, received connection status from chip (0x%x): %s",
+            status, GetUpgradeStatusName(status));
+
+        if (aReconnecting)
+        {
+            std::ostringstream errorStr;
+            errorStr << "Reconnect failure, status received from chip : 0x" << std::hex << status
+                << " (" << GetUpgradeStatusName(status) << ")";
+            retVal = mLastDevError.SetMsg(HIDDFU_ERROR_CONNECTION, errorStr.str());
+        }
+        else
+        {
+            aReconnect = true;
+        }
     }
     else
     {
-        opCodeStr = "Unknown OpCode";
+        std::ostringstream errorStr;
+        if (static_cast<UpgradeStatus>(pResponseBuf[1]) == 1)
+        {
+            errorStr << "Connection failure, status received from chip : 0x" << std::hex << status
+                << " (" << GetUpgradeStatusName(status) << ")";
+        }
+        else if (static_cast<UpgradeStatus>(pResponseBuf[1]) > 1)
+        {
+            UpgradeProtocolOpCode responseMsg = static_cast<UpgradeProtocolOpCode>(pResponseBuf[2]);
+            errorStr << "Connection failure, received unexpected response: 0x" << std::hex << status
+                << " (" << GetUpgradeOpCodeName(responseMsg) << ")";
+        }
+        else
+        {
+            errorStr << "Connection failure, unknown response";
+        }
+        retVal = mLastDevError.SetMsg(HIDDFU_ERROR_CONNECTION, errorStr.str());
     }
 
-    return opCodeStr;
+    return retVal;
 }
-
 ////////////////////////////////////////////////////////////////////////////////
 
 int32 CHidDfuDeviceApplication::HandleUpgradeProtocolMsgReceived(
@@ -774,7 +333,7 @@ int32 CHidDfuDeviceApplication::HandleUpgradeProtocolMsgReceived(
         {
             MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC,
                 "Received Message with OpCode(0x%x): %s",
-                aExpectedOpCode, GetOpCodeStr(static_cast<UpgradeProtocolOpCode>(aExpectedOpCode)).c_str());
+                aExpectedOpCode, GetUpgradeOpCodeName(aExpectedOpCode));
 
             SetHostState(aNewHostState);
             retVal = HIDDFU_ERROR_NONE;
@@ -789,7 +348,7 @@ int32 CHidDfuDeviceApplication::HandleUpgradeProtocolMsgReceived(
                 CUpgradeErrorInd errorIndMsg(apBuffer, aLength);
                 uint16 errorCode = errorIndMsg.GetErrorCode();
                 errorStr << "Received Error Indication from chip, error code: 0x" << std::hex << errorCode
-                        << "(" << GetErrCodeStr(static_cast<UpgradeProtocolErrorCode>(errorCode)).c_str() << ")";
+                        << "(" << GetUpgradeErrorCodeName(errorCode) << ")";
 
                 // Send UPGRADE_ERROR_RES
                 SendUpgradeErrorResp(errorCode);
@@ -797,7 +356,7 @@ int32 CHidDfuDeviceApplication::HandleUpgradeProtocolMsgReceived(
             else
             {
                 errorStr << "Unexpected message (" 
-                        << GetOpCodeStr(static_cast<UpgradeProtocolOpCode>(opCodeReceived)).c_str() << ")"
+                        << GetUpgradeOpCodeName(opCodeReceived) << ")"
                         << " received from the chip";
             }
 
@@ -805,8 +364,8 @@ int32 CHidDfuDeviceApplication::HandleUpgradeProtocolMsgReceived(
 
             MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC,
                 "Expected OpCode(0x%x): %s Received OpCode(0x%x): %s ",
-                aExpectedOpCode, GetOpCodeStr(static_cast<UpgradeProtocolOpCode>(aExpectedOpCode)).c_str(),
-                opCodeReceived, GetOpCodeStr(static_cast<UpgradeProtocolOpCode>(opCodeReceived)).c_str());
+                aExpectedOpCode, GetUpgradeOpCodeName(aExpectedOpCode),
+                opCodeReceived, GetUpgradeOpCodeName(opCodeReceived));
 
         }
     }
@@ -815,40 +374,35 @@ int32 CHidDfuDeviceApplication::HandleUpgradeProtocolMsgReceived(
         MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Received HID message with length: %d", msg.GetUpgradeMsgSize());
     }
 
-    if (mHostState != aNewHostState)
-    {
-        HiResClockSleepMilliSec(10);
-    }
-
     return retVal;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int32 CHidDfuDeviceApplication::HidConnect()
+int32 CHidDfuDeviceApplication::HandleUpgradeIsValidationDoneCfm(int32 aResult)
 {
-    int32 retVal = HIDDFU_ERROR_NONE;
+    int32 retVal = aResult;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "DevicePath: %s", mDevicePath.c_str());
+    const uint8 *pResponseBuf = mInputReport.data();
 
-    // Open the device using device path
-    HANDLE deviceHandle = CreateFile(mDevicePath.c_str(),
-                               GENERIC_READ | GENERIC_WRITE,
-                               FILE_SHARE_READ | FILE_SHARE_WRITE,
-                               NULL,
-                               OPEN_EXISTING,
-                               0,
-                               NULL);
-
-    if (deviceHandle == INVALID_HANDLE_VALUE)
+    if ((retVal == HIDDFU_ERROR_NONE) && (pResponseBuf[2] == UPGRADE_TRANSFER_COMPLETE_IND))
     {
-        retVal = SetLastErrorFromWinError(HIDDFU_ERROR_CONNECTION, "Unable to establish a HID connection", ::GetLastError());
+        mResumePoint = UPGRADE_RESUME_POINT_PRE_REBOOT;
+        RecordJournal(mResumePoint);
     }
     else
     {
-        mDeviceHandle = deviceHandle;
-        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mDeviceHandle: %d", mDeviceHandle);
+        // If it is UPGRADE_IS_VALIDATION_DONE_CFM we need to send UPGRADE_IS_VALIDATION_DONE_REQ again
+        if (mHostState != STATE_UPGRADE_DATA_VALIDATED)
+        {
+            if (pResponseBuf[2] == UPGRADE_IS_VALIDATION_DONE_CFM)
+            {
+                CUpgradeIsValidationDoneCfm isValidationDoneCfm(pResponseBuf, mInputReportLenBytes);
+                mDelayInValidation = isValidationDoneCfm.GetDelayTime();
+                mHostState = STATE_UPGRADE_DATA_VALIDATING;
+            }
+        }
     }
 
     return retVal;
@@ -856,80 +410,147 @@ int32 CHidDfuDeviceApplication::HidConnect()
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void CHidDfuDeviceApplication::Read(uint8 *apBuffer, uint32 &aBytesRead, int32 &aReadRetVal)
+int32 CHidDfuDeviceApplication::HandleUpgradeStartCfm(int32 aResult)
 {
-    FUNCTION_DEBUG_SENTRY;
+    int32 retVal = aResult;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    if (!ReadFile(mDeviceHandle, apBuffer, mInputReportLenBytes, &aBytesRead, NULL))
+    if ((retVal == HIDDFU_ERROR_NONE) && (mResumePoint == UPGRADE_RESUME_POINT_POST_REBOOT))
     {
-        aReadRetVal = SetLastErrorFromWinError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
-            "Failed to read from device", ::GetLastError());
+        SetHostState(STATE_UPGRADE_COMMIT_HOST_CONTINUE);
     }
+
+    CUpgradeStartCfm msg(mInputReport.data(), mInputReportLenBytes);
+    if (msg.GetUpgradeMsgSize() != 0)
+    {
+        if (msg.GetStatus() != 0x00)    // 0x00  Success  0x01  Failure
+        {
+            retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UPGRADE_FAILED,
+                    "Status failure in UPGRADE_START_CFM");
+        }
+
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "UPGRADE_START_CFM status = 0x%0x", msg.GetStatus());
+    }
+
+    return retVal;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int32 CHidDfuDeviceApplication::HidDfuReceiveMsg(uint8 *apBuffer)
+int32 CHidDfuDeviceApplication::HandleUpgradeSyncCfm(int32 aResult)
+{
+    int32 retVal = aResult;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    CUpgradeSyncCfm msg(mInputReport.data(), mInputReportLenBytes);
+    if(msg.GetUpgradeMsgSize() != 0)
+    {
+        mResumePoint = static_cast<UpgradeResumePoint>(msg.GetResumePoint());
+
+        // Compare file identifier
+        if (FILE_ID != msg.GetFileIdentifier())
+        {
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "UPGRADE_START_CFM Expected File Id = 0x%0x, received File Id =0x%x", FILE_ID, msg.GetFileIdentifier());
+
+            retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UPGRADE_FAILED,
+                "Unexpected File Identifier in UPGRADE_SYNC_CFM");
+        }
+
+        // A resumed upgrade may also continue from validation or the reboot
+        if (((mResumePoint == UPGRADE_RESUME_POINT_START)
+                || (mResumePoint == UPGRADE_RESUME_POINT_POST_REBOOT)
+                || (mJournalResume && ((mResumePoint == UPGRADE_RESUME_POINT_PRE_VALIDATE)
+                    || (mResumePoint == UPGRADE_RESUME_POINT_PRE_REBOOT))))
+                && (retVal == HIDDFU_ERROR_NONE))
+        {
+            SetHostState(STATE_UPGRADE_READY);
+        }
+        else
+        {
+            SetHostState(STATE_UPGRADE_IDLE);
+            retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UPGRADE_FAILED,
+                    "Unexpected resume point in UPGRADE_SYNC_CFM");
+        }
+
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "UPGRADE_START_CFM mResumePoint = 0x%0x", mResumePoint);
+    }
+
+    return retVal;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuDeviceApplication::HidConnect()
 {
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    // Use a temporary buffer to pass to thread
-    uint8 *pBuffer = new uint8[mInputReportLenBytes];
-    memset(pBuffer, 0, mInputReportLenBytes);
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "DevicePath: %s", mDevicePath.c_str());
 
-    // Read from device in a seperate thread, so that if the read hangs
-    // then the timed thread will ensure that there is a mechanism to report the failure
-    uint32 bytesRead = 0;
-    std::thread t(&CHidDfuDeviceApplication::Read, this, pBuffer, std::ref(bytesRead), std::ref(retVal));
+    // Open the device using device path
+    if (!mpTransport->Open(mDevicePath))
+    {
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_CONNECTION, "Unable to establish a HID connection",
+            mpTransport->GetError());
+    }
+    else if (!mpTransport->StartReading(mInputReportLenBytes))
+    {
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_CONNECTION, "Unable to open the device for reading",
+            mpTransport->GetError());
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuDeviceApplication::HidDfuReceiveMsg(uint8 *apBuffer)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    memset(apBuffer, 0, mInputReportLenBytes);
 
     StopWatch timeSinceStart;
     // Time duration for which host will wait for a response
     const uint32 maxWaitTimeMs = GetEnvVariable("HID_WAIT_TIME_MS", 70000);
 
-    while ((timeSinceStart.duration() < maxWaitTimeMs) && (bytesRead != mInputReportLenBytes)
-            && (retVal == HIDDFU_ERROR_NONE) && CheckKeepGoing())
+    // The reader returns as soon as the device sends a report, the wait is
+    // only split up so that a request to stop the operation is seen
+    uint32 bytesRead = 0;
+    uint32 elapsedMs = 0;
+    CHidTransport::Result result = CHidTransport::RESULT_TIMEOUT;
+    while ((result == CHidTransport::RESULT_TIMEOUT) && (elapsedMs < maxWaitTimeMs) && CheckKeepGoing())
     {
-        HiResClockSleepMilliSec(5);
+        const uint32 remainingMs = maxWaitTimeMs - elapsedMs;
+        result = mpTransport->ReadReport(apBuffer,
+            (remainingMs < STOP_CHECK_INTERVAL_MS ? remainingMs : STOP_CHECK_INTERVAL_MS), bytesRead);
+        elapsedMs = timeSinceStart.duration();
     }
 
-    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "timeSinceStart.duration()=%d bytesRead=%d retVal=%d",
-            timeSinceStart.duration(), bytesRead, retVal);
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "timeSinceStart.duration()=%d bytesRead=%d result=%d",
+            elapsedMs, bytesRead, result);
 
-    if ((retVal == HIDDFU_ERROR_NONE) && CheckKeepGoing())
+    if (result == CHidTransport::RESULT_OK)
     {
-        if (bytesRead == mInputReportLenBytes)
-        {
-            MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "ReadFile[...]", pBuffer, mInputReportLenBytes);
-            t.join();
-
-            memcpy(apBuffer, pBuffer, mInputReportLenBytes);
-
-        }
-        else if (bytesRead != 0 && bytesRead != mInputReportLenBytes)
+        MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "ReadReport[...]", apBuffer, mInputReportLenBytes);
+    }
+    else if (result == CHidTransport::RESULT_FAILED)
+    {
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
+            "Failed to read from device", mpTransport->GetError());
+    }
+    else if (CheckKeepGoing())
+    {
+        if (result == CHidTransport::RESULT_SHORT)
         {
             retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Not enough bytes received from the device.");
-            t.detach();
         }
         else
         {
             retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_NO_RESPONSE);
-            t.detach();
-        }
-    }
-    else
-    {
-        t.detach();
-
-        if (bytesRead == mInputReportLenBytes)
-        {
-            MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "ReadFile[...]", pBuffer, mInputReportLenBytes);
-            memcpy(apBuffer, pBuffer, mInputReportLenBytes);
         }
     }
 
-    delete[] pBuffer;
-
     return retVal;
 }
 
@@ -941,27 +562,123 @@ int32 CHidDfuDeviceApplication::HidDfuSendMsg(const CUpgradeProtocolMsg& aSendTo
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
     MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Sending %s",
-        GetOpCodeStr(static_cast<UpgradeProtocolOpCode>(aSendToChip.GetOpCode())).c_str());
+        GetUpgradeOpCodeName(aSendToChip.GetOpCode()));
 
-    // Send as raw buffer
-    uint8 *pBuffer = new uint8[mOutputReportLenBytes];
-    memset(pBuffer, 0, mOutputReportLenBytes);
-    aSendToChip.Serialise(pBuffer, mOutputReportLenBytes);
+    // The message has been built in place, send its report buffer as is
+    assert(aSendToChip.GetReportLength() == mOutputReportLenBytes);
+    MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "UpgradeProtocolMsg[...]",
+        aSendToChip.GetReport(), mOutputReportLenBytes);
 
-    uint32 bytesWritten = 0;
-    if (!WriteFile(mDeviceHandle, pBuffer, mOutputReportLenBytes, &bytesWritten, NULL))
+    if (!mpTransport->WriteReport(aSendToChip.GetReport(), mOutputReportLenBytes))
     {
-        retVal = SetLastErrorFromWinError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE, 
-                "Failed to write to device", ::GetLastError());
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE, 
+                "Failed to write to device", mpTransport->GetError());
     }
 
-    delete[] pBuffer;
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuDeviceApplication::HidDfuQueueMsg(const CUpgradeProtocolMsg& aSendToChip)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Queueing %s",
+        GetUpgradeOpCodeName(aSendToChip.GetOpCode()));
+
+    assert(aSendToChip.GetReportLength() == mOutputReportLenBytes);
+    MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "UpgradeProtocolMsg[...]",
+        aSendToChip.GetReport(), mOutputReportLenBytes);
+
+    retVal = GetWriteError(mpTransport->WriteWindowReport());
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuDeviceApplication::GetWriteError(CHidTransport::Result aResult)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+
+    switch (aResult)
+    {
+    case CHidTransport::RESULT_TIMEOUT:
+        retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_NO_RESPONSE);
+        break;
+    case CHidTransport::RESULT_FAILED:
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
+                "Failed to write to device", mpTransport->GetError());
+        break;
+    default:
+        break;
+    }
 
     return retVal;
 }
 
 //////////////////////////////////////////////////////////////////////////////
 
+int32 CHidDfuDeviceApplication::PollReceiveMsg(uint8 *apBuffer, bool &aReceived, uint32 &aWaitMs)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    memset(apBuffer, 0, mInputReportLenBytes);
+    aReceived = false;
+
+    uint32 bytesRead = 0;
+    const CHidTransport::Result result = mpTransport->ReadReport(apBuffer, 0, bytesRead);
+
+    switch (result)
+    {
+    case CHidTransport::RESULT_OK:
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Response after %u ms, bytesRead=%d", mWaitTime.duration(), bytesRead);
+        MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "ReadReport[...]", apBuffer, mInputReportLenBytes);
+        SetLastLatency(mWaitTime.uduration());
+        aReceived = true;
+        break;
+
+    case CHidTransport::RESULT_SHORT:
+        retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Not enough bytes received from the device.");
+        break;
+
+    case CHidTransport::RESULT_TIMEOUT:
+        // The transport's listener wakes the step when a report arrives
+        retVal = CheckWaitTime(aWaitMs);
+        break;
+
+    default:
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE, "Failed to read from device",
+            mpTransport->GetError());
+        break;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuDeviceApplication::PollResponse(uint8 aExpectedOpCode, HostUpgradeState aNewHostState,
+    bool &aReceived, uint32 &aWaitMs)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    uint8 *pResponseBuf = mInputReport.data();
+
+    retVal = PollReceiveMsg(pResponseBuf, aReceived, aWaitMs);
+    if ((retVal == HIDDFU_ERROR_NONE) && aReceived)
+    {
+        retVal = HandleUpgradeProtocolMsgReceived(pResponseBuf, mInputReportLenBytes, aExpectedOpCode, aNewHostState);
+    }
+
+    return retVal;
+}
+////////////////////////////////////////////////////////////////////////////////
+
 uint8 CHidDfuDeviceApplication::ReCalculateProgress(uint8 aWriteProgress)
 {
     uint8 progress = aWriteProgress;
@@ -987,6 +704,8 @@ uint8 CHidDfuDeviceApplication::ReCalculateProgress(uint8 aWriteProgress)
         case STATE_UPGRADE_COMMIT:
             progress = 100;
             break;
+        default:
+            break;
         }
     }
 
@@ -995,51 +714,6 @@ uint8 CHidDfuDeviceApplication::ReCalculateProgress(uint8 aWriteProgress)
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int32 CHidDfuDeviceApplication::ReadDataBytesReq()
-{
-    int32 retVal = HIDDFU_ERROR_NONE;
-    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
-
-    // Open the file and get the file handle
-    mpFileHandle = fopen(mFileName.c_str(), "rb");
-    if (mpFileHandle == NULL)
-    {
-        std::ostringstream msg;
-        msg << "Failed to open file \"" << mFileName << "\"";
-        retVal = mLastDevError.SetMsg(HIDDFU_ERROR_FILE_OPEN_FAILED, msg.str());
-    }
-
-    while((mResumePoint != UPGRADE_RESUME_POINT_PRE_VALIDATE)
-            && (retVal == HIDDFU_ERROR_NONE)
-            && CheckKeepGoing())
-    {
-        uint8 *pResponseBuf = new uint8[mInputReportLenBytes];
-        retVal = ReadResponse(pResponseBuf, UPGRADE_DATA_BYTES_REQ, STATE_UPGRADE_DATA_TRANSFERRING);
-
-        CUpgradeDataBytesReq msg(pResponseBuf, mInputReportLenBytes);
-
-        if((msg.GetUpgradeMsgSize() != 0) && (retVal == HIDDFU_ERROR_NONE))
-        {
-            mRequestedBytes = msg.GetNumberOfBytes();
-            mRequestedDataOffset = msg.GetStartOffset();
-            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC,
-                    "mRequestedBytes: 0x%x mRequestedDataOffset: 0x%x",
-                    mRequestedBytes, mRequestedDataOffset);
-        }
-
-        delete[] pResponseBuf;
-
-        if (retVal == HIDDFU_ERROR_NONE && mHostState == STATE_UPGRADE_DATA_TRANSFERRING && CheckKeepGoing())
-        {
-            retVal = SendUpgradeData();
-        }
-    }
-
-    return retVal;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
 int32 CHidDfuDeviceApplication::ReadResponse(
         uint8 *apBuffer, uint8 aExpectedOpCode, HostUpgradeState aNewHostState)
 {
@@ -1078,91 +752,40 @@ int32 CHidDfuDeviceApplication::GetSizeOfHidReport()
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    PHIDP_PREPARSED_DATA pPreParsedData = NULL; // The opaque parser info describing this device
-    HIDP_CAPS hidCapability;                    // The capabilities of the HID device
-
-    if (!HidD_GetPreparsedData(mDeviceHandle, &pPreParsedData))
-    {
-        retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Error: HidD_GetPreparsedData failed.");
-    }
+    uint16 inputLength = 0;
+    uint16 outputLength = 0;
+    uint16 featureLength = 0;
 
-    if (retVal == HIDDFU_ERROR_NONE)
+    if (!mpTransport->GetReportLengths(inputLength, outputLength, featureLength))
     {
-        if (!HidP_GetCaps(pPreParsedData, &hidCapability))
-        {
-            retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Error: HidP_GetCaps failed.");
-        }
-        else
-        {
-            // Size of data field is 8-bit in HID message, so perform a range check
-            if ((hidCapability.InputReportByteLength > std::numeric_limits<uint8>::max()) 
-                    || (hidCapability.OutputReportByteLength > std::numeric_limits<uint8>::max())
-                    || (hidCapability.FeatureReportByteLength > std::numeric_limits<uint8>::max()))
-            {
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "hidCapability.InputReportByteLength = %d", hidCapability.InputReportByteLength);
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "hidCapability.OutputReportByteLength = %d", hidCapability.OutputReportByteLength);
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "hidCapability.FeatureReportByteLength = %d", hidCapability.FeatureReportByteLength);
-                retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Report length out of range.");
-            }
-            else
-            {
-                // Size of data blobs
-
-                // that are sent from HID device to the application
-                mInputReportLenBytes = static_cast<uint8>(hidCapability.InputReportByteLength);
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mInputReportLenByte = %d", mInputReportLenBytes);
-
-                // that are sent from application to the HID device
-                mOutputReportLenBytes = static_cast<uint8>(hidCapability.OutputReportByteLength);
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mOutputReportLenByte = %d", mOutputReportLenBytes);
-
-                // that can be manually read and/or written (typically related to config info)
-                mFeatureReportLenBytes = static_cast<uint8>(hidCapability.FeatureReportByteLength);
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mFeatureReportLenByte = %d", mFeatureReportLenBytes);
-            }
-        }
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_UNKNOWN, "Error: failed to get the report lengths",
+            mpTransport->GetError());
     }
-
-    HidD_FreePreparsedData(pPreParsedData);
-
-    return retVal;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-int32 CHidDfuDeviceApplication::RunInitialUpgradeSequence()
-{
-    int32 retVal = HIDDFU_ERROR_NONE;
-    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
-
-    if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_IDLE))
+    // Size of data field is 8-bit in HID message, so perform a range check
+    else if ((inputLength > std::numeric_limits<uint8>::max()) 
+            || (outputLength > std::numeric_limits<uint8>::max())
+            || (featureLength > std::numeric_limits<uint8>::max()))
     {
-        retVal = SendConnectionReq();
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "InputReportByteLength = %d", inputLength);
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "OutputReportByteLength = %d", outputLength);
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "FeatureReportByteLength = %d", featureLength);
+        retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Report length out of range.");
     }
-
-    if (mResumePoint == UPGRADE_RESUME_POINT_START)
+    else
     {
-        // Reset state
-        if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_CONNECT))
-        {
-            retVal = SendUpgradeAbortReq();
-        }
+        // Size of data blobs
 
-        // Reset State, because we just forced it to abort
-        if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_IDLE))
-        {
-            SetHostState(STATE_UPGRADE_CONNECT);
-        }
-    }
+        // that are sent from HID device to the application
+        mInputReportLenBytes = static_cast<uint8>(inputLength);
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mInputReportLenByte = %d", mInputReportLenBytes);
 
-    if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_CONNECT))
-    {
-        retVal = SendUpgradeSyncReq();
-    }
+        // that are sent from application to the HID device
+        mOutputReportLenBytes = static_cast<uint8>(outputLength);
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mOutputReportLenByte = %d", mOutputReportLenBytes);
 
-    if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_READY))
-    {
-        retVal = SendUpgradeStartReq();
+        // that can be manually read and/or written (typically related to config info)
+        mFeatureReportLenBytes = static_cast<uint8>(featureLength);
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mFeatureReportLenByte = %d", mFeatureReportLenBytes);
     }
 
     return retVal;
@@ -1195,89 +818,28 @@ int32 CHidDfuDeviceApplication::SendConnectionReq(bool aReconnecting)
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    uint8 *pBuffer = new uint8[mFeatureReportLenBytes];
-    memset(pBuffer, 0, mFeatureReportLenBytes);
-
-    // Report ID, Size, Command Log, Command High
-    pBuffer[0] = HID_REPORTID_COMMAND;
-    pBuffer[1] = 1;
-    pBuffer[2] = HID_CMD_CONNECTION_REQ;
+    retVal = WriteConnectionReq();
 
-    MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "SetFeature[...]", pBuffer, mFeatureReportLenBytes);
-
-    // Check state, if idle
-    if (mHostState != STATE_UPGRADE_IDLE)
-    {
-        retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_SEQUENCE);
-    }
-    else if(HidD_SetFeature(mDeviceHandle, (PVOID)pBuffer, mFeatureReportLenBytes))
+    if (retVal == HIDDFU_ERROR_NONE)
     {
-        uint8 *pResponseBuf = new uint8[mInputReportLenBytes];
+        uint8 *pResponseBuf = mInputReport.data();
         memset(pResponseBuf, 0, mInputReportLenBytes);
 
         retVal = HidDfuReceiveMsg(pResponseBuf);
         if(retVal == HIDDFU_ERROR_NONE)
         {
-            // Status is in third byte of the HID Connection Response
-            UpgradeStatus status = static_cast<UpgradeStatus>(pResponseBuf[2]);
-
-            if (status == UPGRADE_STATUS_SUCCESS)
-            {
-                SetHostState(STATE_UPGRADE_CONNECT);
-            }
-            else if (status == UPGRADE_STATUS_ALREADY_CONNECTED_WARNING)
-            {
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC,
-                    "Warning: Already connected, received connection status from chip (0x%x): %s",
-                    status, GetConnectionStatusStr(status).c_str());
+            bool reconnect = false;
+            retVal = HandleConnectionRsp(aReconnecting, reconnect);
 
-                if (aReconnecting)
-                {
-                    std::ostringstream errorStr;
-                    errorStr << "Reconnect failure, status received from chip : 0x" << std::hex << status
-                        << " (" << GetConnectionStatusStr(status) << ")";
-                    retVal = mLastDevError.SetMsg(HIDDFU_ERROR_CONNECTION, errorStr.str());
-                }
-                else
-                {
-                    retVal = ReConnect();
-                }
-            }
-            else
+            if ((retVal == HIDDFU_ERROR_NONE) && reconnect)
             {
-                std::ostringstream errorStr;
-                if (static_cast<UpgradeStatus>(pResponseBuf[1]) == 1)
-                {
-                    errorStr << "Connection failure, status received from chip : 0x" << std::hex << status
-                        << " (" << GetConnectionStatusStr(status) << ")";
-                }
-                else if (static_cast<UpgradeStatus>(pResponseBuf[1]) > 1)
-                {
-                    UpgradeProtocolOpCode responseMsg = static_cast<UpgradeProtocolOpCode>(pResponseBuf[2]);
-                    errorStr << "Connection failure, received unexpected response: 0x" << std::hex << status
-                        << " (" << GetOpCodeStr(responseMsg).c_str() << ")";
-                }
-                else
-                {
-                    errorStr << "Connection failure, unknown response";
-                }
-                retVal = mLastDevError.SetMsg(HIDDFU_ERROR_CONNECTION, errorStr.str());
+                retVal = ReConnect();
             }
         }
-
-        delete[] pResponseBuf;
     }
-    else
-    {
-        retVal = SetLastErrorFromWinError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE, 
-                "Failed to send HID_CMD_CONNECTION_REQ", ::GetLastError());
-    }
-
-    delete[] pBuffer;
 
     return retVal;
 }
-
 ////////////////////////////////////////////////////////////////////////////////
 
 int32 CHidDfuDeviceApplication::SendDisconnectionReq()
@@ -1287,7 +849,7 @@ int32 CHidDfuDeviceApplication::SendDisconnectionReq()
 
     if ((mLastDevError.GetErrorCode() != HIDDFU_ERROR_NO_RESPONSE))
     {
-        uint8 *pBuffer = new uint8[mFeatureReportLenBytes];
+        uint8 *pBuffer = mFeatureReport.data();
         memset(pBuffer, 0, mFeatureReportLenBytes);
 
         // Report ID, Size, Command Log, Command High
@@ -1297,15 +859,13 @@ int32 CHidDfuDeviceApplication::SendDisconnectionReq()
 
         MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "SetFeature[...]", pBuffer, mFeatureReportLenBytes);
 
-        if (!HidD_SetFeature(mDeviceHandle, (PVOID)pBuffer, mFeatureReportLenBytes))
+        if (!mpTransport->SetFeature(pBuffer, mFeatureReportLenBytes))
         {
-            retVal = SetLastErrorFromWinError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
-                "Failed to send HID_CMD_DISCONNECT_REQ", ::GetLastError());
+            retVal = SetLastErrorFromOsError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
+                "Failed to send HID_CMD_DISCONNECT_REQ", mpTransport->GetError());
         }
 
         mHostState = STATE_UPGRADE_IDLE;
-
-        delete[] pBuffer;
     }
     else
     {
@@ -1322,20 +882,12 @@ int32 CHidDfuDeviceApplication::SendUpgradeAbortReq()
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    CUpgradeAbortReq abortReq(mOutputReportLenBytes);
+    CUpgradeAbortReq abortReq(mOutputReport.data(), mOutputReportLenBytes);
 
     retVal = HidDfuSendMsg(abortReq);
 
-    if(retVal == HIDDFU_ERROR_NONE)
-    {
-        uint8 *pResponseBuf = new uint8[mOutputReportLenBytes];
-        retVal = ReadResponse(pResponseBuf, UPGRADE_ABORT_CFM, STATE_UPGRADE_IDLE);
-        delete[] pResponseBuf;
-    }
-
     return retVal;
 }
-
 ////////////////////////////////////////////////////////////////////////////////
 
 int32 CHidDfuDeviceApplication::SendUpgradeCommitCfm()
@@ -1343,7 +895,7 @@ int32 CHidDfuDeviceApplication::SendUpgradeCommitCfm()
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    CUpgradeCommitCfm commitCfm(mOutputReportLenBytes);
+    CUpgradeCommitCfm commitCfm(mOutputReport.data(), mOutputReportLenBytes);
 
     // Action
     // 0x00  Commit upgrade    0x01  Rollback upgrade
@@ -1352,106 +904,132 @@ int32 CHidDfuDeviceApplication::SendUpgradeCommitCfm()
 
     retVal = HidDfuSendMsg(commitCfm);
 
-    if(retVal == HIDDFU_ERROR_NONE)
-    {
-        uint8 *pResponseBuf = new uint8[mOutputReportLenBytes];
-        retVal = ReadResponse(pResponseBuf, UPGRADE_COMPLETE_IND, STATE_UPGRADE_COMMIT);
-
-        if (retVal == HIDDFU_ERROR_NONE)
-        {
-            // Upgrade process is complete
-            mResumePoint = UPGRADE_RESUME_POINT_POST_COMMIT;
-        }
-        delete[] pResponseBuf;
-    }
-
     return retVal;
 }
-
 ////////////////////////////////////////////////////////////////////////////////
 
-int32 CHidDfuDeviceApplication::SendUpgradeData()
+int32 CHidDfuDeviceApplication::SendUpgradeData(bool &aWaiting, uint32 &aWaitMs)
 {
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
     size_t maxDataSize = mOutputReportLenBytes - (HEADER_SIZE + 1); // Max size of data excluding header and "More Data" field  of 1 byte
 
-    if (mRequestedBytes == 0)
-    {
-        retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Requested data size is 0, unhandled.");
-    }
-    else
-    {
-        uint8 *pBuffer = new uint8[maxDataSize];
-
-        // Move to the 'requested data offset' received from device in UPGRADE_DATA_BYTES_REQ message
-        fseek(mpFileHandle, static_cast<long>(mRequestedDataOffset), SEEK_CUR);
-
-        size_t dataSendLength = 0;
-        size_t octetsToSend = mRequestedBytes;
-        size_t readLength;
+    const uint8 *pImageData = mpUpgradeImage->GetData();
+    const size_t imageSize = mpUpgradeImage->GetSize();
 
-        const uint32 maxTimeBetweenDataSends = GetEnvVariable("HID_DATA_SEND_WAIT_TIME_MS", 2);
+    // If the requested length is greater than maxDataSize, it will be necessary to send the data
+    // in more than one UPGRADE_DATA message. The requested data size may be very large, so after
+    // a window of reports the step lets other devices run, and the user stop the upgrade.
+    uint8 reportsSent = 0;
+    size_t readLength;
 
-        // If the requested length is greater than maxDataSize, it will be necessary to send the data read
-        // from file in more than one UPGRADE_DATA message. The 'keep going' check is present as the
-        // requested data size may be very large and we don't want to prevent the user from stopping
-        // the upgrade in this case.
-        while ((retVal == HIDDFU_ERROR_NONE) && (octetsToSend > 0) && CheckKeepGoing())
+    while ((retVal == HIDDFU_ERROR_NONE) && (mUpgradeStep == STEP_DATA) && !aWaiting)
+    {
+        readLength = 0;
+        if (mImageOffset < imageSize)
         {
-            memset(pBuffer, 0, maxDataSize);
-            readLength = fread(pBuffer, sizeof(pBuffer[0]), octetsToSend > maxDataSize ? maxDataSize : octetsToSend, mpFileHandle);
-
-            if (ferror(mpFileHandle))
+            readLength = imageSize - mImageOffset;
+            if (readLength > mOctetsToSend)
             {
-                retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_FILE_READ_FAILED);
+                readLength = mOctetsToSend;
             }
-
-            if (readLength <= 0)
+            if (readLength > maxDataSize)
             {
-                retVal = mLastDevError.SetMsg(HIDDFU_ERROR_FILE_INVALID_FORMAT, "File format is invalid, no payload found");
+                readLength = maxDataSize;
             }
+        }
 
-            if (retVal == HIDDFU_ERROR_NONE)
-            {
-                MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "ImageData[...]", static_cast<uint8*>(pBuffer), static_cast<uint32>(readLength));
-                CUpgradeDataReq dataReq(mOutputReportLenBytes);
-                dataReq.SetUpgradeMsgSize(static_cast<uint8>(readLength + 4));
-                dataReq.SetLength(static_cast<uint16>(readLength + 1));
-                dataReq.SetImageData(pBuffer, static_cast<uint8>(readLength));
-
-                mCurrentDataOffset += readLength;
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mCurrentDataOffset: %d", mCurrentDataOffset);
+        if (readLength <= 0)
+        {
+            retVal = mLastDevError.SetMsg(HIDDFU_ERROR_FILE_INVALID_FORMAT, "File format is invalid, no payload found");
+        }
 
-                if (CalculateWriteProgress() == 100)
+        uint8 *pReport = mOutputReport.data();
+        if ((retVal == HIDDFU_ERROR_NONE) && mpTransport->IsWindowOpen())
+        {
+            const CHidTransport::Result result = mpTransport->GetWindowReport(0, pReport);
+            if (result == CHidTransport::RESULT_TIMEOUT)
+            {
+                // Wait for the device to accept the oldest report in flight
+                if (!mWindowWaiting)
                 {
-                    dataReq.SetMoreData(1); // More data 1  Last packet of data from the upgrade file
-
-                    // If we are done with all data then changed state, and proceed for validation
-                    mResumePoint = UPGRADE_RESUME_POINT_PRE_VALIDATE;
-                    SetHostState(STATE_UPGRADE_DATA_VALIDATION);
+                    mWindowWaiting = true;
+                    mWaitTime = StopWatch();
                 }
-                else
-                {
-                    dataReq.SetMoreData(0); // More data 0  There is more data in the upgrade file
-                }
-
-                retVal = HidDfuSendMsg(dataReq);
-                octetsToSend -= readLength;
+                retVal = CheckWaitTime(aWaitMs);
+                aWaiting = true;
 
-                if (octetsToSend > 0)
+                // The listener is told once half the window is free, so the
+                // step also runs when the device would count as stalled
+                const uint32 waitedMs = mWaitTime.duration();
+                if ((retVal == HIDDFU_ERROR_NONE) && mDataWindowed)
                 {
-                    HiResClockSleepMilliSec(maxTimeBetweenDataSends);
+                    if (waitedMs > mStallTimeMs)
+                    {
+                        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Device stalled for %u ms, using fixed delay", waitedMs);
+                        mDataWindowed = false;
+                    }
+                    else
+                    {
+                        aWaitMs = std::min(aWaitMs, mStallTimeMs - waitedMs + 1);
+                    }
                 }
             }
+            else
+            {
+                retVal = GetWriteError(result);
+                mWindowWaiting = false;
+            }
         }
 
-        delete[] pBuffer;
+        if ((retVal == HIDDFU_ERROR_NONE) && !aWaiting)
+        {
+            const uint8 *pData = pImageData + mImageOffset;
+            MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "ImageData[...]", pData, static_cast<uint32>(readLength));
+            CUpgradeDataReq dataReq(pReport, mOutputReportLenBytes, pData, static_cast<uint8>(readLength));
+
+            mImageOffset += readLength;
+            mCurrentDataOffset += readLength;
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mCurrentDataOffset: %d", mCurrentDataOffset);
+
+            if (CalculateWriteProgress() == 100)
+            {
+                dataReq.SetMoreData(1); // More data 1  Last packet of data from the upgrade file
+
+                // If we are done with all data then changed state, and proceed for validation
+                mResumePoint = UPGRADE_RESUME_POINT_PRE_VALIDATE;
+                SetHostState(STATE_UPGRADE_DATA_VALIDATION);
+            }
+            else
+            {
+                dataReq.SetMoreData(0); // More data 0  There is more data in the upgrade file
+            }
+
+            retVal = (mpTransport->IsWindowOpen() ? HidDfuQueueMsg(dataReq) : HidDfuSendMsg(dataReq));
+            mOctetsToSend -= readLength;
+            SetThroughput(mCurrentDataOffset, mDataSendTime.uduration());
+            if ((retVal == HIDDFU_ERROR_NONE) && (mResumePoint == UPGRADE_RESUME_POINT_START))
+            {
+                RecordJournal(mResumePoint);
+            }
+
+            // Without the window each report is accepted, and the fixed delay
+            // passes, before the next is sent
+            if ((mOctetsToSend == 0) || !mDataWindowed)
+            {
+                mWaitTime = StopWatch();
+                mUpgradeStep = STEP_DATA_FLUSH;
+            }
+            else if (++reportsSent == CHidTransport::MAX_WINDOW)
+            {
+                aWaitMs = 0;
+                aWaiting = true;
+            }
+        }
     }
 
     return retVal;
 }
-
 ////////////////////////////////////////////////////////////////////////////////
 
 int32 CHidDfuDeviceApplication::SendUpgradeErrorResp(uint16 aErrorCode)
@@ -1459,7 +1037,7 @@ int32 CHidDfuDeviceApplication::SendUpgradeErrorResp(uint16 aErrorCode)
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    CUpgradeErrorRes errorResp(mOutputReportLenBytes);
+    CUpgradeErrorRes errorResp(mOutputReport.data(), mOutputReportLenBytes);
 
     errorResp.SetErrorCode(aErrorCode);
 
@@ -1487,13 +1065,13 @@ int32 CHidDfuDeviceApplication::SendUpgradeHostVersionReq(uint16 &aVersionMajor,
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    CUpgradeHostVersionReq hostVersionReq(mOutputReportLenBytes);
+    CUpgradeHostVersionReq hostVersionReq(mOutputReport.data(), mOutputReportLenBytes);
 
     retVal = HidDfuSendMsg(hostVersionReq);
 
     if (retVal == HIDDFU_ERROR_NONE)
     {
-        uint8 *pResponseBuf = new uint8[mInputReportLenBytes];
+        uint8 *pResponseBuf = mInputReport.data();
         retVal = ReadResponse(pResponseBuf, UPGRADE_HOST_VERSION_CFM, mHostState);
 
         if (retVal == HIDDFU_ERROR_NONE)
@@ -1503,8 +1081,6 @@ int32 CHidDfuDeviceApplication::SendUpgradeHostVersionReq(uint16 &aVersionMajor,
             aVersionMinor = msg.GetVersionMinor();
             aConfigVersion = msg.GetConfigVersion();
         }
-
-        delete[] pResponseBuf;
     }
 
     return retVal;
@@ -1517,40 +1093,12 @@ int32 CHidDfuDeviceApplication::SendUpgradeIsImageValidDoneReq()
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    CUpgradeIsValidationDoneReq validationReq(mOutputReportLenBytes);
+    CUpgradeIsValidationDoneReq validationReq(mOutputReport.data(), mOutputReportLenBytes);
 
     HidDfuSendMsg(validationReq);
 
-    if(retVal == HIDDFU_ERROR_NONE)
-    {
-        uint8 *pResponseBuf = new uint8[mInputReportLenBytes];
-
-        // Response can be UPGRADE_IS_VALIDATION_DONE_CFM or UPGRADE_TRANSFER_COMPLETE_IND,
-        retVal = ReadResponse(pResponseBuf, UPGRADE_TRANSFER_COMPLETE_IND, STATE_UPGRADE_DATA_VALIDATED);
-
-        if ((retVal == HIDDFU_ERROR_NONE) && (pResponseBuf[2] == UPGRADE_TRANSFER_COMPLETE_IND))
-        {
-            mResumePoint = UPGRADE_RESUME_POINT_PRE_REBOOT;
-        }
-        else
-        {
-            // If it is UPGRADE_IS_VALIDATION_DONE_CFM we need to send UPGRADE_IS_VALIDATION_DONE_REQ again
-            if (mHostState != STATE_UPGRADE_DATA_VALIDATED)
-            {
-                if (pResponseBuf[2] == UPGRADE_IS_VALIDATION_DONE_CFM)
-                {
-                    CUpgradeIsValidationDoneCfm isValidationDoneCfm(pResponseBuf, mInputReportLenBytes);
-                    mDelayInValidation = isValidationDoneCfm.GetDelayTime();
-                    mHostState = STATE_UPGRADE_DATA_VALIDATING;
-                }
-            }
-        }
-        delete[] pResponseBuf;
-    }
-
     return retVal;
 }
-
 ////////////////////////////////////////////////////////////////////////////////
 
 int32 CHidDfuDeviceApplication::SendUpgradeProceedToCommit()
@@ -1558,7 +1106,7 @@ int32 CHidDfuDeviceApplication::SendUpgradeProceedToCommit()
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    CUpgradeProceedToCommit commitReq(mOutputReportLenBytes);
+    CUpgradeProceedToCommit commitReq(mOutputReport.data(), mOutputReportLenBytes);
 
     // Action
     // 0x00  Proceed  0x01  Do not proceed 
@@ -1567,16 +1115,8 @@ int32 CHidDfuDeviceApplication::SendUpgradeProceedToCommit()
 
     retVal = HidDfuSendMsg(commitReq);
 
-    if(retVal == HIDDFU_ERROR_NONE)
-    {
-        uint8 *pResponseBuf = new uint8[mInputReportLenBytes];
-        retVal = ReadResponse(pResponseBuf, UPGRADE_COMMIT_REQ, STATE_UPGRADE_COMMIT_VERIFICATION);
-        delete[] pResponseBuf;
-    }
-
     return retVal;
 }
-
 ////////////////////////////////////////////////////////////////////////////////
 
 int32 CHidDfuDeviceApplication::SendUpgradeStartDataReq()
@@ -1584,7 +1124,7 @@ int32 CHidDfuDeviceApplication::SendUpgradeStartDataReq()
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    CUpgradeStartDataReq startDataReq(mOutputReportLenBytes);
+    CUpgradeStartDataReq startDataReq(mOutputReport.data(), mOutputReportLenBytes);
 
     retVal = HidDfuSendMsg(startDataReq);
 
@@ -1603,33 +1143,88 @@ int32 CHidDfuDeviceApplication::SendUpgradeStartReq()
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    CUpgradeStartReq startReq(mOutputReportLenBytes);
+    CUpgradeStartReq startReq(mOutputReport.data(), mOutputReportLenBytes);
 
     retVal = HidDfuSendMsg(startReq);
 
+    return retVal;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuDeviceApplication::SendUpgradeSyncReq()
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    CUpgradeSyncReq syncReq(mOutputReport.data(), mOutputReportLenBytes);
+
+    syncReq.SetFileIdentifier(FILE_ID);
+
+    retVal = HidDfuSendMsg(syncReq);
+
+    return retVal;
+}
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuDeviceApplication::SendUpgradeTransferCompleteResp()
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    CUpgradeTransferCompleteRes transferCmpltRsp(mOutputReport.data(), mOutputReportLenBytes);
+
+    // Action
+    // 0x00  Proceed  0x01  Do not proceed 
+    uint8 action = 0x00;
+    transferCmpltRsp.SetAction(action);
+
+    retVal = HidDfuSendMsg(transferCmpltRsp);
+
     if(retVal == HIDDFU_ERROR_NONE)
     {
-        uint8 *pResponseBuf = new uint8[mInputReportLenBytes];
-        retVal = ReadResponse(pResponseBuf, UPGRADE_START_CFM, STATE_UPGRADE_DATA_READY);
+        SetHostState(STATE_UPGRADE_IDLE);
+    }
 
-        if ((retVal == HIDDFU_ERROR_NONE) && (mResumePoint == UPGRADE_RESUME_POINT_POST_REBOOT))
-        {
-            SetHostState(STATE_UPGRADE_COMMIT_HOST_CONTINUE);
-        }
+    return retVal;
+}
 
-        CUpgradeStartCfm msg(pResponseBuf, mInputReportLenBytes);
-        if (msg.GetUpgradeMsgSize() != 0)
-        {
-            if (msg.GetStatus() != 0x00)    // 0x00  Success  0x01  Failure
-            {
-                retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UPGRADE_FAILED,
-                        "Status failure in UPGRADE_START_CFM");
-            }
+////////////////////////////////////////////////////////////////////////////////
 
-            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "UPGRADE_START_CFM status = 0x%0x", msg.GetStatus());
-        }
+void CHidDfuDeviceApplication::SetHostState(HostUpgradeState aNewHostState)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, 
+            "New HostState: 0x%x  Old HostState: 0x%x ", aNewHostState, mHostState);
+    mHostState = aNewHostState;
+}
 
-        delete[] pResponseBuf;
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuDeviceApplication::StartDataRequest()
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    if (mRequestedBytes == 0)
+    {
+        retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Requested data size is 0, unhandled.");
+    }
+    else
+    {
+        // Move to the 'requested data offset' received from device in UPGRADE_DATA_BYTES_REQ message
+        // (this is relative to the end of the data last sent)
+        mImageOffset += mRequestedDataOffset;
+        mOctetsToSend = mRequestedBytes;
+
+        // The device has acknowledged the data before this request
+        RecordJournal(UPGRADE_RESUME_POINT_START);
+
+        // Reports are kept in flight while the device accepts them promptly. After
+        // a stall the rest of this request waits for each report and the fixed delay.
+        mDataWindowed = ((mDataWindow > 0) && mpTransport->IsWindowOpen());
+        mWindowWaiting = false;
+        mUpgradeStep = STEP_DATA;
     }
 
     return retVal;
@@ -1637,95 +1232,639 @@ int32 CHidDfuDeviceApplication::SendUpgradeStartReq()
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int32 CHidDfuDeviceApplication::SendUpgradeSyncReq()
+int32 CHidDfuDeviceApplication::StartUpgradeData()
 {
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    CUpgradeSyncReq syncReq(mOutputReportLenBytes);
+    // Map the file, unless an image shared with other devices has been given
+    if (!mpUpgradeImage || mpUpgradeImage->GetFileName() != mFileName)
+    {
+        std::shared_ptr<CUpgradeImage> pImage(new CUpgradeImage);
+        retVal = pImage->Open(mFileName, mLastDevError);
+        if (retVal == HIDDFU_ERROR_NONE)
+        {
+            mpUpgradeImage = pImage;
+        }
+    }
+    mImageOffset = 0;
+    mCurrentDataOffset = 0;
+    mOctetsToSend = 0;
+    mDataSendTime = StopWatch();
+
+    // Open the device for windowed writes, so that a step never waits for
+    // the device to accept a report. Without a data window it holds a single
+    // report, and the data is sent with a fixed delay between reports.
+    if (retVal == HIDDFU_ERROR_NONE)
+    {
+        const bool opened = mpTransport->OpenWindow(mOutputReportLenBytes, (mDataWindow > 0 ? mDataWindow : 1));
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Data window %u, open error %u", mDataWindow,
+            (opened ? 0 : mpTransport->GetError()));
+    }
 
-    syncReq.SetFileIdentifier(FILE_ID);
+    return retVal;
+}
 
-    retVal = HidDfuSendMsg(syncReq);
+////////////////////////////////////////////////////////////////////////////////
 
-    if(retVal == HIDDFU_ERROR_NONE)
+void CHidDfuDeviceApplication::RecordJournal(UpgradeResumePoint aResumePoint)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    if (mpJournal && ((aResumePoint != UPGRADE_RESUME_POINT_START)
+        || (mImageOffset >= mJournalOffset + JOURNAL_INTERVAL)))
+    {
+        mpJournal->Record(mParentId, static_cast<uint8>(aResumePoint), mImageOffset);
+        mJournalOffset = mImageOffset;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidDfuDeviceApplication::StepDeviceUpgrade(uint32 &aWaitMs, int32 &aResult)
+{
+    bool running = true;
+    FUNCTION_DEBUG_SENTRY_RET(bool, running);
+
+    int32 retVal = HIDDFU_ERROR_NONE;
+    bool waiting = false;
+    bool received = false;
+
+    // Steps follow each other in this call until one has to wait for the device
+    while (running && !waiting)
     {
-        uint8 *pResponseBuf = new uint8[mInputReportLenBytes];
+        if ((mUpgradeStep != STEP_END) && !CheckKeepGoing())
+        {
+            mUpgradeStep = STEP_END;
+        }
+
+        switch (mUpgradeStep)
+        {
+        case STEP_BEGIN:
+            // Time duration for which host will wait for the device
+            mWaitTimeMs = GetEnvVariable("HID_WAIT_TIME_MS", 70000);
+
+            // Fixed delay between data reports, and the wait for a free window
+            // buffer after which the device is treated as stalled
+            mDataSendWaitMs = GetEnvVariable("HID_DATA_SEND_WAIT_TIME_MS", 2);
+            mStallTimeMs = GetEnvVariable("HID_DATA_STALL_TIME_MS", 50);
+
+            // Time duration during which host can send a data validation request(s)
+            mValidationTimeMs = GetEnvVariable("HID_VALIDATION_TIME_MS", 60000);
+
+            // Wait (in milliseconds) time after data validation has completed and device is rebooting
+            // before attempting to reconnect
+            mRestartDelayMs = GetEnvVariable("HID_RESTART_DELAY_SEC", RESTART_DELAY_SEC) * 1000;
+
+            mRebooted = false;
+
+            // An upgrade recorded in the journal is resumed from the device's
+            // resume point, instead of being aborted
+            mJournalResume = false;
+            mJournalOffset = 0;
+            if (mpJournal)
+            {
+                uint8 resumePoint = 0;
+                uint64 offset = 0;
+                mJournalResume = mpJournal->Find(mParentId, resumePoint, offset);
+                if (mJournalResume)
+                {
+                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Resuming upgrade, journal resume point %u, offset %u",
+                        resumePoint, static_cast<uint32>(offset));
+                }
+            }
+
+            mUpgradeStep = STEP_CONNECT;
+            break;
+
+        case STEP_CONNECT:
+            if (mHostState == STATE_UPGRADE_IDLE)
+            {
+                mReconnecting = false;
+                retVal = WriteConnectionReq();
+                WaitForResponse(STEP_CONNECTION_RSP);
+            }
+            else
+            {
+                mUpgradeStep = STEP_ABORT;
+            }
+            break;
+
+        case STEP_CONNECTION_RSP:
+            retVal = PollReceiveMsg(mInputReport.data(), received, aWaitMs);
+            waiting = !received;
+            if ((retVal == HIDDFU_ERROR_NONE) && received)
+            {
+                bool reconnect = false;
+                retVal = HandleConnectionRsp(mReconnecting, reconnect);
+                if ((retVal == HIDDFU_ERROR_NONE) && reconnect)
+                {
+                    // Send Disconnect, then Connect again
+                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Attempt to reconnect");
+                    retVal = SendDisconnectionReq();
+                    if (retVal == HIDDFU_ERROR_NONE)
+                    {
+                        mReconnecting = true;
+                        retVal = WriteConnectionReq();
+                        WaitForResponse(STEP_CONNECTION_RSP);
+                    }
+                }
+                else
+                {
+                    mUpgradeStep = STEP_ABORT;
+                }
+            }
+            break;
+
+        case STEP_ABORT:
+            // Reset state, unless the device holds part of the image to resume from
+            if ((mResumePoint == UPGRADE_RESUME_POINT_START) && (mHostState == STATE_UPGRADE_CONNECT)
+                && !mJournalResume)
+            {
+                retVal = SendUpgradeAbortReq();
+                WaitForResponse(STEP_ABORT_CFM);
+            }
+            else
+            {
+                mUpgradeStep = STEP_SYNC;
+            }
+            break;
+
+        case STEP_ABORT_CFM:
+            retVal = PollResponse(UPGRADE_ABORT_CFM, STATE_UPGRADE_IDLE, received, aWaitMs);
+            waiting = !received;
+            if (received)
+            {
+                // Reset State, because we just forced it to abort
+                if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_IDLE))
+                {
+                    SetHostState(STATE_UPGRADE_CONNECT);
+                }
+                mUpgradeStep = STEP_SYNC;
+            }
+            break;
+
+        case STEP_SYNC:
+            if (mHostState == STATE_UPGRADE_CONNECT)
+            {
+                retVal = SendUpgradeSyncReq();
+                WaitForResponse(STEP_SYNC_CFM);
+            }
+            else
+            {
+                mUpgradeStep = STEP_START;
+            }
+            break;
+
+        case STEP_SYNC_CFM:
+            retVal = PollResponse(UPGRADE_SYNC_CFM, STATE_UPGRADE_READY, received, aWaitMs);
+            waiting = !received;
+            if (received)
+            {
+                retVal = HandleUpgradeSyncCfm(retVal);
+                mUpgradeStep = STEP_START;
+            }
+            break;
+
+        case STEP_START:
+            if (mHostState == STATE_UPGRADE_READY)
+            {
+                retVal = SendUpgradeStartReq();
+                WaitForResponse(STEP_START_CFM);
+            }
+            else
+            {
+                mUpgradeStep = STEP_SEQUENCE_DONE;
+            }
+            break;
+
+        case STEP_START_CFM:
+            retVal = PollResponse(UPGRADE_START_CFM, STATE_UPGRADE_DATA_READY, received, aWaitMs);
+            waiting = !received;
+            if (received)
+            {
+                retVal = HandleUpgradeStartCfm(retVal);
+                mUpgradeStep = STEP_SEQUENCE_DONE;
+            }
+            break;
 
-        retVal = ReadResponse(pResponseBuf, UPGRADE_SYNC_CFM, STATE_UPGRADE_READY);
+        case STEP_SEQUENCE_DONE:
+            // Before the reboot the data is sent, unless the device has it already.
+            // After the reboot the new image is committed.
+            if (!mRebooted && mJournalResume && (mResumePoint != UPGRADE_RESUME_POINT_START))
+            {
+                // A resumed upgrade continues from the point the device had reached
+                if (mResumePoint == UPGRADE_RESUME_POINT_PRE_VALIDATE)
+                {
+                    SetHostState(STATE_UPGRADE_DATA_VALIDATION);
+                    mUpgradeStep = STEP_VALIDATE;
+                }
+                else if (mResumePoint == UPGRADE_RESUME_POINT_PRE_REBOOT)
+                {
+                    SetHostState(STATE_UPGRADE_DATA_VALIDATED);
+                    mUpgradeStep = STEP_TRANSFER_COMPLETE;
+                }
+                else
+                {
+                    mUpgradeStep = (mResumePoint == UPGRADE_RESUME_POINT_POST_REBOOT ? STEP_PROCEED_TO_COMMIT : STEP_END);
+                }
+            }
+            else if (!mRebooted)
+            {
+                mUpgradeStep = (mResumePoint == UPGRADE_RESUME_POINT_START ? STEP_START_DATA : STEP_FIND_DEVICE);
+            }
+            else
+            {
+                mUpgradeStep = (mResumePoint == UPGRADE_RESUME_POINT_POST_REBOOT ? STEP_PROCEED_TO_COMMIT : STEP_END);
+            }
+            break;
+
+        case STEP_START_DATA:
+            if (mHostState == STATE_UPGRADE_DATA_READY)
+            {
+                retVal = SendUpgradeStartDataReq();
+            }
+            mUpgradeStep = STEP_DATA_TRANSFER;
+            break;
+
+        case STEP_DATA_TRANSFER:
+            if (mHostState == STATE_UPGRADE_DATA_TRANSFER)
+            {
+                SetOperationState(HIDDFU_DEVICE_STATE_TRANSFERRING);
+                retVal = StartUpgradeData();
+                WaitForResponse(STEP_DATA_BYTES_REQ);
+            }
+            else
+            {
+                mUpgradeStep = STEP_VALIDATE;
+            }
+            break;
+
+        case STEP_DATA_BYTES_REQ:
+            if (mResumePoint == UPGRADE_RESUME_POINT_PRE_VALIDATE)
+            {
+                // All the data has been sent
+                mpTransport->CloseWindow();
+                mUpgradeStep = STEP_VALIDATE;
+                received = false;
+            }
+            else
+            {
+                retVal = PollResponse(UPGRADE_DATA_BYTES_REQ, STATE_UPGRADE_DATA_TRANSFERRING, received, aWaitMs);
+                waiting = !received;
+            }
+
+            if (received)
+            {
+                CUpgradeDataBytesReq msg(mInputReport.data(), mInputReportLenBytes);
+
+                if ((msg.GetUpgradeMsgSize() != 0) && (retVal == HIDDFU_ERROR_NONE))
+                {
+                    mRequestedBytes = msg.GetNumberOfBytes();
+                    mRequestedDataOffset = msg.GetStartOffset();
+                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC,
+                            "mRequestedBytes: 0x%x mRequestedDataOffset: 0x%x",
+                            mRequestedBytes, mRequestedDataOffset);
+                }
+
+                if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_DATA_TRANSFERRING))
+                {
+                    retVal = StartDataRequest();
+                }
+                else
+                {
+                    WaitForResponse(STEP_DATA_BYTES_REQ);
+                }
+            }
+            break;
 
-        CUpgradeSyncCfm msg(pResponseBuf, mInputReportLenBytes);
-        if(msg.GetUpgradeMsgSize() != 0)
+        case STEP_DATA:
+            retVal = SendUpgradeData(waiting, aWaitMs);
+            break;
+
+        case STEP_DATA_FLUSH:
+            // The device must have all the data before the next message is read
+            // or sent on the main handle
+            if (mpTransport->IsWindowOpen())
+            {
+                const CHidTransport::Result result = mpTransport->FlushWindow(0);
+                if (result == CHidTransport::RESULT_TIMEOUT)
+                {
+                    retVal = CheckWaitTime(aWaitMs);
+                    waiting = true;
+                }
+                else
+                {
+                    retVal = GetWriteError(result);
+                }
+            }
+
+            if (!waiting)
+            {
+                if (mOctetsToSend > 0)
+                {
+                    WaitForDelay(STEP_DATA, mDataSendWaitMs);
+                }
+                else
+                {
+                    WaitForResponse(STEP_DATA_BYTES_REQ);
+                }
+            }
+            break;
+
+        case STEP_VALIDATE:
+            if (mHostState == STATE_UPGRADE_DATA_VALIDATION)
+            {
+                SetOperationState(HIDDFU_DEVICE_STATE_VALIDATING);
+                RecordJournal(UPGRADE_RESUME_POINT_PRE_VALIDATE);
+                mValidationTime = StopWatch();
+                mUpgradeStep = STEP_VALIDATION_REQ;
+            }
+            else
+            {
+                mUpgradeStep = STEP_TRANSFER_COMPLETE;
+            }
+            break;
+
+        case STEP_VALIDATION_REQ:
+            retVal = SendUpgradeIsImageValidDoneReq();
+            WaitForResponse(STEP_VALIDATION_CFM);
+            break;
+
+        case STEP_VALIDATION_CFM:
+            // Response can be UPGRADE_IS_VALIDATION_DONE_CFM or UPGRADE_TRANSFER_COMPLETE_IND,
+            retVal = PollResponse(UPGRADE_TRANSFER_COMPLETE_IND, STATE_UPGRADE_DATA_VALIDATED, received, aWaitMs);
+            waiting = !received;
+            if (received)
+            {
+                retVal = HandleUpgradeIsValidationDoneCfm(retVal);
+
+                if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_DATA_VALIDATING)
+                    && (mValidationTime.duration() < mValidationTimeMs))
+                {
+                    // Send the data validation request again
+                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Wait(%d milliseconds) for validation", mDelayInValidation);
+                    AddRetry();
+                    WaitForDelay(STEP_VALIDATION_REQ, mDelayInValidation);
+                }
+                else if ((retVal == HIDDFU_ERROR_NONE) && (mHostState != STATE_UPGRADE_DATA_VALIDATED))
+                {
+                    retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UPGRADE_FAILED, "Device failed to validate data");
+                }
+                else
+                {
+                    mUpgradeStep = STEP_TRANSFER_COMPLETE;
+                }
+            }
+            break;
+
+        case STEP_TRANSFER_COMPLETE:
+            if (mHostState == STATE_UPGRADE_DATA_VALIDATED)
+            {
+                // Watched for before the device is told to reboot, so that
+                // it cannot be added back unnoticed
+                mArrivalWatched = WatchArrival(mParentId, mVid, mPid);
+                retVal = SendUpgradeTransferCompleteResp();
+            }
+
+            // Wait for reboot
+            if ((retVal == HIDDFU_ERROR_NONE) && (mHostState == STATE_UPGRADE_IDLE))
+            {
+                // Close the device, it is found again after reboot
+                SetOperationState(HIDDFU_DEVICE_STATE_REBOOTING);
+                RecordJournal(UPGRADE_RESUME_POINT_POST_REBOOT);
+                retVal = DisconnectDevice();
+
+                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Wait(%s%d seconds) for device to reboot",
+                    (mArrivalWatched ? "up to " : ""), mRestartDelayMs/1000);
+                WaitForDelay(STEP_FIND_DEVICE, mRestartDelayMs);
+            }
+            else
+            {
+                mUpgradeStep = STEP_FIND_DEVICE;
+            }
+            break;
+
+        case STEP_FIND_DEVICE:
         {
-            mResumePoint = static_cast<UpgradeResumePoint>(msg.GetResumePoint());
+            // Find the device again after restart, under the same USB device, and sets Device Path
+            std::string oldDevicePath = mDevicePath;
+            mDevicePath.clear();
+
+            const uint32 waitedMs = mWaitTime.duration();
+            if (CHidTransport::FindDevice(mParentId, mVid, mPid, mUsage, mUsagePage, mDevicePath))
+            {
+                if (oldDevicePath.compare(mDevicePath))
+                {
+                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Device Path changed after restart");
+                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Old Device Path: %s", oldDevicePath.c_str());
+                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "New Device Path: %s", mDevicePath.c_str());
+                }
 
-            // Compare file identifier
-            if (FILE_ID != msg.GetFileIdentifier())
+                mReconnectAttempt = 1;
+                mUpgradeStep = STEP_RECONNECT;
+            }
+            else if (mArrivalWatched && (waitedMs < mDelayMs))
+            {
+                // A different device was added, wait the rest of the time for this one
+                mDevicePath = oldDevicePath;
+                WaitForDelay(STEP_FIND_DEVICE, mDelayMs - waitedMs);
+            }
+            else
             {
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "UPGRADE_START_CFM Expected File Id = 0x%0x, received File Id =0x%x", FILE_ID, msg.GetFileIdentifier());
+                std::ostringstream errorStr;
+                errorStr << "Failed to find device after restart under " << mParentId;
+                retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UPGRADE_FAILED, errorStr.str());
+            }
+            break;
+        }
 
-                retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UPGRADE_FAILED,
-                    "Unexpected File Identifier in UPGRADE_SYNC_CFM");
+        case STEP_RECONNECT:
+            // After reboot, connect to use new image
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "[Attempt: %d], DevicePath: %s", mReconnectAttempt,
+                mDevicePath.c_str());
+            retVal = HidConnect();
+            if (retVal == HIDDFU_ERROR_NONE)
+            {
+                SetOperationState(HIDDFU_DEVICE_STATE_COMMITTING);
+                mRebooted = true;
+                mUpgradeStep = STEP_CONNECT;
+            }
+            else if (mReconnectAttempt < (mArrivalWatched ?
+                MAX_RECONNECT_ATTEMPTS * (RECONNECT_DELAY_MS / ARRIVAL_RECONNECT_DELAY_MS) : MAX_RECONNECT_ATTEMPTS))
+            {
+                // Once the device has been added back, it is tried again
+                // sooner, or when it is added again (e.g. once udev has set
+                // up the node)
+                const uint32 delayMs = (mArrivalWatched ? ARRIVAL_RECONNECT_DELAY_MS : RECONNECT_DELAY_MS);
+                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Wait(%u ms)", delayMs);
+                AddRetry();
+                ++mReconnectAttempt;
+                retVal = HIDDFU_ERROR_NONE;
+                WaitForDelay(STEP_RECONNECT, delayMs);
             }
+            break;
 
-            if (((mResumePoint == UPGRADE_RESUME_POINT_START)
-                    || (mResumePoint == UPGRADE_RESUME_POINT_POST_REBOOT))
-                    && (retVal == HIDDFU_ERROR_NONE))
+        case STEP_PROCEED_TO_COMMIT:
+            if (mHostState == STATE_UPGRADE_COMMIT_HOST_CONTINUE)
             {
-                SetHostState(STATE_UPGRADE_READY);
+                retVal = SendUpgradeProceedToCommit();
+                WaitForResponse(STEP_COMMIT_REQ);
             }
             else
             {
-                SetHostState(STATE_UPGRADE_IDLE);
-                retVal = mLastDevError.SetMsg(HIDDFU_ERROR_UPGRADE_FAILED,
-                        "Unexpected resume point in UPGRADE_SYNC_CFM");
+                mUpgradeStep = STEP_COMMIT;
             }
+            break;
 
-            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "UPGRADE_START_CFM mResumePoint = 0x%0x", mResumePoint);
+        case STEP_COMMIT_REQ:
+            retVal = PollResponse(UPGRADE_COMMIT_REQ, STATE_UPGRADE_COMMIT_VERIFICATION, received, aWaitMs);
+            waiting = !received;
+            if (received)
+            {
+                mUpgradeStep = STEP_COMMIT;
+            }
+            break;
+
+        case STEP_COMMIT:
+            if (mHostState == STATE_UPGRADE_COMMIT_VERIFICATION)
+            {
+                retVal = SendUpgradeCommitCfm();
+                WaitForResponse(STEP_COMPLETE_IND);
+            }
+            else
+            {
+                mUpgradeStep = STEP_DISCONNECT;
+            }
+            break;
+
+        case STEP_COMPLETE_IND:
+            retVal = PollResponse(UPGRADE_COMPLETE_IND, STATE_UPGRADE_COMMIT, received, aWaitMs);
+            waiting = !received;
+            if ((retVal == HIDDFU_ERROR_NONE) && received)
+            {
+                // Upgrade process is complete, there is nothing left to resume
+                mResumePoint = UPGRADE_RESUME_POINT_POST_COMMIT;
+                if (mpJournal)
+                {
+                    mpJournal->Remove(mParentId);
+                }
+                mUpgradeStep = STEP_DISCONNECT;
+            }
+            break;
+
+        case STEP_DISCONNECT:
+            SendDisconnectionReq();
+            mUpgradeStep = STEP_END;
+            break;
+
+        case STEP_DELAY:
+        {
+            // The task may be woken before the delay has passed. Waiting for
+            // the device to reboot ends once it has been added back.
+            const uint32 delayedMs = mWaitTime.duration();
+            const bool arrived = mArrivalWatched && TakeArrival();
+            if ((delayedMs < mDelayMs) && !arrived)
+            {
+                aWaitMs = mDelayMs - delayedMs;
+                waiting = true;
+            }
+            else
+            {
+                mUpgradeStep = mDelayNextStep;
+            }
+            break;
         }
 
-        delete[] pResponseBuf;
+        case STEP_END:
+        default:
+            // If stopped, and the device is not rebooting, send a 'Disconnect Request'.
+            // The device is closed while it reboots.
+            if (!CheckKeepGoing() && Connected())
+            {
+                SendDisconnectionReq();
+            }
+
+            mpTransport->CloseWindow();
+
+            if (mArrivalWatched)
+            {
+                UnwatchArrival();
+                mArrivalWatched = false;
+            }
 
+            // Release the upgrade image, the mapping is closed when no device holds it
+            mpUpgradeImage.reset();
+            mpJournal.reset();
+
+            aResult = retVal;
+            mUpgradeStep = STEP_BEGIN;
+            running = false;
+            break;
+        }
+
+        if (running && (retVal != HIDDFU_ERROR_NONE))
+        {
+            waiting = false;
+            mUpgradeStep = STEP_END;
+        }
     }
 
-    return retVal;
+    return running;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int32 CHidDfuDeviceApplication::SendUpgradeTransferCompleteResp()
+void CHidDfuDeviceApplication::WaitForDelay(UpgradeStep aStep, uint32 aDelayMs)
 {
-    int32 retVal = HIDDFU_ERROR_NONE;
-    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
-
-    CUpgradeTransferCompleteRes transferCmpltRsp(mOutputReportLenBytes);
+    FUNCTION_DEBUG_SENTRY;
 
-    // Action
-    // 0x00  Proceed  0x01  Do not proceed 
-    uint8 action = 0x00;
-    transferCmpltRsp.SetAction(action);
+    mDelayNextStep = aStep;
+    mDelayMs = aDelayMs;
+    mWaitTime = StopWatch();
+    mUpgradeStep = STEP_DELAY;
+}
 
-    retVal = HidDfuSendMsg(transferCmpltRsp);
+////////////////////////////////////////////////////////////////////////////////
 
-    if(retVal == HIDDFU_ERROR_NONE)
-    {
-        SetHostState(STATE_UPGRADE_IDLE);
-    }
+void CHidDfuDeviceApplication::WaitForResponse(UpgradeStep aStep)
+{
+    FUNCTION_DEBUG_SENTRY;
 
-    return retVal;
+    mWaitTime = StopWatch();
+    mUpgradeStep = aStep;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void CHidDfuDeviceApplication::SetHostState(HostUpgradeState aNewHostState)
+int32 CHidDfuDeviceApplication::WriteConnectionReq()
 {
-    FUNCTION_DEBUG_SENTRY;
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, 
-            "New HostState: 0x%x  Old HostState: 0x%x ", aNewHostState, mHostState);
-    mHostState = aNewHostState;
-}
+    uint8 *pBuffer = mFeatureReport.data();
+    memset(pBuffer, 0, mFeatureReportLenBytes);
+
+    // Report ID, Size, Command Log, Command High
+    pBuffer[0] = HID_REPORTID_COMMAND;
+    pBuffer[1] = 1;
+    pBuffer[2] = HID_CMD_CONNECTION_REQ;
+
+    MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "SetFeature[...]", pBuffer, mFeatureReportLenBytes);
 
+    // Check state, if idle
+    if (mHostState != STATE_UPGRADE_IDLE)
+    {
+        retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_SEQUENCE);
+    }
+    else if (!mpTransport->SetFeature(pBuffer, mFeatureReportLenBytes))
+    {
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE, 
+                "Failed to send HID_CMD_CONNECTION_REQ", mpTransport->GetError());
+    }
+
+    return retVal;
+}
 ////////////////////////////////////////////////////////////////////////////////
 
 int32 CHidDfuDeviceApplication::WriteToDevice(const uint8* apBuffer, uint32 aLength)
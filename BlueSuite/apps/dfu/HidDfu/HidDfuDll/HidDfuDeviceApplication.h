@@ -15,8 +15,9 @@
 
 #include "HidDfuDevice.h"
 #include "UpgradeProtocol.h"
+#include "time/stop_watch.h"
 
-#include <cfgmgr32.h>
+#include <vector>
 
 ///
 /// Class API for HidDfu Device (Application specific functions).
@@ -25,17 +26,26 @@ class CHidDfuDeviceApplication : public CHidDfuDevice
 {
 public:
     CHidDfuDeviceApplication();
-    CHidDfuDeviceApplication(HANDLE aDeviceHandle,
-        const char *apDevicePath, DEVINST aUsbHubDevInst,
-        uint16 aVid, uint16 aPid, uint16 aUsage, uint16 aUsagePage);
+    CHidDfuDeviceApplication(CHidTransport *apTransport,
+        const CHidTransport::CDeviceInfo &aDeviceInfo);
     ~CHidDfuDeviceApplication();
 
     ///
-    /// Upgrade the device
+    /// Upgrade the device on a thread of its own, not supported: upgrades
+    /// are run as steps on the scheduler.
     /// @return The result.
     ///
     virtual int32 DoDeviceUpgrade();
 
+    ///
+    /// Runs the next step of an upgrade.
+    /// @param[out] aWaitMs Time until the next step.
+    /// @param[out] aResult The result, once the upgrade has finished.
+    /// @return false once the upgrade has finished.
+    /// @see CHidDfuDevice::StepDeviceUpgrade
+    ///
+    virtual bool StepDeviceUpgrade(uint32 &aWaitMs, int32 &aResult);
+
     ///
     /// Backup the device
     /// @return The result.
@@ -80,7 +90,7 @@ public:
 
 private:
 
-    DEVINST mUsbHubDevInst;     //< Device Instance of the top-level device with matchig VID (in USB Tree)
+    std::string mParentId;      //< USB device which the HID interface belongs to, to find it after restart
     uint16 mVid;                //< Vendor ID
     uint16 mPid;                //< Product ID
     uint16 mUsage;              //< USB usage value
@@ -110,14 +120,92 @@ private:
     /// Present state of upgrade on host
     HostUpgradeState mHostState;
 
-    /// Readable Op Codes
-    std::map<UpgradeProtocolOpCode, std::string> mOpCodeMap;
-
-    /// Readable Error Codes
-    std::map<UpgradeProtocolErrorCode, std::string> mErrorCodeMap;
-
-    /// Readable Connection Status
-    std::map<UpgradeStatus, std::string> mConnectionStatusMap;
+    /// Steps of an upgrade run on the scheduler. Each step which sends a
+    /// request is followed by one which reads the response, so that no step
+    /// waits for the device.
+    typedef enum
+    {
+        STEP_BEGIN,                 ///< Read the settings for the upgrade
+        STEP_CONNECT,               ///< Send HID_CMD_CONNECTION_REQ
+        STEP_CONNECTION_RSP,        ///< Read the connection response
+        STEP_ABORT,                 ///< Send UPGRADE_ABORT_REQ to reset the device
+        STEP_ABORT_CFM,             ///< Read UPGRADE_ABORT_CFM
+        STEP_SYNC,                  ///< Send UPGRADE_SYNC_REQ
+        STEP_SYNC_CFM,              ///< Read UPGRADE_SYNC_CFM
+        STEP_START,                 ///< Send UPGRADE_START_REQ
+        STEP_START_CFM,             ///< Read UPGRADE_START_CFM
+        STEP_SEQUENCE_DONE,         ///< Choose the steps after the initial sequence
+        STEP_START_DATA,            ///< Send UPGRADE_START_DATA_REQ
+        STEP_DATA_TRANSFER,         ///< Prepare to send the upgrade image
+        STEP_DATA_BYTES_REQ,        ///< Read UPGRADE_DATA_BYTES_REQ
+        STEP_DATA,                  ///< Send the requested data
+        STEP_DATA_FLUSH,            ///< Wait for the device to accept the data sent
+        STEP_VALIDATE,              ///< Start validation
+        STEP_VALIDATION_REQ,        ///< Send UPGRADE_IS_VALIDATION_DONE_REQ
+        STEP_VALIDATION_CFM,        ///< Read the validation response
+        STEP_TRANSFER_COMPLETE,     ///< Send UPGRADE_TRANSFER_COMPLETE_RES and let the device reboot
+        STEP_FIND_DEVICE,           ///< Find the device after its reboot
+        STEP_RECONNECT,             ///< Open the device after its reboot
+        STEP_PROCEED_TO_COMMIT,     ///< Send UPGRADE_PROCEED_TO_COMMIT
+        STEP_COMMIT_REQ,            ///< Read UPGRADE_COMMIT_REQ
+        STEP_COMMIT,                ///< Send UPGRADE_COMMIT_CFM
+        STEP_COMPLETE_IND,          ///< Read UPGRADE_COMPLETE_IND
+        STEP_DISCONNECT,            ///< Send HID_CMD_DISCONNECT_REQ
+        STEP_DELAY,                 ///< Wait before mDelayNextStep
+        STEP_END                    ///< Clean up and finish
+    } UpgradeStep;
+
+    /// Next step of the upgrade
+    UpgradeStep mUpgradeStep;
+
+    /// Step run after STEP_DELAY
+    UpgradeStep mDelayNextStep;
+
+    /// Time since the step started waiting for the device, or the delay started
+    StopWatch mWaitTime;
+
+    /// Length of the delay of STEP_DELAY
+    uint32 mDelayMs;
+
+    /// Time since validation was first requested
+    StopWatch mValidationTime;
+
+    /// Whether the device has been found again after its reboot
+    bool mRebooted;
+
+    /// Whether the connection request is a reconnection attempt
+    bool mReconnecting;
+
+    /// Whether the journal holds a record of this upgrade of the device,
+    /// which is then resumed rather than aborted
+    bool mJournalResume;
+
+    /// Image offset last recorded in the journal
+    size_t mJournalOffset;
+
+    /// Attempts made to open the device after its reboot
+    uint16 mReconnectAttempt;
+
+    /// Whether the device is watched for being added back to the host after
+    /// its reboot, which ends the wait for the reboot
+    bool mArrivalWatched;
+
+    /// Bytes of the current UPGRADE_DATA_BYTES_REQ still to be sent
+    size_t mOctetsToSend;
+
+    /// Whether upgrade data reports are kept in flight for the current
+    /// request, rather than each waiting for the fixed delay
+    bool mDataWindowed;
+
+    /// Whether a data report is waiting for a free window buffer, since mWaitTime
+    bool mWindowWaiting;
+
+    /// Settings read when the upgrade starts, from the environment
+    uint32 mWaitTimeMs;             //< HID_WAIT_TIME_MS, longest wait for the device
+    uint32 mDataSendWaitMs;         //< HID_DATA_SEND_WAIT_TIME_MS, fixed delay between data reports
+    uint32 mStallTimeMs;            //< HID_DATA_STALL_TIME_MS, window wait after which the device is stalled
+    uint32 mValidationTimeMs;       //< HID_VALIDATION_TIME_MS, longest time for validation
+    uint32 mRestartDelayMs;         //< HID_RESTART_DELAY_SEC, time the device takes to reboot
 
     /// Upgrade resume point
     UpgradeResumePoint mResumePoint;
@@ -134,12 +222,28 @@ private:
     /// Time in ms the host should wait before sending the next UPGRADE_IS_VALIDATION_DONE_REQ message
     uint8 mDelayInValidation;
 
-    /// File handle for binary file
-    FILE *mpFileHandle;
+    /// Offset of the next data to send, within the upgrade image
+    size_t mImageOffset;
 
     /// Unique upgrade file identifier
     static const uint32 FILE_ID = 0x01020304;
 
+    /// Attempts made to open the device after its reboot, and the delay between them
+    static const uint16 MAX_RECONNECT_ATTEMPTS = 10;
+    static const uint32 RECONNECT_DELAY_MS = 2000;
+
+    /// Delay between attempts to open the device once it has been added
+    /// back, as its node may not be ready at once. Attempts are made for
+    /// the same time in all.
+    static const uint32 ARRIVAL_RECONNECT_DELAY_MS = 100;
+
+    /// Longest time spent waiting for a report before checking whether the
+    /// operation has been stopped
+    static const uint32 STOP_CHECK_INTERVAL_MS = 100;
+
+    /// Data sent between updates of the resume journal
+    static const uint32 JOURNAL_INTERVAL = 64 * 1024;
+
     // Size of data blobs that are sent from HID device to the application
     uint8 mInputReportLenBytes;
     // Size of data blobs that are sent from application to the HID device
@@ -147,27 +251,21 @@ private:
     // Size of data blobs (for feature reports) that can be read and/or written (typically related to config info)
     uint8 mFeatureReportLenBytes;
 
-    ///
-    /// Calculate the percentage of data read from file for writing to device.
-    /// @return Progress in percentage.
-    ///
-    uint8 CalculateWriteProgress();
+    /// Report buffers, sized from the HID capabilities on initialisation so
+    /// that no memory is allocated per report. Messages are built and read
+    /// in place in these buffers.
+    std::vector<uint8> mInputReport;    ///< Received message being handled
+    std::vector<uint8> mOutputReport;   ///< Message being sent
+    std::vector<uint8> mFeatureReport;  ///< Command sent as a feature report
 
-    ///
-    /// Get the Device Instance ID
-    /// @param[in] aDevInst Device Instance for the Device to be tested.
-    /// @param[in] aCheck If True, test if the Device has matching VID, PID with a USB Interface.
-    /// @return The result.
-    ///
-    int32 GetDeviceInstanceId(DEVINST aDevInst, bool aCheck = false);
+    /// Time since the first upgrade data was requested, for the throughput
+    StopWatch mDataSendTime;
 
     ///
-    /// Searches for matching HID device in Device Information Set
-    /// and sets the Device Path for connection.
-    /// @param[in] aDevNode Device Node of the device found.
-    /// @return The result.
+    /// Calculate the percentage of the upgrade image sent to the device.
+    /// @return Progress in percentage.
     ///
-    int32 GetDevicePath(DEVNODE aDevNode);
+    uint8 CalculateWriteProgress();
 
     ///
     /// Gets the DFU file length from a file data buffer.
@@ -176,13 +274,6 @@ private:
     ///
     uint32 GetDfuFileLength(const uint8 *apBuffer) const;
 
-    ///
-    /// Get Connection Status as a readable string for logging and error messages.
-    /// @param[in] Connection Status as received from device.
-    /// @return Connection Status String.
-    ///
-    std::string GetConnectionStatusStr(const UpgradeStatus aConnectionStatus) const;
-
     ///
     /// Get the value assigned to environment variable (if available).
     /// @param[in] apEnvVar Environment Variable.
@@ -192,31 +283,47 @@ private:
     uint32 GetEnvVariable(const char *apEnvVar, uint32 aValue) const;
 
     ///
-    /// Get Error Code as a readable string for logging and error messages.
-    /// @param[in] Error Code as received from device.
-    /// @return Error Code String.
+    /// Get the size of the HID report as declared by the device.
+    /// @return The result.
     ///
-    std::string GetErrCodeStr(const UpgradeProtocolErrorCode aErrCode) const;
+    int32 GetSizeOfHidReport();
 
     ///
-    /// Get Op Code as a readable string for logging and error messages.
-    /// @param[in] Upgrade Protocol Op Code.
-    /// @return OpCode String.
+    /// Checks the time left to wait for the device, since mWaitTime started.
+    /// @param[out] aWaitMs Time left to wait.
+    /// @return The result, HIDDFU_ERROR_NO_RESPONSE once HID_WAIT_TIME_MS has passed.
     ///
-    std::string GetOpCodeStr(const UpgradeProtocolOpCode aOpCode) const;
+    int32 CheckWaitTime(uint32 &aWaitMs);
 
     ///
-    /// Get the size of the HID report as declared by the device.
+    /// Handles the connection response in the input report.
+    /// @param[in] aReconnecting Set to true if the request was a reconnection attempt.
+    /// @param[out] aReconnect Set to true if the device is already connected,
+    /// and must be disconnected and connected again.
     /// @return The result.
     ///
-    int32 GetSizeOfHidReport();
+    int32 HandleConnectionRsp(bool aReconnecting, bool &aReconnect);
 
     ///
-    /// Recursive function to search USB tree for matching HID Device.
-    /// @param[in] aDevNode Device Node of the parent device.
+    /// Handles UPGRADE_IS_VALIDATION_DONE_CFM or UPGRADE_TRANSFER_COMPLETE_IND in the input report.
+    /// @param[in] aResult Result of reading the response.
     /// @return The result.
     ///
-    int32 GetSubDevNodesAndDevPath(DEVNODE aDevNode);
+    int32 HandleUpgradeIsValidationDoneCfm(int32 aResult);
+
+    ///
+    /// Handles UPGRADE_START_CFM in the input report.
+    /// @param[in] aResult Result of reading the response.
+    /// @return The result.
+    ///
+    int32 HandleUpgradeStartCfm(int32 aResult);
+
+    ///
+    /// Handles UPGRADE_SYNC_CFM in the input report.
+    /// @param[in] aResult Result of reading the response.
+    /// @return The result.
+    ///
+    int32 HandleUpgradeSyncCfm(int32 aResult);
 
     ///
     /// Handles the message received from device, checks against expected opcode and sends error response if necessary.
@@ -235,8 +342,9 @@ private:
     int32 HidConnect();
 
     ///
-    /// Wrapper function for call to ReadFile.
-    /// @param[in] apBuffer Read buffer.
+    /// Collects the next input report from the report reader, waiting for
+    /// up to HID_WAIT_TIME_MS for the device to send one.
+    /// @param[out] apBuffer Read buffer.
     /// @return The result.
     ///
     int32 HidDfuReceiveMsg(uint8 *apBuffer);
@@ -248,19 +356,39 @@ private:
     ///
     int32 HidDfuSendMsg(const CUpgradeProtocolMsg& aSendToChip);
 
-    /////
-    ///// Read in a timed thread
-    ///// @param[out] apBuffer Read buffer.
-    ///// @param[out] aBytesRead Number of bytes read.
-    ///// @param[out] aReadRetVal The result.
-    /////
-    void Read(uint8 *apBuffer, uint32 &aBytesRead, int32 &aReadRetVal);
+    ///
+    /// Starts writing a message built in a report buffer from the report
+    /// writer, without waiting for the write to complete.
+    /// @param[in] aSendToChip Message for device.
+    /// @return The result.
+    ///
+    int32 HidDfuQueueMsg(const CUpgradeProtocolMsg& aSendToChip);
+
+    ///
+    /// Sets the last error for a windowed write failure.
+    /// @param[in] aResult Result from the transport.
+    /// @return The result.
+    ///
+    int32 GetWriteError(CHidTransport::Result aResult);
 
     ///
-    /// Reads UPGRADE_DATA_BYTES_REQ and runs a loop to send data to device.
+    /// Collects the next input report without waiting, for an upgrade step.
+    /// @param[out] apBuffer Read buffer.
+    /// @param[out] aReceived Set to true if a report was collected.
+    /// @param[out] aWaitMs Time left to wait for the report, if none was collected.
     /// @return The result.
     ///
-    int32 ReadDataBytesReq();
+    int32 PollReceiveMsg(uint8 *apBuffer, bool &aReceived, uint32 &aWaitMs);
+
+    ///
+    /// Reads a response into the input report without waiting, for an upgrade step.
+    /// @param[in] aExpectedOpCode Expected Op Code.
+    /// @param[in] aNewHostState New Host State to set after response is analysed.
+    /// @param[out] aReceived Set to true if a response was read, even if it is an error.
+    /// @param[out] aWaitMs Time left to wait for the response, if none was read.
+    /// @return The result.
+    ///
+    int32 PollResponse(uint8 aExpectedOpCode, HostUpgradeState aNewHostState, bool &aReceived, uint32 &aWaitMs);
 
     ///
     /// Read response from the device.
@@ -286,17 +414,17 @@ private:
     int32 ReConnect();
 
     ///
-    /// Handles the Upgrade Protocol messages send/receive after every connection establishment.
+    /// Send HID connection request (not part of Upgrade Protocol messages).
+    /// @param[in] aReconnecting Set to true if the call is for a reconnection attempt, otherwise false
     /// @return The result.
     ///
-    int32 RunInitialUpgradeSequence();
+    int32 SendConnectionReq(bool aReconnecting = false);
 
     ///
-    /// Send HID connection request (not part of Upgrade Protocol messages).
-    /// @param[in] aReconnecting Set to true if the call is for a reconnection attempt, otherwise false
+    /// Send HID connection request without reading the response.
     /// @return The result.
     ///
-    int32 SendConnectionReq(bool aReconnecting = false);
+    int32 WriteConnectionReq();
 
     ///
     /// Send HID disconnection request (not part of Upgrade Protocol messages).
@@ -305,22 +433,48 @@ private:
     int32 SendDisconnectionReq();
 
     ///
-    /// Send Upgrade Protocol Abort Request.
+    /// Send Upgrade Protocol Abort Request, UPGRADE_ABORT_CFM is read by the upgrade step.
     /// @return The result.
     ///
     int32 SendUpgradeAbortReq();
 
     ///
-    /// Send Upgrade Protocol Commit Confirm.
+    /// Send Upgrade Protocol Commit Confirm, UPGRADE_COMPLETE_IND is read by the upgrade step.
     /// @return The result.
     ///
     int32 SendUpgradeCommitCfm();
 
     ///
-    /// Send Upgrade Protocol Data to device, after reading from binary file.
+    /// Send Upgrade Protocol Data to device, directly from the mapped upgrade
+    /// image, for the STEP_DATA step. With a data window the reports are
+    /// written as fast as the device accepts them, up to a window of reports
+    /// per step, falling back to HID_DATA_SEND_WAIT_TIME_MS between reports
+    /// if the device stalls.
+    /// @param[out] aWaiting Set to true if the step must wait.
+    /// @param[out] aWaitMs Time to wait, 0 to let other devices run first.
+    /// @return The result.
+    ///
+    int32 SendUpgradeData(bool &aWaiting, uint32 &aWaitMs);
+
+    ///
+    /// Starts sending the data asked for by UPGRADE_DATA_BYTES_REQ.
+    /// @return The result.
+    ///
+    int32 StartDataRequest();
+
+    ///
+    /// Maps the upgrade image and opens the data window, for the data transfer.
     /// @return The result.
     ///
-    int32 SendUpgradeData();
+    int32 StartUpgradeData();
+
+    ///
+    /// Records the progress of the upgrade in the resume journal, if there is
+    /// one. The data offset is recorded when it has moved on by
+    /// JOURNAL_INTERVAL, or with a new resume point.
+    /// @param[in] aResumePoint Resume point reached.
+    ///
+    void RecordJournal(UpgradeResumePoint aResumePoint);
 
     ///
     /// Send Upgrade Protocol Error Response.
@@ -339,7 +493,8 @@ private:
     int32 SendUpgradeHostVersionReq(uint16 &aVersionMajor, uint16 &aVersionMinor, uint16 &aConfigVersion);
 
     ///
-    /// Send Upgrade Protocol Image Validation Request to check for completion of the validation process.
+    /// Send Upgrade Protocol Image Validation Request to check for completion
+    /// of the validation process, the response is read by the upgrade step.
     /// @return The result.
     ///
     int32 SendUpgradeIsImageValidDoneReq();
@@ -351,19 +506,20 @@ private:
     int32 SendUpgradeStartDataReq();
 
     ///
-    /// Send Upgrade Protocol Start Request.
+    /// Send Upgrade Protocol Start Request, UPGRADE_START_CFM is read by the upgrade step.
     /// @return The result.
     ///
     int32 SendUpgradeStartReq();
 
     ///
-    /// Send Upgrade Protocol Start Request.to restart the upgrade process.
+    /// Send Upgrade Protocol Sync Request to restart the upgrade process,
+    /// UPGRADE_SYNC_CFM is read by the upgrade step.
     /// @return The result.
     ///
     int32 SendUpgradeSyncReq();
 
     ///
-    /// Send Upgrade Protocol Proceed To Commit message.
+    /// Send Upgrade Protocol Proceed To Commit message, UPGRADE_COMMIT_REQ is read by the upgrade step.
     /// @return The result.
     ///
     int32 SendUpgradeProceedToCommit();
@@ -379,6 +535,20 @@ private:
     /// @param[in] aNewHostState New Host State.
     ///
     void SetHostState(HostUpgradeState aNewHostState);
+
+    ///
+    /// Moves to a step after a delay.
+    /// @param[in] aStep Step to run after the delay.
+    /// @param[in] aDelayMs Delay in milliseconds.
+    ///
+    void WaitForDelay(UpgradeStep aStep, uint32 aDelayMs);
+
+    ///
+    /// Moves to a step which reads the response to a request just sent,
+    /// allowing HID_WAIT_TIME_MS for it.
+    /// @param[in] aStep Step which reads the response.
+    ///
+    void WaitForResponse(UpgradeStep aStep);
 };
 
 #endif // #ifndef HID_DFU_DEVICE_APPLICATION_H
\ No newline at end of file
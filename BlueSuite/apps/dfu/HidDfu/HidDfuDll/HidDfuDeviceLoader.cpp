@@ -12,47 +12,31 @@
 
 #include "HidDfu.h"
 #include "HidDfuDeviceLoader.h"
-#include "DFUEngine/CRC.h"
+#include "BackupWriter.h"
+#include "DfuFile.h"
 #include "time/hi_res_clock.h"
 #include "time/stop_watch.h"
 
 #include <sstream>
 #include <assert.h>
-
-extern "C"
-{
-#include <hidsdi.h>
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-const CHidDfuDeviceLoader::DfuFileSuffix CHidDfuDeviceLoader::STANDARD_DFU_SUFFIX = 
-{
-    0x0001,         // bcdDevice
-    0xFFFE,         // idProduct
-    0x0A12,         // idVendor
-    0x0100,         // bcdDfu
-    {'U','F','D'},  // ucDfuSignature
-    0x10,           // bLength
-    0               // dwCrc - this value is ignored (CRC calculated)
-};
+#include <string.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 
 CHidDfuDeviceLoader::CHidDfuDeviceLoader()
-    : CHidDfuDevice(INVALID_HANDLE_VALUE),
-    mFeatureReportLength(0),
-    mBwPollTimeout(0)
+    : CHidDfuDevice(NULL),
+    mBwPollTimeout(0),
+    mFeatureReportLength(0)
 {
     FUNCTION_DEBUG_SENTRY;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-CHidDfuDeviceLoader::CHidDfuDeviceLoader(HANDLE aDeviceHandle, USHORT aFeatureReportLength)
-    : CHidDfuDevice(aDeviceHandle),
-    mFeatureReportLength(aFeatureReportLength),
-    mBwPollTimeout(0)
+CHidDfuDeviceLoader::CHidDfuDeviceLoader(CHidTransport *apTransport, uint16 aFeatureReportLength)
+    : CHidDfuDevice(apTransport),
+    mBwPollTimeout(0),
+    mFeatureReportLength(aFeatureReportLength)
 {
     FUNCTION_DEBUG_SENTRY;
 }
@@ -80,10 +64,10 @@ void CHidDfuDeviceLoader::AddWriteHeader(uint8 *apBuffer, uint16 aWValue, uint16
     // wLength              2 bytes             total amount of bytes to be written
     apBuffer[0] = DFU_HID_REPORTID_UPGRADE;
     apBuffer[1] = DFU_B_REQUEST;
-    apBuffer[2] = LOBYTE(aWValue);
-    apBuffer[3] = HIBYTE(aWValue);
-    apBuffer[4] = LOBYTE(aWLength);
-    apBuffer[5] = HIBYTE(aWLength);
+    apBuffer[2] = static_cast<uint8>(aWValue & 0xFF);
+    apBuffer[3] = static_cast<uint8>(aWValue >> 8);
+    apBuffer[4] = static_cast<uint8>(aWLength & 0xFF);
+    apBuffer[5] = static_cast<uint8>(aWLength >> 8);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -117,12 +101,13 @@ int32 CHidDfuDeviceLoader::CheckUpgradeComplete(bool aWaitForFullTimeout)
         // the chip may not respond while it is busy writing to flash. If the failure 
         // is for that reason, retry so long as mBwPollTimeout has not been exceeded.
         uint8 status, state;
-        do
+        retVal = GetStatus(&status, &state);
+        while(retVal == HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE && pollTimer.duration() < mBwPollTimeout && 
+            !aWaitForFullTimeout)
         {
+            AddRetry();
             retVal = GetStatus(&status, &state);
         }
-        while(retVal == HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE && pollTimer.duration() < mBwPollTimeout && 
-            !aWaitForFullTimeout);
 
         if (retVal == HIDDFU_ERROR_NONE)
         {
@@ -135,6 +120,7 @@ int32 CHidDfuDeviceLoader::CheckUpgradeComplete(bool aWaitForFullTimeout)
                 {
                     HiResClockSleepMilliSec(mBwPollTimeout - duration);
                 }
+                AddRetry();
 
                 retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_BUSY);
             }
@@ -167,9 +153,9 @@ int32 CHidDfuDeviceLoader::ClearDeviceStatus()
     buffer[0] = DFU_HID_REPORTID_STATE;
     buffer[1] = DFU_CMD_CLRSTATUS;
 
-    if(!HidD_SetFeature(mDeviceHandle, buffer, DFU_HID_REPORTID_STATE_SIZE))
+    if(!mpTransport->SetFeature(buffer, DFU_HID_REPORTID_STATE_SIZE))
     {
-        retVal = SetLastErrorFromWinError(HIDDFU_ERROR_CLEAR_STATUS_FAILED, "Failed to clear device status", ::GetLastError());
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_CLEAR_STATUS_FAILED, "Failed to clear device status", mpTransport->GetError());
     }
 
     return retVal;
@@ -194,16 +180,15 @@ int32 CHidDfuDeviceLoader::DoDeviceBackup()
     {
         mBwPollTimeout = 0;
 
-        uint8 *pBuffer = new uint8[mFeatureReportLength];
-        memset(pBuffer, 0, mFeatureReportLength);
-
         uint32 dataLeftToWrite = 0;
         uint32 dataLength = 0;
-        uint16 replyLength;
+        uint16 replyLength = 0;
+        uint8 *pBuffer = NULL;
 
-        // Open output file
-        FILE *pFile = fopen(mFileName.c_str(), "wb");
-        if (pFile == NULL)
+        // Open output file. The data is written on the writer's thread, while
+        // the next reports are read from the device.
+        CBackupWriter writer;
+        if (!writer.Open(mFileName))
         {
             std::ostringstream msg;
             msg << "Failed to open file \"" << mFileName << "\". File must be writable.";
@@ -212,6 +197,7 @@ int32 CHidDfuDeviceLoader::DoDeviceBackup()
         else
         {
             // Read first chunk of DFU file, this contains the file length
+            pBuffer = writer.GetSpace(mFeatureReportLength);
             retVal = HidReportIdBackup(pBuffer, mFeatureReportLength, &replyLength);
             if (retVal == HIDDFU_ERROR_NONE)
             {
@@ -225,72 +211,57 @@ int32 CHidDfuDeviceLoader::DoDeviceBackup()
             }
         }
 
-        CRC crc;
-
         if (retVal == HIDDFU_ERROR_NONE)
         {
-            // Update CRC
-            crc(pBuffer, replyLength);
-
-            // Write first chunk of data to output file
-            if (fwrite(pBuffer, sizeof(pBuffer[0]), replyLength, pFile) != replyLength)
-            {
-                retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_FILE_WRITE_FAILED);
-            }
-            else
-            {
-                // Decrement the data left to write to the output file 
-                dataLeftToWrite -= replyLength;
-            }
+            // Pass the first chunk of data to the writer, and decrement the
+            // data left to write to the output file
+            writer.Commit(replyLength);
+            dataLeftToWrite -= replyLength;
         }
 
         // Read data from device and copy into output file
+        StopWatch transferTime;
+        SetOperationState(HIDDFU_DEVICE_STATE_TRANSFERRING);
         while ((retVal == HIDDFU_ERROR_NONE && dataLeftToWrite > 0) && KeepGoing())
         {
             // Update progress - this should never get to 100%
             SetProgress(static_cast<uint8>(100 - ((static_cast<float64>(dataLeftToWrite) / dataLength) * 100)));
+            SetThroughput(dataLength - dataLeftToWrite, transferTime.uduration());
 
-            retVal = HidReportIdBackup(pBuffer, mFeatureReportLength, &replyLength);
-            if (retVal == HIDDFU_ERROR_NONE)
+            pBuffer = writer.GetSpace(mFeatureReportLength);
+            if (pBuffer == NULL)
+            {
+                retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_FILE_WRITE_FAILED);
+            }
+            else
             {
-                // Update CRC
-                crc(pBuffer, replyLength);
+                retVal = HidReportIdBackup(pBuffer, mFeatureReportLength, &replyLength);
+            }
 
-                if (fwrite(pBuffer, sizeof(pBuffer[0]), replyLength, pFile) != replyLength)
-                {
-                    retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_FILE_WRITE_FAILED);
-                }
-                else
-                {
-                    dataLeftToWrite -= replyLength;
-                }
+            if (retVal == HIDDFU_ERROR_NONE)
+            {
+                writer.Commit(replyLength);
+                dataLeftToWrite -= replyLength;
             }
         }
 
-        if ((retVal == HIDDFU_ERROR_NONE) && KeepGoing())
+        // Wait for the data to be written, then write the DFU suffix (with the
+        // CRC of the data) and close the file
+        const bool complete = (retVal == HIDDFU_ERROR_NONE) && KeepGoing();
+        if (complete)
         {
-            // Update CRC with DFU file suffix data
-            DfuFileSuffix dfuSuffix = STANDARD_DFU_SUFFIX;
-            crc(&dfuSuffix, DFU_SUFFIX_WITHOUT_CRC_LEN);
-            dfuSuffix.dwCrc = crc();
-
-            // Write DFU suffix data to file
-            if (fwrite(&dfuSuffix, sizeof(uint8), sizeof(DfuFileSuffix), pFile) != sizeof(DfuFileSuffix))
-            {
-                retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_FILE_WRITE_FAILED);
-            }
+            SetThroughput(dataLength, transferTime.uduration());
         }
 
-        // Close file and free buffer
-        if (pFile != NULL)
+        if (!writer.Close(complete) && (retVal == HIDDFU_ERROR_NONE))
         {
-            fclose(pFile);
+            retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_FILE_WRITE_FAILED);
         }
-        delete[] pBuffer;
 
         // Reset the device
         if ((retVal == HIDDFU_ERROR_NONE) && (mResetAfter) && KeepGoing())
         {
+            SetOperationState(HIDDFU_DEVICE_STATE_REBOOTING);
             retVal = ResetDevice(true);
         }
     }
@@ -307,12 +278,15 @@ int32 CHidDfuDeviceLoader::DoDeviceUpgrade()
 
     mBwPollTimeout = 0;
 
-    FILE *pFile = fopen(mFileName.c_str(), "rb");
-    if (pFile == NULL)
+    // Open the file through the same suffix validation as the engine,
+    // then stream it to the device one report at a time
+    CDfuFile dfuFile(mLastDevError);
+    retVal = dfuFile.Open(mFileName);
+
+    if (retVal == HIDDFU_ERROR_NONE && mpDfuIndex &&
+        mpDfuIndex->Matches(dfuFile.GetFileSize(), dfuFile.GetSuffix()))
     {
-        std::ostringstream msg;
-        msg << "Failed to open file \"" << mFileName << "\"";
-        retVal = mLastDevError.SetMsg(HIDDFU_ERROR_FILE_OPEN_FAILED, msg.str());
+        dfuFile.SetIndex(mpDfuIndex.get());
     }
 
     if (!Connected() && (retVal == HIDDFU_ERROR_NONE))
@@ -334,16 +308,12 @@ int32 CHidDfuDeviceLoader::DoDeviceUpgrade()
             memset(pBuffer, 0, mFeatureReportLength);
 
             // Read first block of data from file leaving space at start of buffer for header
-            fread(pBuffer + DFU_HID_FROM_HOST_HEADER_SIZE, sizeof(pBuffer[0]), payloadLength, pFile);
+            retVal = dfuFile.Read(pBuffer + DFU_HID_FROM_HOST_HEADER_SIZE, payloadLength);
 
             int64 fileDataLength = 0;
             int64 dataLeftToWrite = 0;
 
-            if (ferror(pFile))
-            {
-                retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_FILE_READ_FAILED);
-            }
-            else
+            if (retVal == HIDDFU_ERROR_NONE)
             {
                 // Get file length from buffer.
                 // File length does not include DFU suffix which is not written to device
@@ -367,8 +337,11 @@ int32 CHidDfuDeviceLoader::DoDeviceUpgrade()
             }
 
             uint16 blockNumber = 0;
+            StopWatch transferTime;
             if (retVal == HIDDFU_ERROR_NONE)
             {
+                SetOperationState(HIDDFU_DEVICE_STATE_TRANSFERRING);
+
                 // Carry out hid_SetFeature to write block to device
                 retVal = HidSetFeatureWithHeader(payloadLength, pBuffer, &dataLeftToWrite, &blockNumber);
             }
@@ -382,17 +355,13 @@ int32 CHidDfuDeviceLoader::DoDeviceUpgrade()
                 {
                     // Update progress - this should never get to 100%
                     SetProgress(static_cast<uint8>(100 - ((static_cast<float64>(dataLeftToWrite) / fileDataLength) * 100)));
+                    SetThroughput(fileDataLength - dataLeftToWrite, transferTime.uduration());
 
                     // Read first block of data from file leaving space at start of buffer for header
                     memset(pBuffer, 0, mFeatureReportLength);
-                    fread(pBuffer + DFU_HID_FROM_HOST_HEADER_SIZE, sizeof(pBuffer[0]), payloadLength, pFile);
+                    retVal = dfuFile.Read(pBuffer + DFU_HID_FROM_HOST_HEADER_SIZE, payloadLength);
 
-                    // Check for file read error
-                    if (ferror(pFile))
-                    {
-                        retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_FILE_READ_FAILED);
-                    }
-                    else
+                    if (retVal == HIDDFU_ERROR_NONE)
                     {
                         // Carry out hid_SetFeature to write block to device
                         retVal = HidSetFeatureWithHeader(payloadLength, pBuffer, &dataLeftToWrite, &blockNumber);
@@ -403,6 +372,8 @@ int32 CHidDfuDeviceLoader::DoDeviceUpgrade()
             // Check status and complete the upgrade
             if ((retVal == HIDDFU_ERROR_NONE) && KeepGoing())
             {
+                SetThroughput(fileDataLength, transferTime.uduration());
+                SetOperationState(HIDDFU_DEVICE_STATE_COMMITTING);
                 retVal = CheckUpgradeComplete();
 
                 if (retVal == HIDDFU_ERROR_NONE)
@@ -417,14 +388,13 @@ int32 CHidDfuDeviceLoader::DoDeviceUpgrade()
         }
     }
 
-    if (pFile != NULL)
-    {
-        fclose(pFile);
-    }
+    dfuFile.Close();
+    mpDfuIndex.reset();
 
     // Reset the device
     if ((retVal == HIDDFU_ERROR_NONE) && (mResetAfter) && KeepGoing())
     {
+        SetOperationState(HIDDFU_DEVICE_STATE_REBOOTING);
         retVal = ResetDevice(true);
     }
 
@@ -444,10 +414,10 @@ int32 CHidDfuDeviceLoader::EndUpgrade(uint8 *apBuffer, uint16 aBlockNumber)
 
     AddWriteHeader(apBuffer, aBlockNumber, 0);
 
-    if(!HidD_SetFeature(mDeviceHandle, apBuffer, mFeatureReportLength))
+    if(!mpTransport->SetFeature(apBuffer, mFeatureReportLength))
     {
-        retVal = SetLastErrorFromWinError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
-                "Write to device failed attempting to complete upgrade", ::GetLastError());
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
+                "Write to device failed attempting to complete upgrade", mpTransport->GetError());
     }
     else
     {
@@ -507,13 +477,16 @@ int32 CHidDfuDeviceLoader::GetStatus(uint8* apStatus, uint8* apState)
     pBuffer[0] = DFU_HID_REPORTID_STATUS;
 
     // Read status from device
-    if(!HidD_GetFeature(mDeviceHandle, pBuffer, DFU_HID_REPORTID_STATUS_SIZE))
+    StopWatch responseTime;
+    if(!mpTransport->GetFeature(pBuffer, DFU_HID_REPORTID_STATUS_SIZE))
     {
-        retVal = SetLastErrorFromWinError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
-                "Failed to get feature information (GetStatus)", ::GetLastError());
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
+                "Failed to get feature information (GetStatus)", mpTransport->GetError());
     }
     else
     {
+        SetLastLatency(responseTime.uduration());
+
         // Read status, state, and bwPollTimeout fields from reply
         *apStatus = pBuffer[1];
         *apState = pBuffer[5];
@@ -544,7 +517,7 @@ int32 CHidDfuDeviceLoader::HidReportIdBackup(uint8* apBuffer, uint16 aBufferLeng
         memset(pFeatureBuffer, 0, aBufferLength);
         pFeatureBuffer[0] = DFU_HID_REPORTID_UPGRADE;
 
-        if (HidD_GetFeature(mDeviceHandle, pFeatureBuffer, aBufferLength)) 
+        if (mpTransport->GetFeature(pFeatureBuffer, aBufferLength)) 
         {
             // The format of the response is:
             // * 1 byte  - Report ID
@@ -562,10 +535,10 @@ int32 CHidDfuDeviceLoader::HidReportIdBackup(uint8* apBuffer, uint16 aBufferLeng
         }
         else
         {
-            // Since HidD_GetFeature is the first HID API call for backup operation, and fails if the device type is not BlueCore
+            // Since GetFeature is the first HID API call for backup operation, and fails if the device type is not BlueCore
             // and there is no way to detect device type, so display a generic message (by rewriting), and specific details only in the log.
-            SetLastErrorFromWinError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
-                "Failed to get feature information (HidReportIdBackup)", ::GetLastError());
+            SetLastErrorFromOsError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
+                "Failed to get feature information (HidReportIdBackup)", mpTransport->GetError());
             retVal = mLastDevError.SetMsg(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE, "Failed to run backup operation on the connected device.");
         }
 
@@ -597,10 +570,10 @@ int32 CHidDfuDeviceLoader::HidSetFeatureWithHeader(int32 aPayloadLength, uint8*
     // Add header for write operation
     AddWriteHeader(apBuffer, *apBlockNumber, (uint16)aPayloadLength);
 
-    if(!HidD_SetFeature(mDeviceHandle, apBuffer, mFeatureReportLength))
+    if(!mpTransport->SetFeature(apBuffer, mFeatureReportLength))
     {
-        retVal = SetLastErrorFromWinError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
-                "Failed to write to device", ::GetLastError());
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE,
+                "Failed to write to device", mpTransport->GetError());
     }
     else
     {
@@ -646,9 +619,9 @@ int32 CHidDfuDeviceLoader::ResetDevice(const bool aFromOperationThread)
         pBuffer[0] = DFU_HID_REPORTID_STATE;
         pBuffer[1] = DFU_CMD_RESET;
 
-        if(!HidD_SetFeature(mDeviceHandle, pBuffer, DFU_HID_REPORTID_STATE_SIZE))
+        if(!mpTransport->SetFeature(pBuffer, DFU_HID_REPORTID_STATE_SIZE))
         {
-            retVal = SetLastErrorFromWinError(HIDDFU_ERROR_RESET_FAILED, "Device reset failed", ::GetLastError());
+            retVal = SetLastErrorFromOsError(HIDDFU_ERROR_RESET_FAILED, "Device reset failed", mpTransport->GetError());
         }
         else
         {
@@ -681,9 +654,9 @@ int32 CHidDfuDeviceLoader::WriteToDevice(const uint8* apBuffer, uint32 aLength)
         // An operation is currently running, don't want to allow this while that's happening
         retVal = mLastDevError.SetDefaultMsg(HIDDFU_ERROR_BUSY);
     }
-    else if(!HidD_SetFeature(mDeviceHandle, (PVOID)apBuffer, aLength))
+    else if(!mpTransport->SetFeature(apBuffer, aLength))
     {
-        retVal = SetLastErrorFromWinError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE, "Write to device failed", ::GetLastError());
+        retVal = SetLastErrorFromOsError(HIDDFU_ERROR_DRIVER_INTERFACE_FAILURE, "Write to device failed", mpTransport->GetError());
     }
 
     return retVal;
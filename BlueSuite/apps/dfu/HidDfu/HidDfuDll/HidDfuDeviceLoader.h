@@ -17,9 +17,6 @@
 #include "HidDfuErrorMsg.h"
 #include "common/types.h"
 
-#define WIN32_LEAN_AND_MEAN  // Exclude rarely-used stuff from Windows headers
-
-#include <windows.h>
 #include <string>
 
 ///
@@ -29,7 +26,7 @@ class CHidDfuDeviceLoader : public CHidDfuDevice
 {
 public:
     CHidDfuDeviceLoader();
-    CHidDfuDeviceLoader(HANDLE aDeviceHandle, USHORT aFeatureReportLength);
+    CHidDfuDeviceLoader(CHidTransport *apTransport, uint16 aFeatureReportLength);
     ~CHidDfuDeviceLoader();
 
     ///
@@ -81,35 +78,6 @@ public:
 
 private:
 
-    // File suffix structure.
-    // The DFU suffix is defined as offsets from the end of the file, which
-    // is why the fields are listed in the opposite of expected order and
-    // why the "DFU" string for ucDfuSignature is reversed
-    // 
-    // uint16 bcdDevice         0x0001      (not used) This can be used to hold the stack software build integer
-    // uint16 idProduct         0xFFFE      USB Product ID
-    // uint16 idVendor          0x0A12      USB Vendor ID
-    // uint16 bcdDfu            0x0100      DFU specification number (1.0)
-    // uint8 ucDfuSignature[3]  "UFD"       DFU Signature string
-    // uint8 bLength            0x10        DFU Suffix length
-    // uint32 dwCRC                         Added in code, not a constant
-    struct DfuFileSuffix
-    {
-        uint16  bcdDevice;
-        uint16  idProduct;
-        uint16  idVendor;
-        uint16  bcdDfu;
-        uint8   ucDfuSignature[3];
-        uint8   bLength;
-        uint32  dwCrc;
-    };
-
-    /// Standard DFU file suffix data (that expected from a DFU file)
-    static const DfuFileSuffix STANDARD_DFU_SUFFIX;
-
-    /// Length of file suffix without CRC (because the CRC calculation doesn't include itself)
-    static const size_t DFU_SUFFIX_WITHOUT_CRC_LEN = sizeof(DfuFileSuffix) - sizeof(uint32);
-
     // Various class constants
     static const size_t DFU_HID_FROM_HOST_HEADER_SIZE = 6;
     static const size_t DFU_HID_TO_HOST_HEADER_SIZE = DFU_HID_FROM_HOST_HEADER_SIZE;
@@ -161,10 +129,10 @@ private:
     //static const uint8 DFU_STATE_DFU_ERROR               = 10;
 
     /// Max wait period for GetStatus (the chip tells us how long to wait)
-    DWORD mBwPollTimeout;
+    uint32 mBwPollTimeout;
 
     /// Feature report length
-    USHORT mFeatureReportLength;
+    uint16 mFeatureReportLength;
 
     ///
     /// Writes the DFU write header to a data buffer.
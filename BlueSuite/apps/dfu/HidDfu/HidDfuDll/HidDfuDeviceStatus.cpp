@@ -0,0 +1,157 @@
+//*******************************************************************************
+//
+//  HidDfuDeviceStatus.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CHidDfuDeviceStatus class.
+//
+//*******************************************************************************
+
+#include "HidDfuDeviceStatus.h"
+
+#include <assert.h>
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidDfuDeviceStatus::CHidDfuDeviceStatus()
+    : mSequence(0),
+    mState(HIDDFU_DEVICE_STATE_IDLE),
+    mProgress(0),
+    mBytesSent(0),
+    mThroughput(0),
+    mRetries(0),
+    mLastLatencyUs(0),
+    mErrorCode(HIDDFU_ERROR_NONE)
+{
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidDfuDeviceStatus::IsRunning(uint32 aState)
+{
+    return ((aState >= HIDDFU_DEVICE_STATE_CONNECTING) && (aState <= HIDDFU_DEVICE_STATE_COMMITTING));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDeviceStatus::Get(HidDfuDeviceStatus &aStatus) const
+{
+    uint32 sequence = 0;
+
+    do
+    {
+        sequence = mSequence.load(std::memory_order_acquire);
+
+        aStatus.state = mState.load(std::memory_order_relaxed);
+        aStatus.progress = mProgress.load(std::memory_order_relaxed);
+        aStatus.bytesSent = mBytesSent.load(std::memory_order_relaxed);
+        aStatus.throughput = mThroughput.load(std::memory_order_relaxed);
+        aStatus.retries = mRetries.load(std::memory_order_relaxed);
+        aStatus.lastLatencyUs = mLastLatencyUs.load(std::memory_order_relaxed);
+        aStatus.errorCode = mErrorCode.load(std::memory_order_relaxed);
+
+        // The fields must be read before the count is checked again
+        std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    while (((sequence & 1) != 0) || (sequence != mSequence.load(std::memory_order_relaxed)));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDeviceStatus::Reset(uint32 aState)
+{
+    BeginUpdate();
+    mState.store(aState, std::memory_order_relaxed);
+    mProgress.store(0, std::memory_order_relaxed);
+    mBytesSent.store(0, std::memory_order_relaxed);
+    mThroughput.store(0, std::memory_order_relaxed);
+    mRetries.store(0, std::memory_order_relaxed);
+    mLastLatencyUs.store(0, std::memory_order_relaxed);
+    mErrorCode.store(HIDDFU_ERROR_NONE, std::memory_order_relaxed);
+    EndUpdate();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDeviceStatus::SetState(uint32 aState)
+{
+    BeginUpdate();
+    mState.store(aState, std::memory_order_relaxed);
+    EndUpdate();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDeviceStatus::SetProgress(uint8 aProgress)
+{
+    assert(aProgress <= 100);
+
+    BeginUpdate();
+    mProgress.store((aProgress < 100) ? aProgress : 100, std::memory_order_relaxed);
+    EndUpdate();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDeviceStatus::SetTransfer(uint32 aBytesSent, uint32 aThroughput)
+{
+    BeginUpdate();
+    mBytesSent.store(aBytesSent, std::memory_order_relaxed);
+    mThroughput.store(aThroughput, std::memory_order_relaxed);
+    EndUpdate();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDeviceStatus::AddRetry()
+{
+    BeginUpdate();
+    mRetries.store(mRetries.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    EndUpdate();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDeviceStatus::SetLastLatency(uint32 aLatencyUs)
+{
+    BeginUpdate();
+    mLastLatencyUs.store(aLatencyUs, std::memory_order_relaxed);
+    EndUpdate();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDeviceStatus::Finish(uint32 aState, int32 aErrorCode)
+{
+    assert(!IsRunning(aState));
+
+    BeginUpdate();
+    mState.store(aState, std::memory_order_relaxed);
+    if (aState == HIDDFU_DEVICE_STATE_COMPLETE)
+    {
+        mProgress.store(100, std::memory_order_relaxed);
+    }
+    mErrorCode.store(aErrorCode, std::memory_order_relaxed);
+    EndUpdate();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDeviceStatus::BeginUpdate()
+{
+    // Only one thread updates the status, so the count needs no read-modify-write
+    mSequence.store(mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+
+    // The odd count must be seen before any of the fields being updated
+    std::atomic_thread_fence(std::memory_order_release);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuDeviceStatus::EndUpdate()
+{
+    mSequence.store(mSequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
@@ -0,0 +1,124 @@
+//*******************************************************************************
+//
+//  HidDfuDeviceStatus.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CHidDfuDeviceStatus class, the state and counters of a device operation.
+//
+//*******************************************************************************
+
+#ifndef HID_DFU_DEVICE_STATUS_H
+#define HID_DFU_DEVICE_STATUS_H
+
+#include "HidDfu.h"
+#include "common/types.h"
+
+#include <atomic>
+
+///
+/// Status of the current or last operation on a device, published by the
+/// thread running the operation and read by any thread polling it.
+///
+/// The fields are kept consistent with each other by a sequence count
+/// (a seqlock): the count is odd while an update is being made, and a
+/// reader which sees it odd, or changed by the time it has read the fields,
+/// reads them again. Readers take no lock and never make the operation
+/// wait, so polling does not slow the data transfer. Only one thread may
+/// update the status at a time, which holds since an operation's steps
+/// never run concurrently.
+///
+class CHidDfuDeviceStatus
+{
+public:
+    CHidDfuDeviceStatus();
+
+    ///
+    /// Queries whether a state is that of an operation still running.
+    /// @param[in] aState One of the HIDDFU_DEVICE_STATE_ values.
+    /// @return true if the operation has not finished.
+    ///
+    static bool IsRunning(uint32 aState);
+
+    ///
+    /// Gets a consistent copy of the status. May be called from any thread.
+    /// @param[out] aStatus The status.
+    ///
+    void Get(HidDfuDeviceStatus &aStatus) const;
+
+    ///
+    /// Clears the status at the start of an operation.
+    /// @param[in] aState State the operation starts in.
+    ///
+    void Reset(uint32 aState);
+
+    ///
+    /// Sets the state of the operation.
+    /// @param[in] aState One of the HIDDFU_DEVICE_STATE_ values.
+    ///
+    void SetState(uint32 aState);
+
+    ///
+    /// Sets the progress of the operation.
+    /// @param[in] aProgress Progress in percentage, no more than 100.
+    ///
+    void SetProgress(uint8 aProgress);
+
+    ///
+    /// Sets the data transferred so far.
+    /// @param[in] aBytesSent Upgrade data sent, or backup data read.
+    /// @param[in] aThroughput Transfer rate in bytes per second.
+    ///
+    void SetTransfer(uint32 aBytesSent, uint32 aThroughput);
+
+    ///
+    /// Counts a request repeated because the device was busy or did not
+    /// respond.
+    ///
+    void AddRetry();
+
+    ///
+    /// Sets the time the device last took to respond to a request.
+    /// @param[in] aLatencyUs Response time in microseconds.
+    ///
+    void SetLastLatency(uint32 aLatencyUs);
+
+    ///
+    /// Sets the final state and result once the operation has finished,
+    /// and the progress to 100% if it completed.
+    /// @param[in] aState HIDDFU_DEVICE_STATE_COMPLETE, _FAILED or _STOPPED.
+    /// @param[in] aErrorCode Result of the operation.
+    ///
+    void Finish(uint32 aState, int32 aErrorCode);
+
+private:
+
+    CHidDfuDeviceStatus(const CHidDfuDeviceStatus &);
+    CHidDfuDeviceStatus &operator=(const CHidDfuDeviceStatus &);
+
+    ///
+    /// Makes the sequence count odd before the fields are updated.
+    ///
+    void BeginUpdate();
+
+    ///
+    /// Makes the sequence count even once the fields are updated.
+    ///
+    void EndUpdate();
+
+    /// Sequence count, odd while an update is being made
+    std::atomic<uint32> mSequence;
+
+    /// Status fields, see HidDfuDeviceStatus
+    std::atomic<uint32> mState;
+    std::atomic<uint32> mProgress;
+    std::atomic<uint32> mBytesSent;
+    std::atomic<uint32> mThroughput;
+    std::atomic<uint32> mRetries;
+    std::atomic<uint32> mLastLatencyUs;
+    std::atomic<int32> mErrorCode;
+};
+
+#endif // #ifndef HID_DFU_DEVICE_STATUS_H
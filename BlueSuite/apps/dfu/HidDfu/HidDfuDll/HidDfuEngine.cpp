@@ -14,42 +14,32 @@
 #include <algorithm>
 #include <functional>
 #include <assert.h>
+#include <string.h>
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <thread>
 
 #include "HidDfu.h"
 #include "HidDfuEngine.h"
+#include "DfuFile.h"
+#include "DfuIndex.h"
+#include "ImageCache.h"
+#include "UpgradeImage.h"
+#include "UpgradeJournal.h"
 #include "HidDfuDeviceApplication.h"
 #include "HidDfuDeviceLoader.h"
 
-#include "DFUEngine\CRC.h"
-#include "time\hi_res_clock.h"
-#include "time\stop_watch.h"
-
-#include <setupapi.h>
-extern "C"
-{
-#include <hidsdi.h>
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-const CHidDfuEngine::DfuFileSuffix CHidDfuEngine::STANDARD_DFU_SUFFIX = 
-{
-    0x0001,         // bcdDevice
-    0xFFFE,         // idProduct
-    0x0A12,         // idVendor
-    0x0100,         // bcdDfu
-    {'U','F','D'},  // ucDfuSignature
-    0x10,           // bLength
-    0               // dwCrc - this value is ignored (CRC calculated)
-};
+#include "time/hi_res_clock.h"
+#include "time/stop_watch.h"
 
 ////////////////////////////////////////////////////////////////////////////////
 
 CHidDfuEngine::CHidDfuEngine()
-: mProgress(0)
+: mProgress(0),
+  mUseValidationIndex(false),
+  mDataWindow(0),
+  mUseResumeJournal(false)
 {
     FUNCTION_DEBUG_SENTRY;
 }
@@ -79,121 +69,41 @@ int32 CHidDfuEngine::ConnectDevice(uint16 aVid, uint16 aPid, uint16 aUsage,
     else
     {
         *apCount = 0;
-        GUID guid;
-        // Get device intereface GUID
-        HidD_GetHidGuid(&guid);
-        // Get a handle to the device information set (for HID Class devices)
-        // that contains requested device information elements
-        HDEVINFO deviceInfoSet = SetupDiGetClassDevs(&guid, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
 
-        if (deviceInfoSet == INVALID_HANDLE_VALUE)
+        // Find the devices that match the VID, PID, usage and usage page
+        std::vector<CHidTransport::CDeviceInfo> devices;
+        if (!CHidTransport::Enumerate(aVid, aPid, aUsage, aUsagePage, devices))
         {
             retVal = mLastError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Failed to get Device Information Set");
         }
         else
         {
-            // Iterate through the devices found - look for one that matches the VID, PID, usage and usage page
-            SP_INTERFACE_DEVICE_DATA interfaceDeviceData;
-            interfaceDeviceData.cbSize = sizeof(SP_INTERFACE_DEVICE_DATA);
-            for (uint32 index = 0;
-                SetupDiEnumDeviceInterfaces(deviceInfoSet, 0, &guid, index, &interfaceDeviceData);
-                ++index)
+            for (std::vector<CHidTransport::CDeviceInfo>::const_iterator itDevice = devices.begin();
+                itDevice != devices.end();
+                ++itDevice)
             {
                 // Attempt to open the device
+                CHidTransport *pTransport = CHidTransport::Create();
+                if (pTransport->Open(itDevice->mDevicePath))
+                {
+                    // Increment the number of matching HID devices
+                    (*apCount)++;
 
-                DWORD requiredSize;
-                // Get requiredSize to allocate the heap, to get details about the device interface,
-                // following function is expected to return false/failure, hence ignore the return value
-                (void)SetupDiGetDeviceInterfaceDetail(deviceInfoSet, &interfaceDeviceData,
-                        NULL, 0, &requiredSize, NULL);
-
-                PSP_DEVICE_INTERFACE_DETAIL_DATA deviceInterfaceDetailData =
-                    (PSP_DEVICE_INTERFACE_DETAIL_DATA)HeapAlloc(GetProcessHeap(),
-                        HEAP_GENERATE_EXCEPTIONS | HEAP_ZERO_MEMORY, requiredSize);
-
-                // Get Device Information Data, to retrieve the Device Instance
-                SP_DEVINFO_DATA devInfoData;
-                ZeroMemory(&devInfoData, sizeof(devInfoData));
-                devInfoData.cbSize = sizeof(devInfoData);
-
-                deviceInterfaceDetailData->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
+                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Setting DevicePath: %s", itDevice->mDevicePath.c_str());
 
-                // Get details about the device interface
-                if(!SetupDiGetDeviceInterfaceDetail(deviceInfoSet, &interfaceDeviceData,
-                    deviceInterfaceDetailData, requiredSize, NULL, &devInfoData))
-                {
-                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to get Device Interface Detail");
+                    // The parent USB device is saved with the device path, so that it
+                    // can be used after the device restart to get the HID Device Path
+                    CHidDevInfo* pDevInfo = new CHidDevInfo(pTransport, *itDevice);
+                    mHidDevInfo.push_back(pDevInfo);
                 }
                 else
                 {
-                    HANDLE deviceHandle = CreateFile(deviceInterfaceDetailData->DevicePath,
-                        GENERIC_READ | GENERIC_WRITE,
-                        FILE_SHARE_READ | FILE_SHARE_WRITE,
-                        NULL,
-                        OPEN_EXISTING,
-                        0,
-                        NULL);
-
-                    if (deviceHandle != INVALID_HANDLE_VALUE)
-                    {
-                        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Check capabilities, device: %s", deviceInterfaceDetailData->DevicePath);
-
-                        HIDD_ATTRIBUTES attributes;
-                        HidD_GetAttributes(deviceHandle, &attributes);
-
-                        if (attributes.VendorID == aVid && attributes.ProductID == aPid)
-                        {
-                            PHIDP_PREPARSED_DATA preparsedData;
-                            HidD_GetPreparsedData(deviceHandle, &preparsedData);
-
-                            HIDP_CAPS capabilities;
-                            HidP_GetCaps(preparsedData, &capabilities);
-
-                            // Check usage and usage page match
-                            // usage and usagePage check is optional (zero is reserved 
-                            // value in both cases, so using zero as "don't check").
-                            if ((aUsage == 0 || capabilities.Usage == aUsage) &&
-                                (aUsagePage == 0 || capabilities.UsagePage == aUsagePage))
-                            {
-                                // Increment the number of matching HID devices
-                                (*apCount)++;
-
-                                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Setting DeviceHandle: %d", deviceHandle);
-                                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Setting DevicePath: %s", deviceInterfaceDetailData->DevicePath);
-
-                                // Get and save the USB Hub Device Instance, so that it can be used after the device restart,
-                                // to get the HID Device Path
-                                DEVINST usbHubDevInst;
-                                retVal = GetUsbHubDevInst(devInfoData.DevInst, usbHubDevInst, aVid);
-
-                                CHidDevInfo* pDevInfo = new CHidDevInfo(deviceHandle, deviceInterfaceDetailData->DevicePath,
-                                    capabilities.FeatureReportByteLength, usbHubDevInst,
-                                    aVid, aPid, aUsage, aUsagePage);
-                                mHidDevInfo.push_back(pDevInfo);
-                            }
-                            else
-                            {
-                                // Opened wrong device (capabilities), close it.
-                                CloseHandle(deviceHandle);
-                                deviceHandle = INVALID_HANDLE_VALUE;
-                            }
-                        }
-                        else
-                        {
-                            // Opened wrong device (vid/pid), close it.
-                            CloseHandle(deviceHandle);
-                            deviceHandle = INVALID_HANDLE_VALUE;
-                        }
-                    }
-                    else
-                    {
-                        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to access the device");
-                    }
+                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to access the device: %s",
+                        CHidTransport::GetErrorText(pTransport->GetError()).c_str());
+                    delete pTransport;
                 }
-                HeapFree(GetProcessHeap(), 0, deviceInterfaceDetailData);
             }
         }
-        SetupDiDestroyDeviceInfoList(deviceInfoSet);
     }
 
     // If devInfo is not populated, no devices found
@@ -235,17 +145,15 @@ int32 CHidDfuEngine::CreateHidDeviceObjects()
             // Populate mHidDfuDevices with the device information based on device type
             if (typeid(T) == typeid(CHidDfuDeviceApplication))
             {
-                // Store USB Hub Device Instance (etc.) with the HidDfuDeviceApplication object, for reconnection
-                pDevice = new CHidDfuDeviceApplication((*itHidDevInfo)->mDeviceHandle,
-                            (*itHidDevInfo)->mDevPath.c_str(),
-                            (*itHidDevInfo)->mUsbHubDevInst,
-                            (*itHidDevInfo)->mVid, (*itHidDevInfo)->mPid,
-                            (*itHidDevInfo)->mUsage, (*itHidDevInfo)->mUsagePage);
+                // Store the parent USB device (etc.) with the HidDfuDeviceApplication object, for reconnection
+                pDevice = new CHidDfuDeviceApplication((*itHidDevInfo)->mpTransport,
+                            (*itHidDevInfo)->mInfo);
             }
             else if (typeid(T) == typeid(CHidDfuDeviceLoader))
             {
                 // Get FeatureReportLength from USB descriptor and store with the HidDfuDeviceLoader object
-                pDevice = new CHidDfuDeviceLoader((*itHidDevInfo)->mDeviceHandle, (*itHidDevInfo)->mFeatureReportLength);
+                pDevice = new CHidDfuDeviceLoader((*itHidDevInfo)->mpTransport,
+                            (*itHidDevInfo)->mInfo.mFeatureReportLength);
             }
             else
             {
@@ -316,10 +224,11 @@ int32 CHidDfuEngine::DisconnectDevice()
         }
     }
 
-    // Delete mHidDevInfo (since the handle in mHidDevInfo would be invalid after mHidDfuDevices is deleted)
+    // Delete mHidDevInfo, and the transports in it, once no device object uses them
     if (retVal == HIDDFU_ERROR_NONE)
     {
         DeleteHidDevInfo();
+        mVersions.clear();
     }
 
     return retVal;
@@ -352,38 +261,35 @@ int32 CHidDfuEngine::GetFirmwareVersion(char* apVersionString, uint16* apMaxLeng
                 "hidDfuGetFirmwareVersion: Insufficient memory allocated to version buffer");
         }
 
+        // The versions are read from all the devices at once, or kept from
+        // an earlier call
+        if (retVal == HIDDFU_ERROR_NONE)
+        {
+            retVal = ReadVersions(false);
+        }
+
         std::stringstream deviceVersions;
         std::string firstVersion;
         bool sameVersion = true;
 
-        for (HidDfuDeviceVctrItr itHidDfuDevices = mHidDfuDevices.begin();
-            (itHidDfuDevices != mHidDfuDevices.end()) && (retVal == HIDDFU_ERROR_NONE);
-            ++itHidDfuDevices)
+        for (size_t index = 0; (index < mVersions.size()) && (retVal == HIDDFU_ERROR_NONE); ++index)
         {
-            uint16 versionMajor = 0;
-            uint16 versionMinor = 0;
-            uint16 configVersion = 0;
+            std::stringstream version;
+            version << mVersions[index].versionMajor << "," << mVersions[index].versionMinor << ","
+                << mVersions[index].configVersion << ";";
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Version: %s", version.str().c_str());
 
-            retVal = (*itHidDfuDevices)->GetDevFirmwareVersion(versionMajor, versionMinor, configVersion);
+            deviceVersions << version.str();
 
-            if (retVal == HIDDFU_ERROR_NONE)
+            if (index == 0)
             {
-                std::stringstream version;
-                version << versionMajor << "," << versionMinor << "," << configVersion << ";";
-                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Version: %s", version.str().c_str());
-
-                deviceVersions << version.str();
-
-                if (itHidDfuDevices == mHidDfuDevices.begin())
-                {
-                    firstVersion = version.str();
-                }
-                else
+                firstVersion = version.str();
+            }
+            else
+            {
+                if (firstVersion != version.str())
                 {
-                    if (firstVersion != version.str())
-                    {
-                        sameVersion = false;
-                    }
+                    sameVersion = false;
                 }
             }
         }
@@ -406,6 +312,138 @@ int32 CHidDfuEngine::GetFirmwareVersion(char* apVersionString, uint16* apMaxLeng
 
 ////////////////////////////////////////////////////////////////////////////////
 
+int32 CHidDfuEngine::GetDeviceVersions(HidDfuDeviceVersion *apVersions, uint16 *apCount, uint8 aRefresh)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    if (apVersions == NULL || apCount == NULL)
+    {
+        retVal = mLastError.SetDefaultMsg(HIDDFU_ERROR_INVALID_PARAMETER);
+    }
+    else
+    {
+        retVal = CreateHidDeviceObjects<CHidDfuDeviceApplication>();
+    }
+
+    if (retVal == HIDDFU_ERROR_NONE)
+    {
+        if (*apCount < mHidDfuDevices.size())
+        {
+            *apCount = static_cast<uint16>(mHidDfuDevices.size());
+            retVal = mLastError.SetMsg(HIDDFU_ERROR_PARAM_TOO_SMALL,
+                "hidDfuGetDeviceVersions: Insufficient entries in versions array");
+        }
+        else
+        {
+            // Every entry is written, with the error of any device which failed
+            retVal = ReadVersions(aRefresh != 0);
+
+            *apCount = static_cast<uint16>(mVersions.size());
+            for (size_t index = 0; index < mVersions.size(); ++index)
+            {
+                apVersions[index] = mVersions[index];
+            }
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuEngine::ReadVersions(bool aRefresh)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    if (aRefresh || (mVersions.size() != mHidDfuDevices.size()))
+    {
+        HidDfuDeviceVersion unread;
+        memset(&unread, 0, sizeof(unread));
+        unread.errorCode = HIDDFU_ERROR_UNKNOWN;
+        mVersions.assign(mHidDfuDevices.size(), unread);
+    }
+
+    // Devices running an operation are not read
+    std::vector<size_t> indexes;
+    for (size_t index = 0; index < mHidDfuDevices.size(); ++index)
+    {
+        if (mVersions[index].errorCode != HIDDFU_ERROR_NONE)
+        {
+            if (mHidDfuDevices[index]->IsThreadActive())
+            {
+                mVersions[index].errorCode = HIDDFU_ERROR_BUSY;
+            }
+            else
+            {
+                indexes.push_back(index);
+            }
+        }
+    }
+
+    // Each device waits for its responses, so the devices are shared between
+    // a few threads, the calling thread being one of them
+    std::atomic<size_t> next(0);
+    std::vector<std::thread> threads;
+    const size_t threadCount = std::min(indexes.size(), static_cast<size_t>(MAX_VERSION_THREADS));
+    for (size_t n = 1; n < threadCount; ++n)
+    {
+        threads.push_back(std::thread(&CHidDfuEngine::ReadVersionsFunc, this, std::cref(indexes), std::ref(next)));
+    }
+    ReadVersionsFunc(indexes, next);
+    for (std::vector<std::thread>::iterator it = threads.begin(); it != threads.end(); ++it)
+    {
+        it->join();
+    }
+
+    for (size_t index = 0; (index < mVersions.size()) && (retVal == HIDDFU_ERROR_NONE); ++index)
+    {
+        if (mVersions[index].errorCode == HIDDFU_ERROR_BUSY)
+        {
+            retVal = mLastError.SetDefaultMsg(HIDDFU_ERROR_BUSY);
+        }
+        else if (mVersions[index].errorCode != HIDDFU_ERROR_NONE)
+        {
+            retVal = mLastError.SetMsg(mVersions[index].errorCode, mHidDfuDevices[index]->GetLastError());
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuEngine::ReadVersionsFunc(const std::vector<size_t> &aIndexes, std::atomic<size_t> &aNext)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    for (size_t n = aNext++; n < aIndexes.size(); n = aNext++)
+    {
+        HidDfuDeviceVersion &version = mVersions[aIndexes[n]];
+        version.errorCode = mHidDfuDevices[aIndexes[n]]->GetDevFirmwareVersion(
+            version.versionMajor, version.versionMinor, version.configVersion);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidDfuEngine::GetThroughput()
+{
+    uint32 throughput = 0;
+    FUNCTION_DEBUG_SENTRY_RET(uint32, throughput);
+
+    for (HidDfuDeviceVctrItr itHidDfuDevices = mHidDfuDevices.begin();
+        itHidDfuDevices != mHidDfuDevices.end(); ++itHidDfuDevices)
+    {
+        throughput += (*itHidDfuDevices)->GetThroughput();
+    }
+
+    return throughput;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 uint8 CHidDfuEngine::GetProgress()
 {
     uint8 meanProgress = 0;
@@ -471,7 +509,7 @@ int32 CHidDfuEngine::GetResult()
         bool allAreEqual =
             std::find_if(deviceError.begin() + 1, 
             deviceError.end(), 
-            std::bind1st(std::not_equal_to<int32>(), deviceError.front())) == deviceError.end();
+            [&deviceError](int32 aError) { return aError != deviceError.front(); }) == deviceError.end();
 
         if (allAreEqual)
         {
@@ -517,59 +555,6 @@ int32 CHidDfuEngine::GetResult()
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int32 CHidDfuEngine::GetUsbHubDevInst(DEVINST aChildDevInst, DEVINST & aParentDevInst, uint16 aVid)
-{
-    int32 retVal = HIDDFU_ERROR_NONE;
-    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
-
-    std::ostringstream vid;      //< USB Vendor Identifier
-    vid << std::uppercase << "VID_" << std::hex << std::setfill('0') << std::setw(4) << aVid;
-
-    bool matchFound = true;
-    DEVINST parentDevInst;
-
-    // Look up for parents in USB Tree with a matching VID
-    while (matchFound)
-    {
-        // Get parent's Device Instance
-        CONFIGRET status = CM_Get_Parent(&parentDevInst, aChildDevInst, 0);
-        if (status == CR_SUCCESS)
-        {
-            //Get parent's Device Instance ID
-            char *pDevInstID = new char[MAX_DEVICE_ID_LEN];
-            status = CM_Get_Device_IDA(parentDevInst, pDevInstID, MAX_PATH, 0);
-            if (status == CR_SUCCESS)
-            {
-                std::string str(pDevInstID, MAX_DEVICE_ID_LEN);
-                if (str.find(vid.str()) != std::string::npos)
-                {
-                    // Use parent's Device Instance for matching VID
-                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Parent Device: %s", str.c_str());
-                    aParentDevInst = parentDevInst;
-                }
-                else
-                {
-                    // If parent has not got a matching VID stop searching
-                    matchFound = false;
-                }
-            }
-            else
-            {
-                retVal = mLastError.SetMsg(HIDDFU_ERROR_UNKNOWN,
-                    "Failed to get Device Instance ID");
-            }
-            aChildDevInst = parentDevInst;
-        }
-        else
-        {
-            retVal = mLastError.SetMsg(HIDDFU_ERROR_UNKNOWN, "Failed to get parent device");
-        }
-    }
-    return retVal;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
 int32 CHidDfuEngine::StopOperation(uint16 aWaitForStopMs)
 {
     int32 retVal = HIDDFU_ERROR_NONE;
@@ -645,86 +630,201 @@ int32 CHidDfuEngine::ValidateBinFile(const char *apFile)
 
 ////////////////////////////////////////////////////////////////////////////////
 
-int32 CHidDfuEngine::ValidateDfuFile(const char *apFile)
+int32 CHidDfuEngine::ValidateDfuFile(const char *apFile, DfuIndexPtr *apIndex)
 {
     assert(apFile != NULL);
 
     int32 retVal = HIDDFU_ERROR_NONE;
     FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    FILE *pFile = fopen(apFile, "rb");
-    if (pFile == NULL)
+    // Check the suffix, then stream the file through the CRC
+    CDfuFile dfuFile(mLastError);
+    retVal = dfuFile.Open(apFile);
+
+    if (retVal == HIDDFU_ERROR_NONE && mUseValidationIndex)
     {
-        std::ostringstream msg;
-        msg << "Failed to open file \"" << apFile << "\"";
-        retVal = mLastError.SetMsg(HIDDFU_ERROR_FILE_OPEN_FAILED, msg.str());
+        // A sidecar saved for the unchanged file stands in for the CRC.
+        // Otherwise the chunk CRCs are gathered with the file CRC and saved
+        // for next time (failing to save is not an error).
+        std::shared_ptr<CDfuIndex> pIndex(new CDfuIndex);
+        if (!pIndex->Load(apFile) || !pIndex->Matches(dfuFile.GetFileSize(), dfuFile.GetSuffix()))
+        {
+            CImageCache::FileIdentity identity;
+            const bool haveIdentity = CImageCache::GetFileIdentity(apFile, identity);
+
+            retVal = dfuFile.CheckCrc(pIndex.get());
+
+            if (retVal == HIDDFU_ERROR_NONE && haveIdentity)
+            {
+                pIndex->Save(apFile, identity);
+            }
+        }
+
+        if (retVal == HIDDFU_ERROR_NONE && apIndex != NULL)
+        {
+            *apIndex = pIndex;
+        }
+    }
+    else if (retVal == HIDDFU_ERROR_NONE)
+    {
+        retVal = dfuFile.CheckCrc();
     }
 
-    if (retVal == HIDDFU_ERROR_NONE)
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuEngine::ValidateFileCached(const char *apFile,
+    CImageCache::ImageType aType, UpgradeImagePtr &apImage, DfuIndexPtr *apIndex)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    // Validation is skipped if the same, unchanged, file has already passed.
+    // The identity is taken before validating, so a file changed during
+    // validation will not match next time.
+    CImageCache::FileIdentity identity;
+    const bool haveIdentity = CImageCache::GetFileIdentity(apFile, identity);
+
+    apImage.reset();
+    if (apIndex != NULL)
     {
-        // Get file length
-        fseek(pFile, 0, SEEK_END);
-        const size_t fileSize = (size_t)ftell(pFile);
+        apIndex->reset();
+    }
 
-        if (fileSize < sizeof(DfuFileSuffix))
+    if (!haveIdentity || !mImageCache.Lookup(apFile, aType, identity))
+    {
+        if (aType == CImageCache::IMAGE_TYPE_DFU)
         {
-            retVal = mLastError.SetMsg(HIDDFU_ERROR_FILE_INVALID_FORMAT, "File too short");
+            retVal = ValidateDfuFile(apFile, apIndex);
         }
         else
         {
-            // Move to start of suffix
-            fseek(pFile, -(long)sizeof(DfuFileSuffix), SEEK_END);
+            retVal = ValidateBinFile(apFile);
+        }
 
-            // Read suffix
-            DfuFileSuffix suffixData;
-            if (fread(&suffixData, sizeof(uint8), sizeof(DfuFileSuffix), pFile) == 0)
+        if (retVal == HIDDFU_ERROR_NONE && haveIdentity)
+        {
+            mImageCache.Store(apFile, aType, identity);
+        }
+    }
+    else if (aType == CImageCache::IMAGE_TYPE_DFU && mUseValidationIndex && apIndex != NULL)
+    {
+        // Validation is skipped, but the data sent is still checked against
+        // the sidecar (the devices ignore it if it does not match the file)
+        std::shared_ptr<CDfuIndex> pIndex(new CDfuIndex);
+        if (pIndex->Load(apFile))
+        {
+            *apIndex = pIndex;
+        }
+    }
+
+    // A DFU binary file is mapped for each upgrade, and unmapped when the
+    // last device using it finishes, so the file is not held open (and can
+    // be replaced) between upgrades
+    if (retVal == HIDDFU_ERROR_NONE && aType == CImageCache::IMAGE_TYPE_BIN)
+    {
+        std::shared_ptr<CUpgradeImage> pImage(new CUpgradeImage);
+        retVal = pImage->Open(apFile, mLastError);
+        if (retVal == HIDDFU_ERROR_NONE)
+        {
+            apImage = pImage;
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuEngine::GetDeviceStatus(HidDfuDeviceStatus *apStatus, uint16 *apCount)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    if (apStatus == NULL || apCount == NULL)
+    {
+        retVal = mLastError.SetDefaultMsg(HIDDFU_ERROR_INVALID_PARAMETER);
+    }
+    else if (mHidDevInfo.size() == 0)
+    {
+        retVal = mLastError.SetMsg(HIDDFU_ERROR_SEQUENCE, "Invalid sequence");
+    }
+    else if (*apCount < mHidDevInfo.size())
+    {
+        *apCount = static_cast<uint16>(mHidDevInfo.size());
+        retVal = mLastError.SetMsg(HIDDFU_ERROR_PARAM_TOO_SMALL,
+            "hidDfuGetDeviceStatus: Insufficient entries in status array");
+    }
+    else
+    {
+        *apCount = static_cast<uint16>(mHidDevInfo.size());
+
+        // The device objects are created by the first operation, until then
+        // the devices are idle
+        for (uint16 index = 0; index < *apCount; ++index)
+        {
+            if (index < mHidDfuDevices.size())
             {
-                retVal = mLastError.SetMsg(HIDDFU_ERROR_FILE_READ_FAILED, "Failed to read file suffix");
+                mHidDfuDevices[index]->GetStatus(apStatus[index]);
             }
-
-            // Validate suffix
-            if (retVal == HIDDFU_ERROR_NONE &&
-                (suffixData.bLength < sizeof(DfuFileSuffix) ||
-                fileSize < suffixData.bLength ||
-                memcmp(suffixData.ucDfuSignature, STANDARD_DFU_SUFFIX.ucDfuSignature, sizeof(suffixData.ucDfuSignature)) != 0 ||
-                suffixData.bcdDfu != STANDARD_DFU_SUFFIX.bcdDfu))
+            else
             {
-                retVal = mLastError.SetMsg(HIDDFU_ERROR_FILE_INVALID_FORMAT, "File suffix is invalid for the connected device");
+                memset(&apStatus[index], 0, sizeof(apStatus[index]));
+                apStatus[index].state = HIDDFU_DEVICE_STATE_IDLE;
             }
+        }
+    }
 
-            if (retVal == HIDDFU_ERROR_NONE)
-            {
-                // Allocate buffer to read file
-                uint8 *pFileBuffer = new uint8[fileSize];
-                memset(pFileBuffer, 0, fileSize);
+    return retVal;
+}
 
-                // Move to start of file
-                fseek(pFile, 0, SEEK_SET);
+////////////////////////////////////////////////////////////////////////////////
 
-                const size_t fileSizeWithoutCRC = fileSize - sizeof(suffixData.dwCrc); 
+int32 CHidDfuEngine::GetImageCacheStats(uint32 *apHits, uint32 *apMisses)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-                // Read file information into buffer, excluding final CRC (4 bytes)
-                fread(pFileBuffer, sizeof(pFileBuffer[0]), fileSizeWithoutCRC, pFile);
+    if (apHits == NULL || apMisses == NULL)
+    {
+        retVal = mLastError.SetDefaultMsg(HIDDFU_ERROR_INVALID_PARAMETER);
+    }
+    else
+    {
+        mImageCache.GetStats(*apHits, *apMisses);
+    }
 
-                // Calculate file CRC
-                CRC crc;
-                crc(pFileBuffer, fileSizeWithoutCRC);
-                if (crc() != suffixData.dwCrc)
-                {
-                    retVal = mLastError.SetDefaultMsg(HIDDFU_ERROR_FILE_CRC_INCORRECT);
-                }
+    return retVal;
+}
 
-                // Return to start of file
-                fseek(pFile, 0, SEEK_SET);
+////////////////////////////////////////////////////////////////////////////////
 
-                delete[] pFileBuffer;
-            }
-        }
-    }
+int32 CHidDfuEngine::SetValidationIndex(uint8 aEnable)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    mUseValidationIndex = (aEnable != 0);
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CHidDfuEngine::SetDataWindow(uint8 aWindow)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
 
-    if (pFile != NULL)
+    if (aWindow > CHidTransport::MAX_WINDOW)
+    {
+        retVal = mLastError.SetDefaultMsg(HIDDFU_ERROR_INVALID_PARAMETER);
+    }
+    else
     {
-        fclose(pFile);
+        mDataWindow = aWindow;
     }
 
     return retVal;
@@ -732,6 +832,18 @@ int32 CHidDfuEngine::ValidateDfuFile(const char *apFile)
 
 ////////////////////////////////////////////////////////////////////////////////
 
+int32 CHidDfuEngine::SetResumeJournal(uint8 aEnable)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    mUseResumeJournal = (aEnable != 0);
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
 int32 CHidDfuEngine::ResetDevice()
 {
     int32 retVal = HIDDFU_ERROR_NONE;
@@ -809,8 +921,9 @@ int32 CHidDfuEngine::Backup(const char* apFilename, uint8 aResetAfter)
                     {
                         size_t decPosition = fileName.find_last_of(".");
                         fileName.insert(decPosition, "-");
-                        fileName.insert(decPosition + 1,
-                            static_cast<std::ostringstream*>(&(std::ostringstream() << deviceIndex))->str());
+                        std::ostringstream fileNameSuffix;
+                        fileNameSuffix << deviceIndex;
+                        fileName.insert(decPosition + 1, fileNameSuffix.str());
                         deviceIndex++;
                     }
 
@@ -848,8 +961,11 @@ int32 CHidDfuEngine::Upgrade(const char* apFilename, uint8 aResetAfter)
         }
         else
         {
-            // Store the filename
-            retVal = ValidateDfuFile(apFilename);
+            // With a validation index, each device checks the chunks it sends
+            // in case the file has changed without changing its identity
+            UpgradeImagePtr pImage;
+            DfuIndexPtr pIndex;
+            retVal = ValidateFileCached(apFilename, CImageCache::IMAGE_TYPE_DFU, pImage, &pIndex);
 
             if (retVal == HIDDFU_ERROR_NONE)
             {
@@ -870,6 +986,7 @@ int32 CHidDfuEngine::Upgrade(const char* apFilename, uint8 aResetAfter)
                     else
                     {
                         (*itHidDfuDevices)->SetFileName(apFilename);
+                        (*itHidDfuDevices)->SetDfuIndex(pIndex);
                         retValForUpgrade = (*itHidDfuDevices)->DeviceUpgrade(aResetAfter); // Start the upgrade thread
                     }
 
@@ -905,7 +1022,21 @@ int32 CHidDfuEngine::UpgradeBin(const char* apFilename)
         else
         {
             // File validation
-            retVal = ValidateBinFile(apFilename);
+            // The file is mapped once, all devices are then served from the
+            // same read-only view (which is unmapped once they have finished)
+            UpgradeImagePtr pImage;
+            retVal = ValidateFileCached(apFilename, CImageCache::IMAGE_TYPE_BIN, pImage);
+
+            // The journal is shared by all the devices, each has a record in it
+            UpgradeJournalPtr pJournal;
+            if ((retVal == HIDDFU_ERROR_NONE) && mUseResumeJournal)
+            {
+                pJournal.reset(new CUpgradeJournal);
+                if (!pJournal->Open(apFilename))
+                {
+                    pJournal.reset();
+                }
+            }
 
             if (retVal == HIDDFU_ERROR_NONE)
             {
@@ -921,7 +1052,12 @@ int32 CHidDfuEngine::UpgradeBin(const char* apFilename)
                     else
                     {
                         (*itHidDfuDevices)->SetFileName(apFilename);
-                        retValForUpgrade = (*itHidDfuDevices)->DeviceUpgrade(false); // Start the upgrade thread
+                        (*itHidDfuDevices)->SetUpgradeImage(pImage);
+                        (*itHidDfuDevices)->SetResumeJournal(pJournal);
+                        (*itHidDfuDevices)->SetDataWindow(mDataWindow);
+                        (*itHidDfuDevices)->SetScheduler(&mScheduler);
+                        (*itHidDfuDevices)->SetArrivalMonitor(&mArrivalMonitor);
+                        retValForUpgrade = (*itHidDfuDevices)->DeviceUpgrade(false); // Schedule the upgrade
                     }
 
                     // Store any intermediate error for the devices being upgraded
@@ -930,6 +1066,9 @@ int32 CHidDfuEngine::UpgradeBin(const char* apFilename)
                         retVal = retValForUpgrade;
                     }
                 }
+
+                // The upgrades change the versions
+                mVersions.clear();
             }
         }
     }
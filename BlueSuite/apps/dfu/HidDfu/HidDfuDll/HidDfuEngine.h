@@ -14,12 +14,16 @@
 #define HID_DFU_ENGINE_H
 
 #include "common/types.h"
+#include "HidArrivalMonitor.h"
 #include "HidDfuErrorMsg.h"
 #include "HidDfuDevice.h"
+#include "HidDfuScheduler.h"
+#include "HidTransport.h"
+#include "ImageCache.h"
 
+#include <atomic>
 #include <string>
 #include <vector>
-#include <cfgmgr32.h>
 
 ///
 /// Class API for HidDfu functions.
@@ -79,6 +83,49 @@ public:
     ///
     uint8 GetFailedDevicesCount();
 
+    ///
+    /// Gets the status of the current or last operation on each device.
+    /// @param[out] apStatus Array for the status of each connected device.
+    /// @param[in, out] apCount Number of entries in apStatus, returns the
+    ///                         number of connected devices.
+    /// @return The result.
+    /// @see hidDfuGetDeviceStatus.
+    ///
+    int32 GetDeviceStatus(HidDfuDeviceStatus *apStatus, uint16 *apCount);
+
+    ///
+    /// Gets the validated image cache counters.
+    /// @param[out] apHits Number of upgrades which reused a validated file.
+    /// @param[out] apMisses Number of upgrades which validated the file.
+    /// @return The result.
+    /// @see hidDfuGetImageCacheStats.
+    ///
+    int32 GetImageCacheStats(uint32 *apHits, uint32 *apMisses);
+
+    ///
+    /// Enables or disables the DFU file validation sidecar (<file>.idx).
+    /// @param[in] aEnable Non-zero to use and save sidecar files.
+    /// @return The result.
+    /// @see hidDfuSetValidationIndex.
+    ///
+    int32 SetValidationIndex(uint8 aEnable);
+
+    ///
+    /// Sets the number of upgrade data reports kept in flight by UpgradeBin.
+    /// @param[in] aWindow Number of reports, 0 for a fixed delay between reports.
+    /// @return The result.
+    /// @see hidDfuSetDataWindow.
+    ///
+    int32 SetDataWindow(uint8 aWindow);
+
+    ///
+    /// Enables or disables the upgrade resume journal (<file>.journal).
+    /// @param[in] aEnable Non-zero to record and resume upgrades.
+    /// @return The result.
+    /// @see hidDfuSetResumeJournal.
+    ///
+    int32 SetResumeJournal(uint8 aEnable);
+
     ///
     /// Gets the version information of the connected devices.
     /// @param[out] apVersionString Pointer to a buffer where the comma/semicolon separated string representing
@@ -93,6 +140,17 @@ public:
     ///
     int32 GetFirmwareVersion(char* apVersionString, uint16* apMaxLength, bool aCheckMatch);
 
+    ///
+    /// Gets the version information of the connected devices, reading only
+    /// the versions not already read.
+    /// @param[out] apVersions Array of versions, one for each device.
+    /// @param[in, out] apCount Number of entries in apVersions, returns the number of devices.
+    /// @param[in] aRefresh Non-zero to read all the versions again.
+    /// @return The result.
+    /// @see hidDfuGetDeviceVersions.
+    ///
+    int32 GetDeviceVersions(HidDfuDeviceVersion *apVersions, uint16 *apCount, uint8 aRefresh);
+
     ///
     /// Gets the description of the last error.
     /// @return The last error description.
@@ -109,6 +167,14 @@ public:
     ///
     uint8 GetProgress();
 
+    ///
+    /// Gets the rate at which upgrade data is being sent, or was sent in
+    /// the last operation, summed for all devices.
+    /// @return Throughput in bytes per second.
+    /// @see hidDfuGetThroughput.
+    ///
+    uint32 GetThroughput();
+
     ///
     /// Gets the result of the last operation from the devices.
     /// An error will be returned if an operation is ongoing, or if 
@@ -175,22 +241,18 @@ private:
     class CHidDevInfo
     {
     public:
-        HANDLE mDeviceHandle;
-        std::string mDevPath;
-        USHORT mFeatureReportLength;
-        DEVINST mUsbHubDevInst;     //< Device Instance of the top-level device with matchig VID (in USB Tree)
-        uint16 mVid;                //< Vendor ID
-        uint16 mPid;                //< Product ID
-        uint16 mUsage;              //< USB usage value
-        uint16 mUsagePage;          //< USB usage page value
-
-        CHidDevInfo(HANDLE aDeviceHandle, const std::string &aDevPath,
-            USHORT aFeatureReportLength, DEVINST aUsbHubDevInst,
-            uint16 aVid, uint16 aPid, uint16 aUsage, uint16 aUsagePage)
-            : mDeviceHandle(aDeviceHandle), mDevPath(aDevPath),
-              mFeatureReportLength(aFeatureReportLength),
-              mUsbHubDevInst(aUsbHubDevInst),
-              mVid(aVid), mPid(aPid), mUsage(aUsage), mUsagePage(aUsagePage) {};
+        CHidTransport *mpTransport;         //< Open transport to the device, used by the device object
+        CHidTransport::CDeviceInfo mInfo;   //< Device path, parent USB device, IDs and report lengths
+
+        CHidDevInfo(CHidTransport *apTransport, const CHidTransport::CDeviceInfo &aInfo)
+            : mpTransport(apTransport), mInfo(aInfo) {};
+
+        // The transport outlives the device objects, which are deleted first
+        ~CHidDevInfo() { delete mpTransport; };
+
+    private:
+        CHidDevInfo(const CHidDevInfo&);
+        CHidDevInfo& operator=(const CHidDevInfo&);
     };
 
     typedef std::vector <CHidDevInfo *> HidDevInfoVctr;
@@ -203,41 +265,38 @@ private:
     /// CHidDfuDevice Vector, holds information of matching HidDfu devices
     HidDfuDeviceVctr mHidDfuDevices;
 
-    // File suffix structure.
-    // The DFU suffix is defined as offsets from the end of the file, which
-    // is why the fields are listed in the opposite of expected order and
-    // why the "DFU" string for ucDfuSignature is reversed
-    // 
-    // uint16 bcdDevice         0x0001      (not used) This can be used to hold the stack software build integer
-    // uint16 idProduct         0xFFFE      USB Product ID
-    // uint16 idVendor          0x0A12      USB Vendor ID
-    // uint16 bcdDfu            0x0100      DFU specification number (1.0)
-    // uint8 ucDfuSignature[3]  "UFD"       DFU Signature string
-    // uint8 bLength            0x10        DFU Suffix length
-    // uint32 dwCRC                         Added in code, not a constant
-    struct DfuFileSuffix
-    {
-        uint16  bcdDevice;
-        uint16  idProduct;
-        uint16  idVendor;
-        uint16  bcdDfu;
-        uint8   ucDfuSignature[3];
-        uint8   bLength;
-        uint32  dwCrc;
-    };
-
-    /// Standard DFU file suffix data (that expected from a DFU file)
-    static const DfuFileSuffix STANDARD_DFU_SUFFIX;
-
-    /// Length of file suffix without CRC (because the CRC calculation doesn't include itself)
-    static const size_t DFU_SUFFIX_WITHOUT_CRC_LEN = sizeof(DfuFileSuffix) - sizeof(uint32);
-
     /// Last error message
     CHidDfuErrorMsg mLastError;
 
     /// Operation progress (average for all HidDfu devices)
     uint8 mProgress;
 
+    /// Files which have passed validation, for repeated upgrades
+    CImageCache mImageCache;
+
+    /// Whether DFU files are validated through a sidecar index file
+    bool mUseValidationIndex;
+
+    /// Number of upgrade data reports kept in flight (0 for a fixed delay)
+    uint8 mDataWindow;
+
+    /// Whether application upgrades are recorded in a resume journal file
+    bool mUseResumeJournal;
+
+    /// Runs the application upgrades of all the devices on a few worker threads
+    CHidDfuScheduler mScheduler;
+
+    /// Tells devices rebooting after an upgrade when they are added back,
+    /// stopped before the scheduler the devices are woken on
+    CHidArrivalMonitor mArrivalMonitor;
+
+    /// Most threads used to read the versions of the devices
+    static const size_t MAX_VERSION_THREADS = 16;
+
+    /// Version of each device, by index in mHidDfuDevices. An entry read
+    /// successfully is kept until the device is disconnected, upgraded or reset.
+    std::vector<HidDfuDeviceVersion> mVersions;
+
     ///
     /// Queries if all the matching HidDfu devices are connected
     /// @return true if all devices are connected, false otherwise.
@@ -256,14 +315,19 @@ private:
     void DeleteHidDevInfo();
 
     ///
-    /// Gets the Device Instance of top level parent device (USB Hub in USB tree)
-    /// which has same VID as the child device instance.
-    /// @param[in] aChildDevInst Device Instance of the HID device.
-    /// @param[out] aParentDevInst Device Instance of USB Hub for the device.
-    /// @param[in] aVid Vendor Identifier
-    /// @return The result.
+    /// Reads the version of each device which has not already been read,
+    /// reading the devices at the same time. The devices must have been created.
+    /// @param[in] aRefresh Whether to read all the versions again.
+    /// @return The result, the error of the first device which failed.
     ///
-    int32 GetUsbHubDevInst(DEVINST aChildDevInst, DEVINST &aParentDevInst, uint16 aVid);
+    int32 ReadVersions(bool aRefresh);
+
+    ///
+    /// Reads the versions of devices in turn, on one of the threads of ReadVersions.
+    /// @param[in] aIndexes Indexes of the devices to read.
+    /// @param[in, out] aNext Position in aIndexes of the next device to read.
+    ///
+    void ReadVersionsFunc(const std::vector<size_t> &aIndexes, std::atomic<size_t> &aNext);
 
     ///
     /// Validates a DFU binary file.
@@ -275,9 +339,25 @@ private:
     ///
     /// Validates a DFU file by checking its suffix data and CRC.
     /// @param[in] apFile File name.
+    /// @param[out] apIndex If not NULL, receives the validation index of the
+    /// file when it is validated through one (left empty otherwise).
+    /// @return The result.
+    ///
+    int32 ValidateDfuFile(const char *apFile, DfuIndexPtr *apIndex = NULL);
+
+    ///
+    /// Validates a DFU or DFU binary file, unless the unchanged file has
+    /// already been validated.
+    /// @param[in] apFile File name.
+    /// @param[in] aType Type of file.
+    /// @param[out] apImage Mapped image for a DFU binary file, mapped on
+    /// each call and not kept by the cache.
+    /// @param[out] apIndex If not NULL, receives the validation index of a
+    /// DFU file, for checking the data as it is sent (may be left empty).
     /// @return The result.
     ///
-    int32 ValidateDfuFile(const char *apFile);
+    int32 ValidateFileCached(const char *apFile, CImageCache::ImageType aType, UpgradeImagePtr &apImage,
+        DfuIndexPtr *apIndex = NULL);
 };
 
 #endif // #ifndef HID_DFU_ENGINE_H
\ No newline at end of file
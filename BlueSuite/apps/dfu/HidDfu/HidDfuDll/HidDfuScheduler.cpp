@@ -0,0 +1,241 @@
+//*******************************************************************************
+//
+//  HidDfuScheduler.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CHidDfuScheduler class.
+//
+//*******************************************************************************
+
+#include "HidDfuScheduler.h"
+
+#include "engine/enginefw_interface.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <system_error>
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidDfuScheduler::CHidDfuScheduler()
+    : mTaskCount(0),
+    mStopping(false)
+{
+    FUNCTION_DEBUG_SENTRY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidDfuScheduler::~CHidDfuScheduler()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    {
+        // Tasks still scheduled are abandoned once their current step returns
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+        mWorkAvailable.notify_all();
+    }
+
+    for (std::vector<std::thread>::iterator it = mWorkers.begin(); it != mWorkers.end(); ++it)
+    {
+        it->join();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidDfuScheduler::Submit(CTask *apTask)
+{
+    bool retVal = true;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    // Workers which exited when the last task finished are joined before
+    // new ones are started
+    std::vector<std::thread> finished;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        if (mTaskCount == 0)
+        {
+            finished.swap(mWorkers);
+        }
+    }
+
+    for (std::vector<std::thread>::iterator it = finished.begin(); it != finished.end(); ++it)
+    {
+        it->join();
+    }
+
+    const uint32 threadCount = GetThreadCount();
+
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    assert(apTask->mTaskState == CTask::TASK_IDLE);
+
+    try
+    {
+        while (mWorkers.size() < threadCount)
+        {
+            mWorkers.push_back(std::thread(&CHidDfuScheduler::WorkerFunc, this));
+        }
+    }
+    catch (const std::system_error &ex)
+    {
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to start worker thread: %s", ex.what());
+
+        // Fewer workers only limit how many steps run at once
+        retVal = !mWorkers.empty();
+    }
+
+    if (retVal)
+    {
+        ++mTaskCount;
+        MakeReady(apTask);
+        mWorkAvailable.notify_one();
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuScheduler::Wake(CTask *apTask)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (apTask->mTaskState == CTask::TASK_WAITING)
+    {
+        mWaitingTasks.erase(std::make_pair(apTask->mWakeTime, apTask));
+        MakeReady(apTask);
+        mWorkAvailable.notify_one();
+    }
+    else if (apTask->mTaskState == CTask::TASK_RUNNING)
+    {
+        // The step may already have found the device not ready
+        apTask->mWoken = true;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidDfuScheduler::IsScheduled(CTask *apTask)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    return (apTask->mTaskState != CTask::TASK_IDLE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidDfuScheduler::WaitForTask(CTask *apTask, uint32 aTimeoutMs)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    return mTaskFinished.wait_for(lock, std::chrono::milliseconds(aTimeoutMs),
+        [apTask] { return (apTask->mTaskState == CTask::TASK_IDLE); });
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidDfuScheduler::GetThreadCount()
+{
+    uint32 retVal = DEFAULT_THREADS;
+
+    const char *pEnvVar = getenv("HID_SCHEDULER_THREADS");
+    if (pEnvVar != NULL)
+    {
+        // Zero, or a value which does not convert, gives the default
+        const long lVal = strtol(pEnvVar, NULL, 0);
+        if (lVal > 0)
+        {
+            retVal = (static_cast<unsigned long>(lVal) < MAX_THREADS ? static_cast<uint32>(lVal) : MAX_THREADS);
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuScheduler::WorkerFunc()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    while (!mStopping && (mTaskCount > 0))
+    {
+        // Tasks whose wake time has passed are ready
+        const Clock::time_point now = Clock::now();
+        while (!mWaitingTasks.empty() && (mWaitingTasks.begin()->first <= now))
+        {
+            CTask *pTask = mWaitingTasks.begin()->second;
+            mWaitingTasks.erase(mWaitingTasks.begin());
+            MakeReady(pTask);
+        }
+
+        if (!mReadyTasks.empty())
+        {
+            CTask *pTask = mReadyTasks.front();
+            mReadyTasks.pop_front();
+            pTask->mTaskState = CTask::TASK_RUNNING;
+            pTask->mWoken = false;
+
+            // Only wake another worker when there is more to do than this one is taking
+            if (!mReadyTasks.empty())
+            {
+                mWorkAvailable.notify_one();
+            }
+
+            lock.unlock();
+            uint32 waitMs = 0;
+            const bool running = pTask->Step(waitMs);
+            lock.lock();
+
+            if (!running)
+            {
+                pTask->mTaskState = CTask::TASK_IDLE;
+                --mTaskCount;
+                mTaskFinished.notify_all();
+
+                if (mTaskCount == 0)
+                {
+                    // Let the other workers exit
+                    mWorkAvailable.notify_all();
+                }
+            }
+            else if (pTask->mWoken || (waitMs == 0))
+            {
+                MakeReady(pTask);
+            }
+            else
+            {
+                pTask->mTaskState = CTask::TASK_WAITING;
+                pTask->mWakeTime = Clock::now() + std::chrono::milliseconds(waitMs);
+
+                // This worker looks at the wake times again before it sleeps
+                mWaitingTasks.insert(std::make_pair(pTask->mWakeTime, pTask));
+            }
+        }
+        else if (mWaitingTasks.empty())
+        {
+            mWorkAvailable.wait(lock);
+        }
+        else
+        {
+            mWorkAvailable.wait_until(lock, mWaitingTasks.begin()->first);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidDfuScheduler::MakeReady(CTask *apTask)
+{
+    apTask->mTaskState = CTask::TASK_READY;
+    mReadyTasks.push_back(apTask);
+}
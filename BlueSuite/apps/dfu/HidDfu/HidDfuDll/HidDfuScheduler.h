@@ -0,0 +1,157 @@
+//*******************************************************************************
+//
+//  HidDfuScheduler.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CHidDfuScheduler class, runs the operations of many devices on a few
+//  worker threads.
+//
+//*******************************************************************************
+
+#ifndef HID_DFU_SCHEDULER_H
+#define HID_DFU_SCHEDULER_H
+
+#include "common/types.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <utility>
+#include <vector>
+
+///
+/// Scheduler which runs the operations of many devices on a small pool of
+/// worker threads, instead of a thread per device. An operation is a task
+/// broken into steps which never wait for the device: a step sends what it
+/// can, then returns the time until it next needs to run. The task is run
+/// again when that time has passed, or sooner when Wake is called because
+/// the device is ready, so a device waiting for a response holds no thread.
+///
+/// Workers are started by the first task submitted and exit once no tasks
+/// are scheduled, so no thread is left running between operations. The
+/// number of workers is set by the HID_SCHEDULER_THREADS environment
+/// variable.
+///
+class CHidDfuScheduler
+{
+public:
+
+    ///
+    /// An operation run by the scheduler
+    ///
+    class CTask
+    {
+    public:
+        CTask() : mTaskState(TASK_IDLE), mWoken(false) {};
+        virtual ~CTask() {};
+
+        ///
+        /// Runs the next step of the operation, on a worker thread. Steps of
+        /// a task never run concurrently.
+        /// @param[out] aWaitMs Time until the task next needs to run, if it
+        /// is not woken sooner. 0 to run again once other ready tasks have run.
+        /// @return false once the operation has finished.
+        ///
+        virtual bool Step(uint32 &aWaitMs) = 0;
+
+    private:
+
+        friend class CHidDfuScheduler;
+
+        /// Scheduling state of a task
+        typedef enum
+        {
+            TASK_IDLE,      ///< Not scheduled
+            TASK_READY,     ///< Waiting for a worker
+            TASK_RUNNING,   ///< A step is running
+            TASK_WAITING    ///< Waiting to be woken, or for its wake time
+        } TaskState;
+
+        /// Scheduling state, protected by the scheduler's lock
+        TaskState mTaskState;
+        bool mWoken;        //< Woken while running, so it runs again at once
+        std::chrono::steady_clock::time_point mWakeTime;
+    };
+
+    CHidDfuScheduler();
+    ~CHidDfuScheduler();
+
+    ///
+    /// Schedules a task to run, starting the workers if needed.
+    /// @param[in] apTask Task, which must not already be scheduled.
+    /// @return false if no worker could be started.
+    ///
+    bool Submit(CTask *apTask);
+
+    ///
+    /// Runs a waiting task as soon as a worker is free. A task woken while
+    /// a step is running runs again once that step returns. May be called
+    /// from any thread.
+    /// @param[in] apTask Task.
+    ///
+    void Wake(CTask *apTask);
+
+    ///
+    /// Queries whether a task is scheduled.
+    /// @param[in] apTask Task.
+    /// @return true until the task has finished.
+    ///
+    bool IsScheduled(CTask *apTask);
+
+    ///
+    /// Waits for a task to finish.
+    /// @param[in] apTask Task.
+    /// @param[in] aTimeoutMs Maximum time to wait in milliseconds.
+    /// @return true if the task is not scheduled.
+    ///
+    bool WaitForTask(CTask *apTask, uint32 aTimeoutMs);
+
+private:
+
+    CHidDfuScheduler(const CHidDfuScheduler &);
+    CHidDfuScheduler &operator=(const CHidDfuScheduler &);
+
+    typedef std::chrono::steady_clock Clock;
+
+    /// Default number of worker threads
+    static const uint32 DEFAULT_THREADS = 2;
+
+    /// Largest number of worker threads
+    static const uint32 MAX_THREADS = 64;
+
+    ///
+    /// Gets the number of worker threads to run, from HID_SCHEDULER_THREADS.
+    /// @return The number of threads.
+    ///
+    static uint32 GetThreadCount();
+
+    ///
+    /// Worker thread function, runs tasks until none are scheduled.
+    ///
+    void WorkerFunc();
+
+    ///
+    /// Queues a task to run, with mMutex held. The caller wakes a worker
+    /// if none is going to look for work.
+    /// @param[in] apTask Task.
+    ///
+    void MakeReady(CTask *apTask);
+
+    /// Scheduler state, protected by mMutex
+    std::mutex mMutex;
+    std::condition_variable mWorkAvailable;
+    std::condition_variable mTaskFinished;
+    std::deque<CTask *> mReadyTasks;
+    std::set<std::pair<Clock::time_point, CTask *> > mWaitingTasks;
+    std::vector<std::thread> mWorkers;
+    uint32 mTaskCount;      //< Tasks scheduled, the workers exit when it is 0
+    bool mStopping;
+};
+
+#endif // #ifndef HID_DFU_SCHEDULER_H
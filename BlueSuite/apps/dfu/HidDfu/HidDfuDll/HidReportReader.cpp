@@ -0,0 +1,265 @@
+//*******************************************************************************
+//
+//  HidReportReader.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CHidReportReader class.
+//
+//*******************************************************************************
+
+#include "HidReportReader.h"
+
+#include "engine/enginefw_interface.h"
+
+#include <chrono>
+#include <string.h>
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidReportReader::CHidReportReader()
+    : mReadHandle(INVALID_HANDLE_VALUE),
+    mpIo(NULL),
+    mReportLenBytes(0),
+    mQueueHead(0),
+    mQueueCount(0),
+    mWinError(ERROR_SUCCESS),
+    mClosing(false),
+    mpListener(NULL)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    memset(&mOverlapped, 0, sizeof(mOverlapped));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidReportReader::~CHidReportReader()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidReportReader::Open(const std::string &aDevicePath, size_t aReportLenBytes)
+{
+    uint32 retVal = ERROR_SUCCESS;
+    FUNCTION_DEBUG_SENTRY_RET(uint32, retVal);
+
+    Close();
+
+    mReadHandle = CreateFile(aDevicePath.c_str(),
+                             GENERIC_READ,
+                             FILE_SHARE_READ | FILE_SHARE_WRITE,
+                             NULL,
+                             OPEN_EXISTING,
+                             FILE_FLAG_OVERLAPPED,
+                             NULL);
+    if (mReadHandle == INVALID_HANDLE_VALUE)
+    {
+        retVal = ::GetLastError();
+    }
+    else
+    {
+        mpIo = CreateThreadpoolIo(mReadHandle, &CHidReportReader::IoCallback, this, NULL);
+        if (mpIo == NULL)
+        {
+            retVal = ::GetLastError();
+            CloseHandle(mReadHandle);
+            mReadHandle = INVALID_HANDLE_VALUE;
+        }
+    }
+
+    if (retVal == ERROR_SUCCESS)
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+
+        mReportLenBytes = aReportLenBytes;
+        mQueue.assign(QUEUE_DEPTH * aReportLenBytes, 0);
+        mQueueHead = 0;
+        mQueueCount = 0;
+        mWinError = ERROR_SUCCESS;
+        mReadBuffer.assign(aReportLenBytes, 0);
+        mClosing = false;
+
+        StartRead();
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidReportReader::Close()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    if (mpIo != NULL)
+    {
+        {
+            // Cancelled with the lock held, so that the callback cannot
+            // start another read once it has been cancelled
+            std::lock_guard<std::mutex> lock(mMutex);
+            mClosing = true;
+            CancelIoEx(mReadHandle, NULL);
+        }
+
+        // The read must complete before its buffer is released
+        WaitForThreadpoolIoCallbacks(mpIo, FALSE);
+        CloseThreadpoolIo(mpIo);
+        mpIo = NULL;
+    }
+
+    if (mReadHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(mReadHandle);
+        mReadHandle = INVALID_HANDLE_VALUE;
+    }
+
+    std::lock_guard<std::mutex> lock(mMutex);
+    mQueueHead = 0;
+    mQueueCount = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidReportReader::ReadResult CHidReportReader::Read(uint8 *apReport, uint32 aTimeoutMs, uint32 &aBytesRead)
+{
+    ReadResult retVal = READ_TIMEOUT;
+    FUNCTION_DEBUG_SENTRY_RET(ReadResult, retVal);
+
+    aBytesRead = 0;
+
+    std::unique_lock<std::mutex> lock(mMutex);
+
+    if (mReadHandle == INVALID_HANDLE_VALUE)
+    {
+        mWinError = ERROR_INVALID_HANDLE;
+    }
+
+    mReportQueued.wait_for(lock, std::chrono::milliseconds(aTimeoutMs),
+        [this] { return (mQueueCount > 0) || (mWinError != ERROR_SUCCESS); });
+
+    // Reports queued before a read failed are still delivered
+    if (mQueueCount > 0)
+    {
+        aBytesRead = mQueueBytes[mQueueHead];
+        memcpy(apReport, &mQueue[mQueueHead * mReportLenBytes], mReportLenBytes);
+        mQueueHead = (mQueueHead + 1) % QUEUE_DEPTH;
+        --mQueueCount;
+
+        retVal = (aBytesRead == mReportLenBytes ? READ_OK : READ_SHORT);
+    }
+    else if (mWinError != ERROR_SUCCESS)
+    {
+        retVal = READ_FAILED;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidReportReader::GetWinError()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mWinError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidReportReader::SetListener(CHidTransport::CListener *apListener)
+{
+    // Listeners are called with mMutex held
+    std::lock_guard<std::mutex> lock(mMutex);
+    mpListener = apListener;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+VOID CALLBACK CHidReportReader::IoCallback(PTP_CALLBACK_INSTANCE apInstance, PVOID apContext, PVOID apOverlapped,
+    ULONG aIoResult, ULONG_PTR aBytesTransferred, PTP_IO apIo)
+{
+    CHidReportReader *pReader = static_cast<CHidReportReader *>(apContext);
+
+    std::lock_guard<std::mutex> lock(pReader->mMutex);
+
+    if (pReader->mClosing)
+    {
+        // Cancelled, Close is waiting for this callback
+    }
+    else if (aIoResult != NO_ERROR)
+    {
+        pReader->Fail(aIoResult);
+    }
+    else
+    {
+        pReader->Push(pReader->mReadBuffer.data(), static_cast<uint32>(aBytesTransferred));
+        pReader->StartRead();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidReportReader::StartRead()
+{
+    memset(&mOverlapped, 0, sizeof(mOverlapped));
+    StartThreadpoolIo(mpIo);
+
+    // A read which completes at once still completes through the callback
+    if (!ReadFile(mReadHandle, mReadBuffer.data(), static_cast<DWORD>(mReportLenBytes), NULL, &mOverlapped))
+    {
+        const uint32 winError = ::GetLastError();
+        if (winError != ERROR_IO_PENDING)
+        {
+            CancelThreadpoolIo(mpIo);
+            Fail(winError);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidReportReader::Push(const uint8 *apReport, uint32 aBytesRead)
+{
+    if (mQueueCount == QUEUE_DEPTH)
+    {
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Report queue full, oldest report dropped");
+        mQueueHead = (mQueueHead + 1) % QUEUE_DEPTH;
+        --mQueueCount;
+    }
+
+    const size_t slot = (mQueueHead + mQueueCount) % QUEUE_DEPTH;
+    memcpy(&mQueue[slot * mReportLenBytes], apReport, mReportLenBytes);
+    mQueueBytes[slot] = aBytesRead;
+    ++mQueueCount;
+
+    mReportQueued.notify_one();
+
+    if (mpListener != NULL)
+    {
+        mpListener->OnTransportReady();
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidReportReader::Fail(uint32 aWinError)
+{
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Read from device failed, error %u", aWinError);
+
+    mWinError = aWinError;
+    mReportQueued.notify_all();
+
+    if (mpListener != NULL)
+    {
+        mpListener->OnTransportReady();
+    }
+}
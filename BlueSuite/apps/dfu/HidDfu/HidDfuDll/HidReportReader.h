@@ -0,0 +1,146 @@
+//*******************************************************************************
+//
+//  HidReportReader.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CHidReportReader class, reads input reports from a HID device.
+//
+//*******************************************************************************
+
+#ifndef HID_REPORT_READER_H
+#define HID_REPORT_READER_H
+
+#ifdef WIN32
+
+#include "HidTransport.h"
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <windows.h>
+
+///
+/// Class which keeps a read pending on a HID device and queues the input
+/// reports until they are collected. Reads complete on the system thread
+/// pool, which serves every open device, so no thread is held per device.
+/// The device is opened a second time for overlapped reading, so that a
+/// pending read never blocks writes and feature reports on the main device
+/// handle, and can be cancelled when the reader is closed.
+///
+class CHidReportReader
+{
+public:
+
+    /// Result of collecting a report
+    typedef enum
+    {
+        READ_OK,        ///< A full report was collected
+        READ_SHORT,     ///< A report with fewer bytes than expected was collected
+        READ_TIMEOUT,   ///< No report arrived in the time allowed
+        READ_FAILED     ///< Reading from the device failed, see GetWinError
+    } ReadResult;
+
+    /// Maximum number of reports held in the queue, the oldest report is
+    /// dropped if another arrives when the queue is full
+    static const size_t QUEUE_DEPTH = 16;
+
+    CHidReportReader();
+    ~CHidReportReader();
+
+    ///
+    /// Opens the device and starts reading. Reports sent by the device from
+    /// this point on are queued.
+    /// @param[in] aDevicePath Device path.
+    /// @param[in] aReportLenBytes Input report length, including the report ID.
+    /// @return ERROR_SUCCESS, or the Windows error code on failure.
+    ///
+    uint32 Open(const std::string &aDevicePath, size_t aReportLenBytes);
+
+    ///
+    /// Cancels the pending read, waiting for it to complete, and closes the
+    /// device. Queued reports are discarded.
+    ///
+    void Close();
+
+    ///
+    /// Collects the oldest queued report, waiting for one to arrive if the
+    /// queue is empty. Returns as soon as a report is queued.
+    /// @param[out] apReport Buffer for the report, of the input report length.
+    /// @param[in] aTimeoutMs Maximum time to wait in milliseconds.
+    /// @param[out] aBytesRead Number of bytes in the report.
+    /// @return The result.
+    ///
+    ReadResult Read(uint8 *apReport, uint32 aTimeoutMs, uint32 &aBytesRead);
+
+    ///
+    /// Gets the Windows error code of a failed read.
+    /// @return The error code.
+    ///
+    uint32 GetWinError();
+
+    ///
+    /// Sets the listener told when a report is queued or reading fails.
+    /// @param[in] apListener The listener, NULL for none. The previous
+    /// listener is not called once this returns.
+    ///
+    void SetListener(CHidTransport::CListener *apListener);
+
+private:
+
+    ///
+    /// Thread pool callback for a completed read, queues the report and
+    /// starts the next read.
+    ///
+    static VOID CALLBACK IoCallback(PTP_CALLBACK_INSTANCE apInstance, PVOID apContext, PVOID apOverlapped,
+        ULONG aIoResult, ULONG_PTR aBytesTransferred, PTP_IO apIo);
+
+    ///
+    /// Starts a read, with mMutex held.
+    ///
+    void StartRead();
+
+    ///
+    /// Adds a report to the queue and wakes a waiting caller, with mMutex held.
+    /// @param[in] apReport The report.
+    /// @param[in] aBytesRead Number of bytes in the report.
+    ///
+    void Push(const uint8 *apReport, uint32 aBytesRead);
+
+    ///
+    /// Records a failed read and wakes a waiting caller, with mMutex held.
+    /// @param[in] aWinError Windows error code.
+    ///
+    void Fail(uint32 aWinError);
+
+    /// Handle of the device opened for overlapped reading
+    HANDLE mReadHandle;
+
+    /// Thread pool I/O object on which reads complete
+    PTP_IO mpIo;
+
+    /// Input report length
+    size_t mReportLenBytes;
+
+    /// Queue and read state, protected by mMutex. The queue is a ring of
+    /// QUEUE_DEPTH report slots allocated on Open.
+    std::mutex mMutex;
+    std::condition_variable mReportQueued;
+    std::vector<uint8> mQueue;
+    uint32 mQueueBytes[QUEUE_DEPTH];
+    size_t mQueueHead;
+    size_t mQueueCount;
+    uint32 mWinError;
+    OVERLAPPED mOverlapped;
+    std::vector<uint8> mReadBuffer;
+    bool mClosing;
+    CHidTransport::CListener *mpListener;
+};
+
+#endif // #ifdef WIN32
+
+#endif // #ifndef HID_REPORT_READER_H
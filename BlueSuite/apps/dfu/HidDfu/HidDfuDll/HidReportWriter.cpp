@@ -0,0 +1,277 @@
+//*******************************************************************************
+//
+//  HidReportWriter.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CHidReportWriter class.
+//
+//*******************************************************************************
+
+#include "HidReportWriter.h"
+
+#include "engine/enginefw_interface.h"
+#include "time/stop_watch.h"
+
+#include <string.h>
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidReportWriter::CHidReportWriter()
+    : mWriteHandle(INVALID_HANDLE_VALUE),
+    mReportLenBytes(0),
+    mWindow(0),
+    mHead(0),
+    mInFlight(0),
+    mLastWaitMs(0),
+    mWinError(ERROR_SUCCESS),
+    mpListener(NULL),
+    mListenerWait(NULL)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    memset(mOverlapped, 0, sizeof(mOverlapped));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidReportWriter::~CHidReportWriter()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidReportWriter::Open(const std::string &aDevicePath, size_t aReportLenBytes, uint8 aWindow)
+{
+    uint32 retVal = ERROR_SUCCESS;
+    FUNCTION_DEBUG_SENTRY_RET(uint32, retVal);
+
+    Close();
+
+    if (aWindow == 0 || aWindow > MAX_WINDOW)
+    {
+        retVal = ERROR_INVALID_PARAMETER;
+    }
+    else
+    {
+        mWriteHandle = CreateFile(aDevicePath.c_str(),
+                                  GENERIC_WRITE,
+                                  FILE_SHARE_READ | FILE_SHARE_WRITE,
+                                  NULL,
+                                  OPEN_EXISTING,
+                                  FILE_FLAG_OVERLAPPED,
+                                  NULL);
+        if (mWriteHandle == INVALID_HANDLE_VALUE)
+        {
+            retVal = ::GetLastError();
+        }
+    }
+
+    for (uint8 slot = 0; (retVal == ERROR_SUCCESS) && (slot < aWindow); ++slot)
+    {
+        mOverlapped[slot].hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (mOverlapped[slot].hEvent == NULL)
+        {
+            retVal = ::GetLastError();
+        }
+    }
+
+    if (retVal == ERROR_SUCCESS)
+    {
+        mReportLenBytes = aReportLenBytes;
+        mWindow = aWindow;
+        mReports.assign(aWindow * aReportLenBytes, 0);
+        mHead = 0;
+        mInFlight = 0;
+        mWinError = ERROR_SUCCESS;
+    }
+    else
+    {
+        Close();
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidReportWriter::Close()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    CancelWait();
+
+    if (mInFlight > 0)
+    {
+        // The writes must complete before their buffers are released
+        CancelIo(mWriteHandle);
+        for (; mInFlight > 0; --mInFlight, mHead = (mHead + 1) % mWindow)
+        {
+            DWORD bytesWritten = 0;
+            GetOverlappedResult(mWriteHandle, &mOverlapped[mHead], &bytesWritten, TRUE);
+        }
+    }
+
+    for (uint8 slot = 0; slot < MAX_WINDOW; ++slot)
+    {
+        if (mOverlapped[slot].hEvent != NULL)
+        {
+            CloseHandle(mOverlapped[slot].hEvent);
+        }
+    }
+    memset(mOverlapped, 0, sizeof(mOverlapped));
+
+    if (mWriteHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(mWriteHandle);
+        mWriteHandle = INVALID_HANDLE_VALUE;
+    }
+
+    mWindow = 0;
+    mHead = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidReportWriter::WriteResult CHidReportWriter::GetReport(uint32 aTimeoutMs, uint8 *&appReport)
+{
+    WriteResult retVal = WRITE_OK;
+
+    StopWatch waitTime;
+
+    if (mInFlight == mWindow)
+    {
+        // The listener is told once half the window is free
+        retVal = Complete(aTimeoutMs, static_cast<uint8>((mInFlight + 1) / 2));
+    }
+
+    mLastWaitMs = waitTime.duration();
+
+    if (retVal == WRITE_OK)
+    {
+        appReport = &mReports[((mHead + mInFlight) % mWindow) * mReportLenBytes];
+        memset(appReport, 0, mReportLenBytes);
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidReportWriter::WriteResult CHidReportWriter::Write()
+{
+    WriteResult retVal = WRITE_OK;
+
+    const size_t slot = (mHead + mInFlight) % mWindow;
+    ResetEvent(mOverlapped[slot].hEvent);
+
+    if (!WriteFile(mWriteHandle, &mReports[slot * mReportLenBytes], static_cast<DWORD>(mReportLenBytes),
+            NULL, &mOverlapped[slot])
+        && (::GetLastError() != ERROR_IO_PENDING))
+    {
+        mWinError = ::GetLastError();
+        retVal = WRITE_FAILED;
+    }
+    else
+    {
+        ++mInFlight;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidReportWriter::WriteResult CHidReportWriter::Flush(uint32 aTimeoutMs)
+{
+    WriteResult retVal = WRITE_OK;
+    FUNCTION_DEBUG_SENTRY_RET(WriteResult, retVal);
+
+    StopWatch waitTime;
+
+    while ((retVal == WRITE_OK) && (mInFlight > 0))
+    {
+        retVal = Complete(aTimeoutMs, mInFlight);
+    }
+
+    mLastWaitMs = waitTime.duration();
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidReportWriter::WriteResult CHidReportWriter::Complete(uint32 aTimeoutMs, uint8 aNotifyWrites)
+{
+    WriteResult retVal = WRITE_OK;
+
+    if (WaitForSingleObject(mOverlapped[mHead].hEvent, aTimeoutMs) != WAIT_OBJECT_0)
+    {
+        // Left in flight, Close cancels it
+        retVal = WRITE_TIMEOUT;
+
+        if ((aTimeoutMs == 0) && (mpListener != NULL))
+        {
+            // Tell the listener when the writes complete, from the thread
+            // pool. Writes complete in order, so one event is waited for.
+            const size_t slot = (mHead + aNotifyWrites - 1) % mWindow;
+            CancelWait();
+            if (!RegisterWaitForSingleObject(&mListenerWait, mOverlapped[slot].hEvent, &CHidReportWriter::WaitCallback,
+                    this, INFINITE, WT_EXECUTEONLYONCE))
+            {
+                mListenerWait = NULL;
+                mWinError = ::GetLastError();
+                retVal = WRITE_FAILED;
+            }
+        }
+    }
+    else
+    {
+        DWORD bytesWritten = 0;
+        if (!GetOverlappedResult(mWriteHandle, &mOverlapped[mHead], &bytesWritten, FALSE))
+        {
+            mWinError = ::GetLastError();
+            retVal = WRITE_FAILED;
+        }
+
+        mHead = (mHead + 1) % mWindow;
+        --mInFlight;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidReportWriter::SetListener(CHidTransport::CListener *apListener)
+{
+    CancelWait();
+    mpListener = apListener;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+VOID CALLBACK CHidReportWriter::WaitCallback(PVOID apContext, BOOLEAN aTimedOut)
+{
+    CHidReportWriter *pWriter = static_cast<CHidReportWriter *>(apContext);
+    pWriter->mpListener->OnTransportReady();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidReportWriter::CancelWait()
+{
+    if (mListenerWait != NULL)
+    {
+        UnregisterWaitEx(mListenerWait, INVALID_HANDLE_VALUE);
+        mListenerWait = NULL;
+    }
+}
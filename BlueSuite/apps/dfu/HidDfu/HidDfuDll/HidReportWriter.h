@@ -0,0 +1,172 @@
+//*******************************************************************************
+//
+//  HidReportWriter.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CHidReportWriter class, writes output reports to a HID device with
+//  several reports in flight.
+//
+//*******************************************************************************
+
+#ifndef HID_REPORT_WRITER_H
+#define HID_REPORT_WRITER_H
+
+#ifdef WIN32
+
+#include "HidTransport.h"
+
+#include <string>
+#include <vector>
+
+#include <windows.h>
+
+///
+/// Class which writes output reports to a HID device without waiting for
+/// each write to complete before starting the next, up to a window of
+/// reports in flight. The device is opened a second time for overlapped
+/// writing. The USB stack completes each write when the device has accepted
+/// the report, so the window is paced by the device itself.
+///
+/// Reports written through this class may overtake writes made on another
+/// handle, so Flush must be called before the next message is sent on
+/// the main device handle.
+///
+class CHidReportWriter
+{
+public:
+
+    /// Result of a write operation
+    typedef enum
+    {
+        WRITE_OK,       ///< Completed
+        WRITE_TIMEOUT,  ///< A write did not complete in the time allowed
+        WRITE_FAILED    ///< Writing to the device failed, see GetWinError
+    } WriteResult;
+
+    /// Largest window supported
+    static const uint8 MAX_WINDOW = 16;
+
+    CHidReportWriter();
+    ~CHidReportWriter();
+
+    ///
+    /// Opens the device for writing.
+    /// @param[in] aDevicePath Device path.
+    /// @param[in] aReportLenBytes Output report length, including the report ID.
+    /// @param[in] aWindow Maximum number of reports in flight (1 to MAX_WINDOW).
+    /// @return ERROR_SUCCESS, or the Windows error code on failure.
+    ///
+    uint32 Open(const std::string &aDevicePath, size_t aReportLenBytes, uint8 aWindow);
+
+    ///
+    /// Cancels any writes in flight and closes the device.
+    ///
+    void Close();
+
+    ///
+    /// Queries whether the device is open.
+    /// @return true if open.
+    ///
+    bool IsOpen() const { return mWriteHandle != INVALID_HANDLE_VALUE; }
+
+    ///
+    /// Gets a free report buffer, waiting for the oldest write to complete
+    /// if the window is full. The message is built in this buffer, then
+    /// written with Write.
+    /// @param[in] aTimeoutMs Maximum time to wait for a write to complete.
+    /// @param[out] appReport Report buffer, of the output report length.
+    /// @return The result.
+    ///
+    WriteResult GetReport(uint32 aTimeoutMs, uint8 *&appReport);
+
+    ///
+    /// Starts writing the report buffer last given by GetReport.
+    /// @return The result.
+    ///
+    WriteResult Write();
+
+    ///
+    /// Waits for all the writes in flight to complete.
+    /// @param[in] aTimeoutMs Maximum time to wait for each write to complete.
+    /// @return The result.
+    ///
+    WriteResult Flush(uint32 aTimeoutMs);
+
+    ///
+    /// Gets the time the last GetReport or Flush spent waiting for the
+    /// device to accept reports.
+    /// @return The time in milliseconds.
+    ///
+    uint32 GetLastWaitMs() const { return mLastWaitMs; }
+
+    ///
+    /// Gets the Windows error code of a failed write.
+    /// @return The error code.
+    ///
+    uint32 GetWinError() const { return mWinError; }
+
+    ///
+    /// Sets the listener told when the oldest write in flight completes,
+    /// after GetReport or Flush has timed out with a zero timeout.
+    /// @param[in] apListener The listener, NULL for none. The previous
+    /// listener is not called once this returns.
+    ///
+    void SetListener(CHidTransport::CListener *apListener);
+
+private:
+
+    ///
+    /// Thread pool callback for the completion of the write being waited for.
+    ///
+    static VOID CALLBACK WaitCallback(PVOID apContext, BOOLEAN aTimedOut);
+
+    ///
+    /// Stops waiting for a write to complete for the listener, waiting for
+    /// any callback in progress.
+    ///
+    void CancelWait();
+
+    ///
+    /// Waits for the oldest write in flight to complete.
+    /// @param[in] aTimeoutMs Maximum time to wait.
+    /// @param[in] aNotifyWrites Writes which must complete before the listener
+    /// is told, if the wait times out with a zero timeout.
+    /// @return The result.
+    ///
+    WriteResult Complete(uint32 aTimeoutMs, uint8 aNotifyWrites);
+
+    /// Handle of the device opened for overlapped writing
+    HANDLE mWriteHandle;
+
+    /// Output report length
+    size_t mReportLenBytes;
+
+    /// Window size
+    uint8 mWindow;
+
+    /// One report buffer and overlapped structure per report in flight,
+    /// used as a ring
+    std::vector<uint8> mReports;
+    OVERLAPPED mOverlapped[MAX_WINDOW];
+    size_t mHead;
+    size_t mInFlight;
+
+    /// Time the last GetReport or Flush waited
+    uint32 mLastWaitMs;
+
+    /// Error code of a failed write
+    uint32 mWinError;
+
+    /// Told when a write completes, NULL for none
+    CHidTransport::CListener *mpListener;
+
+    /// Thread pool wait for the listener, NULL when not waiting
+    HANDLE mListenerWait;
+};
+
+#endif // #ifdef WIN32
+
+#endif // #ifndef HID_REPORT_WRITER_H
@@ -0,0 +1,86 @@
+//*******************************************************************************
+//
+//  HidTransport.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CHidTransport class, choosing between the transport
+//  of the host and, in HidDfuBench only, simulated devices.
+//
+//*******************************************************************************
+
+#include "HidTransport.h"
+
+// The simulated transport is built into HidDfuBench, never into the library
+#ifdef HIDDFU_SIM_TRANSPORT
+#include "HidTransportSim.h"
+#endif
+
+#include "engine/enginefw_interface.h"
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport *CHidTransport::Create()
+{
+    CHidTransport *pTransport = NULL;
+
+#ifdef HIDDFU_SIM_TRANSPORT
+    pTransport = new CHidTransportSim();
+#else
+    pTransport = CreateHost();
+#endif
+
+    return pTransport;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransport::Enumerate(uint16 aVid, uint16 aPid, uint16 aUsage, uint16 aUsagePage,
+    std::vector<CDeviceInfo> &aDevices)
+{
+    bool retVal = false;
+
+#ifdef HIDDFU_SIM_TRANSPORT
+    retVal = CHidTransportSim::EnumerateDevices(aVid, aPid, aUsage, aUsagePage, aDevices);
+#else
+    retVal = EnumerateHost(aVid, aPid, aUsage, aUsagePage, aDevices);
+#endif
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransport::FindDevice(const std::string &aParentId, uint16 aVid, uint16 aPid,
+    uint16 aUsage, uint16 aUsagePage, std::string &aDevicePath)
+{
+    bool retVal = false;
+
+#ifdef HIDDFU_SIM_TRANSPORT
+    retVal = CHidTransportSim::FindSimDevice(aParentId, aDevicePath);
+#else
+    retVal = FindHostDevice(aParentId, aVid, aPid, aUsage, aUsagePage, aDevicePath);
+#endif
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::CArrivalWatcher *CHidTransport::WatchArrivals(CArrivalListener *apListener)
+{
+    CArrivalWatcher *pWatcher = NULL;
+
+#ifdef HIDDFU_SIM_TRANSPORT
+    pWatcher = CHidTransportSim::WatchSimArrivals(apListener);
+#else
+    pWatcher = WatchHostArrivals(apListener);
+#endif
+
+    return pWatcher;
+}
@@ -0,0 +1,346 @@
+//*******************************************************************************
+//
+//  HidTransport.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CHidTransport class, the interface through which HidDfu devices access
+//  the HID driver of the host operating system.
+//
+//*******************************************************************************
+
+#ifndef HID_TRANSPORT_H
+#define HID_TRANSPORT_H
+
+#include "common/types.h"
+
+#include <string>
+#include <vector>
+
+///
+/// Class API for access to a HID device. A transport is opened on a device
+/// path found by Enumerate, and carries feature reports, output reports and
+/// input reports to and from the device. There is one implementation per
+/// host operating system, Create returns the one built for this host. The
+/// simulated transport (CHidTransportSim) takes its place when built into
+/// HidDfuBench with HIDDFU_SIM_TRANSPORT defined.
+///
+/// Functions returning bool give the operating system error code of a
+/// failure through GetError.
+///
+class CHidTransport
+{
+public:
+
+    /// Result of reading or writing reports
+    typedef enum
+    {
+        RESULT_OK,          ///< Completed
+        RESULT_SHORT,       ///< A report with fewer bytes than expected was read
+        RESULT_TIMEOUT,     ///< The device did not respond in the time allowed
+        RESULT_FAILED       ///< Access to the device failed, see GetError
+    } Result;
+
+    ///
+    /// Details of a HID device found by Enumerate
+    ///
+    class CDeviceInfo
+    {
+    public:
+        std::string mDevicePath;        //< Path used to open the device
+        std::string mParentId;          //< Identifies the USB device which the HID interface belongs to
+        uint16 mVid;                    //< Vendor ID
+        uint16 mPid;                    //< Product ID
+        uint16 mUsage;                  //< Usage of the top level collection
+        uint16 mUsagePage;              //< Usage page of the top level collection
+        uint16 mInputReportLength;      //< Input report length, including the report ID
+        uint16 mOutputReportLength;     //< Output report length, including the report ID
+        uint16 mFeatureReportLength;    //< Feature report length, including the report ID
+
+        CDeviceInfo()
+            : mVid(0), mPid(0), mUsage(0), mUsagePage(0),
+              mInputReportLength(0), mOutputReportLength(0), mFeatureReportLength(0) {};
+    };
+
+    ///
+    /// Interface through which a transport tells its user that the device is
+    /// ready, so that several devices can be waited for without a thread
+    /// blocked in each transport
+    ///
+    class CListener
+    {
+    public:
+        virtual ~CListener() {};
+
+        ///
+        /// Called, on a thread of the transport, once a ReadReport,
+        /// GetWindowReport or FlushWindow which returned RESULT_TIMEOUT with
+        /// a zero timeout can be made again without waiting. It may also be
+        /// called when nothing has changed, and must not call the transport.
+        /// After GetWindowReport it is called once half of the window has
+        /// been accepted, rather than the oldest report, so that a device
+        /// sending data wakes its listener once per half window.
+        ///
+        virtual void OnTransportReady() = 0;
+    };
+
+    ///
+    /// Interface through which the arrival of HID devices on the host is
+    /// reported, see WatchArrivals
+    ///
+    class CArrivalListener
+    {
+    public:
+        virtual ~CArrivalListener() {};
+
+        ///
+        /// Called, on a thread of the watcher, when a HID device has been
+        /// added to the host. The device may not be ready to open for a
+        /// short time after.
+        /// @param[in] aInfo Parent ID, VID and PID of the device. The parent
+        /// ID is empty, and the VID and PID zero, if the host does not give them.
+        ///
+        virtual void OnDeviceArrival(const CDeviceInfo &aInfo) = 0;
+    };
+
+    ///
+    /// Watcher of the HID devices added to the host, created by
+    /// WatchArrivals. Deleting it stops the watching, waiting for any call
+    /// to the listener in progress.
+    ///
+    class CArrivalWatcher
+    {
+    public:
+        virtual ~CArrivalWatcher() {};
+    };
+
+    /// Maximum number of reports in flight for windowed writing
+    static const uint8 MAX_WINDOW = 16;
+
+    virtual ~CHidTransport() {};
+
+    ///
+    /// Creates a transport for this host, not yet opened.
+    /// @return The transport, to be deleted by the caller.
+    ///
+    static CHidTransport *Create();
+
+    ///
+    /// Finds the HID devices with a matching VID, PID, usage and usage page.
+    /// Usage and usage page are not checked if zero.
+    /// @param[in] aVid Vendor ID.
+    /// @param[in] aPid Product ID.
+    /// @param[in] aUsage Usage.
+    /// @param[in] aUsagePage Usage page.
+    /// @param[out] aDevices Details of the matching devices.
+    /// @return false if the HID devices of the host could not be listed.
+    ///
+    static bool Enumerate(uint16 aVid, uint16 aPid, uint16 aUsage, uint16 aUsagePage,
+        std::vector<CDeviceInfo> &aDevices);
+
+    ///
+    /// Finds a matching HID device which belongs to the given USB device,
+    /// used to find a device again after it has rebooted.
+    /// @param[in] aParentId USB device identifier, from CDeviceInfo.
+    /// @param[in] aVid Vendor ID.
+    /// @param[in] aPid Product ID.
+    /// @param[in] aUsage Usage, not checked if zero.
+    /// @param[in] aUsagePage Usage page, not checked if zero.
+    /// @param[out] aDevicePath Path used to open the device.
+    /// @return true if the device was found.
+    ///
+    static bool FindDevice(const std::string &aParentId, uint16 aVid, uint16 aPid,
+        uint16 aUsage, uint16 aUsagePage, std::string &aDevicePath);
+
+    ///
+    /// Starts watching for HID devices added to the host, such as a device
+    /// returning from a reboot, so that it can be opened without polling.
+    /// @param[in] apListener Listener told of each device added.
+    /// @return The watcher, to be deleted by the caller, or NULL if the
+    /// host cannot report devices being added.
+    ///
+    static CArrivalWatcher *WatchArrivals(CArrivalListener *apListener);
+
+    ///
+    /// Gets a readable description of an operating system error code.
+    /// @param[in] aError Error code.
+    /// @return The description.
+    ///
+    static std::string GetErrorText(uint32 aError);
+
+    ///
+    /// Opens the device.
+    /// @param[in] aDevicePath Device path.
+    /// @return true on success.
+    ///
+    virtual bool Open(const std::string &aDevicePath) = 0;
+
+    ///
+    /// Stops reading, cancels any windowed writes and closes the device.
+    ///
+    virtual void Close() = 0;
+
+    ///
+    /// Queries whether the device is open.
+    /// @return true if open.
+    ///
+    virtual bool IsOpen() const = 0;
+
+    ///
+    /// Gets the report lengths declared by the device.
+    /// @param[out] aInputLength Input report length, including the report ID.
+    /// @param[out] aOutputLength Output report length, including the report ID.
+    /// @param[out] aFeatureLength Feature report length, including the report ID.
+    /// @return true on success.
+    ///
+    virtual bool GetReportLengths(uint16 &aInputLength, uint16 &aOutputLength, uint16 &aFeatureLength) = 0;
+
+    ///
+    /// Sends a feature report.
+    /// @param[in] apReport Report, starting with the report ID.
+    /// @param[in] aLength Report length.
+    /// @return true on success.
+    ///
+    virtual bool SetFeature(const uint8 *apReport, size_t aLength) = 0;
+
+    ///
+    /// Gets a feature report.
+    /// @param[in,out] apReport Report buffer, the first byte set to the report ID.
+    /// @param[in] aLength Report length.
+    /// @return true on success.
+    ///
+    virtual bool GetFeature(uint8 *apReport, size_t aLength) = 0;
+
+    ///
+    /// Writes an output report, waiting for the device to accept it.
+    /// @param[in] apReport Report, starting with the report ID.
+    /// @param[in] aLength Report length.
+    /// @return true on success.
+    ///
+    virtual bool WriteReport(const uint8 *apReport, size_t aLength) = 0;
+
+    ///
+    /// Waits for reports written with WriteReport to be sent.
+    ///
+    virtual void FlushOutput() = 0;
+
+    ///
+    /// Starts collecting input reports. Reports sent by the device from this
+    /// point on are held until read with ReadReport.
+    /// @param[in] aReportLength Input report length, including the report ID.
+    /// @return true on success.
+    ///
+    virtual bool StartReading(size_t aReportLength) = 0;
+
+    ///
+    /// Stops collecting input reports, any held are discarded.
+    ///
+    virtual void StopReading() = 0;
+
+    ///
+    /// Reads the oldest input report, waiting for one to arrive if none is
+    /// held. Returns as soon as a report arrives.
+    /// @param[out] apReport Buffer for the report, of the input report length.
+    /// The first byte is the report ID.
+    /// @param[in] aTimeoutMs Maximum time to wait in milliseconds.
+    /// @param[out] aBytesRead Number of bytes in the report.
+    /// @return The result.
+    ///
+    virtual Result ReadReport(uint8 *apReport, uint32 aTimeoutMs, uint32 &aBytesRead) = 0;
+
+    ///
+    /// Starts writing output reports without waiting for each to be
+    /// accepted by the device, up to a window of reports in flight.
+    /// @param[in] aReportLength Output report length, including the report ID.
+    /// @param[in] aWindow Maximum number of reports in flight (1 to MAX_WINDOW).
+    /// @return true on success.
+    ///
+    virtual bool OpenWindow(size_t aReportLength, uint8 aWindow) = 0;
+
+    ///
+    /// Cancels any reports in flight and stops windowed writing.
+    ///
+    virtual void CloseWindow() = 0;
+
+    ///
+    /// Queries whether windowed writing has been started.
+    /// @return true if started.
+    ///
+    virtual bool IsWindowOpen() const = 0;
+
+    ///
+    /// Gets a free report buffer for windowed writing, waiting for the oldest
+    /// report in flight to be accepted if the window is full.
+    /// @param[in] aTimeoutMs Maximum time to wait.
+    /// @param[out] appReport Report buffer, of the output report length.
+    /// @return The result.
+    ///
+    virtual Result GetWindowReport(uint32 aTimeoutMs, uint8 *&appReport) = 0;
+
+    ///
+    /// Starts writing the report buffer last given by GetWindowReport.
+    /// @return The result.
+    ///
+    virtual Result WriteWindowReport() = 0;
+
+    ///
+    /// Waits for all the reports in flight to be accepted.
+    /// @param[in] aTimeoutMs Maximum time to wait for each report.
+    /// @return The result.
+    ///
+    virtual Result FlushWindow(uint32 aTimeoutMs) = 0;
+
+    ///
+    /// Gets the time the last GetWindowReport or FlushWindow spent waiting
+    /// for the device to accept reports.
+    /// @return The time in milliseconds.
+    ///
+    virtual uint32 GetLastWaitMs() const = 0;
+
+    ///
+    /// Gets the operating system error code of the last failure.
+    /// @return The error code.
+    ///
+    virtual uint32 GetError() const = 0;
+
+    ///
+    /// Sets the listener told when the device is ready. The listener is kept
+    /// when the device is closed and opened again.
+    /// @param[in] apListener The listener, NULL for none. The previous
+    /// listener is not called once this returns.
+    ///
+    virtual void SetListener(CListener *apListener) = 0;
+
+private:
+
+    ///
+    /// Creates the transport for the host operating system, see Create.
+    /// Implemented in the file of the host transport.
+    /// @return The transport, to be deleted by the caller.
+    ///
+    static CHidTransport *CreateHost();
+
+    ///
+    /// Finds the HID devices of the host, see Enumerate.
+    /// Implemented in the file of the host transport.
+    ///
+    static bool EnumerateHost(uint16 aVid, uint16 aPid, uint16 aUsage, uint16 aUsagePage,
+        std::vector<CDeviceInfo> &aDevices);
+
+    ///
+    /// Finds a HID device of the host after a reboot, see FindDevice.
+    /// Implemented in the file of the host transport.
+    ///
+    static bool FindHostDevice(const std::string &aParentId, uint16 aVid, uint16 aPid,
+        uint16 aUsage, uint16 aUsagePage, std::string &aDevicePath);
+
+    ///
+    /// Starts watching for HID devices added to the host, see WatchArrivals.
+    /// Implemented in the file of the host transport.
+    ///
+    static CArrivalWatcher *WatchHostArrivals(CArrivalListener *apListener);
+};
+
+#endif // #ifndef HID_TRANSPORT_H
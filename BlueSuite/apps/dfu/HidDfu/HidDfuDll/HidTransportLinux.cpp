@@ -0,0 +1,1336 @@
+//*******************************************************************************
+//
+//  HidTransportLinux.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CHidTransportLinux class.
+//
+//*******************************************************************************
+
+#include "HidTransportLinux.h"
+
+#include "engine/enginefw_interface.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
+#include <mutex>
+#include <system_error>
+#include <thread>
+#include <errno.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <linux/hidraw.h>
+#include <linux/netlink.h>
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+namespace
+{
+    ///
+    /// Waits for the devices of all transports with a listener, in one
+    /// thread, calling each listener once its device is ready
+    ///
+    class CPollThread
+    {
+    public:
+        CPollThread()
+            : mpNotifying(NULL),
+            mStopping(false)
+        {
+            mWakePipe[0] = -1;
+            mWakePipe[1] = -1;
+        }
+
+        ~CPollThread()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mMutex);
+                mStopping = true;
+                WakeThread();
+            }
+
+            if (mThread.joinable())
+            {
+                mThread.join();
+            }
+
+            for (size_t end = 0; end < 2; ++end)
+            {
+                if (mWakePipe[end] != -1)
+                {
+                    close(mWakePipe[end]);
+                }
+            }
+        }
+
+        ///
+        /// Calls a listener once, when a device node is ready.
+        /// @param[in] aFd Device node.
+        /// @param[in] aEvents poll() events to wait for.
+        /// @param[in] apListener The listener, replacing any earlier watch for it.
+        /// @return 0, or the error code (errno) if the thread could not be started.
+        ///
+        int Watch(int aFd, short aEvents, CHidTransport::CListener *apListener)
+        {
+            int retVal = 0;
+
+            std::lock_guard<std::mutex> lock(mMutex);
+
+            // Started on first use, so that no thread runs until a device is waited for
+            if (!mThread.joinable())
+            {
+                if (pipe2(mWakePipe, O_CLOEXEC | O_NONBLOCK) != 0)
+                {
+                    retVal = errno;
+                }
+                else
+                {
+                    try
+                    {
+                        mThread = std::thread(&CPollThread::ThreadFunc, this);
+                    }
+                    catch (const std::system_error &ex)
+                    {
+                        retVal = ex.code().value();
+                        close(mWakePipe[0]);
+                        close(mWakePipe[1]);
+                        mWakePipe[0] = -1;
+                        mWakePipe[1] = -1;
+                    }
+                }
+            }
+
+            if (retVal == 0)
+            {
+                mWatches[apListener] = CWatch(aFd, aEvents);
+                WakeThread();
+            }
+
+            return retVal;
+        }
+
+        ///
+        /// Forgets the watch of a listener, waiting for any call in progress.
+        /// It must be called before the device node is closed.
+        /// @param[in] apListener The listener.
+        ///
+        void Cancel(CHidTransport::CListener *apListener)
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            if (mWatches.erase(apListener) > 0)
+            {
+                WakeThread();
+            }
+
+            while (mpNotifying == apListener)
+            {
+                mNotified.wait(lock);
+            }
+        }
+
+    private:
+
+        /// Makes the thread poll again with the current watches, with mMutex held
+        void WakeThread()
+        {
+            if (mWakePipe[1] != -1)
+            {
+                const uint8 wake = 0;
+                (void)write(mWakePipe[1], &wake, 1);
+            }
+        }
+
+        void ThreadFunc()
+        {
+            std::vector<struct pollfd> pollFds;
+            std::vector<CHidTransport::CListener *> listeners;
+
+            std::unique_lock<std::mutex> lock(mMutex);
+
+            while (!mStopping)
+            {
+                struct pollfd pollFd;
+                pollFd.fd = mWakePipe[0];
+                pollFd.events = POLLIN;
+                pollFd.revents = 0;
+                pollFds.assign(1, pollFd);
+                listeners.assign(1, NULL);
+
+                for (WatchMap::const_iterator it = mWatches.begin(); it != mWatches.end(); ++it)
+                {
+                    pollFd.fd = it->second.mFd;
+                    pollFd.events = it->second.mEvents;
+                    pollFds.push_back(pollFd);
+                    listeners.push_back(it->first);
+                }
+
+                lock.unlock();
+                const int ready = poll(pollFds.data(), static_cast<nfds_t>(pollFds.size()), -1);
+                lock.lock();
+
+                if ((ready > 0) && (pollFds[0].revents != 0))
+                {
+                    uint8 drain[64];
+                    while (read(mWakePipe[0], drain, sizeof(drain)) > 0)
+                    {
+                    }
+                }
+
+                // A watch cancelled, or replaced, while polling is not called.
+                // Errors and hangups are notified too, the read then fails.
+                for (size_t index = 1; (ready > 0) && (index < pollFds.size()) && !mStopping; ++index)
+                {
+                    WatchMap::iterator it = mWatches.find(listeners[index]);
+                    if ((pollFds[index].revents != 0) && (it != mWatches.end()) && (it->second.mFd == pollFds[index].fd))
+                    {
+                        mWatches.erase(it);
+
+                        mpNotifying = listeners[index];
+                        lock.unlock();
+                        mpNotifying->OnTransportReady();
+                        lock.lock();
+                        mpNotifying = NULL;
+                        mNotified.notify_all();
+                    }
+                }
+            }
+        }
+
+        /// Device node and poll() events watched for a listener
+        class CWatch
+        {
+        public:
+            int mFd;
+            short mEvents;
+
+            CWatch() : mFd(-1), mEvents(0) {};
+            CWatch(int aFd, short aEvents) : mFd(aFd), mEvents(aEvents) {};
+        };
+
+        typedef std::map<CHidTransport::CListener *, CWatch> WatchMap;
+
+        std::mutex mMutex;
+        std::condition_variable mNotified;
+        WatchMap mWatches;
+        CHidTransport::CListener *mpNotifying;
+        bool mStopping;
+        int mWakePipe[2];
+        std::thread mThread;
+    };
+
+    CPollThread &GetPollThread()
+    {
+        static CPollThread pollThread;
+        return pollThread;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport *CHidTransport::CreateHost()
+{
+    return new CHidTransportLinux();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransport::EnumerateHost(uint16 aVid, uint16 aPid, uint16 aUsage, uint16 aUsagePage,
+    std::vector<CDeviceInfo> &aDevices)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    std::vector<std::string> names;
+    retVal = CHidTransportLinux::ListDevices(names);
+
+    for (std::vector<std::string>::const_iterator itName = names.begin(); itName != names.end(); ++itName)
+    {
+        CDeviceInfo info;
+        if (CHidTransportLinux::CheckDevice(*itName, aVid, aPid, aUsage, aUsagePage, info))
+        {
+            aDevices.push_back(info);
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransport::FindHostDevice(const std::string &aParentId, uint16 aVid, uint16 aPid,
+    uint16 aUsage, uint16 aUsagePage, std::string &aDevicePath)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    aDevicePath.clear();
+
+    // A USB device keeps its sysfs path, which is named after the port it
+    // is plugged into, when it reboots
+    std::vector<std::string> names;
+    (void)CHidTransportLinux::ListDevices(names);
+
+    for (std::vector<std::string>::const_iterator itName = names.begin();
+        (itName != names.end()) && !retVal; ++itName)
+    {
+        CDeviceInfo info;
+        if (CHidTransportLinux::CheckDevice(*itName, aVid, aPid, aUsage, aUsagePage, info)
+            && (info.mParentId == aParentId))
+        {
+            aDevicePath = info.mDevicePath;
+            retVal = true;
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::CArrivalWatcher *CHidTransport::WatchHostArrivals(CArrivalListener *apListener)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    CHidTransportLinux::CArrivalWatcherLinux *pWatcher = new CHidTransportLinux::CArrivalWatcherLinux(apListener);
+
+    const int error = pWatcher->Start();
+    if (error != 0)
+    {
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Cannot watch for devices being added: %s",
+            GetErrorText(static_cast<uint32>(error)).c_str());
+        delete pWatcher;
+        pWatcher = NULL;
+    }
+
+    return pWatcher;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::string CHidTransport::GetErrorText(uint32 aError)
+{
+    return std::system_category().message(static_cast<int>(aError));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransportLinux::CHidTransportLinux()
+    : mFd(-1),
+    mReadLength(0),
+    mLastWaitMs(0),
+    mError(0),
+    mpListener(NULL)
+{
+    FUNCTION_DEBUG_SENTRY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransportLinux::~CHidTransportLinux()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::Open(const std::string &aDevicePath)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    Close();
+
+    mFd = open(aDevicePath.c_str(), O_RDWR | O_NONBLOCK | O_CLOEXEC);
+    if (mFd == -1)
+    {
+        mError = errno;
+    }
+    else
+    {
+        // The report descriptor tells whether reports are numbered, and the
+        // length of each report
+        int descriptorSize = 0;
+        struct hidraw_report_descriptor descriptor;
+        if (ioctl(mFd, HIDIOCGRDESCSIZE, &descriptorSize) < 0)
+        {
+            mError = errno;
+        }
+        else if ((descriptorSize < 0) || (descriptorSize > HID_MAX_DESCRIPTOR_SIZE))
+        {
+            mError = EINVAL;
+        }
+        else
+        {
+            descriptor.size = descriptorSize;
+            if (ioctl(mFd, HIDIOCGRDESC, &descriptor) < 0)
+            {
+                mError = errno;
+            }
+            else if (!ParseReportDescriptor(descriptor.value, descriptor.size, mDescriptor))
+            {
+                mError = EINVAL;
+            }
+            else
+            {
+                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Opened %s, fd %d", aDevicePath.c_str(), mFd);
+                retVal = true;
+            }
+        }
+
+        if (!retVal)
+        {
+            close(mFd);
+            mFd = -1;
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportLinux::Close()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    CloseWindow();
+
+    if (mpListener != NULL)
+    {
+        GetPollThread().Cancel(mpListener);
+    }
+
+    if (mFd != -1)
+    {
+        close(mFd);
+        mFd = -1;
+    }
+
+    mDescriptor = CReportDescriptor();
+    mReadLength = 0;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::IsOpen() const
+{
+    return (mFd != -1);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::GetReportLengths(uint16 &aInputLength, uint16 &aOutputLength, uint16 &aFeatureLength)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    if (mDescriptor.mCollections.empty())
+    {
+        mError = (mFd == -1 ? EBADF : EINVAL);
+    }
+    else
+    {
+        // hidraw gives all the top level collections of a device through one
+        // node, their reports are told apart by report ID
+        aInputLength = 0;
+        aOutputLength = 0;
+        aFeatureLength = 0;
+        for (std::vector<CCollection>::const_iterator itCollection = mDescriptor.mCollections.begin();
+            itCollection != mDescriptor.mCollections.end(); ++itCollection)
+        {
+            aInputLength = std::max(aInputLength, itCollection->mInputLength);
+            aOutputLength = std::max(aOutputLength, itCollection->mOutputLength);
+            aFeatureLength = std::max(aFeatureLength, itCollection->mFeatureLength);
+        }
+        retVal = true;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::SetFeature(const uint8 *apReport, size_t aLength)
+{
+    bool retVal = true;
+
+    const size_t length = GetDeclaredLength(REPORT_FEATURE, apReport[0], aLength);
+    if (ioctl(mFd, HIDIOCSFEATURE(length), apReport) < 0)
+    {
+        mError = errno;
+        retVal = false;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::GetFeature(uint8 *apReport, size_t aLength)
+{
+    bool retVal = true;
+
+    if (ioctl(mFd, HIDIOCGFEATURE(aLength), apReport) < 0)
+    {
+        mError = errno;
+        retVal = false;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::WriteReport(const uint8 *apReport, size_t aLength)
+{
+    bool retVal = false;
+
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+    // Windows pads every report to the longest, hidraw sends the bytes given
+    // so the report is cut to its declared length
+    const size_t length = GetDeclaredLength(REPORT_OUTPUT, apReport[0], aLength);
+
+    Result result = RESULT_OK;
+    while (!retVal && (result == RESULT_OK))
+    {
+        if (write(mFd, apReport, length) >= 0)
+        {
+            retVal = true;
+        }
+        else if (errno == EAGAIN)
+        {
+            result = Wait(POLLOUT, WRITE_TIMEOUT_MS);
+        }
+        else if (errno != EINTR)
+        {
+            mError = errno;
+            result = RESULT_FAILED;
+        }
+    }
+
+    mLastWaitMs = static_cast<uint32>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now() - start).count());
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportLinux::FlushOutput()
+{
+    // Writes to hidraw complete when the device has accepted the report,
+    // so nothing is left to flush
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::StartReading(size_t aReportLength)
+{
+    bool retVal = true;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    if (mFd == -1)
+    {
+        mError = EBADF;
+        retVal = false;
+    }
+    else
+    {
+        mReadLength = aReportLength;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportLinux::StopReading()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    // Discard the reports queued by hidraw
+    std::vector<uint8> report(mReadLength > 0 ? mReadLength : 1);
+    while ((mFd != -1) && (read(mFd, report.data(), report.size()) > 0))
+    {
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportLinux::ReadReport(uint8 *apReport, uint32 aTimeoutMs, uint32 &aBytesRead)
+{
+    Result retVal = RESULT_OK;
+
+    aBytesRead = 0;
+
+    const std::chrono::steady_clock::time_point deadline =
+        std::chrono::steady_clock::now() + std::chrono::milliseconds(aTimeoutMs);
+
+    // hidraw only gives the report ID if the device uses them, the report
+    // is returned with the leading zero Windows gives in that case
+    const size_t offset = (mDescriptor.mNumberedReports ? 0 : 1);
+    memset(apReport, 0, mReadLength);
+
+    if ((mFd == -1) || (mReadLength <= offset))
+    {
+        mError = EBADF;
+        retVal = RESULT_FAILED;
+    }
+
+    while ((retVal == RESULT_OK) && (aBytesRead == 0))
+    {
+        const ssize_t bytes = read(mFd, apReport + offset, mReadLength - offset);
+        if (bytes > 0)
+        {
+            aBytesRead = static_cast<uint32>(bytes + offset);
+        }
+        else if (bytes == 0)
+        {
+            // End of file, the device has gone
+            mError = ENODEV;
+            retVal = RESULT_FAILED;
+        }
+        else if (errno == EAGAIN)
+        {
+            const long long remainingMs = std::chrono::duration_cast<std::chrono::milliseconds>(
+                deadline - std::chrono::steady_clock::now()).count();
+            retVal = Wait(POLLIN, static_cast<int>(remainingMs > 0 ? remainingMs : 0));
+        }
+        else if (errno != EINTR)
+        {
+            mError = errno;
+            retVal = RESULT_FAILED;
+        }
+    }
+
+    if ((retVal == RESULT_TIMEOUT) && (aTimeoutMs == 0) && (mpListener != NULL))
+    {
+        const int error = GetPollThread().Watch(mFd, POLLIN, mpListener);
+        if (error != 0)
+        {
+            mError = error;
+            retVal = RESULT_FAILED;
+        }
+    }
+
+    // A report shorter than the longest is complete if it has its declared length
+    if ((retVal == RESULT_OK)
+        && (aBytesRead < GetDeclaredLength(REPORT_INPUT, apReport[0], mReadLength)))
+    {
+        retVal = RESULT_SHORT;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::OpenWindow(size_t aReportLength, uint8 aWindow)
+{
+    bool retVal = true;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    if ((mFd == -1) || (aWindow == 0) || (aWindow > MAX_WINDOW) || (aReportLength == 0))
+    {
+        mError = (mFd == -1 ? EBADF : EINVAL);
+        retVal = false;
+    }
+    else
+    {
+        // Each write returns once the device has accepted the report, so
+        // there is never more than one in flight. Windowed writing still
+        // sends the next report without the fixed delay.
+        mWindowReport.assign(aReportLength, 0);
+        mLastWaitMs = 0;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportLinux::CloseWindow()
+{
+    mWindowReport.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::IsWindowOpen() const
+{
+    return !mWindowReport.empty();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportLinux::GetWindowReport(uint32 aTimeoutMs, uint8 *&appReport)
+{
+    // The report last written has been accepted, so the buffer is free once
+    // the device can take another. GetLastWaitMs gives the time the last
+    // write waited.
+    const Result retVal = WaitOrWatch(POLLOUT, aTimeoutMs);
+    if (retVal == RESULT_OK)
+    {
+        memset(mWindowReport.data(), 0, mWindowReport.size());
+        appReport = mWindowReport.data();
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportLinux::WriteWindowReport()
+{
+    Result retVal = RESULT_OK;
+
+    if (!WriteReport(mWindowReport.data(), mWindowReport.size()))
+    {
+        retVal = (mError == ETIMEDOUT ? RESULT_TIMEOUT : RESULT_FAILED);
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportLinux::FlushWindow(uint32 aTimeoutMs)
+{
+    // No report is left in flight, wait for the device to take the next
+    return WaitOrWatch(POLLOUT, aTimeoutMs);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidTransportLinux::GetLastWaitMs() const
+{
+    return mLastWaitMs;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidTransportLinux::GetError() const
+{
+    return mError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportLinux::SetListener(CListener *apListener)
+{
+    if (mpListener != NULL)
+    {
+        GetPollThread().Cancel(mpListener);
+    }
+
+    mpListener = apListener;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t CHidTransportLinux::GetDeclaredLength(ReportType aType, uint8 aReportId, size_t aLength) const
+{
+    size_t retVal = aLength;
+
+    std::map<uint16, uint16>::const_iterator it =
+        mDescriptor.mReportLengths.find(static_cast<uint16>((aType << 8) | aReportId));
+    if ((it != mDescriptor.mReportLengths.end()) && (it->second < aLength))
+    {
+        retVal = it->second;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportLinux::Wait(short aEvents, int aTimeoutMs)
+{
+    Result retVal = RESULT_OK;
+
+    struct pollfd pollFd;
+    pollFd.fd = mFd;
+    pollFd.events = aEvents;
+    pollFd.revents = 0;
+
+    int ready = -1;
+    do
+    {
+        ready = poll(&pollFd, 1, aTimeoutMs);
+    } while ((ready < 0) && (errno == EINTR));
+
+    if (ready < 0)
+    {
+        mError = errno;
+        retVal = RESULT_FAILED;
+    }
+    else if (ready == 0)
+    {
+        mError = ETIMEDOUT;
+        retVal = RESULT_TIMEOUT;
+    }
+    else if ((pollFd.revents & aEvents) == 0)
+    {
+        // POLLERR, POLLHUP or POLLNVAL, the device has been unplugged
+        mError = ENODEV;
+        retVal = RESULT_FAILED;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportLinux::WaitOrWatch(short aEvents, uint32 aTimeoutMs)
+{
+    Result retVal = RESULT_OK;
+
+    if (mFd == -1)
+    {
+        mError = EBADF;
+        retVal = RESULT_FAILED;
+    }
+    else
+    {
+        retVal = Wait(aEvents, static_cast<int>(std::min<uint32>(aTimeoutMs, INT_MAX)));
+
+        if ((retVal == RESULT_TIMEOUT) && (aTimeoutMs == 0) && (mpListener != NULL))
+        {
+            const int error = GetPollThread().Watch(mFd, aEvents, mpListener);
+            if (error != 0)
+            {
+                mError = error;
+                retVal = RESULT_FAILED;
+            }
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::ParseReportDescriptor(const uint8 *apDescriptor, size_t aLength,
+    CReportDescriptor &aDescriptor)
+{
+    bool retVal = true;
+
+    // Global items, saved and restored by Push and Pop
+    class CGlobalState
+    {
+    public:
+        uint16 mUsagePage;
+        uint32 mReportSize;
+        uint32 mReportCount;
+        uint8 mReportId;
+
+        CGlobalState() : mUsagePage(0), mReportSize(0), mReportCount(0), mReportId(0) {};
+    };
+    CGlobalState global;
+    std::vector<CGlobalState> globalStack;
+
+    // First usage given in the local items of the current main item
+    uint32 usage = 0;
+    bool usageFound = false;
+    bool usageExtended = false;
+
+    size_t depth = 0;
+
+    // Size in bits and top level collection of each report
+    std::map<uint16, uint32> reportBits;
+    std::map<uint16, size_t> reportCollection;
+
+    aDescriptor = CReportDescriptor();
+
+    size_t pos = 0;
+    while (retVal && (pos < aLength))
+    {
+        const uint8 prefix = apDescriptor[pos];
+
+        if (prefix == 0xFE)
+        {
+            // Long item, not used by any defined tag
+            if (pos + 2 < aLength)
+            {
+                pos += 3 + apDescriptor[pos + 1];
+            }
+            else
+            {
+                retVal = false;
+            }
+            continue;
+        }
+
+        const size_t size = ((prefix & 0x3) == 0x3 ? 4 : (prefix & 0x3));
+        const uint8 type = (prefix >> 2) & 0x3;
+        const uint8 tag = prefix >> 4;
+
+        if (pos + 1 + size > aLength)
+        {
+            retVal = false;
+            break;
+        }
+
+        uint32 data = 0;
+        for (size_t byte = 0; byte < size; ++byte)
+        {
+            data |= static_cast<uint32>(apDescriptor[pos + 1 + byte]) << (8 * byte);
+        }
+        pos += 1 + size;
+
+        if (type == 0)
+        {
+            // Main item
+            if (tag == 0xA)
+            {
+                // Collection
+                if (depth == 0)
+                {
+                    aDescriptor.mCollections.push_back(CCollection(
+                        (usageExtended ? static_cast<uint16>(usage >> 16) : global.mUsagePage),
+                        static_cast<uint16>(usage)));
+                }
+                ++depth;
+            }
+            else if (tag == 0xC)
+            {
+                // End Collection
+                if (depth > 0)
+                {
+                    --depth;
+                }
+            }
+            else if (((tag == REPORT_INPUT) || (tag == REPORT_OUTPUT) || (tag == REPORT_FEATURE))
+                && !aDescriptor.mCollections.empty())
+            {
+                const uint16 key = static_cast<uint16>((tag << 8) | global.mReportId);
+                reportBits[key] += global.mReportSize * global.mReportCount;
+                reportCollection.insert(std::make_pair(key, aDescriptor.mCollections.size() - 1));
+            }
+
+            // Local items only apply to the main item that follows them
+            usage = 0;
+            usageFound = false;
+            usageExtended = false;
+        }
+        else if (type == 1)
+        {
+            // Global item
+            switch (tag)
+            {
+            case 0x0:
+                global.mUsagePage = static_cast<uint16>(data);
+                break;
+            case 0x7:
+                global.mReportSize = data;
+                break;
+            case 0x8:
+                global.mReportId = static_cast<uint8>(data);
+                aDescriptor.mNumberedReports = true;
+                break;
+            case 0x9:
+                global.mReportCount = data;
+                break;
+            case 0xA:
+                globalStack.push_back(global);
+                break;
+            case 0xB:
+                if (globalStack.empty())
+                {
+                    retVal = false;
+                }
+                else
+                {
+                    global = globalStack.back();
+                    globalStack.pop_back();
+                }
+                break;
+            default:
+                break;
+            }
+        }
+        else if ((type == 2) && (tag == 0x0) && !usageFound)
+        {
+            // Usage, a 4 byte usage gives its own usage page
+            usage = data;
+            usageFound = true;
+            usageExtended = (size == 4);
+        }
+    }
+
+    // Lengths include the report ID byte, as on Windows, whether or not
+    // the device numbers its reports
+    for (std::map<uint16, uint32>::const_iterator itReport = reportBits.begin();
+        itReport != reportBits.end(); ++itReport)
+    {
+        const uint16 length = static_cast<uint16>((itReport->second + 7) / 8 + 1);
+        aDescriptor.mReportLengths[itReport->first] = length;
+
+        CCollection &collection = aDescriptor.mCollections[reportCollection[itReport->first]];
+        switch (itReport->first >> 8)
+        {
+        case REPORT_INPUT:
+            collection.mInputLength = std::max(collection.mInputLength, length);
+            break;
+        case REPORT_OUTPUT:
+            collection.mOutputLength = std::max(collection.mOutputLength, length);
+            break;
+        default:
+            collection.mFeatureLength = std::max(collection.mFeatureLength, length);
+            break;
+        }
+    }
+
+    return (retVal && !aDescriptor.mCollections.empty());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::CheckDevice(const std::string &aName, uint16 aVid, uint16 aPid,
+    uint16 aUsage, uint16 aUsagePage, CDeviceInfo &aInfo)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    const std::string hidDevice = GetDirectory("HID_SYSFS_DIR", "/sys/class/hidraw") + "/" + aName + "/device";
+
+    uint16 vid = 0;
+    uint16 pid = 0;
+    if (ReadHidId(hidDevice, vid, pid) && (vid == aVid) && (pid == aPid))
+    {
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Check capabilities, device: %s", aName.c_str());
+
+        std::ifstream descriptorFile((hidDevice + "/report_descriptor").c_str(), std::ios::binary);
+        std::vector<uint8> descriptor((std::istreambuf_iterator<char>(descriptorFile)),
+            std::istreambuf_iterator<char>());
+
+        CReportDescriptor parsed;
+        if (ParseReportDescriptor(descriptor.data(), descriptor.size(), parsed))
+        {
+            // Check usage and usage page match, against each top level collection.
+            // usage and usagePage check is optional (zero is reserved
+            // value in both cases, so using zero as "don't check").
+            for (std::vector<CCollection>::const_iterator itCollection = parsed.mCollections.begin();
+                (itCollection != parsed.mCollections.end()) && !retVal; ++itCollection)
+            {
+                if ((aUsage == 0 || itCollection->mUsage == aUsage) &&
+                    (aUsagePage == 0 || itCollection->mUsagePage == aUsagePage))
+                {
+                    aInfo.mDevicePath = GetDirectory("HID_DEV_DIR", "/dev") + "/" + aName;
+                    aInfo.mVid = vid;
+                    aInfo.mPid = pid;
+                    aInfo.mUsage = itCollection->mUsage;
+                    aInfo.mUsagePage = itCollection->mUsagePage;
+                    aInfo.mInputReportLength = itCollection->mInputLength;
+                    aInfo.mOutputReportLength = itCollection->mOutputLength;
+                    aInfo.mFeatureReportLength = itCollection->mFeatureLength;
+                    retVal = true;
+                }
+            }
+        }
+
+        if (retVal)
+        {
+            aInfo.mParentId = GetParentId(hidDevice);
+
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Found matching device: %s, parent %s",
+                aInfo.mDevicePath.c_str(), aInfo.mParentId.c_str());
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::ListDevices(std::vector<std::string> &aNames)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    DIR *pDir = opendir(GetDirectory("HID_SYSFS_DIR", "/sys/class/hidraw").c_str());
+    if (pDir != NULL)
+    {
+        const struct dirent *pEntry;
+        while ((pEntry = readdir(pDir)) != NULL)
+        {
+            if (strncmp(pEntry->d_name, "hidraw", 6) == 0)
+            {
+                aNames.push_back(pEntry->d_name);
+            }
+        }
+        closedir(pDir);
+
+        // hidraw2 before hidraw10
+        std::sort(aNames.begin(), aNames.end(),
+            [](const std::string &aLeft, const std::string &aRight)
+            { return (aLeft.size() != aRight.size() ? aLeft.size() < aRight.size() : aLeft < aRight); });
+
+        retVal = true;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::string CHidTransportLinux::GetDirectory(const char *apEnvVar, const char *apDefault)
+{
+    const char *pValue = getenv(apEnvVar);
+
+    return ((pValue != NULL && *pValue != '\0') ? pValue : apDefault);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportLinux::ReadHidId(const std::string &aHidDevice, uint16 &aVid, uint16 &aPid)
+{
+    // The HID device's uevent gives its bus, VID and PID as HID_ID=bbbb:vvvvvvvv:pppppppp
+    unsigned int bus = 0;
+    unsigned int vid = 0;
+    unsigned int pid = 0;
+    bool idFound = false;
+
+    std::ifstream uevent((aHidDevice + "/uevent").c_str());
+    std::string line;
+    while (!idFound && std::getline(uevent, line))
+    {
+        idFound = (sscanf(line.c_str(), "HID_ID=%x:%x:%x", &bus, &vid, &pid) == 3);
+    }
+
+    if (idFound)
+    {
+        aVid = static_cast<uint16>(vid);
+        aPid = static_cast<uint16>(pid);
+    }
+
+    return idFound;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::string CHidTransportLinux::GetParentId(const std::string &aHidDevice)
+{
+    std::string parent;
+
+    // The HID device sits under the USB interface, under the USB device
+    char *pRealPath = realpath(aHidDevice.c_str(), NULL);
+    if (pRealPath != NULL)
+    {
+        parent = pRealPath;
+        free(pRealPath);
+
+        for (int level = 0; (level < 2) && !parent.empty(); ++level)
+        {
+            const size_t slash = parent.rfind('/');
+            parent.erase((slash != std::string::npos) ? slash : 0);
+        }
+    }
+
+    return parent;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransportLinux::CArrivalWatcherLinux::CArrivalWatcherLinux(CArrivalListener *apListener)
+    : mpListener(apListener),
+    mSocket(-1)
+{
+    mWakePipe[0] = -1;
+    mWakePipe[1] = -1;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransportLinux::CArrivalWatcherLinux::~CArrivalWatcherLinux()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    if (mThread.joinable())
+    {
+        const uint8 wake = 0;
+        (void)write(mWakePipe[1], &wake, 1);
+        mThread.join();
+    }
+
+    for (size_t end = 0; end < 2; ++end)
+    {
+        if (mWakePipe[end] != -1)
+        {
+            close(mWakePipe[end]);
+        }
+    }
+
+    if (mSocket != -1)
+    {
+        close(mSocket);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int CHidTransportLinux::CArrivalWatcherLinux::Start()
+{
+    int retVal = 0;
+    FUNCTION_DEBUG_SENTRY_RET(int, retVal);
+
+    // Both the kernel's messages and udev's are received: udev's are sent
+    // once its rules have set up the device node, but udev may not be running
+    struct sockaddr_nl address;
+    memset(&address, 0, sizeof(address));
+    address.nl_family = AF_NETLINK;
+    address.nl_groups = UEVENT_GROUP_KERNEL | UEVENT_GROUP_UDEV;
+
+    mSocket = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK, NETLINK_KOBJECT_UEVENT);
+    if ((mSocket == -1)
+        || (bind(mSocket, reinterpret_cast<struct sockaddr *>(&address), sizeof(address)) != 0)
+        || (pipe2(mWakePipe, O_CLOEXEC | O_NONBLOCK) != 0))
+    {
+        retVal = errno;
+    }
+    else
+    {
+        try
+        {
+            mThread = std::thread(&CArrivalWatcherLinux::ThreadFunc, this);
+        }
+        catch (const std::system_error &ex)
+        {
+            retVal = ex.code().value();
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportLinux::CArrivalWatcherLinux::ThreadFunc()
+{
+    std::vector<char> message(UEVENT_BUFFER_SIZE);
+    bool stopping = false;
+
+    while (!stopping)
+    {
+        struct pollfd pollFds[2];
+        pollFds[0].fd = mWakePipe[0];
+        pollFds[0].events = POLLIN;
+        pollFds[0].revents = 0;
+        pollFds[1].fd = mSocket;
+        pollFds[1].events = POLLIN;
+        pollFds[1].revents = 0;
+
+        const int ready = poll(pollFds, 2, -1);
+        stopping = (ready > 0) && (pollFds[0].revents != 0);
+
+        // Messages are read until none are left, and a lost message may
+        // have been a device being added, which the listener is then told
+        // of without details
+        ssize_t length = 0;
+        while (!stopping && (ready > 0) && (pollFds[1].revents != 0)
+            && ((length = recv(mSocket, message.data(), message.size(), 0)) != 0))
+        {
+            if (length > 0)
+            {
+                HandleMessage(message.data(), static_cast<size_t>(length));
+            }
+            else if (errno == ENOBUFS)
+            {
+                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Device events lost");
+                mpListener->OnDeviceArrival(CDeviceInfo());
+            }
+            else if (errno != EINTR)
+            {
+                break;
+            }
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportLinux::CArrivalWatcherLinux::HandleMessage(const char *apMessage, size_t aLength)
+{
+    // A kernel message is "action@devpath" followed by the properties. A
+    // udev message has a header, starting "libudev", which gives the offset
+    // and length of the properties. Properties are "KEY=value" strings.
+    static const char UDEV_PREFIX[] = "libudev";
+    static const size_t UDEV_PROPERTIES_OFFSET = 16;
+
+    size_t start = 0;
+    size_t end = aLength;
+    if ((aLength >= sizeof(UDEV_PREFIX)) && (memcmp(apMessage, UDEV_PREFIX, sizeof(UDEV_PREFIX)) == 0))
+    {
+        uint32 properties[2] = { 0, 0 };
+        if (aLength >= UDEV_PROPERTIES_OFFSET + sizeof(properties))
+        {
+            memcpy(properties, apMessage + UDEV_PROPERTIES_OFFSET, sizeof(properties));
+        }
+        start = std::min<size_t>(properties[0], aLength);
+        end = std::min<size_t>(static_cast<size_t>(properties[0]) + properties[1], aLength);
+    }
+    else
+    {
+        start = strnlen(apMessage, aLength) + 1;
+    }
+
+    std::string action;
+    std::string subsystem;
+    std::string devName;
+    while (start < end)
+    {
+        const std::string property(apMessage + start, strnlen(apMessage + start, end - start));
+        start += property.size() + 1;
+
+        if (property.compare(0, 7, "ACTION=") == 0)
+        {
+            action = property.substr(7);
+        }
+        else if (property.compare(0, 10, "SUBSYSTEM=") == 0)
+        {
+            subsystem = property.substr(10);
+        }
+        else if (property.compare(0, 8, "DEVNAME=") == 0)
+        {
+            // The kernel gives the node name, udev its path
+            const size_t slash = property.rfind('/');
+            devName = property.substr((slash != std::string::npos) ? slash + 1 : 8);
+        }
+    }
+
+    if ((action == "add") && (subsystem == "hidraw") && !devName.empty())
+    {
+        const std::string hidDevice = GetDirectory("HID_SYSFS_DIR", "/sys/class/hidraw") + "/" + devName + "/device";
+
+        CDeviceInfo info;
+        info.mDevicePath = GetDirectory("HID_DEV_DIR", "/dev") + "/" + devName;
+        (void)ReadHidId(hidDevice, info.mVid, info.mPid);
+        info.mParentId = GetParentId(hidDevice);
+
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Device added: %s (%04X:%04X), parent %s",
+            info.mDevicePath.c_str(), info.mVid, info.mPid, info.mParentId.c_str());
+
+        mpListener->OnDeviceArrival(info);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,280 @@
+//*******************************************************************************
+//
+//  HidTransportLinux.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CHidTransportLinux class, HID device access through the Linux hidraw
+//  driver.
+//
+//*******************************************************************************
+
+#ifndef HID_TRANSPORT_LINUX_H
+#define HID_TRANSPORT_LINUX_H
+
+#include "HidTransport.h"
+
+#include <map>
+#include <thread>
+
+///
+/// HID transport using /dev/hidraw* device nodes. Devices are found through
+/// sysfs (/sys/class/hidraw), which udev populates, and their report
+/// descriptors are parsed for the usage and report lengths that Windows
+/// gets from the HID class driver. The node is opened non-blocking, and
+/// reads and writes wait for it with poll(), so no thread is needed to
+/// read input reports: hidraw queues them from the time the node is opened.
+/// Listeners waiting for the node are served by one poll() thread shared
+/// by all devices. Writes wait for the device to accept each report, so a
+/// window has no report in flight and only waits for the node to be
+/// writable.
+///
+/// Devices being added are watched for through the kernel's uevent netlink
+/// socket, which also carries udev's messages.
+///
+/// The sysfs and device node directories can be overridden with the
+/// HID_SYSFS_DIR and HID_DEV_DIR environment variables, to run against
+/// simulated devices.
+///
+class CHidTransportLinux : public CHidTransport
+{
+public:
+
+    /// Maximum time to wait for the device to accept an output report
+    static const int WRITE_TIMEOUT_MS = 10000;
+
+    CHidTransportLinux();
+    virtual ~CHidTransportLinux();
+
+    virtual bool Open(const std::string &aDevicePath);
+    virtual void Close();
+    virtual bool IsOpen() const;
+    virtual bool GetReportLengths(uint16 &aInputLength, uint16 &aOutputLength, uint16 &aFeatureLength);
+    virtual bool SetFeature(const uint8 *apReport, size_t aLength);
+    virtual bool GetFeature(uint8 *apReport, size_t aLength);
+    virtual bool WriteReport(const uint8 *apReport, size_t aLength);
+    virtual void FlushOutput();
+    virtual bool StartReading(size_t aReportLength);
+    virtual void StopReading();
+    virtual Result ReadReport(uint8 *apReport, uint32 aTimeoutMs, uint32 &aBytesRead);
+    virtual bool OpenWindow(size_t aReportLength, uint8 aWindow);
+    virtual void CloseWindow();
+    virtual bool IsWindowOpen() const;
+    virtual Result GetWindowReport(uint32 aTimeoutMs, uint8 *&appReport);
+    virtual Result WriteWindowReport();
+    virtual Result FlushWindow(uint32 aTimeoutMs);
+    virtual uint32 GetLastWaitMs() const;
+    virtual uint32 GetError() const;
+    virtual void SetListener(CListener *apListener);
+
+private:
+
+    friend class CHidTransport;
+
+    /// Checks the report descriptor parsing, report reading and polling
+    /// against a simulated device node (see HidRawCheck)
+    friend class CHidTransportLinuxCheck;
+
+    /// Report types, as the main item tags in a report descriptor
+    typedef enum
+    {
+        REPORT_INPUT = 0x8,
+        REPORT_OUTPUT = 0x9,
+        REPORT_FEATURE = 0xB
+    } ReportType;
+
+    ///
+    /// Usage and report lengths of a top level collection
+    ///
+    class CCollection
+    {
+    public:
+        uint16 mUsagePage;
+        uint16 mUsage;
+        uint16 mInputLength;    //< Longest input report, including the report ID
+        uint16 mOutputLength;   //< Longest output report, including the report ID
+        uint16 mFeatureLength;  //< Longest feature report, including the report ID
+
+        CCollection(uint16 aUsagePage, uint16 aUsage)
+            : mUsagePage(aUsagePage), mUsage(aUsage),
+              mInputLength(0), mOutputLength(0), mFeatureLength(0) {};
+    };
+
+    ///
+    /// Contents of a report descriptor used by the transport
+    ///
+    class CReportDescriptor
+    {
+    public:
+        /// Top level collections
+        std::vector<CCollection> mCollections;
+
+        /// Length of each report, including the report ID, keyed by
+        /// report type and ID as (type << 8) | ID
+        std::map<uint16, uint16> mReportLengths;
+
+        /// Whether the reports are prefixed with a report ID
+        bool mNumberedReports;
+
+        CReportDescriptor() : mNumberedReports(false) {};
+    };
+
+    ///
+    /// Watcher of hidraw devices being added, reading the uevent messages of
+    /// the kernel and of udev on a thread
+    ///
+    class CArrivalWatcherLinux : public CArrivalWatcher
+    {
+    public:
+        explicit CArrivalWatcherLinux(CArrivalListener *apListener);
+        virtual ~CArrivalWatcherLinux();
+
+        ///
+        /// Opens the netlink socket and starts the thread.
+        /// @return 0, or the error code (errno) of the failure.
+        ///
+        int Start();
+
+    private:
+
+        CArrivalWatcherLinux(const CArrivalWatcherLinux &);
+        CArrivalWatcherLinux &operator=(const CArrivalWatcherLinux &);
+
+        /// Netlink multicast groups of the kernel's and udev's messages
+        static const uint32 UEVENT_GROUP_KERNEL = 1;
+        static const uint32 UEVENT_GROUP_UDEV = 2;
+
+        /// Largest message read
+        static const size_t UEVENT_BUFFER_SIZE = 8192;
+
+        ///
+        /// Thread function, reads messages until the wake pipe is written.
+        ///
+        void ThreadFunc();
+
+        ///
+        /// Tells the listener if a message is of a hidraw device being added.
+        /// @param[in] apMessage Message, from the kernel or udev.
+        /// @param[in] aLength Message length.
+        ///
+        void HandleMessage(const char *apMessage, size_t aLength);
+
+        /// Told of each device added
+        CArrivalListener *mpListener;
+
+        /// Netlink socket, opened non-blocking
+        int mSocket;
+
+        /// Written to stop the thread
+        int mWakePipe[2];
+
+        /// Reads the messages
+        std::thread mThread;
+    };
+
+    /// Device node, opened non-blocking
+    int mFd;
+
+    /// Report descriptor of the open device
+    CReportDescriptor mDescriptor;
+
+    /// Input report length
+    size_t mReadLength;
+
+    /// Report buffer for windowed writing, empty when not open
+    std::vector<uint8> mWindowReport;
+
+    /// Time the last windowed write waited
+    uint32 mLastWaitMs;
+
+    /// Error code (errno) of the last failure
+    uint32 mError;
+
+    /// Told when an input report can be read, NULL for none
+    CListener *mpListener;
+
+    ///
+    /// Gets the length of a report declared by the device.
+    /// @param[in] aType Report type.
+    /// @param[in] aReportId Report ID.
+    /// @param[in] aLength Length to use if the report is not declared.
+    /// @return The length, including the report ID.
+    ///
+    size_t GetDeclaredLength(ReportType aType, uint8 aReportId, size_t aLength) const;
+
+    ///
+    /// Waits for the device node to be ready.
+    /// @param[in] aEvents poll() events to wait for.
+    /// @param[in] aTimeoutMs Maximum time to wait, negative to wait indefinitely.
+    /// @return The result.
+    ///
+    Result Wait(short aEvents, int aTimeoutMs);
+
+    ///
+    /// Waits for the device node to be ready, up to a timeout given to the
+    /// transport. If a zero timeout expires the listener is told once the
+    /// node is ready.
+    /// @param[in] aEvents poll() events to wait for.
+    /// @param[in] aTimeoutMs Maximum time to wait.
+    /// @return The result.
+    ///
+    Result WaitOrWatch(short aEvents, uint32 aTimeoutMs);
+
+    ///
+    /// Parses a report descriptor.
+    /// @param[in] apDescriptor Report descriptor.
+    /// @param[in] aLength Length of the report descriptor.
+    /// @param[out] aDescriptor The parsed contents.
+    /// @return false if the descriptor is malformed.
+    ///
+    static bool ParseReportDescriptor(const uint8 *apDescriptor, size_t aLength, CReportDescriptor &aDescriptor);
+
+    ///
+    /// Reads the details of a hidraw device from sysfs and checks its VID,
+    /// PID, usage and usage page.
+    /// @param[in] aName Device name (hidrawN).
+    /// @param[in] aVid Vendor ID.
+    /// @param[in] aPid Product ID.
+    /// @param[in] aUsage Usage, not checked if zero.
+    /// @param[in] aUsagePage Usage page, not checked if zero.
+    /// @param[out] aInfo Details of the device if it matches.
+    /// @return true if the device matches.
+    ///
+    static bool CheckDevice(const std::string &aName, uint16 aVid, uint16 aPid,
+        uint16 aUsage, uint16 aUsagePage, CDeviceInfo &aInfo);
+
+    ///
+    /// Reads the VID and PID of a HID device from sysfs.
+    /// @param[in] aHidDevice sysfs directory of the HID device.
+    /// @param[out] aVid Vendor ID.
+    /// @param[out] aPid Product ID.
+    /// @return false if they could not be read.
+    ///
+    static bool ReadHidId(const std::string &aHidDevice, uint16 &aVid, uint16 &aPid);
+
+    ///
+    /// Gets the parent ID of a HID device, the sysfs path of its USB device.
+    /// @param[in] aHidDevice sysfs directory of the HID device.
+    /// @return The parent ID, empty if it could not be read.
+    ///
+    static std::string GetParentId(const std::string &aHidDevice);
+
+    ///
+    /// Lists the hidraw devices in sysfs.
+    /// @param[out] aNames Device names (hidrawN), in device number order.
+    /// @return false if sysfs could not be read.
+    ///
+    static bool ListDevices(std::vector<std::string> &aNames);
+
+    ///
+    /// Gets a directory, which may be overridden by an environment variable.
+    /// @param[in] apEnvVar Environment variable.
+    /// @param[in] apDefault Directory if the variable is not set.
+    /// @return The directory.
+    ///
+    static std::string GetDirectory(const char *apEnvVar, const char *apDefault);
+};
+
+#endif // #ifndef HID_TRANSPORT_LINUX_H
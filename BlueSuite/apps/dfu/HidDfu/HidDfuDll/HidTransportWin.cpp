@@ -0,0 +1,806 @@
+//*******************************************************************************
+//
+//  HidTransportWin.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CHidTransportWin class.
+//
+//*******************************************************************************
+
+#include "HidTransportWin.h"
+
+#include "engine/enginefw_interface.h"
+
+#include <iomanip>
+#include <sstream>
+#include <string.h>
+#include <setupapi.h>
+#include <cfgmgr32.h>
+
+extern "C"
+{
+#include <hidsdi.h>
+}
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+namespace
+{
+    ///
+    /// Watcher of HID interfaces being added, through a configuration
+    /// manager notification. The parent of the interface is not looked up,
+    /// so the listener is told of each HID device added without details.
+    ///
+    class CArrivalWatcherWin : public CHidTransport::CArrivalWatcher
+    {
+    public:
+        explicit CArrivalWatcherWin(CHidTransport::CArrivalListener *apListener)
+            : mpListener(apListener),
+            mNotification(NULL)
+        {
+        }
+
+        virtual ~CArrivalWatcherWin()
+        {
+            // Waits for any callback in progress
+            if (mNotification != NULL)
+            {
+                (void)CM_Unregister_Notification(mNotification);
+            }
+        }
+
+        ///
+        /// Registers for the notification.
+        /// @return CR_SUCCESS, or the configuration manager error.
+        ///
+        CONFIGRET Start()
+        {
+            CM_NOTIFY_FILTER filter;
+            memset(&filter, 0, sizeof(filter));
+            filter.cbSize = sizeof(filter);
+            filter.FilterType = CM_NOTIFY_FILTER_TYPE_DEVICEINTERFACE;
+            HidD_GetHidGuid(&filter.u.DeviceInterface.ClassGuid);
+
+            return CM_Register_Notification(&filter, this, &CArrivalWatcherWin::Callback, &mNotification);
+        }
+
+    private:
+
+        CArrivalWatcherWin(const CArrivalWatcherWin &);
+        CArrivalWatcherWin &operator=(const CArrivalWatcherWin &);
+
+        static DWORD CALLBACK Callback(HCMNOTIFICATION aNotification, PVOID apContext,
+            CM_NOTIFY_ACTION aAction, PCM_NOTIFY_EVENT_DATA apEventData, DWORD aEventDataSize)
+        {
+            if (aAction == CM_NOTIFY_ACTION_DEVICEINTERFACEARRIVAL)
+            {
+                static_cast<CArrivalWatcherWin *>(apContext)->mpListener->OnDeviceArrival(CHidTransport::CDeviceInfo());
+            }
+
+            return ERROR_SUCCESS;
+        }
+
+        CHidTransport::CArrivalListener *mpListener;
+        HCMNOTIFICATION mNotification;
+    };
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport *CHidTransport::CreateHost()
+{
+    return new CHidTransportWin();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransport::EnumerateHost(uint16 aVid, uint16 aPid, uint16 aUsage, uint16 aUsagePage,
+    std::vector<CDeviceInfo> &aDevices)
+{
+    bool retVal = true;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    GUID guid;
+    // Get device intereface GUID
+    HidD_GetHidGuid(&guid);
+    // Get a handle to the device information set (for HID Class devices)
+    // that contains requested device information elements
+    HDEVINFO deviceInfoSet = SetupDiGetClassDevs(&guid, NULL, NULL, DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+
+    if (deviceInfoSet == INVALID_HANDLE_VALUE)
+    {
+        retVal = false;
+    }
+    else
+    {
+        // Iterate through the devices found - look for one that matches the VID, PID, usage and usage page
+        SP_INTERFACE_DEVICE_DATA interfaceDeviceData;
+        interfaceDeviceData.cbSize = sizeof(SP_INTERFACE_DEVICE_DATA);
+        for (uint32 index = 0;
+            SetupDiEnumDeviceInterfaces(deviceInfoSet, 0, &guid, index, &interfaceDeviceData);
+            ++index)
+        {
+            DWORD requiredSize;
+            // Get requiredSize to allocate the heap, to get details about the device interface,
+            // following function is expected to return false/failure, hence ignore the return value
+            (void)SetupDiGetDeviceInterfaceDetail(deviceInfoSet, &interfaceDeviceData,
+                    NULL, 0, &requiredSize, NULL);
+
+            PSP_DEVICE_INTERFACE_DETAIL_DATA deviceInterfaceDetailData =
+                (PSP_DEVICE_INTERFACE_DETAIL_DATA)HeapAlloc(GetProcessHeap(),
+                    HEAP_GENERATE_EXCEPTIONS | HEAP_ZERO_MEMORY, requiredSize);
+
+            // Get Device Information Data, to retrieve the Device Instance
+            SP_DEVINFO_DATA devInfoData;
+            ZeroMemory(&devInfoData, sizeof(devInfoData));
+            devInfoData.cbSize = sizeof(devInfoData);
+
+            deviceInterfaceDetailData->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
+
+            // Get details about the device interface
+            CDeviceInfo info;
+            if (!SetupDiGetDeviceInterfaceDetail(deviceInfoSet, &interfaceDeviceData,
+                deviceInterfaceDetailData, requiredSize, NULL, &devInfoData))
+            {
+                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to get Device Interface Detail");
+            }
+            else if (CHidTransportWin::CheckDevice(deviceInterfaceDetailData->DevicePath,
+                aVid, aPid, aUsage, aUsagePage, info))
+            {
+                // Get and save the USB Hub Device Instance ID, so that it can be used after the device restart,
+                // to get the HID Device Path
+                (void)CHidTransportWin::GetUsbHubId(devInfoData.DevInst, aVid, info.mParentId);
+                aDevices.push_back(info);
+            }
+            HeapFree(GetProcessHeap(), 0, deviceInterfaceDetailData);
+        }
+        SetupDiDestroyDeviceInfoList(deviceInfoSet);
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransport::FindHostDevice(const std::string &aParentId, uint16 aVid, uint16 aPid,
+    uint16 aUsage, uint16 aUsagePage, std::string &aDevicePath)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    aDevicePath.clear();
+
+    // USB Hub - Top Level enumeration for the USB Device to connect
+    // Check if it is available
+    DEVINST usbHubDevInst;
+    CONFIGRET status = CM_Locate_DevNodeA(&usbHubDevInst, const_cast<DEVINSTID_A>(aParentId.c_str()),
+        CM_LOCATE_DEVNODE_NORMAL);
+    if (status != CR_SUCCESS)
+    {
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to locate %s (status = %d)", aParentId.c_str(), status);
+    }
+    else
+    {
+        // Get the child (USB Composite Device)
+        DEVINST childDevInst;
+        status = CM_Get_Child(&childDevInst, usbHubDevInst, 0);
+        if (status != CR_SUCCESS)
+        {
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to get Child Device Instance for %s (status = %d)",
+                aParentId.c_str(), status);
+        }
+        else
+        {
+            // Search the sub tree to get the new Device Path
+            CHidTransportWin::GetSubDevNodesAndDevPath(childDevInst, aVid, aPid, aUsage, aUsagePage, aDevicePath);
+            retVal = !aDevicePath.empty();
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::CArrivalWatcher *CHidTransport::WatchHostArrivals(CArrivalListener *apListener)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    CArrivalWatcherWin *pWatcher = new CArrivalWatcherWin(apListener);
+
+    const CONFIGRET status = pWatcher->Start();
+    if (status != CR_SUCCESS)
+    {
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Cannot watch for devices being added (status = %d)", status);
+        delete pWatcher;
+        pWatcher = NULL;
+    }
+
+    return pWatcher;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+std::string CHidTransport::GetErrorText(uint32 aError)
+{
+    std::string retVal;
+
+    char *pError = NULL;
+    if (FormatMessage(FORMAT_MESSAGE_ALLOCATE_BUFFER | FORMAT_MESSAGE_FROM_SYSTEM,
+        NULL,
+        aError,
+        MAKELANGID(LANG_NEUTRAL, SUBLANG_DEFAULT),
+        (LPTSTR)&pError,
+        0,
+        NULL))
+    {
+        // Remove '\r' from end of string
+        char *pos = strchr(pError, '\r');
+        if (pos != NULL)
+        {
+            *pos = '\0';
+        }
+        retVal = pError;
+        LocalFree(pError);
+    }
+    else
+    {
+        std::ostringstream msg;
+        msg << "error 0x" << std::hex << aError;
+        retVal = msg.str();
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransportWin::CHidTransportWin()
+    : mDeviceHandle(INVALID_HANDLE_VALUE),
+    mError(ERROR_SUCCESS)
+{
+    FUNCTION_DEBUG_SENTRY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransportWin::~CHidTransportWin()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::Open(const std::string &aDevicePath)
+{
+    bool retVal = true;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    Close();
+
+    mDeviceHandle = CreateFile(aDevicePath.c_str(),
+                               GENERIC_READ | GENERIC_WRITE,
+                               FILE_SHARE_READ | FILE_SHARE_WRITE,
+                               NULL,
+                               OPEN_EXISTING,
+                               0,
+                               NULL);
+
+    if (mDeviceHandle == INVALID_HANDLE_VALUE)
+    {
+        mError = ::GetLastError();
+        retVal = false;
+    }
+    else
+    {
+        mDevicePath = aDevicePath;
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "mDeviceHandle: %d", mDeviceHandle);
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportWin::Close()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    mReportWriter.Close();
+    mReportReader.Close();
+
+    if (mDeviceHandle != INVALID_HANDLE_VALUE)
+    {
+        // Reads are made on a separate handle, so no read can be left
+        // pending on this one after a device stops responding
+        CloseHandle(mDeviceHandle);
+        mDeviceHandle = INVALID_HANDLE_VALUE;
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::IsOpen() const
+{
+    return (mDeviceHandle != INVALID_HANDLE_VALUE);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::GetReportLengths(uint16 &aInputLength, uint16 &aOutputLength, uint16 &aFeatureLength)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    PHIDP_PREPARSED_DATA pPreParsedData = NULL; // The opaque parser info describing this device
+    HIDP_CAPS hidCapability;                    // The capabilities of the HID device
+
+    if (!HidD_GetPreparsedData(mDeviceHandle, &pPreParsedData))
+    {
+        mError = ::GetLastError();
+    }
+    else
+    {
+        if (HidP_GetCaps(pPreParsedData, &hidCapability) != HIDP_STATUS_SUCCESS)
+        {
+            mError = ERROR_INVALID_DATA;
+        }
+        else
+        {
+            aInputLength = hidCapability.InputReportByteLength;
+            aOutputLength = hidCapability.OutputReportByteLength;
+            aFeatureLength = hidCapability.FeatureReportByteLength;
+            retVal = true;
+        }
+
+        HidD_FreePreparsedData(pPreParsedData);
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::SetFeature(const uint8 *apReport, size_t aLength)
+{
+    bool retVal = true;
+
+    if (!HidD_SetFeature(mDeviceHandle, (PVOID)apReport, static_cast<ULONG>(aLength)))
+    {
+        mError = ::GetLastError();
+        retVal = false;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::GetFeature(uint8 *apReport, size_t aLength)
+{
+    bool retVal = true;
+
+    if (!HidD_GetFeature(mDeviceHandle, apReport, static_cast<ULONG>(aLength)))
+    {
+        mError = ::GetLastError();
+        retVal = false;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::WriteReport(const uint8 *apReport, size_t aLength)
+{
+    bool retVal = true;
+
+    DWORD bytesWritten = 0;
+    if (!WriteFile(mDeviceHandle, apReport, static_cast<DWORD>(aLength), &bytesWritten, NULL))
+    {
+        mError = ::GetLastError();
+        retVal = false;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportWin::FlushOutput()
+{
+    FlushFileBuffers(mDeviceHandle);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::StartReading(size_t aReportLength)
+{
+    bool retVal = true;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    const uint32 winError = mReportReader.Open(mDevicePath, aReportLength);
+    if (winError != ERROR_SUCCESS)
+    {
+        mError = winError;
+        retVal = false;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportWin::StopReading()
+{
+    mReportReader.Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportWin::ReadReport(uint8 *apReport, uint32 aTimeoutMs, uint32 &aBytesRead)
+{
+    Result retVal = RESULT_OK;
+
+    switch (mReportReader.Read(apReport, aTimeoutMs, aBytesRead))
+    {
+    case CHidReportReader::READ_SHORT:
+        retVal = RESULT_SHORT;
+        break;
+    case CHidReportReader::READ_TIMEOUT:
+        retVal = RESULT_TIMEOUT;
+        break;
+    case CHidReportReader::READ_FAILED:
+        mError = mReportReader.GetWinError();
+        retVal = RESULT_FAILED;
+        break;
+    default:
+        break;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::OpenWindow(size_t aReportLength, uint8 aWindow)
+{
+    bool retVal = true;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    const uint32 winError = mReportWriter.Open(mDevicePath, aReportLength, aWindow);
+    if (winError != ERROR_SUCCESS)
+    {
+        mError = winError;
+        retVal = false;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportWin::CloseWindow()
+{
+    mReportWriter.Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::IsWindowOpen() const
+{
+    return mReportWriter.IsOpen();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportWin::GetWindowReport(uint32 aTimeoutMs, uint8 *&appReport)
+{
+    return GetWriteResult(mReportWriter.GetReport(aTimeoutMs, appReport));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportWin::WriteWindowReport()
+{
+    return GetWriteResult(mReportWriter.Write());
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportWin::FlushWindow(uint32 aTimeoutMs)
+{
+    return GetWriteResult(mReportWriter.Flush(aTimeoutMs));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidTransportWin::GetLastWaitMs() const
+{
+    return mReportWriter.GetLastWaitMs();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+uint32 CHidTransportWin::GetError() const
+{
+    return mError;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportWin::SetListener(CListener *apListener)
+{
+    mReportReader.SetListener(apListener);
+    mReportWriter.SetListener(apListener);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CHidTransport::Result CHidTransportWin::GetWriteResult(CHidReportWriter::WriteResult aResult)
+{
+    Result retVal = RESULT_OK;
+
+    switch (aResult)
+    {
+    case CHidReportWriter::WRITE_TIMEOUT:
+        retVal = RESULT_TIMEOUT;
+        break;
+    case CHidReportWriter::WRITE_FAILED:
+        mError = mReportWriter.GetWinError();
+        retVal = RESULT_FAILED;
+        break;
+    default:
+        break;
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::CheckDevice(const char *apDevicePath, uint16 aVid, uint16 aPid,
+    uint16 aUsage, uint16 aUsagePage, CDeviceInfo &aInfo)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    // Attempt to open the device
+    HANDLE deviceHandle = CreateFile(apDevicePath,
+        GENERIC_READ | GENERIC_WRITE,
+        FILE_SHARE_READ | FILE_SHARE_WRITE,
+        NULL,
+        OPEN_EXISTING,
+        0,
+        NULL);
+
+    if (deviceHandle != INVALID_HANDLE_VALUE)
+    {
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Check capabilities, device: %s", apDevicePath);
+
+        HIDD_ATTRIBUTES attributes;
+        attributes.Size = sizeof(attributes);
+        PHIDP_PREPARSED_DATA preparsedData;
+
+        if (HidD_GetAttributes(deviceHandle, &attributes)
+            && (attributes.VendorID == aVid) && (attributes.ProductID == aPid)
+            && HidD_GetPreparsedData(deviceHandle, &preparsedData))
+        {
+            HIDP_CAPS capabilities;
+            HidP_GetCaps(preparsedData, &capabilities);
+
+            // Check usage and usage page match
+            // usage and usagePage check is optional (zero is reserved
+            // value in both cases, so using zero as "don't check").
+            if ((aUsage == 0 || capabilities.Usage == aUsage) &&
+                (aUsagePage == 0 || capabilities.UsagePage == aUsagePage))
+            {
+                MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Found matching device: %s", apDevicePath);
+
+                aInfo.mDevicePath = apDevicePath;
+                aInfo.mVid = attributes.VendorID;
+                aInfo.mPid = attributes.ProductID;
+                aInfo.mUsage = capabilities.Usage;
+                aInfo.mUsagePage = capabilities.UsagePage;
+                aInfo.mInputReportLength = capabilities.InputReportByteLength;
+                aInfo.mOutputReportLength = capabilities.OutputReportByteLength;
+                aInfo.mFeatureReportLength = capabilities.FeatureReportByteLength;
+                retVal = true;
+            }
+
+            HidD_FreePreparsedData(preparsedData);
+        }
+
+        // The device is opened again by the transport which uses it
+        CloseHandle(deviceHandle);
+    }
+    else
+    {
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to access the device");
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::GetUsbHubId(DEVINST aChildDevInst, uint16 aVid, std::string &aParentId)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    std::ostringstream vid;      //< USB Vendor Identifier
+    vid << std::uppercase << "VID_" << std::hex << std::setfill('0') << std::setw(4) << aVid;
+
+    bool matchFound = true;
+
+    // Look up for parents in USB Tree with a matching VID
+    while (matchFound)
+    {
+        // Get parent's Device Instance
+        DEVINST parentDevInst;
+        std::string parentId;
+        if ((CM_Get_Parent(&parentDevInst, aChildDevInst, 0) == CR_SUCCESS)
+            && GetDeviceInstanceId(parentDevInst, parentId)
+            && (parentId.find(vid.str()) != std::string::npos))
+        {
+            // Use parent's Device Instance for matching VID
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Parent Device: %s", parentId.c_str());
+            aParentId = parentId;
+            aChildDevInst = parentDevInst;
+            retVal = true;
+        }
+        else
+        {
+            // If parent has not got a matching VID stop searching
+            matchFound = false;
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CHidTransportWin::GetDeviceInstanceId(DEVINST aDevInst, std::string &aDevInstId)
+{
+    bool retVal = false;
+
+    char devInstId[MAX_DEVICE_ID_LEN];
+    CONFIGRET status = CM_Get_Device_IDA(aDevInst, devInstId, MAX_DEVICE_ID_LEN, 0);
+    if (status == CR_SUCCESS)
+    {
+        aDevInstId = devInstId;
+        retVal = true;
+    }
+    else
+    {
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to get Device Instance ID for %d (status = %d)",
+            aDevInst, status);
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportWin::GetDevicePath(DEVNODE aDevNode, uint16 aVid, uint16 aPid,
+    uint16 aUsage, uint16 aUsagePage, std::string &aDevicePath)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    std::string devInstId;
+    if (GetDeviceInstanceId(aDevNode, devInstId))
+    {
+        GUID guid;
+        // Get device intereface GUID for HID Class devices.
+        HidD_GetHidGuid(&guid);
+        // Get a handle to the device information set (for HID Class devices)
+        // that contains requested device information elements
+        HDEVINFO deviceInfoSet = SetupDiGetClassDevs(&guid, devInstId.c_str(), NULL,
+                                    DIGCF_PRESENT | DIGCF_DEVICEINTERFACE);
+
+        if (deviceInfoSet == INVALID_HANDLE_VALUE)
+        {
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to get Device Information Set");
+        }
+        else
+        {
+            // Iterate through the devices found - look for one that matches
+            // the VID, PID, usage and usage page
+            SP_INTERFACE_DEVICE_DATA interfaceDeviceData;
+            interfaceDeviceData.cbSize = sizeof(SP_INTERFACE_DEVICE_DATA);
+            for (uint32 index = 0;
+                aDevicePath.empty()
+                && SetupDiEnumDeviceInterfaces(deviceInfoSet, 0, &guid, index, &interfaceDeviceData);
+                ++index)
+            {
+                DWORD requiredSize;
+
+                // Get requiredSize to allocate the heap, to get details about the device interface,
+                // following function is expected to return false/failure, hence ignore the return value
+                (void)SetupDiGetDeviceInterfaceDetail(deviceInfoSet, &interfaceDeviceData,
+                    NULL, 0, &requiredSize, NULL);
+
+                PSP_DEVICE_INTERFACE_DETAIL_DATA deviceInterfaceDetailData =
+                    (PSP_DEVICE_INTERFACE_DETAIL_DATA)HeapAlloc(GetProcessHeap(),
+                        HEAP_GENERATE_EXCEPTIONS | HEAP_ZERO_MEMORY, requiredSize);
+
+                deviceInterfaceDetailData->cbSize = sizeof(SP_DEVICE_INTERFACE_DETAIL_DATA);
+
+                // Get details about the device interface
+                CDeviceInfo info;
+                if (!SetupDiGetDeviceInterfaceDetail(deviceInfoSet, &interfaceDeviceData,
+                    deviceInterfaceDetailData, requiredSize, NULL, NULL))
+                {
+                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Failed to get Device Interface Detail");
+                }
+                else if (CheckDevice(deviceInterfaceDetailData->DevicePath, aVid, aPid, aUsage, aUsagePage, info))
+                {
+                    // Set the Device Path
+                    aDevicePath = info.mDevicePath;
+                    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Setting DevicePath: %s", aDevicePath.c_str());
+                }
+                HeapFree(GetProcessHeap(), 0, deviceInterfaceDetailData);
+            }
+            SetupDiDestroyDeviceInfoList(deviceInfoSet);
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CHidTransportWin::GetSubDevNodesAndDevPath(DEVNODE aDevNode, uint16 aVid, uint16 aPid,
+    uint16 aUsage, uint16 aUsagePage, std::string &aDevicePath)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    // USB Vendor and Product Identifier with USB Interface (MI_)
+    // e.g. VID_xxxx&PID_xxxx&MI_
+    std::ostringstream vidPidMi;
+    vidPidMi << std::uppercase << "VID_" << std::hex << std::setfill('0') << std::setw(4) << aVid
+        << "&PID_" << std::setw(4) << aPid << "&MI_";
+
+    // Traverse the USB Tree
+    do
+    {
+        // If the Device Node has got same VID, PID with USB Interface,
+        // search for HID Device under it's sub nodes
+        std::string devInstId;
+        if (GetDeviceInstanceId(aDevNode, devInstId))
+        {
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Device: %s", devInstId.c_str());
+            if (devInstId.find(vidPidMi.str()) != std::string::npos)
+            {
+                GetDevicePath(aDevNode, aVid, aPid, aUsage, aUsagePage, aDevicePath);
+            }
+        }
+
+        // Get Device Instance handle to the first child node
+        DEVNODE devNodeChild;
+        CONFIGRET status = CM_Get_Child(&devNodeChild, aDevNode, 0);
+        if ((status == CR_SUCCESS) && aDevicePath.empty())
+        {
+            // Recurse, then check for the sibling
+            GetSubDevNodesAndDevPath(devNodeChild, aVid, aPid, aUsage, aUsagePage, aDevicePath);
+        }
+
+        // Get Device Instance Handle to the next sibling node
+        DEVNODE devNodeSibling;
+        status = CM_Get_Sibling(&devNodeSibling, aDevNode, 0);
+        if (status != CR_SUCCESS)
+        {
+            devNodeSibling = NULL;
+        }
+
+        aDevNode = devNodeSibling;
+    } while (aDevNode != NULL && aDevicePath.empty());
+}
+
+////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,145 @@
+//*******************************************************************************
+//
+//  HidTransportWin.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CHidTransportWin class, HID device access through the Windows HID class
+//  driver.
+//
+//*******************************************************************************
+
+#ifndef HID_TRANSPORT_WIN_H
+#define HID_TRANSPORT_WIN_H
+
+#ifdef WIN32
+
+#include "HidTransport.h"
+#include "HidReportReader.h"
+#include "HidReportWriter.h"
+
+#define WIN32_LEAN_AND_MEAN  // Exclude rarely-used stuff from Windows headers
+
+#include <windows.h>
+#include <cfgmgr32.h>
+
+///
+/// HID transport using SetupAPI to find devices and the HidD_* functions,
+/// ReadFile and WriteFile to access them. Input reports are read on a
+/// CHidReportReader thread and windowed writes use a CHidReportWriter,
+/// each on its own overlapped handle.
+///
+class CHidTransportWin : public CHidTransport
+{
+public:
+    CHidTransportWin();
+    virtual ~CHidTransportWin();
+
+    virtual bool Open(const std::string &aDevicePath);
+    virtual void Close();
+    virtual bool IsOpen() const;
+    virtual bool GetReportLengths(uint16 &aInputLength, uint16 &aOutputLength, uint16 &aFeatureLength);
+    virtual bool SetFeature(const uint8 *apReport, size_t aLength);
+    virtual bool GetFeature(uint8 *apReport, size_t aLength);
+    virtual bool WriteReport(const uint8 *apReport, size_t aLength);
+    virtual void FlushOutput();
+    virtual bool StartReading(size_t aReportLength);
+    virtual void StopReading();
+    virtual Result ReadReport(uint8 *apReport, uint32 aTimeoutMs, uint32 &aBytesRead);
+    virtual bool OpenWindow(size_t aReportLength, uint8 aWindow);
+    virtual void CloseWindow();
+    virtual bool IsWindowOpen() const;
+    virtual Result GetWindowReport(uint32 aTimeoutMs, uint8 *&appReport);
+    virtual Result WriteWindowReport();
+    virtual Result FlushWindow(uint32 aTimeoutMs);
+    virtual uint32 GetLastWaitMs() const;
+    virtual uint32 GetError() const;
+    virtual void SetListener(CListener *apListener);
+
+private:
+
+    friend class CHidTransport;
+
+    /// Device handle, opened for synchronous access
+    HANDLE mDeviceHandle;
+
+    /// Device path, for opening the reader and writer handles
+    std::string mDevicePath;
+
+    /// Reads input reports from the device
+    CHidReportReader mReportReader;
+
+    /// Writes output reports with several in flight
+    CHidReportWriter mReportWriter;
+
+    /// Error code of the last failure
+    uint32 mError;
+
+    ///
+    /// Sets the error code from the result of the report writer.
+    /// @param[in] aResult Result from the report writer.
+    /// @return The result.
+    ///
+    Result GetWriteResult(CHidReportWriter::WriteResult aResult);
+
+    ///
+    /// Opens a device and checks its VID, PID, usage and usage page.
+    /// @param[in] apDevicePath Device path.
+    /// @param[in] aVid Vendor ID.
+    /// @param[in] aPid Product ID.
+    /// @param[in] aUsage Usage, not checked if zero.
+    /// @param[in] aUsagePage Usage page, not checked if zero.
+    /// @param[out] aInfo Details of the device if it matches.
+    /// @return true if the device matches.
+    ///
+    static bool CheckDevice(const char *apDevicePath, uint16 aVid, uint16 aPid,
+        uint16 aUsage, uint16 aUsagePage, CDeviceInfo &aInfo);
+
+    ///
+    /// Gets the Device Instance ID of the top level parent device (USB Hub
+    /// in USB tree) which has the same VID as the HID device.
+    /// @param[in] aChildDevInst Device Instance of the HID device.
+    /// @param[in] aVid Vendor Identifier.
+    /// @param[out] aParentId Device Instance ID of the USB Hub for the device.
+    /// @return true if found.
+    ///
+    static bool GetUsbHubId(DEVINST aChildDevInst, uint16 aVid, std::string &aParentId);
+
+    ///
+    /// Get the Device Instance ID.
+    /// @param[in] aDevInst Device Instance.
+    /// @param[out] aDevInstId Device Instance ID.
+    /// @return true on success.
+    ///
+    static bool GetDeviceInstanceId(DEVINST aDevInst, std::string &aDevInstId);
+
+    ///
+    /// Searches the HID interfaces of a device node for a matching device.
+    /// @param[in] aDevNode Device Node.
+    /// @param[in] aVid Vendor ID.
+    /// @param[in] aPid Product ID.
+    /// @param[in] aUsage Usage, not checked if zero.
+    /// @param[in] aUsagePage Usage page, not checked if zero.
+    /// @param[out] aDevicePath Device path, if found.
+    ///
+    static void GetDevicePath(DEVNODE aDevNode, uint16 aVid, uint16 aPid,
+        uint16 aUsage, uint16 aUsagePage, std::string &aDevicePath);
+
+    ///
+    /// Recursive function to search USB tree for matching HID Device.
+    /// @param[in] aDevNode Device Node of the parent device.
+    /// @param[in] aVid Vendor ID.
+    /// @param[in] aPid Product ID.
+    /// @param[in] aUsage Usage, not checked if zero.
+    /// @param[in] aUsagePage Usage page, not checked if zero.
+    /// @param[out] aDevicePath Device path, if found.
+    ///
+    static void GetSubDevNodesAndDevPath(DEVNODE aDevNode, uint16 aVid, uint16 aPid,
+        uint16 aUsage, uint16 aUsagePage, std::string &aDevicePath);
+};
+
+#endif // #ifdef WIN32
+
+#endif // #ifndef HID_TRANSPORT_WIN_H
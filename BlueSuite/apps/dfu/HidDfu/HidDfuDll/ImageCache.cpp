@@ -0,0 +1,172 @@
+//*******************************************************************************
+//
+//  ImageCache.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CImageCache class.
+//
+//*******************************************************************************
+
+#include "ImageCache.h"
+
+#include "engine/enginefw_interface.h"
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CImageCache::FileIdentity::operator==(const FileIdentity &aRhs) const
+{
+    return size == aRhs.size && modifiedTime == aRhs.modifiedTime &&
+        fileId == aRhs.fileId && volumeId == aRhs.volumeId;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CImageCache::CImageCache()
+    : mUseCount(0),
+    mHits(0),
+    mMisses(0)
+{
+    FUNCTION_DEBUG_SENTRY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CImageCache::GetFileIdentity(const std::string &aFileName, FileIdentity &aIdentity)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+#ifdef WIN32
+    HANDLE fileHandle = CreateFileA(aFileName.c_str(), FILE_READ_ATTRIBUTES,
+        FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (fileHandle != INVALID_HANDLE_VALUE)
+    {
+        BY_HANDLE_FILE_INFORMATION info;
+        if (GetFileInformationByHandle(fileHandle, &info))
+        {
+            aIdentity.size = (static_cast<uint64>(info.nFileSizeHigh) << 32) | info.nFileSizeLow;
+            aIdentity.modifiedTime = (static_cast<uint64>(info.ftLastWriteTime.dwHighDateTime) << 32)
+                | info.ftLastWriteTime.dwLowDateTime;
+            aIdentity.fileId = (static_cast<uint64>(info.nFileIndexHigh) << 32) | info.nFileIndexLow;
+            aIdentity.volumeId = info.dwVolumeSerialNumber;
+            retVal = true;
+        }
+        CloseHandle(fileHandle);
+    }
+#else
+    struct stat fileStat;
+    if (stat(aFileName.c_str(), &fileStat) == 0)
+    {
+        aIdentity.size = static_cast<uint64>(fileStat.st_size);
+        aIdentity.modifiedTime = static_cast<uint64>(fileStat.st_mtim.tv_sec) * 1000000000
+            + fileStat.st_mtim.tv_nsec;
+        aIdentity.fileId = static_cast<uint64>(fileStat.st_ino);
+        aIdentity.volumeId = static_cast<uint64>(fileStat.st_dev);
+        retVal = true;
+    }
+#endif
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CImageCache::Lookup(const std::string &aFileName, ImageType aType, const FileIdentity &aIdentity)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    CriticalSection::Lock here(mLock);
+
+    EntryMap::iterator it = mEntries.find(EntryKey(aFileName, aType));
+    if (it != mEntries.end())
+    {
+        if (it->second.identity == aIdentity)
+        {
+            it->second.lastUsed = ++mUseCount;
+            retVal = true;
+        }
+        else
+        {
+            // The file has changed, the entry can never be used again
+            mEntries.erase(it);
+        }
+    }
+
+    if (retVal)
+    {
+        ++mHits;
+    }
+    else
+    {
+        ++mMisses;
+    }
+
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Image cache %s for \"%s\" (hits %u, misses %u)",
+        (retVal ? "hit" : "miss"), aFileName.c_str(), mHits, mMisses);
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CImageCache::Store(const std::string &aFileName, ImageType aType, const FileIdentity &aIdentity)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    CriticalSection::Lock here(mLock);
+
+    EntryKey key(aFileName, aType);
+    if (mEntries.find(key) == mEntries.end() && mEntries.size() >= MAX_ENTRIES)
+    {
+        EntryMap::iterator oldest = mEntries.begin();
+        for (EntryMap::iterator it = mEntries.begin(); it != mEntries.end(); ++it)
+        {
+            if (it->second.lastUsed < oldest->second.lastUsed)
+            {
+                oldest = it;
+            }
+        }
+        mEntries.erase(oldest);
+    }
+
+    Entry &entry = mEntries[key];
+    entry.identity = aIdentity;
+    entry.lastUsed = ++mUseCount;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CImageCache::Clear()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    CriticalSection::Lock here(mLock);
+
+    mEntries.clear();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CImageCache::GetStats(uint32 &aHits, uint32 &aMisses)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    CriticalSection::Lock here(mLock);
+
+    aHits = mHits;
+    aMisses = mMisses;
+}
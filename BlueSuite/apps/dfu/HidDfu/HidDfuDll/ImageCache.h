@@ -0,0 +1,123 @@
+//*******************************************************************************
+//
+//  ImageCache.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CImageCache class, remembers upgrade files which have passed validation.
+//
+//*******************************************************************************
+
+#ifndef IMAGE_CACHE_H
+#define IMAGE_CACHE_H
+
+#include "common/types.h"
+#include "thread/critical_section.h"
+
+#include <map>
+#include <string>
+
+///
+/// Class holding the upgrade files which have already been validated, so that
+/// the same file can be used for repeated upgrades without validating it
+/// again. Entries are keyed on the file path and type, and are only used
+/// while the file identity (size, modification time and file ID) is
+/// unchanged. Only the identity is held, the file is not kept open, so it
+/// can be replaced between upgrades.
+///
+class CImageCache
+{
+public:
+
+    /// Type of validation an entry has passed
+    typedef enum
+    {
+        IMAGE_TYPE_DFU,
+        IMAGE_TYPE_BIN
+    } ImageType;
+
+    /// Identity of a file, any change to the file contents changes this
+    struct FileIdentity
+    {
+        uint64 size;            ///< File size in bytes
+        uint64 modifiedTime;    ///< Last write time (OS specific units)
+        uint64 fileId;          ///< File index / inode number
+        uint64 volumeId;        ///< Volume serial number / device ID
+
+        bool operator==(const FileIdentity &aRhs) const;
+    };
+
+    /// Maximum number of entries held, the least recently used is discarded
+    static const size_t MAX_ENTRIES = 8;
+
+    CImageCache();
+    ~CImageCache() {};
+
+    ///
+    /// Gets the identity of a file.
+    /// @param[in] aFileName File name.
+    /// @param[out] aIdentity The file identity.
+    /// @return true if successful, false if the file could not be queried.
+    ///
+    static bool GetFileIdentity(const std::string &aFileName, FileIdentity &aIdentity);
+
+    ///
+    /// Looks for a validated entry for a file. Counts a hit or a miss.
+    /// @param[in] aFileName File name.
+    /// @param[in] aType Type of validation required.
+    /// @param[in] aIdentity Current identity of the file.
+    /// @return true if the file has been validated and is unchanged.
+    ///
+    bool Lookup(const std::string &aFileName, ImageType aType, const FileIdentity &aIdentity);
+
+    ///
+    /// Stores an entry for a file which has passed validation.
+    /// @param[in] aFileName File name.
+    /// @param[in] aType Type of validation passed.
+    /// @param[in] aIdentity Identity of the file before validation.
+    ///
+    void Store(const std::string &aFileName, ImageType aType, const FileIdentity &aIdentity);
+
+    ///
+    /// Removes all entries. The counters are kept.
+    ///
+    void Clear();
+
+    ///
+    /// Gets the lookup counters.
+    /// @param[out] aHits Number of lookups which found a valid entry.
+    /// @param[out] aMisses Number of lookups which did not.
+    ///
+    void GetStats(uint32 &aHits, uint32 &aMisses);
+
+private:
+    CImageCache(const CImageCache &);
+    CImageCache &operator=(const CImageCache &);
+
+    /// Cache entry
+    struct Entry
+    {
+        FileIdentity identity;
+        uint32 lastUsed;
+    };
+
+    typedef std::pair<std::string, ImageType> EntryKey;
+    typedef std::map<EntryKey, Entry> EntryMap;
+
+    /// Cached entries
+    EntryMap mEntries;
+
+    /// Use counter, for discarding the least recently used entry
+    uint32 mUseCount;
+
+    /// Lookup counters
+    uint32 mHits;
+    uint32 mMisses;
+
+    /// Lock for multi-thread use
+    CriticalSection mLock;
+};
+
+#endif // #ifndef IMAGE_CACHE_H
@@ -0,0 +1,180 @@
+//*******************************************************************************
+//
+//  UpgradeImage.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CUpgradeImage class.
+//
+//*******************************************************************************
+
+#include "UpgradeImage.h"
+#include "HidDfu.h"
+
+#include "engine/enginefw_interface.h"
+
+#include <sstream>
+
+#ifndef WIN32
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+////////////////////////////////////////////////////////////////////////////////
+
+CUpgradeImage::CUpgradeImage()
+    : mpData(NULL),
+    mSize(0)
+#ifdef WIN32
+    , mFileHandle(INVALID_HANDLE_VALUE),
+    mMappingHandle(NULL)
+#endif
+{
+    FUNCTION_DEBUG_SENTRY;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CUpgradeImage::~CUpgradeImage()
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    Close();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+int32 CUpgradeImage::Open(const std::string &aFileName, CHidDfuErrorMsg &aLastError)
+{
+    int32 retVal = HIDDFU_ERROR_NONE;
+    FUNCTION_DEBUG_SENTRY_RET(int32, retVal);
+
+    Close();
+
+    std::ostringstream msg;
+    msg << "Failed to open file \"" << aFileName << "\"";
+
+#ifdef WIN32
+    mFileHandle = CreateFileA(aFileName.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mFileHandle == INVALID_HANDLE_VALUE)
+    {
+        retVal = aLastError.SetMsg(HIDDFU_ERROR_FILE_OPEN_FAILED, msg.str());
+    }
+    else
+    {
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(mFileHandle, &fileSize))
+        {
+            retVal = aLastError.SetDefaultMsg(HIDDFU_ERROR_FILE_READ_FAILED);
+        }
+        else if (fileSize.QuadPart == 0)
+        {
+            retVal = aLastError.SetMsg(HIDDFU_ERROR_FILE_INVALID_FORMAT, "File format is invalid, no payload found");
+        }
+        else
+        {
+            mSize = static_cast<size_t>(fileSize.QuadPart);
+
+            mMappingHandle = CreateFileMapping(mFileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+            if (mMappingHandle != NULL)
+            {
+                mpData = static_cast<const uint8 *>(MapViewOfFile(mMappingHandle, FILE_MAP_READ, 0, 0, 0));
+            }
+
+            if (mpData == NULL)
+            {
+                retVal = aLastError.SetMsg(HIDDFU_ERROR_FILE_READ_FAILED, "Failed to map file into memory");
+            }
+        }
+    }
+#else
+    int fd = open(aFileName.c_str(), O_RDONLY);
+    if (fd == -1)
+    {
+        retVal = aLastError.SetMsg(HIDDFU_ERROR_FILE_OPEN_FAILED, msg.str());
+    }
+    else
+    {
+        struct stat fileStat;
+        if (fstat(fd, &fileStat) != 0)
+        {
+            retVal = aLastError.SetDefaultMsg(HIDDFU_ERROR_FILE_READ_FAILED);
+        }
+        else if (fileStat.st_size == 0)
+        {
+            retVal = aLastError.SetMsg(HIDDFU_ERROR_FILE_INVALID_FORMAT, "File format is invalid, no payload found");
+        }
+        else
+        {
+            mSize = static_cast<size_t>(fileStat.st_size);
+
+            void *pMap = mmap(NULL, mSize, PROT_READ, MAP_SHARED, fd, 0);
+            if (pMap == MAP_FAILED)
+            {
+                retVal = aLastError.SetMsg(HIDDFU_ERROR_FILE_READ_FAILED, "Failed to map file into memory");
+            }
+            else
+            {
+                mpData = static_cast<const uint8 *>(pMap);
+                madvise(pMap, mSize, MADV_SEQUENTIAL);
+            }
+        }
+
+        // The mapping remains valid once the descriptor is closed
+        close(fd);
+    }
+#endif
+
+    if (retVal == HIDDFU_ERROR_NONE)
+    {
+        mFileName = aFileName;
+        MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Mapped \"%s\", %u bytes",
+            mFileName.c_str(), static_cast<uint32>(mSize));
+    }
+    else
+    {
+        Close();
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CUpgradeImage::Close()
+{
+#ifdef WIN32
+    if (mpData != NULL)
+    {
+        UnmapViewOfFile(mpData);
+    }
+    if (mMappingHandle != NULL)
+    {
+        CloseHandle(mMappingHandle);
+        mMappingHandle = NULL;
+    }
+    if (mFileHandle != INVALID_HANDLE_VALUE)
+    {
+        CloseHandle(mFileHandle);
+        mFileHandle = INVALID_HANDLE_VALUE;
+    }
+#else
+    if (mpData != NULL)
+    {
+        munmap(const_cast<uint8 *>(mpData), mSize);
+    }
+#endif
+
+    mpData = NULL;
+    mSize = 0;
+    mFileName.clear();
+}
@@ -0,0 +1,93 @@
+//*******************************************************************************
+//
+//  UpgradeImage.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CUpgradeImage class, read-only memory mapped view of an upgrade file.
+//
+//*******************************************************************************
+
+#ifndef UPGRADE_IMAGE_H
+#define UPGRADE_IMAGE_H
+
+#include "HidDfuErrorMsg.h"
+#include "common/types.h"
+
+#include <memory>
+#include <string>
+
+#ifdef WIN32
+#include <windows.h>
+#endif
+
+///
+/// Class giving random access to an upgrade file through a read-only memory
+/// mapping. The file is mapped once and the object can then be shared by any
+/// number of devices (the data is never written, so no locking is needed).
+///
+class CUpgradeImage
+{
+public:
+    CUpgradeImage();
+    ~CUpgradeImage();
+
+    ///
+    /// Opens and maps a file. Any previously mapped file is closed first.
+    /// @param[in] aFileName File name.
+    /// @param[in] aLastError Error message object to receive failure details.
+    /// @return The result.
+    ///
+    int32 Open(const std::string &aFileName, CHidDfuErrorMsg &aLastError);
+
+    ///
+    /// Unmaps and closes the file, if open.
+    ///
+    void Close();
+
+    ///
+    /// Gets a pointer to the mapped file data.
+    /// @return The file data, NULL if no file is mapped.
+    ///
+    const uint8 *GetData() const { return mpData; }
+
+    ///
+    /// Gets the size of the mapped file.
+    /// @return The file size in bytes.
+    ///
+    size_t GetSize() const { return mSize; }
+
+    ///
+    /// Gets the name of the mapped file.
+    /// @return The file name.
+    ///
+    const std::string &GetFileName() const { return mFileName; }
+
+private:
+    CUpgradeImage(const CUpgradeImage &);
+    CUpgradeImage &operator=(const CUpgradeImage &);
+
+    /// Name of the mapped file
+    std::string mFileName;
+
+    /// Start of the mapped file data, NULL if not mapped
+    const uint8 *mpData;
+
+    /// File size in bytes
+    size_t mSize;
+
+#ifdef WIN32
+    /// File handle
+    HANDLE mFileHandle;
+
+    /// File mapping handle
+    HANDLE mMappingHandle;
+#endif
+};
+
+/// Shared, read-only reference to an upgrade image
+typedef std::shared_ptr<const CUpgradeImage> UpgradeImagePtr;
+
+#endif // #ifndef UPGRADE_IMAGE_H
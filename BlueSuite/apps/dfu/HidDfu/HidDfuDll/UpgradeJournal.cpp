@@ -0,0 +1,257 @@
+//*******************************************************************************
+//
+//  UpgradeJournal.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Implementation for CUpgradeJournal class.
+//
+//*******************************************************************************
+
+#include "UpgradeJournal.h"
+#include "DFUEngine/CRC.h"
+
+#include "engine/enginefw_interface.h"
+
+#include <stddef.h>
+#include <string.h>
+
+#undef  EF_GROUP
+#define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
+
+const char *const CUpgradeJournal::FILE_EXTENSION = ".journal";
+
+////////////////////////////////////////////////////////////////////////////////
+
+CUpgradeJournal::CUpgradeJournal()
+    : mpFile(NULL)
+{
+    memset(&mIdentity, 0, sizeof(mIdentity));
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+CUpgradeJournal::~CUpgradeJournal()
+{
+    if (mpFile != NULL)
+    {
+        fclose(mpFile);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CUpgradeJournal::Open(const std::string &aFileName)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    CriticalSection::Lock here(mLock);
+
+    mJournalName = aFileName + FILE_EXTENSION;
+    mRecords.clear();
+
+    retVal = CImageCache::GetFileIdentity(aFileName, mIdentity);
+    if (retVal)
+    {
+        FILE *pFile = fopen(mJournalName.c_str(), "rb");
+        if (pFile != NULL)
+        {
+            // Records which are torn or unused are kept as free slots
+            JournalRecord record;
+            while (fread(&record, sizeof(record), 1, pFile) == 1)
+            {
+                if (!IsValid(record))
+                {
+                    memset(&record, 0, sizeof(record));
+                }
+                mRecords.push_back(record);
+            }
+
+            fclose(pFile);
+        }
+    }
+
+    MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Upgrade journal for \"%s\" %s, %u records",
+        aFileName.c_str(), (retVal ? "opened" : "not usable"), static_cast<uint32>(mRecords.size()));
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CUpgradeJournal::Find(const std::string &aKey, uint8 &aResumePoint, uint64 &aOffset) const
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    CriticalSection::Lock here(mLock);
+
+    const size_t slot = FindSlot(aKey);
+    if (slot < mRecords.size())
+    {
+        const JournalRecord &record = mRecords[slot];
+        retVal = record.fileSize == mIdentity.size &&
+            record.modifiedTime == mIdentity.modifiedTime &&
+            record.fileId == mIdentity.fileId &&
+            record.volumeId == mIdentity.volumeId;
+
+        if (retVal)
+        {
+            aResumePoint = static_cast<uint8>(record.resumePoint);
+            aOffset = record.offset;
+        }
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CUpgradeJournal::Record(const std::string &aKey, uint8 aResumePoint, uint64 aOffset)
+{
+    bool retVal = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, retVal);
+
+    CriticalSection::Lock here(mLock);
+
+    if (!mJournalName.empty() && !aKey.empty() && aKey.size() <= MAX_KEY_LENGTH)
+    {
+        // Use the device's slot, or else the first free one
+        size_t slot = FindSlot(aKey);
+        if (slot == mRecords.size())
+        {
+            for (slot = 0; slot < mRecords.size() && mRecords[slot].magic != 0; ++slot)
+            {
+            }
+        }
+        if (slot == mRecords.size())
+        {
+            mRecords.push_back(JournalRecord());
+        }
+
+        JournalRecord &record = mRecords[slot];
+        memset(&record, 0, sizeof(record));
+        record.magic = JOURNAL_MAGIC;
+        record.version = JOURNAL_VERSION;
+        record.fileSize = mIdentity.size;
+        record.modifiedTime = mIdentity.modifiedTime;
+        record.fileId = mIdentity.fileId;
+        record.volumeId = mIdentity.volumeId;
+        record.offset = aOffset;
+        record.resumePoint = aResumePoint;
+        memcpy(record.key, aKey.c_str(), aKey.size());
+
+        CRC crc;
+        record.crc = crc(&record, offsetof(JournalRecord, crc));
+
+        retVal = WriteSlot(slot);
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+void CUpgradeJournal::Remove(const std::string &aKey)
+{
+    FUNCTION_DEBUG_SENTRY;
+
+    CriticalSection::Lock here(mLock);
+
+    const size_t slot = FindSlot(aKey);
+    if (slot < mRecords.size())
+    {
+        memset(&mRecords[slot], 0, sizeof(JournalRecord));
+
+        size_t used = 0;
+        for (size_t n = 0; n < mRecords.size(); ++n)
+        {
+            used += (mRecords[n].magic != 0 ? 1 : 0);
+        }
+
+        if (used > 0)
+        {
+            WriteSlot(slot);
+        }
+        else
+        {
+            // No upgrade is left to resume
+            if (mpFile != NULL)
+            {
+                fclose(mpFile);
+                mpFile = NULL;
+            }
+            remove(mJournalName.c_str());
+            mRecords.clear();
+        }
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CUpgradeJournal::IsValid(const JournalRecord &aRecord)
+{
+    bool retVal = (aRecord.magic == JOURNAL_MAGIC) && (aRecord.version == JOURNAL_VERSION);
+
+    if (retVal)
+    {
+        CRC crc;
+        retVal = (crc(&aRecord, offsetof(JournalRecord, crc)) == aRecord.crc);
+    }
+
+    return retVal;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+size_t CUpgradeJournal::FindSlot(const std::string &aKey) const
+{
+    size_t slot = 0;
+
+    for (; slot < mRecords.size(); ++slot)
+    {
+        const JournalRecord &record = mRecords[slot];
+        if (record.magic != 0 && strncmp(record.key, aKey.c_str(), sizeof(record.key)) == 0)
+        {
+            break;
+        }
+    }
+
+    return slot;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+bool CUpgradeJournal::WriteSlot(size_t aSlot)
+{
+    bool retVal = false;
+
+    if (mpFile == NULL)
+    {
+        // Keep the records of other devices, creating the file if there is none
+        mpFile = fopen(mJournalName.c_str(), "r+b");
+        if (mpFile == NULL)
+        {
+            mpFile = fopen(mJournalName.c_str(), "w+b");
+        }
+
+        if (mpFile == NULL)
+        {
+            MSG_HANDLER_NOTIFY_DEBUG(DEBUG_BASIC, "Upgrade journal \"%s\" could not be created", mJournalName.c_str());
+        }
+    }
+
+    // Each record is flushed as soon as it is written, so that it is kept
+    // if the process is stopped
+    if (mpFile != NULL)
+    {
+        retVal = fseek(mpFile, static_cast<long>(aSlot * sizeof(JournalRecord)), SEEK_SET) == 0 &&
+            fwrite(&mRecords[aSlot], sizeof(JournalRecord), 1, mpFile) == 1 &&
+            fflush(mpFile) == 0;
+    }
+
+    return retVal;
+}
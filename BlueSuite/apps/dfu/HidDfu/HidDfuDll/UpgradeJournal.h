@@ -0,0 +1,154 @@
+//*******************************************************************************
+//
+//  UpgradeJournal.h
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  CUpgradeJournal class, resume journal (<file>.journal) for an upgrade file.
+//
+//*******************************************************************************
+
+#ifndef UPGRADE_JOURNAL_H
+#define UPGRADE_JOURNAL_H
+
+#include "ImageCache.h"
+#include "common/types.h"
+#include "thread/critical_section.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+///
+/// Journal of the application upgrades in progress from an upgrade file,
+/// saved next to the file. Each device being upgraded has a fixed-size
+/// record holding the device key, the identity of the file, the resume point
+/// reached and the offset of the data the device has acknowledged. A record
+/// is rewritten in place as the upgrade moves on, and removed when the
+/// upgrade completes, so that a later process upgrading the device from the
+/// unchanged file knows the device holds part of this image and can resume
+/// the upgrade instead of aborting it.
+///
+/// A record is protected by a CRC, and one which is torn, or was saved for a
+/// different version of the file, is ignored. May be used from any thread.
+///
+class CUpgradeJournal
+{
+public:
+
+    /// Extension appended to the upgrade file name for the journal file
+    static const char *const FILE_EXTENSION;
+
+    /// Longest device key which can be recorded
+    static const size_t MAX_KEY_LENGTH = 199;
+
+    CUpgradeJournal();
+    ~CUpgradeJournal();
+
+    ///
+    /// Reads the journal for an upgrade file, if there is one. The journal
+    /// file is created when the first record is written.
+    /// @param[in] aFileName Upgrade file name.
+    /// @return false if the identity of the upgrade file cannot be read.
+    ///
+    bool Open(const std::string &aFileName);
+
+    ///
+    /// Looks for the record of a device upgraded from this version of the file.
+    /// @param[in] aKey Device key.
+    /// @param[out] aResumePoint Resume point recorded (UpgradeResumePoint).
+    /// @param[out] aOffset Offset of the data acknowledged by the device.
+    /// @return true if a record was found.
+    ///
+    bool Find(const std::string &aKey, uint8 &aResumePoint, uint64 &aOffset) const;
+
+    ///
+    /// Records the progress of the upgrade of a device, replacing any
+    /// earlier record for the device.
+    /// @param[in] aKey Device key.
+    /// @param[in] aResumePoint Resume point reached (UpgradeResumePoint).
+    /// @param[in] aOffset Offset of the data acknowledged by the device.
+    /// @return true if the record was written.
+    ///
+    bool Record(const std::string &aKey, uint8 aResumePoint, uint64 aOffset);
+
+    ///
+    /// Removes the record of a device once its upgrade has completed. The
+    /// journal file is deleted when no records remain.
+    /// @param[in] aKey Device key.
+    ///
+    void Remove(const std::string &aKey);
+
+private:
+
+    CUpgradeJournal(const CUpgradeJournal &);
+    CUpgradeJournal &operator=(const CUpgradeJournal &);
+
+    /// Journal file record, followed by the next record. The fields are
+    /// fixed width (uint32 is 8 bytes on 64-bit Linux) and laid out without
+    /// padding, so a record is 256 bytes long on every platform.
+    struct JournalRecord
+    {
+        uint32_t magic;
+        uint32_t version;
+        uint64_t fileSize;
+        uint64_t modifiedTime;
+        uint64_t fileId;
+        uint64_t volumeId;
+        uint64_t offset;
+        uint32_t resumePoint;
+        char key[MAX_KEY_LENGTH + 1];
+        uint32_t crc;
+    };
+    static_assert(sizeof(JournalRecord) == 256, "Journal record is 256 bytes");
+
+    /// Magic number ("UJNL") and format version
+    static const uint32_t JOURNAL_MAGIC = 0x4C4E4A55;
+    static const uint32_t JOURNAL_VERSION = 1;
+
+    ///
+    /// Checks that a record was completely written.
+    /// @param[in] aRecord The record.
+    /// @return true if the magic number, version and CRC are correct.
+    ///
+    static bool IsValid(const JournalRecord &aRecord);
+
+    ///
+    /// Finds the slot holding the record of a device, for any file version.
+    /// @param[in] aKey Device key.
+    /// @return The slot, or the number of slots if there is none.
+    ///
+    size_t FindSlot(const std::string &aKey) const;
+
+    ///
+    /// Writes a record to the journal file, opening the file if needed.
+    /// Called with mLock held.
+    /// @param[in] aSlot Slot of the record.
+    /// @return true if successful.
+    ///
+    bool WriteSlot(size_t aSlot);
+
+    /// Journal file name
+    std::string mJournalName;
+
+    /// Identity of the upgrade file when the journal was opened
+    CImageCache::FileIdentity mIdentity;
+
+    /// Records as held in the journal file, a cleared record is a free slot
+    std::vector<JournalRecord> mRecords;
+
+    /// Journal file, NULL until the first record is written
+    FILE *mpFile;
+
+    /// Protects the records and the file
+    mutable CriticalSection mLock;
+};
+
+/// Shared reference to an upgrade journal
+typedef std::shared_ptr<CUpgradeJournal> UpgradeJournalPtr;
+
+#endif // #ifndef UPGRADE_JOURNAL_H
@@ -13,230 +13,270 @@
 #include "UpgradeProtocol.h"
 
 #include <assert.h>
+#include <string.h>
 #include "engine/enginefw_interface.h"
 
 #undef  EF_GROUP
 #define EF_GROUP CMessageHandler::GROUP_ENUM_HID_DFU_LIB
 
-////////////////////////////////////////////////////////////////////////////////
-
-CUpgradeProtocolMsg::CUpgradeProtocolMsg(const uint8 aReportId, uint8 aReportLenBytes,
-        const uint8 aOpCode, const uint16 aLength)
-        : mReportId(aReportId), mOpCode(aOpCode), mLength(aLength)
+namespace
 {
-    FUNCTION_DEBUG_SENTRY;
-
-    mUpgradeMsgSize = static_cast<uint8>(sizeof(aOpCode) + sizeof(aLength) + aLength);
-
-    size_t upgradeDataSize = aReportLenBytes - HEADER_SIZE;
-
-    // Set data size to 'Upgrade Data Size' and initialise to 0's
-    mData.resize(upgradeDataSize, 0);
-}
-
-CUpgradeProtocolMsg::CUpgradeProtocolMsg(const uint8 *apBuffer, const uint8 aLength)
-{
-    FUNCTION_DEBUG_SENTRY;
-
-    // Report ID
-    mReportId = apBuffer[0];
-
-    // Size
-    mUpgradeMsgSize = apBuffer[1];
-
-    // Opcode (8-bits)
-    mOpCode = apBuffer[2];
+    /// A protocol value and its name, for logging
+    struct UpgradeCodeName
+    {
+        uint16 code;
+        const char *pName;
+    };
 
-    // Length (16-bits MSB, LSB)
-    mLength = apBuffer[4];
-    mLength = (apBuffer[3] << 8) & mLength;
+#define UPGRADE_CODE_NAME(code) { code, #code }
 
-    // Data
-    size_t upgradeDataSize = aLength - HEADER_SIZE;
-    // Set data size to 'Upgrade Data Size' and initialise to 0's
-    mData.resize(upgradeDataSize, 0);
+    /// Names of the values of each enumeration, in ascending order of value
+    constexpr UpgradeCodeName OPCODE_NAMES[] =
+    {
+        UPGRADE_CODE_NAME(UPGRADE_START_REQ),
+        UPGRADE_CODE_NAME(UPGRADE_START_CFM),
+        UPGRADE_CODE_NAME(UPGRADE_DATA_BYTES_REQ),
+        UPGRADE_CODE_NAME(UPGRADE_DATA),
+        UPGRADE_CODE_NAME(UPGRADE_ABORT_REQ),
+        UPGRADE_CODE_NAME(UPGRADE_ABORT_CFM),
+        UPGRADE_CODE_NAME(UPGRADE_TRANSFER_COMPLETE_IND),
+        UPGRADE_CODE_NAME(UPGRADE_TRANSFER_COMPLETE_RES),
+        UPGRADE_CODE_NAME(UPGRADE_PROCEED_TO_COMMIT),
+        UPGRADE_CODE_NAME(UPGRADE_COMMIT_REQ),
+        UPGRADE_CODE_NAME(UPGRADE_COMMIT_CFM),
+        UPGRADE_CODE_NAME(UPGRADE_ERROR_IND),
+        UPGRADE_CODE_NAME(UPGRADE_COMPLETE_IND),
+        UPGRADE_CODE_NAME(UPGRADE_SYNC_REQ),
+        UPGRADE_CODE_NAME(UPGRADE_SYNC_CFM),
+        UPGRADE_CODE_NAME(UPGRADE_START_DATA_REQ),
+        UPGRADE_CODE_NAME(UPGRADE_IS_VALIDATION_DONE_REQ),
+        UPGRADE_CODE_NAME(UPGRADE_IS_VALIDATION_DONE_CFM),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_VERSION_REQ),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_VERSION_CFM),
+        UPGRADE_CODE_NAME(UPGRADE_ERROR_RES),
+    };
+
+    constexpr UpgradeCodeName ERROR_CODE_NAMES[] =
+    {
+        UPGRADE_CODE_NAME(UPGRADE_HOST_SUCCESS),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_OEM_VALIDATION_SUCCESS),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_INTERNAL_ERROR_DEPRECATED),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_UNKNOWN_ID),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_BAD_LENGTH_DEPRECATED),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_WRONG_VARIANT),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_WRONG_PARTITION_NUMBER),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_SIZE_MISMATCH),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_TYPE_NOT_FOUND_DEPRECATED),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_OPEN_FAILED),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_WRITE_FAILED_DEPRECATED),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED_DEPRECATED),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_SFS_VALIDATION_FAILED),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_DEPRECATED),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_UPDATE_FAILED),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_APP_NOT_READY),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_LOADER_ERROR),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_UNEXPECTED_LOADER_MSG),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_MISSING_LOADER_MSG),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_BATTERY_LOW),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_INVALID_SYNC_ID),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_IN_ERROR_STATE),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_NO_MEMORY),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_SQIF_ERASE),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_BAD_LENGTH_PARTITION_PARSE),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_BAD_LENGTH_TOO_SHORT),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_BAD_LENGTH_UPGRADE_HEADER),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_BAD_LENGTH_PARTITION_HEADER),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_BAD_LENGTH_SIGNATURE),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_BAD_LENGTH_DATAHDR_RESUME),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_HEADERS),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_UPGRADE_HEADER),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_PARTITION_HEADER1),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_PARTITION_HEADER2),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_PARTITION_DATA),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_FOOTER),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_OEM_VALIDATION_FAILED_MEMORY),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED_HEADER),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_CLOSE_FAILED_PS_SPACE),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_TYPE_NOT_MATCHING),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_TYPE_TWO_DFU),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_WRITE_FAILED_HEADER),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_PARTITION_WRITE_FAILED_DATA),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_FILE_TOO_SMALL),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_FILE_TOO_BIG),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_INTERNAL_ERROR_1),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_INTERNAL_ERROR_2),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_INTERNAL_ERROR_3),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_INTERNAL_ERROR_4),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_INTERNAL_ERROR_5),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_INTERNAL_ERROR_6),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_ERROR_INTERNAL_ERROR_7),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_WARN_APP_CONFIG_VERSION_INCOMPATIBLE),
+        UPGRADE_CODE_NAME(UPGRADE_HOST_WARN_SYNC_ID_IS_DIFFERENT),
+    };
+
+    constexpr UpgradeCodeName STATUS_NAMES[] =
+    {
+        UPGRADE_CODE_NAME(UPGRADE_STATUS_SUCCESS),
+        UPGRADE_CODE_NAME(UPGRADE_STATUS_UNEXPECTED_ERROR),
+        UPGRADE_CODE_NAME(UPGRADE_STATUS_ALREADY_CONNECTED_WARNING),
+        UPGRADE_CODE_NAME(UPGRADE_STATUS_IN_PROGRESS),
+        UPGRADE_CODE_NAME(UPGRADE_STATUS_BUSY),
+        UPGRADE_CODE_NAME(UPGRADE_STATUS_INVALID_POWER_STATE),
+    };
+
+#undef UPGRADE_CODE_NAME
+
+    ///
+    /// Checks that a table is in ascending order of value, so it can be
+    /// searched by bisection.
+    /// @param[in] aNames The table.
+    /// @return true if the table is sorted.
+    ///
+    template <size_t N>
+    constexpr bool IsSorted(const UpgradeCodeName (&aNames)[N])
+    {
+        bool sorted = true;
+        for (size_t n = 1; n < N; ++n)
+        {
+            sorted = sorted && (aNames[n - 1].code < aNames[n].code);
+        }
+        return sorted;
+    }
 
-    for (uint8 i = 0; i < upgradeDataSize; ++i)
+    static_assert(IsSorted(OPCODE_NAMES), "OPCODE_NAMES must be sorted");
+    static_assert(IsSorted(ERROR_CODE_NAMES), "ERROR_CODE_NAMES must be sorted");
+    static_assert(IsSorted(STATUS_NAMES), "STATUS_NAMES must be sorted");
+
+    ///
+    /// Finds the name of a value.
+    /// @param[in] aNames Table of names, sorted by value.
+    /// @param[in] aCode The value.
+    /// @param[in] apUnknown Name returned if the value is not in the table.
+    /// @return The name.
+    ///
+    template <size_t N>
+    const char *FindName(const UpgradeCodeName (&aNames)[N], uint16 aCode, const char *apUnknown)
     {
-        mData.at(i) = apBuffer[i + 5];
+        size_t first = 0;
+        size_t last = N;
+
+        while (first < last)
+        {
+            const size_t middle = first + (last - first) / 2;
+            if (aNames[middle].code < aCode)
+            {
+                first = middle + 1;
+            }
+            else
+            {
+                last = middle;
+            }
+        }
+
+        return (((first < N) && (aNames[first].code == aCode)) ? aNames[first].pName : apUnknown);
     }
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void CUpgradeProtocolMsg::Serialise(uint8 *apBuffer, uint8 aLength) const
+CUpgradeProtocolMsg::CUpgradeProtocolMsg(uint8 *apReport, const uint8 aReportId, uint8 aReportLenBytes,
+        const uint8 aOpCode, const uint16 aLength)
+        : mpReport(apReport), mpOutReport(apReport), mReportLenBytes(aReportLenBytes)
 {
     FUNCTION_DEBUG_SENTRY;
 
+    assert(apReport != NULL && aReportLenBytes >= HEADER_SIZE);
+
     // Report ID
-    apBuffer[0] = mReportId;
+    apReport[0] = aReportId;
 
     // Size
-    apBuffer[1] = mUpgradeMsgSize;
+    SetUpgradeMsgSize(static_cast<uint8>(sizeof(aOpCode) + sizeof(aLength) + aLength));
 
     // Opcode (8-bits)
-    apBuffer[2] = mOpCode;
+    apReport[2] = aOpCode;
 
     // Length (16-bits MSB, LSB)
-    apBuffer[3] = (mLength >> 8) & 0xFF;;
-    apBuffer[4] = mLength & 0xFF;
+    SetLength(aLength);
 
-    // Data
-    uint8 upgradeDataSize = aLength - HEADER_SIZE;
-    for (uint8 i = 0; i < upgradeDataSize; ++i)
-    {
-        apBuffer[i + 5] = mData.at(i);
-    }
-
-    MSG_HANDLER_NOTIFY_DEBUG_BUFFER(DEBUG_BASIC, "UpgradeProtocolMsg[...]", apBuffer, upgradeDataSize);
+    // Data, initialised to 0's
+    memset(apReport + HEADER_SIZE, 0, aReportLenBytes - HEADER_SIZE);
 }
 
-////////////////////////////////////////////////////////////////////////////////
-
-void CUpgradeProtocolMsg::SetData(const uint8 aIndex, const uint8* apBuffer, uint8 aLength)
+CUpgradeProtocolMsg::CUpgradeProtocolMsg(uint8 *apReport, const uint8 aReportId, uint8 aReportLenBytes,
+        const uint8 aOpCode, const uint16 aLength, const uint8 *apData, const uint8 aDataIndex)
+        : mpReport(apReport), mpOutReport(apReport), mReportLenBytes(aReportLenBytes)
 {
-    FUNCTION_DEBUG_SENTRY;
+    assert(apReport != NULL && aReportLenBytes >= HEADER_SIZE + aLength && aDataIndex <= aLength);
+
+    apReport[0] = aReportId;
+    SetUpgradeMsgSize(static_cast<uint8>(sizeof(aOpCode) + sizeof(aLength) + aLength));
+    apReport[2] = aOpCode;
+    SetLength(aLength);
 
-    // Data
-    for (uint8 i = 0; i < aLength; ++i)
+    uint8 *pData = apReport + HEADER_SIZE;
+    memset(pData, 0, aDataIndex);
+    if (aLength > aDataIndex)
     {
-        mData.at(aIndex + i) = apBuffer[i];
+        memcpy(pData + aDataIndex, apData, aLength - aDataIndex);
     }
+    memset(pData + aLength, 0, aReportLenBytes - HEADER_SIZE - aLength);
 }
 
-////////////////////////////////////////////////////////////////////////////////
-
-uint8 CUpgradeProtocolMsg::GetDataUint8(const uint8 aIndex) const
-{
-    uint8 retVal = 0;
-    FUNCTION_DEBUG_SENTRY_RET(uint8, retVal);
-
-    retVal = mData.at(aIndex);
-
-    return retVal;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-uint16 CUpgradeProtocolMsg::GetDataUint16(const uint8 aIndex) const
-{
-    uint16 retVal = 0;
-    FUNCTION_DEBUG_SENTRY_RET(uint16, retVal);
-
-    retVal = mData.at(aIndex + 1);
-    retVal = (mData.at(aIndex) << 8) | retVal;
-
-    return retVal;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-uint32 CUpgradeProtocolMsg::GetDataUint32(const uint8 aIndex) const
-{
-    uint32 retVal = 0;
-    FUNCTION_DEBUG_SENTRY_RET(uint32, retVal);
-
-    retVal = mData.at(aIndex + 3);
-    retVal = (mData.at(aIndex + 2) << 8) | retVal;
-    retVal = (mData.at(aIndex + 1) << 16) | retVal;
-    retVal = (mData.at(aIndex) << 24) | retVal;
-
-    return retVal;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-void CUpgradeProtocolMsg::SetDataUint8(const uint8 aIndex, const uint8 aValue)
-{
-    FUNCTION_DEBUG_SENTRY;
-
-    mData.at(aIndex) = aValue & 0xFF;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-void CUpgradeProtocolMsg::SetDataUint16(const uint8 aIndex, const uint16 aValue)
-{
-    FUNCTION_DEBUG_SENTRY;
-
-    mData.at(aIndex) = (aValue >> 8) & 0xFF;
-    mData.at(aIndex + 1) = aValue & 0xFF;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-void CUpgradeProtocolMsg::SetDataUint32(const uint8 aIndex, const uint32 aValue)
-{
-    FUNCTION_DEBUG_SENTRY;
-
-    mData.at(aIndex) = (aValue >> 24) & 0xFF;
-    mData.at(aIndex + 1) = (aValue >> 16) & 0xFF;
-    mData.at(aIndex + 2) = (aValue >> 8) & 0xFF;
-    mData.at(aIndex + 3) = aValue & 0xFF;
-}
-
-////////////////////////////////////////////////////////////////////////////////
-
-void CUpgradeCommitCfm::SetAction(const uint8 aAction)
+CUpgradeProtocolMsg::CUpgradeProtocolMsg(const uint8 *apReport, const uint8 aReportLenBytes)
+        : mpReport(apReport), mpOutReport(NULL), mReportLenBytes(aReportLenBytes)
 {
     FUNCTION_DEBUG_SENTRY;
 
-    SetDataUint8(0, aAction);
+    assert(apReport != NULL && aReportLenBytes >= HEADER_SIZE);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void CUpgradeDataReq::SetMoreData(const uint8 aMoreData)
+void CUpgradeProtocolMsg::SetLength(const uint16 aLength)
 {
-    FUNCTION_DEBUG_SENTRY;
+    uint8 *pHeader = GetDataForWrite(0, 0) - HEADER_SIZE;
 
-    SetDataUint8(0, aMoreData);
+    pHeader[3] = (aLength >> 8) & 0xFF;
+    pHeader[4] = aLength & 0xFF;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void CUpgradeDataReq::SetImageData(const uint8 *apImageData, uint8 aLength)
+void CUpgradeProtocolMsg::SetUpgradeMsgSize(const uint8 aUpgradeMsgSize)
 {
-    FUNCTION_DEBUG_SENTRY;
+    uint8 *pHeader = GetDataForWrite(0, 0) - HEADER_SIZE;
 
-    // "More data" flag goes before data, so write data at index 1
-    SetData(1, apImageData, aLength);
+    pHeader[1] = aUpgradeMsgSize;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void CUpgradeErrorRes::SetErrorCode(const uint16 aErrorCode)
+CUpgradeDataReq::CUpgradeDataReq(uint8 *apReport, const uint8 aReportLenBytes, const uint8 *apImageData,
+        const uint8 aLength)
+        : CUpgradeProtocolMsg(apReport, HID_REPORTID_DATA_TRANSFER, aReportLenBytes, UPGRADE_DATA,
+            static_cast<uint16>(MoreData::End + aLength), apImageData, MoreData::End)
 {
-    FUNCTION_DEBUG_SENTRY;
-
-    SetDataUint16(0, aErrorCode);
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void CUpgradeProceedToCommit::SetAction(const uint8 aAction)
+const char *GetUpgradeOpCodeName(const uint8 aOpCode)
 {
-    FUNCTION_DEBUG_SENTRY;
-
-    SetDataUint8(0, aAction);
+    return FindName(OPCODE_NAMES, aOpCode, "Unknown OpCode");
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void CUpgradeSyncReq::SetFileIdentifier(const uint32 aFileIdentifier)
+const char *GetUpgradeErrorCodeName(const uint16 aErrorCode)
 {
-    FUNCTION_DEBUG_SENTRY;
-
-    SetDataUint32(0, aFileIdentifier);
+    return FindName(ERROR_CODE_NAMES, aErrorCode, "Unknown Error Code");
 }
 
 ////////////////////////////////////////////////////////////////////////////////
 
-void CUpgradeTransferCompleteRes::SetAction(const uint8 aAction)
+const char *GetUpgradeStatusName(const uint8 aStatus)
 {
-    FUNCTION_DEBUG_SENTRY;
-
-    SetDataUint8(0, aAction);
+    return FindName(STATUS_NAMES, aStatus, "Unknown Connection Status");
 }
-
-////////////////////////////////////////////////////////////////////////////////
\ No newline at end of file
@@ -15,8 +15,8 @@
 
 #include "common/types.h"
 
-#include <vector>
-
+#include <assert.h>
+#include <stddef.h>
 
 ///
 /// The device may record that part of the upgrade process was completed.
@@ -170,54 +170,192 @@ static const uint16 HID_CMD_DISCONNECT_REQ = 0x07;
 static const uint8 HEADER_SIZE = 5;
 
 ///
-/// Class API for UpgradeProtocol functions
+/// Gets the name of an upgrade protocol opcode, for logging.
+/// @param[in] aOpCode The opcode.
+/// @return The name, or "Unknown OpCode".
 ///
-class CUpgradeProtocolMsg
-{
-public:
+const char *GetUpgradeOpCodeName(uint8 aOpCode);
 
-    CUpgradeProtocolMsg(uint8 aReportId, uint8 aReportLenBytes, uint8 aOpCode, uint16 alength = 0);
-    ~CUpgradeProtocolMsg() {};
+///
+/// Gets the name of an upgrade protocol error code, for logging.
+/// @param[in] aErrorCode The error code.
+/// @return The name, or "Unknown Error Code".
+///
+const char *GetUpgradeErrorCodeName(uint16 aErrorCode);
 
-    CUpgradeProtocolMsg(const uint8 *apBuffer, uint8 aLength);
+///
+/// Gets the name of an upgrade status given in response to a connection
+/// request, for logging.
+/// @param[in] aStatus The status.
+/// @return The name, or "Unknown Connection Status".
+///
+const char *GetUpgradeStatusName(uint8 aStatus);
 
-    void Serialise(uint8 *apBuffer, uint8 aLength) const;
+///
+/// Size on the wire of each type of message field. This is not sizeof(T), as
+/// uint32 is wider than 32 bits on some platforms.
+///
+template <typename T> struct UpgradeMsgFieldSize;
+template <> struct UpgradeMsgFieldSize<uint8>  { static constexpr uint8 Value = 1; };
+template <> struct UpgradeMsgFieldSize<uint16> { static constexpr uint8 Value = 2; };
+template <> struct UpgradeMsgFieldSize<uint32> { static constexpr uint8 Value = 4; };
 
-    uint8 GetUpgradeMsgSize() const { return mUpgradeMsgSize; };
+///
+/// Describes a field of the data of an upgrade protocol message, a big-endian
+/// value at a fixed index. The offsets and sizes of a message are all known at
+/// compile time, so reading or writing a field is a few loads or stores.
+/// @tparam INDEX Index of the field within the data field.
+/// @tparam T Type of the field, uint8, uint16 or uint32.
+///
+template <uint8 INDEX, typename T>
+class CUpgradeMsgField
+{
+public:
 
-    uint8 GetOpCode() const { return mOpCode; };
+    typedef T Type;
+
+    static constexpr uint8 Index = INDEX;                                   ///< Index within the data field
+    static constexpr uint8 Size = UpgradeMsgFieldSize<T>::Value;            ///< Length in bytes
+    static constexpr uint8 End = static_cast<uint8>(INDEX + Size);          ///< Index following the field
+
+    ///
+    /// Reads the field.
+    /// @param[in] apData Data field of the message.
+    /// @return The value.
+    ///
+    static T Decode(const uint8 *apData)
+    {
+        T value = 0;
+        for (uint8 n = 0; n < Size; ++n)
+        {
+            value = static_cast<T>((value << 8) | apData[INDEX + n]);
+        }
+        return value;
+    }
+
+    ///
+    /// Writes the field.
+    /// @param[out] apData Data field of the message.
+    /// @param[in] aValue The value.
+    ///
+    static void Encode(uint8 *apData, T aValue)
+    {
+        for (uint8 n = 0; n < Size; ++n)
+        {
+            apData[INDEX + n] = static_cast<uint8>(aValue >> (8 * (Size - 1 - n)));
+        }
+    }
+};
 
-    void SetLength(uint16 aLength) { mLength = aLength; };
+///
+/// Class API for UpgradeProtocol functions.
+/// A message is a view of a HID report buffer owned by the caller: messages
+/// to send are built in place in the buffer, received messages are read
+/// directly from it. The buffer must outlive the message.
+///
+class CUpgradeProtocolMsg
+{
+public:
 
-    void SetUpgradeMsgSize(uint8 aUpgradeMsgSize) { mUpgradeMsgSize = aUpgradeMsgSize; };
+    ///
+    /// Constructs a message to send. The header is written to the report and
+    /// the data field cleared, so fields not set are sent as 0.
+    /// @param[out] apReport Report buffer, aReportLenBytes long.
+    /// @param[in] aReportId HID report ID.
+    /// @param[in] aReportLenBytes HID report length.
+    /// @param[in] aOpCode Upgrade protocol opcode.
+    /// @param[in] aLength Length of the data field.
+    ///
+    CUpgradeProtocolMsg(uint8 *apReport, uint8 aReportId, uint8 aReportLenBytes, uint8 aOpCode, uint16 alength = 0);
+    ~CUpgradeProtocolMsg() {};
 
-protected:
+    ///
+    /// Constructs a view of a received message.
+    /// @param[in] apReport Report buffer, aReportLenBytes long.
+    /// @param[in] aReportLenBytes HID report length.
+    ///
+    CUpgradeProtocolMsg(const uint8 *apReport, uint8 aReportLenBytes);
 
-    void SetDataUint8(uint8 aIndex, uint8 aValue);
+    const uint8 *GetReport() const { return mpReport; };
 
-    uint8 GetDataUint8(uint8 aIndex) const;
+    uint8 GetReportLength() const { return mReportLenBytes; };
 
-    void SetDataUint16(uint8 aIndex, uint16 aValue);
+    uint8 GetUpgradeMsgSize() const { return mpReport[1]; };
 
-    uint16 GetDataUint16(uint8 aIndex) const;
+    uint8 GetOpCode() const { return mpReport[2]; };
 
-    void SetDataUint32(uint8 aIndex, uint32 aValue);
+    void SetLength(uint16 aLength);
 
-    uint32 GetDataUint32(uint8 aIndex) const;
+    void SetUpgradeMsgSize(uint8 aUpgradeMsgSize);
 
-    void SetData(uint8 aIndex, const uint8 * apBuffer, uint8 aLength);
+protected:
 
-private:
+    ///
+    /// Constructs a message to send holding a block of data. The data is
+    /// copied to the report once: the fields before it are cleared, for the
+    /// derived class to set, and so is the rest of the report.
+    /// @param[out] apReport Report buffer, aReportLenBytes long.
+    /// @param[in] aReportId HID report ID.
+    /// @param[in] aReportLenBytes HID report length.
+    /// @param[in] aOpCode Upgrade protocol opcode.
+    /// @param[in] aLength Length of the data field, including the block.
+    /// @param[in] apData The block of data.
+    /// @param[in] aDataIndex Index of the block within the data field.
+    ///
+    CUpgradeProtocolMsg(uint8 *apReport, uint8 aReportId, uint8 aReportLenBytes, uint8 aOpCode, uint16 aLength,
+        const uint8 *apData, uint8 aDataIndex);
+
+    ///
+    /// Reads a field of the data.
+    /// @tparam FIELD CUpgradeMsgField describing the field.
+    /// @return The value.
+    ///
+    template <typename FIELD>
+    typename FIELD::Type Get() const { return FIELD::Decode(GetDataForRead(0, FIELD::End)); };
+
+    ///
+    /// Writes a field of the data of a message being sent.
+    /// @tparam FIELD CUpgradeMsgField describing the field.
+    /// @param[in] aValue The value.
+    ///
+    template <typename FIELD>
+    void Set(typename FIELD::Type aValue) { FIELD::Encode(GetDataForWrite(0, FIELD::End), aValue); };
+
+    ///
+    /// Gets the writable data field of a message being sent.
+    /// @param[in] aIndex Index within the data field.
+    /// @param[in] aLength Number of bytes to be written.
+    /// @return Pointer to the data.
+    ///
+    uint8 *GetDataForWrite(uint8 aIndex, uint8 aLength)
+    {
+        assert(mpOutReport != NULL);
+        assert(static_cast<size_t>(aIndex) + aLength <= static_cast<size_t>(mReportLenBytes - HEADER_SIZE));
+        return mpOutReport + HEADER_SIZE + aIndex;
+    };
+
+    ///
+    /// Gets the data field of the message.
+    /// @param[in] aIndex Index within the data field.
+    /// @param[in] aLength Number of bytes to be read.
+    /// @return Pointer to the data.
+    ///
+    const uint8 *GetDataForRead(uint8 aIndex, uint8 aLength) const
+    {
+        assert(static_cast<size_t>(aIndex) + aLength <= static_cast<size_t>(mReportLenBytes - HEADER_SIZE));
+        return mpReport + HEADER_SIZE + aIndex;
+    };
 
-    // HID header
-    uint8 mReportId;        ///< HID report descriptor
-    uint8 mUpgradeMsgSize;  ///< Includes OpCode, Length and data
+private:
 
-    // Upgrade Protocol header
-    uint8 mOpCode;          ///< 8-bit opcode value
-    uint16 mLength;         ///< 16-bit value of number of bytes in Data field, in big-endian format, i.e. MSB, LSB.
+    // Report layout:
+    // HID header: Report ID (1 byte), message size (1 byte, includes OpCode, Length and data)
+    // Upgrade Protocol header: OpCode (1 byte), Length (2 bytes, big-endian, number of bytes in Data field)
+    // Data
 
-    std::vector<uint8> mData;
+    const uint8 *mpReport;  ///< Report holding the message
+    uint8 *mpOutReport;     ///< Report holding a message being built, NULL for a received message
+    uint8 mReportLenBytes;  ///< Report length
 };
 
 ///
@@ -226,11 +364,13 @@ private:
 class CUpgradeSyncReq : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeSyncReq(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_SYNC_REQ, 4) {};
+    typedef CUpgradeMsgField<0, uint32> FileIdentifier;
+
+    CUpgradeSyncReq(uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, HID_REPORTID_DATA_TRANSFER,
+            aReportLenBytes, UPGRADE_SYNC_REQ, FileIdentifier::End) {};
     ~CUpgradeSyncReq() {};
 
-    void SetFileIdentifier(uint32 aFileIdentifier);
+    void SetFileIdentifier(uint32 aFileIdentifier) { Set<FileIdentifier>(aFileIdentifier); };
 };
 
 ///
@@ -239,14 +379,16 @@ public:
 class CUpgradeSyncCfm : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeSyncCfm(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_SYNC_CFM, 6) {};
-    CUpgradeSyncCfm(const uint8 *apBuffer, uint8 aLength) : CUpgradeProtocolMsg(apBuffer, aLength) {};
+    typedef CUpgradeMsgField<0, uint8> ResumePoint;         // UpgradeResumePoint
+    typedef CUpgradeMsgField<1, uint32> FileIdentifier;     // Unique upgrade file identifier
+    typedef CUpgradeMsgField<5, uint8> ProtocolVersion;
+
+    CUpgradeSyncCfm(const uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, aReportLenBytes) {};
     ~CUpgradeSyncCfm() {};
 
-    uint8 GetResumePoint() const        { return GetDataUint8(0); };    // UpgradeResumePoint
-    uint32 GetFileIdentifier() const    { return GetDataUint32(1); };   // Unique upgrade file identifier  4 bytes
-    uint8 GetProtocolVersion() const    { return GetDataUint8(5); };
+    uint8 GetResumePoint() const        { return Get<ResumePoint>(); };
+    uint32 GetFileIdentifier() const    { return Get<FileIdentifier>(); };
+    uint8 GetProtocolVersion() const    { return Get<ProtocolVersion>(); };
 };
 
 ///
@@ -255,7 +397,7 @@ public:
 class CUpgradeStartReq : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeStartReq(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
+    CUpgradeStartReq(uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, HID_REPORTID_DATA_TRANSFER,
             aReportLenBytes, UPGRADE_START_REQ) {};
     ~CUpgradeStartReq() {};
 };
@@ -268,13 +410,14 @@ public:
 class CUpgradeStartCfm : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeStartCfm(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_START_CFM, 2) {};
-    CUpgradeStartCfm(const uint8 *apBuffer, uint8 aLength) : CUpgradeProtocolMsg(apBuffer, aLength) {};
+    typedef CUpgradeMsgField<0, uint8> Status;              // 0x00  Success 0x01  Failure
+    typedef CUpgradeMsgField<1, uint8> BatteryLevel;        // Device battery level in mV
+
+    CUpgradeStartCfm(const uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, aReportLenBytes) {};
     ~CUpgradeStartCfm() {};
 
-    uint8 GetStatus() const         { return GetDataUint8(0); };    // 0x00  Success 0x01  Failure
-    uint8 GetBatteryLevel() const   { return GetDataUint8(1); };    // Device battery level in mV
+    uint8 GetStatus() const         { return Get<Status>(); };
+    uint8 GetBatteryLevel() const   { return Get<BatteryLevel>(); };
 };
 
 ///
@@ -283,7 +426,7 @@ public:
 class CUpgradeStartDataReq : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeStartDataReq(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
+    CUpgradeStartDataReq(uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, HID_REPORTID_DATA_TRANSFER,
             aReportLenBytes, UPGRADE_START_DATA_REQ) {};
     ~CUpgradeStartDataReq() {};
 };
@@ -294,13 +437,14 @@ public:
 class CUpgradeDataBytesReq : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeDataBytesReq(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_DATA_BYTES_REQ, 8) {};
-    CUpgradeDataBytesReq(const uint8 *apBuffer, uint8 aLength) : CUpgradeProtocolMsg(apBuffer, aLength) {};
+    typedef CUpgradeMsgField<0, uint32> NumberOfBytes;
+    typedef CUpgradeMsgField<4, uint32> StartOffset;
+
+    CUpgradeDataBytesReq(const uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, aReportLenBytes) {};
     ~CUpgradeDataBytesReq() {};
 
-    uint32 GetNumberOfBytes() const { return GetDataUint32(0); };
-    uint32 GetStartOffset() const   { return GetDataUint32(4); };
+    uint32 GetNumberOfBytes() const { return Get<NumberOfBytes>(); };
+    uint32 GetStartOffset() const   { return Get<StartOffset>(); };
 };
 
 ///
@@ -309,12 +453,20 @@ public:
 class CUpgradeDataReq : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeDataReq(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_DATA) {};
+    typedef CUpgradeMsgField<0, uint8> MoreData;            // Followed by the image data
+
+    ///
+    /// Constructs the message with its image data, copied to the report once.
+    /// @param[out] apReport Report buffer, aReportLenBytes long.
+    /// @param[in] aReportLenBytes HID report length.
+    /// @param[in] apImageData Image data.
+    /// @param[in] aLength Length of the image data.
+    ///
+    CUpgradeDataReq(uint8 *apReport, uint8 aReportLenBytes, const uint8 *apImageData, uint8 aLength);
     ~CUpgradeDataReq() {};
 
-    void SetMoreData(uint8 aMoreData); // 0  There is more data in the upgrade file 1  Last packet of data from the upgrade file
-    void SetImageData(const uint8 *apImageData, uint8 aLength);
+    // 0  There is more data in the upgrade file 1  Last packet of data from the upgrade file
+    void SetMoreData(uint8 aMoreData) { Set<MoreData>(aMoreData); };
 };
 
 ///
@@ -323,7 +475,7 @@ public:
 class CUpgradeHostVersionReq : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeHostVersionReq(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
+    CUpgradeHostVersionReq(uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, HID_REPORTID_DATA_TRANSFER,
             aReportLenBytes, UPGRADE_HOST_VERSION_REQ) {};
     ~CUpgradeHostVersionReq() {};
 };
@@ -334,14 +486,16 @@ public:
 class CUpgradeHostVersionCfm : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeHostVersionCfm(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_HOST_VERSION_CFM, 6) {};
-    CUpgradeHostVersionCfm(const uint8 *apBuffer, uint8 aLength) : CUpgradeProtocolMsg(apBuffer, aLength) {};
+    typedef CUpgradeMsgField<0, uint16> VersionMajor;
+    typedef CUpgradeMsgField<2, uint16> VersionMinor;
+    typedef CUpgradeMsgField<4, uint16> ConfigVersion;
+
+    CUpgradeHostVersionCfm(const uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, aReportLenBytes) {};
     ~CUpgradeHostVersionCfm() {};
 
-    uint16 GetVersionMajor() const { return GetDataUint16(0); };
-    uint16 GetVersionMinor() const { return GetDataUint16(2); };
-    uint16 GetConfigVersion() const { return GetDataUint16(4); };
+    uint16 GetVersionMajor() const { return Get<VersionMajor>(); };
+    uint16 GetVersionMinor() const { return Get<VersionMinor>(); };
+    uint16 GetConfigVersion() const { return Get<ConfigVersion>(); };
 };
 
 ///
@@ -351,7 +505,7 @@ public:
 class CUpgradeIsValidationDoneReq : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeIsValidationDoneReq(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
+    CUpgradeIsValidationDoneReq(uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, HID_REPORTID_DATA_TRANSFER,
             aReportLenBytes, UPGRADE_IS_VALIDATION_DONE_REQ) {};
     ~CUpgradeIsValidationDoneReq() {};
 };
@@ -363,13 +517,13 @@ public:
 class CUpgradeIsValidationDoneCfm : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeIsValidationDoneCfm(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_IS_VALIDATION_DONE_CFM, 1) {};
-    CUpgradeIsValidationDoneCfm(const uint8 *apBuffer, uint8 aLength) : CUpgradeProtocolMsg(apBuffer, aLength) {};
+    // Time in ms the host should wait before sending the next UPGRADE_IS_VALIDATION_DONE_REQ message
+    typedef CUpgradeMsgField<0, uint8> DelayTime;
+
+    CUpgradeIsValidationDoneCfm(const uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, aReportLenBytes) {};
     ~CUpgradeIsValidationDoneCfm() {};
 
-    // Time in ms the host should wait before sending the next UPGRADE_IS_VALIDATION_DONE_REQ message
-    uint8 GetDelayTime() { return GetDataUint8(0); };
+    uint8 GetDelayTime() const { return Get<DelayTime>(); };
 };
 
 ///
@@ -378,9 +532,7 @@ public:
 class CUpgradeTransferCompleteInd : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeTransferCompleteInd(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_TRANSFER_COMPLETE_IND) {};
-    CUpgradeTransferCompleteInd(const uint8 *apBuffer, uint8 aLength) : CUpgradeProtocolMsg(apBuffer, aLength) {};
+    CUpgradeTransferCompleteInd(const uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, aReportLenBytes) {};
     ~CUpgradeTransferCompleteInd() {};
 };
 
@@ -390,11 +542,13 @@ public:
 class CUpgradeTransferCompleteRes : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeTransferCompleteRes(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_TRANSFER_COMPLETE_RES, 1) {};
+    typedef CUpgradeMsgField<0, uint8> Action;              // 0x00  Proceed 0x01  Do not proceed
+
+    CUpgradeTransferCompleteRes(uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, HID_REPORTID_DATA_TRANSFER,
+            aReportLenBytes, UPGRADE_TRANSFER_COMPLETE_RES, Action::End) {};
     ~CUpgradeTransferCompleteRes() {};
 
-    void SetAction(uint8 aAction); // 0x00  Proceed 0x01  Do not proceed 
+    void SetAction(uint8 aAction) { Set<Action>(aAction); };
 };
 
 ///
@@ -404,11 +558,13 @@ public:
 class CUpgradeProceedToCommit : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeProceedToCommit(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_PROCEED_TO_COMMIT, 1) {};
+    typedef CUpgradeMsgField<0, uint8> Action;              // 0x00  Proceed 0x01  Do not proceed
+
+    CUpgradeProceedToCommit(uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, HID_REPORTID_DATA_TRANSFER,
+            aReportLenBytes, UPGRADE_PROCEED_TO_COMMIT, Action::End) {};
     ~CUpgradeProceedToCommit() {};
 
-    void SetAction(uint8 aAction); // 0x00  Proceed 0x01  Do not proceed 
+    void SetAction(uint8 aAction) { Set<Action>(aAction); };
 };
 
 ///
@@ -418,9 +574,7 @@ public:
 class CUpgradeCommitReq : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeCommitReq(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_COMMIT_REQ) {};
-    CUpgradeCommitReq(const uint8 *apBuffer, uint8 aLength) : CUpgradeProtocolMsg(apBuffer, aLength) {};
+    CUpgradeCommitReq(const uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, aReportLenBytes) {};
     ~CUpgradeCommitReq() {};
 };
 
@@ -430,11 +584,13 @@ public:
 class CUpgradeCommitCfm : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeCommitCfm(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_COMMIT_CFM, 1) {};
+    typedef CUpgradeMsgField<0, uint8> Action;              // 0x00  Proceed 0x01  Do not proceed
+
+    CUpgradeCommitCfm(uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, HID_REPORTID_DATA_TRANSFER,
+            aReportLenBytes, UPGRADE_COMMIT_CFM, Action::End) {};
     ~CUpgradeCommitCfm() {};
 
-    void SetAction(uint8 aAction); // 0x00  Proceed 0x01  Do not proceed 
+    void SetAction(uint8 aAction) { Set<Action>(aAction); };
 };
 
 ///
@@ -443,9 +599,7 @@ public:
 class CUpgradeCompleteInd : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeCompleteInd(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_COMPLETE_IND) {};
-    CUpgradeCompleteInd(const uint8 *apBuffer, uint8 aLength) : CUpgradeProtocolMsg(apBuffer, aLength) {};
+    CUpgradeCompleteInd(const uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, aReportLenBytes) {};
     ~CUpgradeCompleteInd() {};
 };
 
@@ -455,12 +609,12 @@ public:
 class CUpgradeErrorInd : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeErrorInd(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_ERROR_IND, 2) {};
-    CUpgradeErrorInd(const uint8 *apBuffer, uint8 aLength) : CUpgradeProtocolMsg(apBuffer, aLength) {};
+    typedef CUpgradeMsgField<0, uint16> ErrorCode;          // Error codes are implementation dependent
+
+    CUpgradeErrorInd(const uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, aReportLenBytes) {};
     ~CUpgradeErrorInd() {};
 
-    uint16 GetErrorCode() const { return GetDataUint16(0); };    // Error codes are implementation dependent
+    uint16 GetErrorCode() const { return Get<ErrorCode>(); };
 };
 
 ///
@@ -469,11 +623,13 @@ public:
 class CUpgradeErrorRes : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeErrorRes(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_ERROR_RES, 2) {};
+    typedef CUpgradeMsgField<0, uint16> ErrorCode;          // Error code confirmation
+
+    CUpgradeErrorRes(uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, HID_REPORTID_DATA_TRANSFER,
+            aReportLenBytes, UPGRADE_ERROR_RES, ErrorCode::End) {};
     ~CUpgradeErrorRes() {};
 
-    void SetErrorCode(const uint16 aErrorCode); // Error code confirmation
+    void SetErrorCode(uint16 aErrorCode) { Set<ErrorCode>(aErrorCode); };
 };
 
 ///
@@ -482,7 +638,7 @@ public:
 class CUpgradeAbortReq : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeAbortReq(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
+    CUpgradeAbortReq(uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, HID_REPORTID_DATA_TRANSFER,
             aReportLenBytes, UPGRADE_ABORT_REQ) {};
     ~CUpgradeAbortReq() {};
 };
@@ -493,9 +649,7 @@ public:
 class CUpgradeAbortCfm : public CUpgradeProtocolMsg
 {
 public:
-    CUpgradeAbortCfm(uint8 aReportLenBytes) : CUpgradeProtocolMsg(HID_REPORTID_DATA_TRANSFER,
-            aReportLenBytes, UPGRADE_ABORT_CFM) {};
-    CUpgradeAbortCfm(const uint8 *apBuffer, uint8 aLength) : CUpgradeProtocolMsg(apBuffer, aLength) {};
+    CUpgradeAbortCfm(const uint8 *apReport, uint8 aReportLenBytes) : CUpgradeProtocolMsg(apReport, aReportLenBytes) {};
     ~CUpgradeAbortCfm() {};
 };
 
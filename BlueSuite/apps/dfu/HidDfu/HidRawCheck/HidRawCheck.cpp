@@ -0,0 +1,900 @@
+//*******************************************************************************
+//
+//  HidRawCheck.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Checks of the Linux hidraw transport (CHidTransportLinux) against
+//  simulated device nodes: report descriptor parsing, declared report
+//  lengths, the report ID offset of input reports, the shared poll thread
+//  and enumeration through sysfs
+//
+//*******************************************************************************
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "HidTransportLinux.h"
+
+//////////////////////////////////////////////////////////////////////////////
+
+///
+/// Access to the internals of CHidTransportLinux for the checks
+///
+class CHidTransportLinuxCheck
+{
+public:
+    typedef CHidTransportLinux::CReportDescriptor Descriptor;
+    typedef CHidTransportLinux::CCollection Collection;
+
+    static const int REPORT_INPUT = CHidTransportLinux::REPORT_INPUT;
+    static const int REPORT_OUTPUT = CHidTransportLinux::REPORT_OUTPUT;
+    static const int REPORT_FEATURE = CHidTransportLinux::REPORT_FEATURE;
+
+    static bool Parse(const std::vector<uint8> &aDescriptor, Descriptor &aParsed)
+    {
+        return CHidTransportLinux::ParseReportDescriptor(aDescriptor.data(), aDescriptor.size(), aParsed);
+    }
+
+    static size_t GetDeclaredLength(const CHidTransportLinux &aTransport, int aType, uint8 aReportId, size_t aLength)
+    {
+        return aTransport.GetDeclaredLength(static_cast<CHidTransportLinux::ReportType>(aType), aReportId, aLength);
+    }
+
+    ///
+    /// Opens a transport on a simulated node, in place of the hidraw ioctls
+    /// of Open. The transport takes the node, and closes it.
+    ///
+    static bool Attach(CHidTransportLinux &aTransport, int aFd, const std::vector<uint8> &aDescriptor)
+    {
+        aTransport.Close();
+        aTransport.mFd = aFd;
+        return Parse(aDescriptor, aTransport.mDescriptor);
+    }
+};
+
+typedef CHidTransportLinuxCheck Check;
+
+///
+/// Simulated hidraw node: a non-blocking SOCK_SEQPACKET socket given to the
+/// transport, which like hidraw keeps report boundaries and cuts a report
+/// read into a shorter buffer, and the device end, written with input
+/// reports and read for output reports
+///
+class CSimNode
+{
+public:
+    CSimNode() : mHostFd(-1), mDeviceFd(-1)
+    {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) == 0)
+        {
+            mHostFd = fds[0];
+            mDeviceFd = fds[1];
+            (void)fcntl(mHostFd, F_SETFL, fcntl(mHostFd, F_GETFL) | O_NONBLOCK);
+        }
+    }
+
+    ~CSimNode()
+    {
+        CloseDevice();
+    }
+
+    /// Node for the transport, which closes it
+    int TakeHostFd()
+    {
+        const int fd = mHostFd;
+        mHostFd = -1;
+        return fd;
+    }
+
+    bool Send(const std::vector<uint8> &aReport)
+    {
+        return (write(mDeviceFd, aReport.data(), aReport.size()) == static_cast<ssize_t>(aReport.size()));
+    }
+
+    /// Reads an output report, empty if there is none
+    std::vector<uint8> Receive()
+    {
+        std::vector<uint8> report(1024);
+        const ssize_t bytes = recv(mDeviceFd, report.data(), report.size(), MSG_DONTWAIT);
+        report.resize(bytes > 0 ? static_cast<size_t>(bytes) : 0);
+        return report;
+    }
+
+    /// Unplugs the device
+    void CloseDevice()
+    {
+        if (mDeviceFd != -1)
+        {
+            close(mDeviceFd);
+            mDeviceFd = -1;
+        }
+    }
+
+private:
+    CSimNode(const CSimNode &);
+    CSimNode &operator=(const CSimNode &);
+
+    int mHostFd;
+    int mDeviceFd;
+};
+
+///
+/// Listener counting its calls, optionally slow to return
+///
+class CCountingListener : public CHidTransport::CListener
+{
+public:
+    explicit CCountingListener(uint32 aDelayMs = 0)
+        : mCalls(0), mInCall(false), mDelayMs(aDelayMs) {};
+
+    virtual void OnTransportReady()
+    {
+        mInCall = true;
+        std::this_thread::sleep_for(std::chrono::milliseconds(mDelayMs));
+        ++mCalls;
+        mInCall = false;
+    }
+
+    /// Waits up to a time for the number of calls to reach a value
+    bool WaitForCalls(int aCalls, uint32 aTimeoutMs) const
+    {
+        const std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(aTimeoutMs);
+        while ((mCalls < aCalls) && (std::chrono::steady_clock::now() < deadline))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return (mCalls >= aCalls);
+    }
+
+    std::atomic<int> mCalls;
+    std::atomic<bool> mInCall;
+
+private:
+    uint32 mDelayMs;
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+static bool CheckParseUnnumbered();
+static bool CheckParseNumbered();
+static bool CheckParseMalformed();
+static bool CheckDeclaredLength();
+static bool CheckReadUnnumbered();
+static bool CheckReadNumbered();
+static bool CheckWrite();
+static bool CheckWatch();
+static bool CheckCancel();
+static bool CheckCancelInCall();
+static bool CheckEnumerate();
+static std::vector<uint8> MakeReport(uint8 aFirst, size_t aLength);
+static bool MakeDirectories(const std::string &aPath);
+static bool WriteFile(const std::string &aFileName, const std::vector<uint8> &aData);
+static int RemoveEntry(const char *apPath, const struct stat *apStat, int aType, struct FTW *apFtw);
+static void ShowUsageMessage(const char *apFormat, ...);
+static void Usage();
+
+//////////////////////////////////////////////////////////////////////////////
+
+static const char *gpExeName = "HidRawCheck";
+
+// Define leading character for options
+static const char OPTION_MARKER_CH        = '-';
+
+// Ask for help
+static const char *OPTION_HELP1_STR       = "-help";
+static const char *OPTION_HELP2_STR       = "-?";
+
+static const int HIDRAWCHECK_SUCCESS = 0;
+static const int HIDRAWCHECK_ERROR   = 1;
+
+// Time allowed for the poll thread to call a listener
+static const uint32 LISTENER_TIMEOUT_MS = 2000;
+
+// Time after which a listener which should not be called is taken as not called
+static const uint32 NO_CALL_WAIT_MS = 200;
+
+// Vendor collection without report IDs, 63 byte input and output reports
+static const uint8 UNNUMBERED_DESCRIPTOR[] =
+{
+    0x06, 0x00, 0xFF,       // Usage Page (Vendor 0xFF00)
+    0x09, 0x01,             // Usage (1)
+    0xA1, 0x01,             // Collection (Application)
+    0x15, 0x00,             //   Logical Minimum (0)
+    0x26, 0xFF, 0x00,       //   Logical Maximum (255)
+    0x75, 0x08,             //   Report Size (8)
+    0x95, 0x3F,             //   Report Count (63)
+    0x09, 0x01,             //   Usage (1)
+    0x81, 0x02,             //   Input
+    0x09, 0x01,             //   Usage (1)
+    0x91, 0x02,             //   Output
+    0xC0                    // End Collection
+};
+
+// Vendor collection with numbered input, output and feature reports of
+// several lengths, then a consumer collection with a 4 byte usage
+static const uint8 NUMBERED_DESCRIPTOR[] =
+{
+    0x06, 0x00, 0xFF,       // Usage Page (Vendor 0xFF00)
+    0x09, 0x01,             // Usage (1)
+    0xA1, 0x01,             // Collection (Application)
+    0x75, 0x08,             //   Report Size (8)
+    0x85, 0x01,             //   Report ID (1)
+    0x95, 0x0C,             //   Report Count (12)
+    0x09, 0x01,             //   Usage (1)
+    0x81, 0x02,             //   Input
+    0x85, 0x02,             //   Report ID (2)
+    0x95, 0x3F,             //   Report Count (63)
+    0x09, 0x01,             //   Usage (1)
+    0x81, 0x02,             //   Input
+    0xA4,                   //   Push
+    0x85, 0x03,             //   Report ID (3)
+    0x75, 0x04,             //   Report Size (4)
+    0x95, 0x7E,             //   Report Count (126)
+    0x09, 0x01,             //   Usage (1)
+    0x91, 0x02,             //   Output
+    0xB4,                   //   Pop
+    0x85, 0x04,             //   Report ID (4)
+    0x95, 0x3B,             //   Report Count (59)
+    0x09, 0x01,             //   Usage (1)
+    0xB1, 0x02,             //   Feature
+    0xFE, 0x02, 0x10, 0xAA, 0xBB, // Long item, skipped
+    0xC0,                   // End Collection
+    0x0B, 0x01, 0x00, 0x0C, 0x00, // Usage (Consumer 0x0001), 4 bytes
+    0xA1, 0x01,             // Collection (Application)
+    0x85, 0x05,             //   Report ID (5)
+    0x75, 0x08,             //   Report Size (8)
+    0x95, 0x02,             //   Report Count (2)
+    0x81, 0x02,             //   Input
+    0xC0                    // End Collection
+};
+
+//////////////////////////////////////////////////////////////////////////////
+// Main entry point
+//////////////////////////////////////////////////////////////////////////////
+int main(int argc, char* argv[])
+{
+    int retVal = HIDRAWCHECK_SUCCESS;
+
+    for (int argIndex = 1; argIndex < argc; ++argIndex)
+    {
+        const std::string arg = argv[argIndex];
+
+        if (arg.compare(OPTION_HELP1_STR) == 0 ||
+            arg.compare(OPTION_HELP2_STR) == 0)
+        {
+            Usage();
+        }
+        else if (arg[0] == OPTION_MARKER_CH)
+        {
+            ShowUsageMessage("\"%s\" invalid option", argv[argIndex]);
+        }
+        else
+        {
+            ShowUsageMessage("\"%s\" unexpected argument", argv[argIndex]);
+        }
+    }
+
+    static const struct
+    {
+        const char *mpName;
+        bool (*mpCheck)();
+    } CHECKS[] =
+    {
+        { "parse unnumbered", CheckParseUnnumbered },
+        { "parse numbered", CheckParseNumbered },
+        { "parse malformed", CheckParseMalformed },
+        { "declared length", CheckDeclaredLength },
+        { "read unnumbered", CheckReadUnnumbered },
+        { "read numbered", CheckReadNumbered },
+        { "write", CheckWrite },
+        { "watch", CheckWatch },
+        { "cancel", CheckCancel },
+        { "cancel in call", CheckCancelInCall },
+        { "enumerate", CheckEnumerate }
+    };
+
+    std::cout << std::left;
+    for (size_t n = 0; n < sizeof(CHECKS) / sizeof(CHECKS[0]); ++n)
+    {
+        const bool passed = CHECKS[n].mpCheck();
+        std::cout << std::setw(20) << CHECKS[n].mpName << (passed ? "ok" : "FAILED") << std::endl;
+        if (!passed)
+        {
+            retVal = HIDRAWCHECK_ERROR;
+        }
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks the lengths of reports without IDs, which include the zero report
+// ID byte as on Windows
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckParseUnnumbered()
+{
+    const std::vector<uint8> descriptor(UNNUMBERED_DESCRIPTOR,
+        UNNUMBERED_DESCRIPTOR + sizeof(UNNUMBERED_DESCRIPTOR));
+
+    Check::Descriptor parsed;
+    bool retVal = Check::Parse(descriptor, parsed)
+        && !parsed.mNumberedReports
+        && (parsed.mCollections.size() == 1);
+
+    if (retVal)
+    {
+        const Check::Collection &collection = parsed.mCollections[0];
+        retVal = (collection.mUsagePage == 0xFF00) && (collection.mUsage == 0x0001)
+            && (collection.mInputLength == 64) && (collection.mOutputLength == 64)
+            && (collection.mFeatureLength == 0)
+            && (parsed.mReportLengths.size() == 2);
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks numbered reports of several lengths, Push and Pop, a long item and
+// a second top level collection with a 4 byte usage
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckParseNumbered()
+{
+    const std::vector<uint8> descriptor(NUMBERED_DESCRIPTOR,
+        NUMBERED_DESCRIPTOR + sizeof(NUMBERED_DESCRIPTOR));
+
+    Check::Descriptor parsed;
+    bool retVal = Check::Parse(descriptor, parsed)
+        && parsed.mNumberedReports
+        && (parsed.mCollections.size() == 2);
+
+    if (retVal)
+    {
+        const Check::Collection &vendor = parsed.mCollections[0];
+        const Check::Collection &consumer = parsed.mCollections[1];
+        retVal = (vendor.mUsagePage == 0xFF00) && (vendor.mUsage == 0x0001)
+            && (vendor.mInputLength == 64) && (vendor.mOutputLength == 64) && (vendor.mFeatureLength == 60)
+            && (consumer.mUsagePage == 0x000C) && (consumer.mUsage == 0x0001)
+            && (consumer.mInputLength == 3) && (consumer.mOutputLength == 0) && (consumer.mFeatureLength == 0);
+    }
+
+    // Report 1 is shorter than the longest input report
+    if (retVal)
+    {
+        std::map<uint16, uint16>::const_iterator it =
+            parsed.mReportLengths.find(static_cast<uint16>((Check::REPORT_INPUT << 8) | 1));
+        retVal = (it != parsed.mReportLengths.end()) && (it->second == 13);
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks that truncated items, an unbalanced Pop and a descriptor without a
+// collection are rejected
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckParseMalformed()
+{
+    static const uint8 TRUNCATED_ITEM[] = { 0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0x26, 0xFF };
+    static const uint8 TRUNCATED_LONG_ITEM[] = { 0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0xFE, 0x02 };
+    static const uint8 UNBALANCED_POP[] = { 0x06, 0x00, 0xFF, 0x09, 0x01, 0xA1, 0x01, 0xB4, 0xC0 };
+    static const uint8 NO_COLLECTION[] = { 0x06, 0x00, 0xFF, 0x09, 0x01, 0x75, 0x08, 0x95, 0x3F, 0x81, 0x02 };
+
+    const std::vector<uint8> descriptors[] =
+    {
+        std::vector<uint8>(TRUNCATED_ITEM, TRUNCATED_ITEM + sizeof(TRUNCATED_ITEM)),
+        std::vector<uint8>(TRUNCATED_LONG_ITEM, TRUNCATED_LONG_ITEM + sizeof(TRUNCATED_LONG_ITEM)),
+        std::vector<uint8>(UNBALANCED_POP, UNBALANCED_POP + sizeof(UNBALANCED_POP)),
+        std::vector<uint8>(NO_COLLECTION, NO_COLLECTION + sizeof(NO_COLLECTION)),
+        std::vector<uint8>()
+    };
+
+    bool retVal = true;
+    for (size_t n = 0; retVal && (n < sizeof(descriptors) / sizeof(descriptors[0])); ++n)
+    {
+        Check::Descriptor parsed;
+        retVal = !Check::Parse(descriptors[n], parsed);
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks that reports are cut to their declared length, and that undeclared
+// reports keep the length given
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckDeclaredLength()
+{
+    const std::vector<uint8> descriptor(NUMBERED_DESCRIPTOR,
+        NUMBERED_DESCRIPTOR + sizeof(NUMBERED_DESCRIPTOR));
+
+    CSimNode node;
+    CHidTransportLinux transport;
+    bool retVal = Check::Attach(transport, node.TakeHostFd(), descriptor);
+
+    if (retVal)
+    {
+        retVal = (Check::GetDeclaredLength(transport, Check::REPORT_INPUT, 1, 64) == 13)
+            && (Check::GetDeclaredLength(transport, Check::REPORT_INPUT, 2, 64) == 64)
+            && (Check::GetDeclaredLength(transport, Check::REPORT_OUTPUT, 3, 100) == 64)
+            && (Check::GetDeclaredLength(transport, Check::REPORT_FEATURE, 4, 64) == 60)
+            && (Check::GetDeclaredLength(transport, Check::REPORT_INPUT, 5, 64) == 3)
+            // Undeclared report ID and type
+            && (Check::GetDeclaredLength(transport, Check::REPORT_INPUT, 9, 64) == 64)
+            && (Check::GetDeclaredLength(transport, Check::REPORT_OUTPUT, 1, 20) == 20)
+            // Declared longer than the length given
+            && (Check::GetDeclaredLength(transport, Check::REPORT_INPUT, 2, 20) == 20);
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks that a report without an ID is read after a zero report ID byte,
+// that a short report is reported, and the timeout and unplugged device
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckReadUnnumbered()
+{
+    const std::vector<uint8> descriptor(UNNUMBERED_DESCRIPTOR,
+        UNNUMBERED_DESCRIPTOR + sizeof(UNNUMBERED_DESCRIPTOR));
+
+    CSimNode node;
+    CHidTransportLinux transport;
+    bool retVal = Check::Attach(transport, node.TakeHostFd(), descriptor) && transport.StartReading(64);
+
+    std::vector<uint8> report(64, 0xEE);
+    uint32 bytesRead = 0;
+
+    // Whole report
+    const std::vector<uint8> sent = MakeReport(0x40, 63);
+    if (retVal)
+    {
+        retVal = node.Send(sent)
+            && (transport.ReadReport(report.data(), 1000, bytesRead) == CHidTransport::RESULT_OK)
+            && (bytesRead == 64) && (report[0] == 0)
+            && (memcmp(&report[1], sent.data(), sent.size()) == 0);
+    }
+
+    // Short report
+    if (retVal)
+    {
+        retVal = node.Send(MakeReport(0x40, 10))
+            && (transport.ReadReport(report.data(), 1000, bytesRead) == CHidTransport::RESULT_SHORT)
+            && (bytesRead == 11) && (report[0] == 0) && (report[1] == 0x40);
+    }
+
+    // No report, waited for in whole milliseconds so up to one short
+    if (retVal)
+    {
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        retVal = (transport.ReadReport(report.data(), 50, bytesRead) == CHidTransport::RESULT_TIMEOUT)
+            && (bytesRead == 0)
+            && (std::chrono::steady_clock::now() - start >= std::chrono::milliseconds(49));
+    }
+
+    // Unplugged
+    if (retVal)
+    {
+        node.CloseDevice();
+        retVal = (transport.ReadReport(report.data(), 1000, bytesRead) == CHidTransport::RESULT_FAILED)
+            && (transport.GetError() == ENODEV);
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks that a numbered report is read with its ID in the first byte, and
+// that a report shorter than the longest is complete at its declared length
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckReadNumbered()
+{
+    const std::vector<uint8> descriptor(NUMBERED_DESCRIPTOR,
+        NUMBERED_DESCRIPTOR + sizeof(NUMBERED_DESCRIPTOR));
+
+    CSimNode node;
+    CHidTransportLinux transport;
+    bool retVal = Check::Attach(transport, node.TakeHostFd(), descriptor) && transport.StartReading(64);
+
+    std::vector<uint8> report(64, 0xEE);
+    uint32 bytesRead = 0;
+
+    // Longest report
+    const std::vector<uint8> sent = MakeReport(2, 64);
+    if (retVal)
+    {
+        retVal = node.Send(sent)
+            && (transport.ReadReport(report.data(), 1000, bytesRead) == CHidTransport::RESULT_OK)
+            && (bytesRead == 64) && (report == sent);
+    }
+
+    // Report 1 has 12 bytes after its ID
+    if (retVal)
+    {
+        retVal = node.Send(MakeReport(1, 13))
+            && (transport.ReadReport(report.data(), 1000, bytesRead) == CHidTransport::RESULT_OK)
+            && (bytesRead == 13) && (report[0] == 1) && (report[13] == 0);
+    }
+
+    // Report 2 cut short
+    if (retVal)
+    {
+        retVal = node.Send(MakeReport(2, 11))
+            && (transport.ReadReport(report.data(), 1000, bytesRead) == CHidTransport::RESULT_SHORT)
+            && (bytesRead == 11) && (report[0] == 2);
+    }
+
+    // A report longer than the buffer is cut to it
+    if (retVal)
+    {
+        retVal = node.Send(MakeReport(2, 80))
+            && (transport.ReadReport(report.data(), 1000, bytesRead) == CHidTransport::RESULT_OK)
+            && (bytesRead == 64) && (report[0] == 2);
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks that output reports are cut to their declared length
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckWrite()
+{
+    const std::vector<uint8> numbered(NUMBERED_DESCRIPTOR, NUMBERED_DESCRIPTOR + sizeof(NUMBERED_DESCRIPTOR));
+    const std::vector<uint8> unnumbered(UNNUMBERED_DESCRIPTOR,
+        UNNUMBERED_DESCRIPTOR + sizeof(UNNUMBERED_DESCRIPTOR));
+
+    bool retVal = true;
+
+    {
+        CSimNode node;
+        CHidTransportLinux transport;
+        const std::vector<uint8> report = MakeReport(3, 100);
+        retVal = Check::Attach(transport, node.TakeHostFd(), numbered)
+            && transport.WriteReport(report.data(), report.size())
+            && (node.Receive() == std::vector<uint8>(report.begin(), report.begin() + 64));
+    }
+
+    // Sent with the zero report ID byte, as hidraw expects
+    if (retVal)
+    {
+        CSimNode node;
+        CHidTransportLinux transport;
+        const std::vector<uint8> report = MakeReport(0, 64);
+        retVal = Check::Attach(transport, node.TakeHostFd(), unnumbered)
+            && transport.WriteReport(report.data(), report.size())
+            && (node.Receive() == report);
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks that a listener is called once, by the poll thread, after a read
+// with a zero timeout found no report, and that the watches of two
+// transports are kept apart
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckWatch()
+{
+    const std::vector<uint8> descriptor(UNNUMBERED_DESCRIPTOR,
+        UNNUMBERED_DESCRIPTOR + sizeof(UNNUMBERED_DESCRIPTOR));
+
+    CSimNode node1;
+    CSimNode node2;
+    CHidTransportLinux transport1;
+    CHidTransportLinux transport2;
+    CCountingListener listener1;
+    CCountingListener listener2;
+    bool retVal = Check::Attach(transport1, node1.TakeHostFd(), descriptor) && transport1.StartReading(64)
+        && Check::Attach(transport2, node2.TakeHostFd(), descriptor) && transport2.StartReading(64);
+    transport1.SetListener(&listener1);
+    transport2.SetListener(&listener2);
+
+    std::vector<uint8> report(64);
+    uint32 bytesRead = 0;
+
+    // A watch made twice is one watch
+    if (retVal)
+    {
+        retVal = (transport1.ReadReport(report.data(), 0, bytesRead) == CHidTransport::RESULT_TIMEOUT)
+            && (transport1.ReadReport(report.data(), 0, bytesRead) == CHidTransport::RESULT_TIMEOUT)
+            && (transport2.ReadReport(report.data(), 0, bytesRead) == CHidTransport::RESULT_TIMEOUT)
+            && (listener1.mCalls == 0) && (listener2.mCalls == 0);
+    }
+
+    // Only the device sending a report wakes its listener
+    if (retVal)
+    {
+        retVal = node2.Send(MakeReport(0x20, 63))
+            && listener2.WaitForCalls(1, LISTENER_TIMEOUT_MS);
+        std::this_thread::sleep_for(std::chrono::milliseconds(NO_CALL_WAIT_MS));
+        retVal = retVal && (listener1.mCalls == 0) && (listener2.mCalls == 1)
+            && (transport2.ReadReport(report.data(), 0, bytesRead) == CHidTransport::RESULT_OK);
+    }
+
+    if (retVal)
+    {
+        retVal = node1.Send(MakeReport(0x10, 63))
+            && listener1.WaitForCalls(1, LISTENER_TIMEOUT_MS);
+        std::this_thread::sleep_for(std::chrono::milliseconds(NO_CALL_WAIT_MS));
+        retVal = retVal && (listener1.mCalls == 1) && (listener2.mCalls == 1)
+            && (transport1.ReadReport(report.data(), 0, bytesRead) == CHidTransport::RESULT_OK);
+    }
+
+    // A window waits for the node to be writable, which it is
+    if (retVal)
+    {
+        retVal = transport1.OpenWindow(64, 4)
+            && (transport1.FlushWindow(0) == CHidTransport::RESULT_OK);
+        transport1.CloseWindow();
+    }
+
+    transport1.Close();
+    transport2.Close();
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks that a cancelled watch is not called
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckCancel()
+{
+    const std::vector<uint8> descriptor(UNNUMBERED_DESCRIPTOR,
+        UNNUMBERED_DESCRIPTOR + sizeof(UNNUMBERED_DESCRIPTOR));
+
+    CSimNode node;
+    CHidTransportLinux transport;
+    CCountingListener listener;
+    bool retVal = Check::Attach(transport, node.TakeHostFd(), descriptor) && transport.StartReading(64);
+    transport.SetListener(&listener);
+
+    std::vector<uint8> report(64);
+    uint32 bytesRead = 0;
+
+    if (retVal)
+    {
+        retVal = (transport.ReadReport(report.data(), 0, bytesRead) == CHidTransport::RESULT_TIMEOUT);
+    }
+
+    // Removing the listener cancels its watch
+    transport.SetListener(NULL);
+
+    if (retVal)
+    {
+        retVal = node.Send(MakeReport(0x30, 63));
+        std::this_thread::sleep_for(std::chrono::milliseconds(NO_CALL_WAIT_MS));
+        retVal = retVal && (listener.mCalls == 0)
+            && (transport.ReadReport(report.data(), 0, bytesRead) == CHidTransport::RESULT_OK);
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks that closing a transport waits for a call of its listener in
+// progress, so that the listener can be destroyed once Close returns
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckCancelInCall()
+{
+    const std::vector<uint8> descriptor(UNNUMBERED_DESCRIPTOR,
+        UNNUMBERED_DESCRIPTOR + sizeof(UNNUMBERED_DESCRIPTOR));
+
+    CSimNode node;
+    CHidTransportLinux transport;
+    CCountingListener listener(300);
+    bool retVal = Check::Attach(transport, node.TakeHostFd(), descriptor) && transport.StartReading(64);
+    transport.SetListener(&listener);
+
+    std::vector<uint8> report(64);
+    uint32 bytesRead = 0;
+
+    if (retVal)
+    {
+        retVal = (transport.ReadReport(report.data(), 0, bytesRead) == CHidTransport::RESULT_TIMEOUT)
+            && node.Send(MakeReport(0x50, 63));
+    }
+
+    if (retVal)
+    {
+        const std::chrono::steady_clock::time_point deadline =
+            std::chrono::steady_clock::now() + std::chrono::milliseconds(LISTENER_TIMEOUT_MS);
+        while (!listener.mInCall && (std::chrono::steady_clock::now() < deadline))
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        retVal = listener.mInCall;
+    }
+
+    transport.Close();
+
+    return retVal && !listener.mInCall && (listener.mCalls == 1);
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks enumeration against a simulated sysfs tree (HID_SYSFS_DIR) with a
+// device matching on its second collection, one of another product, and
+// one found again by parent ID after a reboot
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckEnumerate()
+{
+    char dirTemplate[] = "/tmp/hidrawcheck.XXXXXX";
+    const char *pRoot = mkdtemp(dirTemplate);
+    if (pRoot == NULL)
+    {
+        return false;
+    }
+
+    const std::string root = pRoot;
+    const std::string usbDevice = root + "/devices/usb1/1-2";
+    const std::string hidDevices[] =
+    {
+        usbDevice + "/1-2:1.0/0003:0A12:4007.0001",
+        root + "/devices/usb1/1-3/1-3:1.0/0003:0A12:4008.0002"
+    };
+    const char *names[] = { "hidraw10", "hidraw2" };
+    const char *uevents[] = { "HID_ID=0003:00000A12:00004007\n", "HID_ID=0003:00000A12:00004008\n" };
+
+    bool retVal = true;
+    for (size_t n = 0; retVal && (n < 2); ++n)
+    {
+        const std::string uevent(uevents[n]);
+        retVal = MakeDirectories(hidDevices[n]) && MakeDirectories(root + "/class/" + names[n])
+            && (symlink(hidDevices[n].c_str(), (root + "/class/" + names[n] + "/device").c_str()) == 0)
+            && WriteFile(hidDevices[n] + "/uevent", std::vector<uint8>(uevent.begin(), uevent.end()))
+            && WriteFile(hidDevices[n] + "/report_descriptor",
+                std::vector<uint8>(NUMBERED_DESCRIPTOR, NUMBERED_DESCRIPTOR + sizeof(NUMBERED_DESCRIPTOR)));
+    }
+
+    setenv("HID_SYSFS_DIR", (root + "/class").c_str(), 1);
+    setenv("HID_DEV_DIR", (root + "/dev").c_str(), 1);
+
+    // The consumer collection is matched by its usage page
+    std::vector<CHidTransport::CDeviceInfo> devices;
+    if (retVal)
+    {
+        retVal = CHidTransport::Enumerate(0x0A12, 0x4007, 0, 0x000C, devices) && (devices.size() == 1);
+    }
+
+    if (retVal)
+    {
+        const CHidTransport::CDeviceInfo &info = devices[0];
+        char *pUsbDevice = realpath(usbDevice.c_str(), NULL);
+        retVal = (info.mDevicePath == root + "/dev/hidraw10")
+            && (pUsbDevice != NULL) && (info.mParentId == pUsbDevice)
+            && (info.mUsagePage == 0x000C) && (info.mUsage == 0x0001)
+            && (info.mInputReportLength == 3) && (info.mOutputReportLength == 0);
+        free(pUsbDevice);
+    }
+
+    // Any collection, in device number order
+    if (retVal)
+    {
+        devices.clear();
+        retVal = CHidTransport::Enumerate(0x0A12, 0x4008, 0, 0, devices) && (devices.size() == 1)
+            && (devices[0].mDevicePath == root + "/dev/hidraw2")
+            && (devices[0].mUsagePage == 0xFF00) && (devices[0].mInputReportLength == 64)
+            && (devices[0].mFeatureReportLength == 60);
+    }
+
+    if (retVal)
+    {
+        std::vector<CHidTransport::CDeviceInfo> first;
+        std::string devicePath;
+        retVal = CHidTransport::Enumerate(0x0A12, 0x4007, 0x0001, 0xFF00, first) && (first.size() == 1)
+            && CHidTransport::FindDevice(first[0].mParentId, 0x0A12, 0x4007, 0x0001, 0xFF00, devicePath)
+            && (devicePath == first[0].mDevicePath)
+            && !CHidTransport::FindDevice(first[0].mParentId, 0x0A12, 0x4008, 0x0001, 0xFF00, devicePath);
+    }
+
+    unsetenv("HID_SYSFS_DIR");
+    unsetenv("HID_DEV_DIR");
+
+    (void)nftw(root.c_str(), RemoveEntry, 16, FTW_DEPTH | FTW_PHYS);
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Makes a report of the given length, starting with the given byte (the
+// report ID of a numbered report)
+//////////////////////////////////////////////////////////////////////////////
+static std::vector<uint8> MakeReport(uint8 aFirst, size_t aLength)
+{
+    std::vector<uint8> report(aLength);
+    for (size_t n = 0; n < aLength; ++n)
+    {
+        report[n] = static_cast<uint8>(aFirst + n);
+    }
+    return report;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Makes a directory of the simulated sysfs tree, and any missing parents
+//////////////////////////////////////////////////////////////////////////////
+static bool MakeDirectories(const std::string &aPath)
+{
+    bool retVal = true;
+
+    for (size_t slash = aPath.find('/', 1); retVal; slash = aPath.find('/', slash + 1))
+    {
+        const std::string path = aPath.substr(0, slash);
+        retVal = (mkdir(path.c_str(), 0700) == 0) || (errno == EEXIST);
+        if (slash == std::string::npos)
+        {
+            break;
+        }
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Writes a file of the simulated sysfs tree
+//////////////////////////////////////////////////////////////////////////////
+static bool WriteFile(const std::string &aFileName, const std::vector<uint8> &aData)
+{
+    std::ofstream file(aFileName.c_str(), std::ios::binary);
+    file.write(reinterpret_cast<const char *>(aData.data()), aData.size());
+    return file.good();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Removes a file, link or directory of the simulated sysfs tree, called by
+// nftw after the contents of a directory
+//////////////////////////////////////////////////////////////////////////////
+static int RemoveEntry(const char *apPath, const struct stat *, int, struct FTW *)
+{
+    (void)remove(apPath);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Show usage message
+//////////////////////////////////////////////////////////////////////////////
+static void ShowUsageMessage(const char *apFormat, ...)
+{
+    va_list args;
+    va_start(args, apFormat);
+    vfprintf(stderr, apFormat, args);
+    va_end(args);
+    fprintf(stderr, "\n\n");
+    Usage();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Usage
+//////////////////////////////////////////////////////////////////////////////
+static void Usage()
+{
+    std::cout << gpExeName << std::endl;
+    std::cout << "Checks the Linux hidraw transport against simulated device nodes: report" << std::endl;
+    std::cout << "descriptor parsing, declared report lengths, the report ID byte of input" << std::endl;
+    std::cout << "reports, the poll thread which wakes listeners, and enumeration through a" << std::endl;
+    std::cout << "simulated sysfs tree. Exits with 1 if a check fails." << std::endl;
+    std::cout << std::endl;
+
+    // Always exit program on usage
+    exit(HIDRAWCHECK_ERROR);
+}
@@ -0,0 +1,447 @@
+//*******************************************************************************
+//
+//  crcbench.cpp
+//
+//  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+//  All Rights Reserved.
+//  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+//
+//  Checks each CRC update implementation, CRC::UpdateParallel and
+//  CRC::Combine against the CRC table, and reports the throughput of each
+//
+//*******************************************************************************
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#include "DFUEngine/CRC.h"
+extern "C"
+{
+#include "crc/crctbl.h"
+}
+
+//////////////////////////////////////////////////////////////////////////////
+
+static uint32 TableCrc(uint32 aCrc, const uint8 *apBuffer, size_t aLength);
+static bool CheckImplementation(const std::vector<uint8> &aData);
+static bool CheckParallel(const std::vector<uint8> &aData);
+static bool CheckCombine(const std::vector<uint8> &aData);
+static bool CheckSelectionChange(const std::vector<uint8> &aData);
+static double TimeUpdate(const std::vector<uint8> &aData, size_t aLength, unsigned long aRepeat, bool aParallel);
+static bool ParseNumber(const char *apValueStr, unsigned long aMax, unsigned long &aValue);
+static void ShowUsageMessage(const char *apFormat, ...);
+static void Usage();
+
+//////////////////////////////////////////////////////////////////////////////
+
+static const char *gpExeName = "crcbench";
+
+// Define leading character for options
+static const char OPTION_MARKER_CH        = '-';
+
+// Number of times each size is timed, followed by the number
+static const char *OPTION_REPEAT_STR      = "-repeat";
+
+// Ask for help
+static const char *OPTION_HELP1_STR       = "-help";
+static const char *OPTION_HELP2_STR       = "-?";
+
+static const int CRCBENCH_SUCCESS = 0;
+static const int CRCBENCH_ERROR   = 1;
+
+static const unsigned long DEFAULT_REPEAT = 3;
+
+// Buffer sizes timed
+static const size_t SIZES[] = { 1024, 64 * 1024, 64 * 1024 * 1024 };
+
+// Each timing updates about this many bytes, in as many calls as it takes
+static const size_t BYTES_PER_TIMING = 256 * 1024 * 1024;
+
+// Lengths up to this are checked at every alignment, covering the tails
+// left by each implementation
+static const size_t CHECK_LENGTH = 300;
+static const size_t CHECK_ALIGNMENTS = 16;
+
+// Implementations in the order reported
+static const CRC::Implementation IMPLEMENTATIONS[] =
+{
+    CRC::IMPL_BYTEWISE,
+    CRC::IMPL_SLICE_BY_8,
+    CRC::IMPL_SLICE_BY_16,
+    CRC::IMPL_CLMUL
+};
+
+//////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char* argv[])
+{
+    int retVal = CRCBENCH_SUCCESS;
+
+    gpExeName = argv[0];
+
+    unsigned long repeat = DEFAULT_REPEAT;
+
+    for (int argIndex = 1; argIndex < argc; ++argIndex)
+    {
+        const std::string arg = argv[argIndex];
+        const char *pValue = (argIndex + 1 < argc) ? argv[argIndex + 1] : "";
+
+        if (arg.compare(OPTION_REPEAT_STR) == 0)
+        {
+            if (!ParseNumber(pValue, 1000, repeat) || repeat == 0)
+            {
+                ShowUsageMessage("\"%s\" must be followed by a number from 1 to 1000", OPTION_REPEAT_STR);
+            }
+            ++argIndex;
+        }
+        else if (arg.compare(OPTION_HELP1_STR) == 0 ||
+                 arg.compare(OPTION_HELP2_STR) == 0)
+        {
+            Usage();
+        }
+        else if (arg[0] == OPTION_MARKER_CH)
+        {
+            ShowUsageMessage("\"%s\" invalid option", argv[argIndex]);
+        }
+        else
+        {
+            ShowUsageMessage("\"%s\" unexpected argument", argv[argIndex]);
+        }
+    }
+
+    // The largest size, with room to check it at every alignment
+    const size_t maxSize = SIZES[sizeof(SIZES) / sizeof(SIZES[0]) - 1];
+    std::vector<uint8> data(maxSize + CHECK_ALIGNMENTS);
+    uint32 value = 0x1234;
+    for (size_t n = 0; n < data.size(); ++n)
+    {
+        value = value * 1103515245 + 12345;
+        data[n] = static_cast<uint8>(value >> 16);
+    }
+
+    const CRC::Implementation autoImpl = CRC::GetImplementation();
+
+    std::cout << std::setw(14) << "Implementation" << std::setw(8) << "Check";
+    for (size_t size = 0; size < sizeof(SIZES) / sizeof(SIZES[0]); ++size)
+    {
+        std::cout << std::setw(10) << (SIZES[size] >= 1024 * 1024 ? SIZES[size] / (1024 * 1024) : SIZES[size] / 1024)
+                  << (SIZES[size] >= 1024 * 1024 ? " MB" : " KB");
+    }
+    std::cout << "  (GB/s)" << std::endl;
+
+    for (size_t impl = 0; impl < sizeof(IMPLEMENTATIONS) / sizeof(IMPLEMENTATIONS[0]); ++impl)
+    {
+        std::cout << std::setw(14) << CRC::GetImplementationName(IMPLEMENTATIONS[impl]);
+
+        if (!CRC::SetImplementation(IMPLEMENTATIONS[impl]))
+        {
+            std::cout << "   not supported by the host CPU" << std::endl;
+            continue;
+        }
+
+        const bool match = CheckImplementation(data);
+        std::cout << std::setw(8) << (match ? "ok" : "FAILED");
+        if (!match)
+        {
+            retVal = CRCBENCH_ERROR;
+        }
+
+        for (size_t size = 0; size < sizeof(SIZES) / sizeof(SIZES[0]); ++size)
+        {
+            std::cout << std::fixed << std::setprecision(2) << std::setw(13)
+                      << TimeUpdate(data, SIZES[size], repeat, false);
+        }
+        std::cout << std::endl;
+    }
+
+    CRC::SetImplementation(autoImpl);
+
+    // UpdateParallel splits buffers of 8 MB and more between threads
+    {
+        const bool match = CheckParallel(data);
+        std::cout << std::setw(14) << "parallel" << std::setw(8) << (match ? "ok" : "FAILED")
+                  << std::setw(13) << "-" << std::setw(13) << "-"
+                  << std::fixed << std::setprecision(2) << std::setw(13)
+                  << TimeUpdate(data, maxSize, repeat, true) << std::endl;
+        if (!match)
+        {
+            retVal = CRCBENCH_ERROR;
+        }
+    }
+
+    {
+        const bool match = CheckCombine(data);
+        std::cout << std::setw(14) << "combine" << std::setw(8) << (match ? "ok" : "FAILED") << std::endl;
+        if (!match)
+        {
+            retVal = CRCBENCH_ERROR;
+        }
+    }
+
+    {
+        const bool match = CheckSelectionChange(data);
+        std::cout << std::setw(14) << "reselect" << std::setw(8) << (match ? "ok" : "FAILED") << std::endl;
+        if (!match)
+        {
+            retVal = CRCBENCH_ERROR;
+        }
+    }
+
+    std::cout << "Selected implementation: " << CRC::GetImplementationName(autoImpl)
+              << ", " << std::thread::hardware_concurrency() << " hardware threads" << std::endl;
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Updates a CRC a byte at a time with the table, as the reference
+//////////////////////////////////////////////////////////////////////////////
+static uint32 TableCrc(uint32 aCrc, const uint8 *apBuffer, size_t aLength)
+{
+    for (size_t n = 0; n < aLength; ++n)
+    {
+        UPDCRC(aCrc, apBuffer[n]);
+    }
+    return aCrc;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks the selected implementation against the table, for short lengths
+// at every alignment and for the whole buffer
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckImplementation(const std::vector<uint8> &aData)
+{
+    bool retVal = true;
+
+    for (size_t offset = 0; retVal && (offset < CHECK_ALIGNMENTS); ++offset)
+    {
+        for (size_t length = 0; retVal && (length <= CHECK_LENGTH); ++length)
+        {
+            CRC crc;
+            retVal = (crc(&aData[offset], length) == TableCrc(0xFFFFFFFF, &aData[offset], length));
+        }
+    }
+
+    // An odd length from an odd address, continuing from a previous update
+    if (retVal)
+    {
+        const size_t length = aData.size() - 2 * CHECK_ALIGNMENTS - 1;
+        CRC crc;
+        crc(&aData[0], 1);
+        retVal = (crc(&aData[1], length) == TableCrc(TableCrc(0xFFFFFFFF, &aData[0], 1), &aData[1], length));
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks UpdateParallel against the table with various thread counts,
+// lengths and starting values
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckParallel(const std::vector<uint8> &aData)
+{
+    bool retVal = true;
+
+    const unsigned threadCounts[] = { 0, 1, 2, 3, 5, 8 };
+    const size_t lengths[] = { 0, 1, 4 * 1024 * 1024 - 1, 8 * 1024 * 1024 + 3, aData.size() - 1 };
+
+    for (size_t l = 0; retVal && (l < sizeof(lengths) / sizeof(lengths[0])); ++l)
+    {
+        // From the default starting value and continuing from a previous update
+        const uint32 expected = TableCrc(0xFFFFFFFF, &aData[1], lengths[l]);
+        const uint32 expectedAfter = TableCrc(TableCrc(0xFFFFFFFF, &aData[0], 1), &aData[1], lengths[l]);
+
+        for (size_t t = 0; retVal && (t < sizeof(threadCounts) / sizeof(threadCounts[0])); ++t)
+        {
+            CRC crc;
+            retVal = (crc.UpdateParallel(&aData[1], lengths[l], threadCounts[t]) == expected);
+
+            CRC crcAfter;
+            crcAfter(&aData[0], 1);
+            retVal = retVal && (crcAfter.UpdateParallel(&aData[1], lengths[l], threadCounts[t]) == expectedAfter);
+        }
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks Combine against the table for blocks split at various points,
+// from the default and a zero starting value
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckCombine(const std::vector<uint8> &aData)
+{
+    bool retVal = true;
+
+    const uint32 initCrcs[] = { 0xFFFFFFFF, 0 };
+    const size_t length = 1024 * 1024 + 7;
+    const size_t splits[] = { 0, 1, 15, 16, 17, 4096, length / 2, length - 1, length };
+
+    for (size_t i = 0; retVal && (i < sizeof(initCrcs) / sizeof(initCrcs[0])); ++i)
+    {
+        const uint32 expected = TableCrc(initCrcs[i], &aData[0], length);
+
+        for (size_t s = 0; retVal && (s < sizeof(splits) / sizeof(splits[0])); ++s)
+        {
+            const uint32 crc1 = TableCrc(initCrcs[i], &aData[0], splits[s]);
+            const uint32 crc2 = TableCrc(initCrcs[i], &aData[splits[s]], length - splits[s]);
+            retVal = (CRC::Combine(crc1, crc2, length - splits[s], initCrcs[i]) == expected);
+        }
+    }
+
+    return retVal;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Checks that CRCs updated on several threads stay correct while another
+// thread keeps changing the implementation
+//////////////////////////////////////////////////////////////////////////////
+static bool CheckSelectionChange(const std::vector<uint8> &aData)
+{
+    const CRC::Implementation autoImpl = CRC::GetImplementation();
+    const size_t length = 64 * 1024 + 5;
+    const uint32 expected = TableCrc(0xFFFFFFFF, &aData[3], length);
+
+    std::atomic<bool> stop(false);
+    std::atomic<bool> match(true);
+
+    std::thread selector([&]()
+    {
+        size_t impl = 0;
+        while (!stop)
+        {
+            CRC::SetImplementation(IMPLEMENTATIONS[impl]);
+            impl = (impl + 1) % (sizeof(IMPLEMENTATIONS) / sizeof(IMPLEMENTATIONS[0]));
+        }
+    });
+
+    std::vector<std::thread> updaters;
+    for (size_t n = 0; n < 4; ++n)
+    {
+        updaters.push_back(std::thread([&]()
+        {
+            for (size_t i = 0; (i < 2000) && match; ++i)
+            {
+                CRC crc;
+                if (crc(&aData[3], length) != expected)
+                {
+                    match = false;
+                }
+            }
+        }));
+    }
+
+    for (std::vector<std::thread>::iterator it = updaters.begin(); it != updaters.end(); ++it)
+    {
+        it->join();
+    }
+    stop = true;
+    selector.join();
+
+    CRC::SetImplementation(autoImpl);
+
+    return match;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Times updates of aLength bytes with the selected implementation, or with
+// UpdateParallel, returning the best throughput of aRepeat runs in GB/s
+//////////////////////////////////////////////////////////////////////////////
+static double TimeUpdate(const std::vector<uint8> &aData, size_t aLength, unsigned long aRepeat, bool aParallel)
+{
+    double best = 0;
+
+    const size_t calls = (aLength < BYTES_PER_TIMING ? BYTES_PER_TIMING / aLength : 1);
+    for (unsigned long run = 0; run < aRepeat; ++run)
+    {
+        CRC crc;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (size_t n = 0; n < calls; ++n)
+        {
+            if (aParallel)
+            {
+                crc.UpdateParallel(&aData[0], aLength);
+            }
+            else
+            {
+                crc(&aData[0], aLength);
+            }
+        }
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        // Use the result, so that the updates are not optimised away
+        if (crc() == 0x12345678)
+        {
+            std::cout << " ";
+        }
+
+        const double gbPerSec = (seconds > 0) ? (static_cast<double>(aLength) * calls / seconds / 1e9) : 0;
+        if (gbPerSec > best)
+        {
+            best = gbPerSec;
+        }
+    }
+
+    return best;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Converts a decimal number, making sure it is in range
+//////////////////////////////////////////////////////////////////////////////
+static bool ParseNumber(const char *apValueStr, unsigned long aMax, unsigned long &aValue)
+{
+    char *pErr = NULL;
+    const unsigned long value = strtoul(apValueStr, &pErr, 10);
+    const bool valid = (pErr != apValueStr && *pErr == '\0' && value <= aMax);
+    if (valid)
+    {
+        aValue = value;
+    }
+    return valid;
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Display a message followed by the usage information
+//////////////////////////////////////////////////////////////////////////////
+static void ShowUsageMessage(const char *apFormat, ...)
+{
+    std::cout << "== Error: ";
+
+    va_list argptr;
+    va_start(argptr, apFormat);
+    vprintf(apFormat, argptr);
+    va_end(argptr);
+
+    std::cout << std::endl << std::endl;
+
+    Usage();
+}
+
+//////////////////////////////////////////////////////////////////////////////
+// Output usage information
+//////////////////////////////////////////////////////////////////////////////
+static void Usage()
+{
+    std::cout << gpExeName << " [-repeat <n>]" << std::endl;
+    std::cout << "Checks each CRC implementation supported by the host CPU against the CRC" << std::endl;
+    std::cout << "table, at every alignment, and reports its throughput for 1 KB, 64 KB and" << std::endl;
+    std::cout << "64 MB buffers. Then checks and times CRC::UpdateParallel, checks CRC::Combine," << std::endl;
+    std::cout << "and checks CRCs stay correct while the implementation is changed." << std::endl;
+    std::cout << "Exits with an error if any check fails." << std::endl;
+    std::cout << "Options:" << std::endl;
+    std::cout << "    -repeat - Number of times each size is timed, the fastest is shown, default "
+              << DEFAULT_REPEAT << "." << std::endl;
+    std::cout << std::endl;
+
+    // Always exit program on usage
+    exit(CRCBENCH_ERROR);
+}
@@ -0,0 +1,428 @@
+/*******************************************************************************
+ *
+ *  digestbench.cpp
+ *
+ *  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+ *  All Rights Reserved.
+ *  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+ *
+ *  Check of securlib::DigestFile against the single digest functions it
+ *  replaces (CRC, HashSha256 and OsslCbcMac), and timing of the single pass
+ *  over a file against reading it once and running each digest in turn.
+ *
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "securlib/securlib.h"
+#include "dfu/DFUEngine/CRC.h"
+
+static const char *gpExeName = "digestbench";
+
+/* Size of the generated file to time in MB, followed by the size */
+static const char *OPTION_SIZE_STR = "-size";
+
+/* Number of times each pass is timed, followed by the number */
+static const char *OPTION_REPEAT_STR = "-repeat";
+
+/* Ask for help */
+static const char *OPTION_HELP1_STR = "-help";
+static const char *OPTION_HELP2_STR = "-?";
+
+static const int DIGESTBENCH_SUCCESS = 0;
+static const int DIGESTBENCH_ERROR = 1;
+
+static const unsigned long DEFAULT_SIZE_MB = 64;
+static const unsigned long DEFAULT_REPEAT = 3;
+
+/* Bytes of CRC at the end of a DFU file, not covered by the CRC */
+static const size_t DFU_CRC_SIZE = 4;
+
+/* File written for the checks and the timing */
+static const char *FILENAME = "digestbench.bin";
+
+/* Key for the CBC-MAC, any value will do */
+static const unsigned char CBCMAC_KEY[16] =
+{
+    0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6,
+    0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C
+};
+
+/*****************************************************************
+@brief Fill a buffer with pseudo-random bytes.
+*/
+static void Fill(std::vector<unsigned char> &aData)
+{
+    unsigned int value = 0x1234;
+    for(size_t i = 0; i < aData.size(); ++i)
+    {
+        value = value * 1103515245 + 12345;
+        aData[i] = static_cast<unsigned char>(value >> 16);
+    }
+}
+
+/*****************************************************************
+@brief Write a buffer to a file.
+*/
+static bool WriteFile(const char *aFilename, const unsigned char *apData, size_t aSize)
+{
+    FILE *pFile = fopen(aFilename, "wb");
+    if(!pFile)
+    {
+        return false;
+    }
+    const bool written = (aSize == 0 || fwrite(apData, 1, aSize, pFile) == aSize);
+    return (0 == fclose(pFile)) && written;
+}
+
+/*****************************************************************
+@brief Read a whole file into a buffer.
+*/
+static bool ReadFile(const char *aFilename, std::vector<unsigned char> &aData)
+{
+    FILE *pFile = fopen(aFilename, "rb");
+    if(!pFile)
+    {
+        return false;
+    }
+    fseek(pFile, 0, SEEK_END);
+    const long fileSize = ftell(pFile);
+    fseek(pFile, 0, SEEK_SET);
+    bool read = (fileSize >= 0);
+    if(read)
+    {
+        aData.resize(static_cast<size_t>(fileSize));
+        read = aData.empty() || fread(&aData[0], 1, aData.size(), pFile) == aData.size();
+    }
+    fclose(pFile);
+    return read;
+}
+
+/*****************************************************************
+@brief Calculate the digests one at a time with the single digest functions.
+
+@returns true on success.
+*/
+static bool SeparateDigests(const unsigned char *apData, size_t aSize, int aPadding,
+                            securlib::ImageDigestsType &aDigests)
+{
+    memset(&aDigests, 0, sizeof(aDigests));
+
+    CRC crc;
+    aDigests.crc32 = crc(apData, aSize);
+
+    bool ok = (securlib::HashSha256(&aDigests.sha256, apData, aSize) == 1);
+
+    /* OsslCbcMac does not accept a partial block without padding */
+    const size_t BLKSIZE = EVP_CIPHER_block_size(EVP_aes_128_cbc());
+    aDigests.cbcMacSize = BLKSIZE;
+    if(ok && (aPadding || aSize % BLKSIZE == 0))
+    {
+        ok = (OsslCbcMac(EVP_aes_128_cbc(), aDigests.cbcMac, apData, aSize, CBCMAC_KEY, aPadding) > 0);
+    }
+    aDigests.dataSize = aSize;
+    return ok;
+}
+
+/*****************************************************************
+@brief Calculate the digests of a file in a single pass with DigestFile.
+
+@returns true on success.
+*/
+static bool FileDigests(const char *aFilename, size_t aTrailerSize, int aPadding,
+                        securlib::ImageDigestsType &aDigests, std::vector<unsigned char> *apTrailer)
+{
+    securlib::ImageDigest digest(securlib::DIGEST_CRC32 | securlib::DIGEST_SHA256 | securlib::DIGEST_CBCMAC);
+    return digest.SetCbcMacKey(EVP_aes_128_cbc(), CBCMAC_KEY, aPadding) == 1
+           && !securlib::DigestFile(digest, aFilename, aTrailerSize, apTrailer)
+           && digest.Final(&aDigests) == 1;
+}
+
+/*****************************************************************
+@brief Check DigestFile gives the same digests as the single digest
+       functions, for files of many sizes, with and without a trailer.
+*/
+static bool CheckDigestFile()
+{
+    const size_t BLKSIZE = EVP_CIPHER_block_size(EVP_aes_128_cbc());
+    const size_t CHUNK = securlib::DIGEST_FILE_CHUNK_SIZE;
+    const size_t sizes[] =
+    {
+        0, 1, 4, 15, 16, 17, 31, 32, 4096, 4100,
+        CHUNK - 16, CHUNK - 1, CHUNK, CHUNK + 1, CHUNK + 16, CHUNK + 20,
+        3 * CHUNK, 3 * CHUNK + 4, 3 * CHUNK + 7
+    };
+    const size_t trailers[] = { 0, DFU_CRC_SIZE };
+    const int paddings[] = { 0, 1 };
+
+    std::vector<unsigned char> data(3 * CHUNK + 16);
+    Fill(data);
+
+    bool ok = true;
+    for(size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s)
+    {
+        if(!WriteFile(FILENAME, &data[0], sizes[s]))
+        {
+            fprintf(stderr, "Failed to write %s\n", FILENAME);
+            return false;
+        }
+        for(size_t t = 0; t < sizeof(trailers) / sizeof(trailers[0]) && trailers[t] <= sizes[s]; ++t)
+        {
+            const size_t dataSize = sizes[s] - trailers[t];
+            for(size_t p = 0; p < sizeof(paddings) / sizeof(paddings[0]); ++p)
+            {
+                const bool cbcMacValid = paddings[p] || dataSize % BLKSIZE == 0;
+                securlib::ImageDigestsType expected;
+                securlib::ImageDigestsType actual;
+                std::vector<unsigned char> trailer;
+
+                const bool separate = SeparateDigests(&data[0], dataSize, paddings[p], expected);
+                const bool fused = FileDigests(FILENAME, trailers[t], paddings[p], actual, &trailer);
+                bool same = (separate && fused == cbcMacValid);
+                if(same && fused)
+                {
+                    same = actual.crc32 == expected.crc32
+                           && !memcmp(actual.sha256.digest, expected.sha256.digest, sizeof(actual.sha256.digest))
+                           && actual.cbcMacSize == expected.cbcMacSize
+                           && !memcmp(actual.cbcMac, expected.cbcMac, actual.cbcMacSize)
+                           && actual.dataSize == dataSize
+                           && trailer.size() == trailers[t]
+                           && (trailer.empty() || !memcmp(&trailer[0], &data[dataSize], trailer.size()));
+                }
+                if(!same)
+                {
+                    printf("DigestFile DIFFERS: size %lu, trailer %lu, padding %d\n",
+                           static_cast<unsigned long>(sizes[s]),
+                           static_cast<unsigned long>(trailers[t]), paddings[p]);
+                    ok = false;
+                }
+            }
+        }
+    }
+    printf("DigestFile against CRC, HashSha256 and OsslCbcMac %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+/*****************************************************************
+@brief Check the DFU pre-flight, DigestFile with the suffix CRC as the
+       trailer, accepts a file with the right CRC and rejects one with a
+       byte changed.
+*/
+static bool CheckDfuPreflight()
+{
+    std::vector<unsigned char> data(5 * securlib::DIGEST_FILE_CHUNK_SIZE / 2 + DFU_CRC_SIZE);
+    Fill(data);
+
+    /* DFU file CRC, stored little endian after the data it covers */
+    const size_t dataSize = data.size() - DFU_CRC_SIZE;
+    CRC crc;
+    const uint32_t fileCrc = crc(&data[0], dataSize);
+    for(size_t i = 0; i < DFU_CRC_SIZE; ++i)
+    {
+        data[dataSize + i] = static_cast<unsigned char>(fileCrc >> (8 * i));
+    }
+
+    bool ok = true;
+    for(int corrupt = 0; ok && corrupt < 2; ++corrupt)
+    {
+        if(corrupt)
+        {
+            data[dataSize / 2] ^= 0x01;
+        }
+        securlib::ImageDigest digest(securlib::DIGEST_CRC32 | securlib::DIGEST_SHA256);
+        securlib::ImageDigestsType digests;
+        std::vector<unsigned char> trailer;
+        ok = WriteFile(FILENAME, &data[0], data.size())
+             && !securlib::DigestFile(digest, FILENAME, DFU_CRC_SIZE, &trailer)
+             && digest.Final(&digests) == 1
+             && trailer.size() == DFU_CRC_SIZE;
+        if(ok)
+        {
+            uint32_t suffixCrc = 0;
+            for(size_t i = 0; i < DFU_CRC_SIZE; ++i)
+            {
+                suffixCrc |= static_cast<uint32_t>(trailer[i]) << (8 * i);
+            }
+            ok = ((suffixCrc == digests.crc32) == !corrupt);
+        }
+    }
+    printf("DFU pre-flight %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+/*****************************************************************
+@brief Check a CBC-MAC without a key fails rather than crashing.
+*/
+static bool CheckNoKey()
+{
+    const unsigned char data[32] = {0};
+    securlib::ImageDigestsType digests;
+
+    securlib::ImageDigest unused(securlib::DIGEST_CBCMAC);
+    securlib::ImageDigest updated(securlib::DIGEST_CBCMAC);
+    const bool ok = unused.Final(&digests) == 0
+                    && updated.Update(data, sizeof(data)) == 0
+                    && updated.Final(&digests) == 0;
+    printf("CBC-MAC without a key %s\n", ok ? "ok" : "FAILED");
+    return ok;
+}
+
+/*****************************************************************
+@brief Time aRepeat single passes over the file with DigestFile.
+
+@returns Fastest pass in milliseconds, negative if a pass failed.
+*/
+static double TimeFused(const char *aFilename, unsigned long aRepeat, securlib::ImageDigestsType &aDigests)
+{
+    double best = -1;
+    for(unsigned long i = 0; i < aRepeat; ++i)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if(!FileDigests(aFilename, 0, 0, aDigests, NULL))
+        {
+            return -1;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(best < 0 || ms < best)
+        {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+/*****************************************************************
+@brief Time aRepeat reads of the file followed by each digest in turn.
+
+@returns Fastest pass in milliseconds, negative if a pass failed.
+*/
+static double TimeSeparate(const char *aFilename, unsigned long aRepeat, securlib::ImageDigestsType &aDigests)
+{
+    double best = -1;
+    for(unsigned long i = 0; i < aRepeat; ++i)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        std::vector<unsigned char> data;
+        if(!ReadFile(aFilename, data) || data.empty() || !SeparateDigests(&data[0], data.size(), 0, aDigests))
+        {
+            return -1;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(best < 0 || ms < best)
+        {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+static bool ParseNumber(const char *aValueStr, unsigned long &aValue)
+{
+    char *pEnd;
+    aValue = strtoul(aValueStr, &pEnd, 10);
+    return *aValueStr && !*pEnd && aValue;
+}
+
+static void Usage()
+{
+    printf("Usage: %s [%s <MB>] [%s <count>]\n", gpExeName, OPTION_SIZE_STR, OPTION_REPEAT_STR);
+    printf("\n");
+    printf("Checks securlib::DigestFile gives the same CRC, SHA-256 and CBC-MAC as the\n");
+    printf("CRC class, HashSha256 and OsslCbcMac, for files of many sizes. Checks the\n");
+    printf("DFU pre-flight, the file CRC against the suffix CRC, and a CBC-MAC without\n");
+    printf("a key. Then times DigestFile against reading the file and running each\n");
+    printf("digest in turn, over a file of the given size (default %lu MB) generated\n", DEFAULT_SIZE_MB);
+    printf("in the current directory. Each pass is done %lu times by default, the\n", DEFAULT_REPEAT);
+    printf("fastest is shown. Files written are removed afterwards.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long sizeMb = DEFAULT_SIZE_MB;
+    unsigned long repeat = DEFAULT_REPEAT;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], OPTION_HELP1_STR) || !strcmp(argv[i], OPTION_HELP2_STR))
+        {
+            Usage();
+            return DIGESTBENCH_SUCCESS;
+        }
+        else if(!strcmp(argv[i], OPTION_SIZE_STR) && i + 1 < argc)
+        {
+            if(!ParseNumber(argv[++i], sizeMb))
+            {
+                fprintf(stderr, "Invalid size \"%s\"\n", argv[i]);
+                return DIGESTBENCH_ERROR;
+            }
+        }
+        else if(!strcmp(argv[i], OPTION_REPEAT_STR) && i + 1 < argc)
+        {
+            if(!ParseNumber(argv[++i], repeat))
+            {
+                fprintf(stderr, "Invalid repeat count \"%s\"\n", argv[i]);
+                return DIGESTBENCH_ERROR;
+            }
+        }
+        else
+        {
+            fprintf(stderr, "Invalid option \"%s\"\n", argv[i]);
+            Usage();
+            return DIGESTBENCH_ERROR;
+        }
+    }
+
+    int result = DIGESTBENCH_SUCCESS;
+    const bool checksOk = CheckDigestFile();
+    if(!CheckDfuPreflight() || !CheckNoKey() || !checksOk)
+    {
+        result = DIGESTBENCH_ERROR;
+    }
+
+    if(DIGESTBENCH_SUCCESS == result)
+    {
+        std::vector<unsigned char> data(sizeMb * 1024 * 1024);
+        Fill(data);
+        printf("Writing %lu MB to %s\n", sizeMb, FILENAME);
+        if(!WriteFile(FILENAME, &data[0], data.size()))
+        {
+            fprintf(stderr, "Failed to write %s\n", FILENAME);
+            result = DIGESTBENCH_ERROR;
+        }
+    }
+
+    if(DIGESTBENCH_SUCCESS == result)
+    {
+        securlib::ImageDigestsType separate;
+        securlib::ImageDigestsType fused;
+        const double separateMs = TimeSeparate(FILENAME, repeat, separate);
+        const double fusedMs = TimeFused(FILENAME, repeat, fused);
+        if(separateMs < 0 || fusedMs < 0)
+        {
+            fprintf(stderr, "Failed to digest %s\n", FILENAME);
+            result = DIGESTBENCH_ERROR;
+        }
+        else
+        {
+            const bool same = fused.crc32 == separate.crc32
+                              && !memcmp(fused.sha256.digest, separate.sha256.digest, sizeof(fused.sha256.digest))
+                              && !memcmp(fused.cbcMac, separate.cbcMac, fused.cbcMacSize);
+            printf("Read, then each digest %10.1f ms\n", separateMs);
+            printf("DigestFile             %10.1f ms  (%.1fx)\n", fusedMs, separateMs / fusedMs);
+            printf("Digests %s\n", same ? "match" : "DIFFER");
+            if(!same)
+            {
+                result = DIGESTBENCH_ERROR;
+            }
+        }
+    }
+
+    remove(FILENAME);
+    return result;
+}
@@ -17,6 +17,7 @@
 #include <cstdlib>
 #include <ctype.h>
 #include <cassert>
+#include <cerrno>
 
 #include <string>
 #include <vector>
@@ -47,6 +48,7 @@
 #define EF_GROUP CMessageHandler::GROUP_ENUM_APPLICATION
 
 #define ENV_SECURITYCMD_XUVE "SECURITYCMD_XUVE"
+#define ENV_SECURITYCMD_XUVB "SECURITYCMD_XUVB"
 
 #define OPERATION_LIST      "OPERATION_LIST"
 #define CMD_KEYGEN_USBDBG   "createunlockkey"
@@ -60,6 +62,8 @@
 #define CMD_SIGNENCRYPT     "signencrypt"
 #define CMD_SCRAMBLEASPK    "scrambleaspk"
 #define CMD_PEMTODFUKEY     "pem2dfukey"
+#define CMD_XUVCONVERT      "xuvconvert"
+#define CMD_PIPELINE        "pipeline"
 #define OPT_COPYEXEC        "copyexec"
 
 #define OPT_PRODUCT         "-product"
@@ -75,7 +79,18 @@ enum ENDIAN   { EN_DEFAULT, EN_U16BE, EN_U16LE };
 enum KEYTYPES { KY_PRV, KY_PUB };
 enum KEYFORMAT { KF_TEXT, KF_PEM, KF_DFU };
 enum OPERATIONS { OP_KEYGEN_UNLOCK, OP_KEYGEN_RSA, OP_HASH, OP_SIGN, OP_ENCRYPT, OP_SIGNENCRYPT, 
-    OP_PEMTODFUKEY, OP_CBCMAC, OP_SCRAMBLEASPK, OP_WRAP_KEY, OP_WRAP_KEY_AR };
+    OP_PEMTODFUKEY, OP_CBCMAC, OP_SCRAMBLEASPK, OP_WRAP_KEY, OP_WRAP_KEY_AR, OP_XUVCONVERT,
+    OP_PIPELINE };
+
+/* A stage of the pipeline command, the parameters of its command */
+struct PipelineStage
+{
+    OPERATIONS Command;
+    std::string OutFile;
+    std::string SignKeyFile; /* reused for IV file */
+    std::string EncrKeyFile;
+    uint64_t U64Address; /* Address of image for hyd encryption command */
+};
 
 struct
 {
@@ -109,6 +124,8 @@ struct
     unsigned int Address;       /* Address of store header */
     /* global -useimageheader flag*/
     bool UseImageHeader;
+    /* pipeline command stages, in order */
+    std::vector<PipelineStage> Pipeline;
 } static CmdLineParams =
 {
     /* CmdLineParams initial values */
@@ -278,8 +295,26 @@ void DefineCmdLine(CCmdLine& aCmdLine, int aProduct)
         aCmdLine.AddExpectedValue(DATA_TYPE_STRING, "exponent", "The public exponent. 3 or F4 (65537). Must match firmware support", MANDATORY);
         aCmdLine.AddExpectedValue(DATA_TYPE_STRING, "private key file", "The filename of the private key", MANDATORY);
         aCmdLine.AddExpectedValue(DATA_TYPE_STRING, "public key file", "The filename of the public key. Optional", NOT_MANDATORY);
+
+        /* pipeline command */
+        aCmdLine.SetExpectedParam(CMD_PIPELINE, HydOnly + "Run several XUV image commands on one input XUV image,"
+            " which is read once for all of them. Each command writes its own output XUV image", NOT_MANDATORY, NOT_HIDDEN);
+        aCmdLine.AddExpectedValue(DATA_TYPE_STRING, "commands", "Comma separated list of two or more commands to run, in"
+            " order. Each of " CMD_HASH ", " CMD_SIGN ", " CMD_ENCRYPT " or " CMD_CBCMAC ", e.g. " CMD_HASH "," CMD_SIGN, MANDATORY);
+        aCmdLine.AddExpectedValue(DATA_TYPE_STRING, "input XUV file", "The filename of the input XUV image", MANDATORY);
+        aCmdLine.AddExpectedUnterminatedList(DATA_TYPE_STRING, "value", "The values each command takes after its"
+            " input XUV file, starting with its output XUV file, for each command in turn");
     }
 
+    /* xuvconvert command */
+    aCmdLine.SetExpectedParam(CMD_XUVCONVERT, "Convert an XUV image between the text and binary XUV formats."
+        " A binary XUV file named as an XUV file with \"" + std::string(xuv::BINARY_EXTENSION) + "\" appended is read"
+        " in its place, so is parsed faster, until the XUV file changes. Setting the " ENV_SECURITYCMD_XUVB
+        " environment variable to 1 writes one alongside each output XUV file", NOT_MANDATORY, NOT_HIDDEN);
+    aCmdLine.AddExpectedValue(DATA_TYPE_STRING, "input XUV file", "The filename of the input XUV image, in either format", MANDATORY);
+    aCmdLine.AddExpectedValue(DATA_TYPE_STRING, "output XUV file", "The filename of the output XUV image,"
+        " in the binary format if it ends in \"" + std::string(xuv::BINARY_EXTENSION) + "\"", MANDATORY);
+
     if(PR_UE == aProduct || aProduct < 0)
     {
         /* -address option */
@@ -319,6 +354,7 @@ void DefineCmdLine(CCmdLine& aCmdLine, int aProduct)
     if(PR_HYD == aProduct || aProduct < 0)
     {
         aCmdLine.AddToList(OPERATION_LIST, CMD_PEMTODFUKEY);
+        aCmdLine.AddToList(OPERATION_LIST, CMD_PIPELINE);
         aCmdLine.AddToList(OPERATION_LIST, CMD_SCRAMBLEASPK);
     }
     aCmdLine.AddToList(OPERATION_LIST, CMD_SIGN);
@@ -326,7 +362,120 @@ void DefineCmdLine(CCmdLine& aCmdLine, int aProduct)
     {
         aCmdLine.AddToList(OPERATION_LIST, CMD_SIGNENCRYPT);
     }
+    aCmdLine.AddToList(OPERATION_LIST, CMD_XUVCONVERT);
+
+}
+
+/******************************************************************************
+@brief Get the next value of the pipeline command.
+
+@param[in]      aCmdLine    The command line.
+@param[in,out]  aParamIdx   Index of the value, moved on to the next.
+@param[out]     aValue      to receive the value.
+@param[in]      aName       Name of the value for the error message.
+
+@return true if the value has not been supplied. Error message was output to user.
+*/
+bool GetPipelineValue(CCmdLine &aCmdLine, int &aParamIdx, std::string &aValue, const std::string &aName)
+{
+    bool failure = false;
+    /* The commands and input XUV file, then the list of values */
+    const int count = 2 + aCmdLine.GetUnterminatedListLength(CMD_PIPELINE);
+    if(aParamIdx > count || GET_PARAMETER_SUCCESS != aCmdLine.GetParameterValue(CMD_PIPELINE, aParamIdx, aValue))
+    {
+        aCmdLine.OutputErrorMessage(aName + " has not been supplied.");
+        aCmdLine.PrintHelp();
+        failure = true;
+    }
+    ++aParamIdx;
+    return failure;
+}
+
+/******************************************************************************
+@brief Process the pipeline command line into its stages.
+
+Each stage takes the values of its command after the input XUV file, in the
+order of the commands.
+*/
+bool CheckPipelineCmdLine(CCmdLine &aCmdLine)
+{
+    bool failure = false;
+    FUNCTION_DEBUG_SENTRY_RET(bool, failure);
+    std::string commands;
+    int paramidx = 1;
+    failure = GetPipelineValue(aCmdLine, paramidx, commands, "commands")
+        || GetPipelineValue(aCmdLine, paramidx, CmdLineParams.InFile, "input file");
+
+    CmdLineParams.Pipeline.clear();
+    for(size_t start = 0; !failure && start <= commands.size(); )
+    {
+        size_t end = commands.find(',', start);
+        if(std::string::npos == end)
+        {
+            end = commands.size();
+        }
+        const std::string command = commands.substr(start, end - start);
+        start = end + 1;
+
+        PipelineStage stage;
+        stage.U64Address = 0;
+        if(0 == STRICMP(command.c_str(), CMD_HASH))
+        {
+            stage.Command = OP_HASH;
+            failure = GetPipelineValue(aCmdLine, paramidx, stage.OutFile, command + " output file");
+        }
+        else if(0 == STRICMP(command.c_str(), CMD_SIGN))
+        {
+            stage.Command = OP_SIGN;
+            failure = GetPipelineValue(aCmdLine, paramidx, stage.OutFile, command + " output file")
+                || GetPipelineValue(aCmdLine, paramidx, stage.SignKeyFile, "sign private key file");
+        }
+        else if(0 == STRICMP(command.c_str(), CMD_ENCRYPT))
+        {
+            stage.Command = OP_ENCRYPT;
+            std::string address;
+            failure = GetPipelineValue(aCmdLine, paramidx, stage.OutFile, command + " output file")
+                || GetPipelineValue(aCmdLine, paramidx, stage.EncrKeyFile, "encryption key file")
+                || GetPipelineValue(aCmdLine, paramidx, stage.SignKeyFile, "nonce file")
+                || GetPipelineValue(aCmdLine, paramidx, address, "address");
+            if(!failure)
+            {
+                /* As the address of the encrypt command, in hexadecimal */
+                char *pEnd = NULL;
+                errno = 0;
+                stage.U64Address = strtoull(address.c_str(), &pEnd, 16);
+                if(address.empty() || errno || *pEnd)
+                {
+                    aCmdLine.OutputErrorMessage("Invalid address argument.");
+                    aCmdLine.PrintHelp();
+                    failure = true;
+                }
+            }
+        }
+        else if(0 == STRICMP(command.c_str(), CMD_CBCMAC))
+        {
+            stage.Command = OP_CBCMAC;
+            failure = GetPipelineValue(aCmdLine, paramidx, stage.OutFile, command + " output file")
+                || GetPipelineValue(aCmdLine, paramidx, stage.EncrKeyFile, "authentication key file");
+        }
+        else
+        {
+            aCmdLine.OutputErrorMessage("Invalid pipeline command \"" + command + "\". Should be one of "
+                CMD_HASH ", " CMD_SIGN ", " CMD_ENCRYPT " or " CMD_CBCMAC ".");
+            aCmdLine.PrintHelp();
+            failure = true;
+        }
+        CmdLineParams.Pipeline.push_back(stage);
+    }
 
+    /* The input XUV file and the values of every stage, nothing more */
+    if(!failure && paramidx - 3 != aCmdLine.GetUnterminatedListLength(CMD_PIPELINE))
+    {
+        aCmdLine.OutputErrorMessage("Too many values for the pipeline commands.");
+        aCmdLine.PrintHelp();
+        failure = true;
+    }
+    return failure;
 }
 
 /******************************************************************************
@@ -372,8 +521,9 @@ bool CheckCmdLine(CCmdLine &aCmdLine)
     }
 
     int paramidx = 1;
-    /* neither CMD_PEMTODFUKEY nor CMD_KEYGEN_RSA nor CMD_SCRAMBLEASPK */
-    if(STRICMP(pOp, CMD_PEMTODFUKEY) && STRICMP(pOp, CMD_KEYGEN_RSA) && STRICMP(pOp, CMD_SCRAMBLEASPK))
+    /* neither CMD_PEMTODFUKEY nor CMD_KEYGEN_RSA nor CMD_SCRAMBLEASPK nor CMD_PIPELINE */
+    if(STRICMP(pOp, CMD_PEMTODFUKEY) && STRICMP(pOp, CMD_KEYGEN_RSA) && STRICMP(pOp, CMD_SCRAMBLEASPK)
+        && STRICMP(pOp, CMD_PIPELINE))
     {
         /* Get the input XUV filename */
         res = aCmdLine.GetParameterValue(pOp, paramidx, CmdLineParams.InFile);
@@ -428,6 +578,10 @@ bool CheckCmdLine(CCmdLine &aCmdLine)
         {
             CmdLineParams.Command = OP_HASH;
         }
+        else if(0 == STRICMP(pOp, CMD_XUVCONVERT))
+        {
+            CmdLineParams.Command = OP_XUVCONVERT;
+        }
         else if(0 == STRICMP(pOp, CMD_SIGN))
         {
             CmdLineParams.Command = OP_SIGN;
@@ -740,6 +894,11 @@ bool CheckCmdLine(CCmdLine &aCmdLine)
             res = aCmdLine.GetParameterValue(pOp, paramidx, CmdLineParams.PubKeyFile);
             ++paramidx;
         }
+        else if(PR_HYD == CmdLineParams.product && 0 == STRICMP(pOp, CMD_PIPELINE))
+        {
+            CmdLineParams.Command = OP_PIPELINE;
+            failure = CheckPipelineCmdLine(aCmdLine);
+        }
         else
         {
             aCmdLine.OutputErrorMessage("Command not available for this product.");
@@ -874,30 +1033,69 @@ bool ProcessCmdLine(CCmdLine &aCmdLine, int aProduct)
 }
 
 /******************************************************************************
-@brief Calculate hash using SHA256 on the XUV image outputting hash into an XUV image.
+@brief XUV image flattened into a contiguous block, as the XUV commands process it.
+*/
+struct XuvBlock
+{
+    unsigned int AddrFirst;     /* Address of first word */
+    unsigned int AddrLast;      /* Address of last word */
+    xuv::ByteBlockType block;   /* Words from AddrFirst to AddrLast */
+};
 
-@param[out] aXuvImageHash   Output XUV image containing generated hash.
-@param[in]  aXuvImageIn     Input XUV image.
-@param[in]  aAddrFirst      Address of first word to be hashed.
-@param[in]  aAddrLast       Address of last word to be hashed.
+/******************************************************************************
+@brief Read an XUV image and flatten it into a contiguous block.
+
+@param[out] aInput      The flattened image.
+@param[in]  apInFile    Input XUV image.
 
 @note
 The image is expected to be a contiguous block. If not the gaps will default to
 0xFF.
 */
+enum {READXUVBLOCK_SUCCESS = 0, READXUVBLOCK_ERR_READ_IMG, READXUVBLOCK_ERR_IMG_EMPTY};
+int ReadXuvBlock(XuvBlock &aInput, const char *apInFile)
+{
+    int res = READXUVBLOCK_SUCCESS;
+    FUNCTION_DEBUG_SENTRY_RET(int, res);
+
+    /* Read XUV file. */
+    xuv::image image;
+    if(xuv::READ_OK != xuv::Read(image, apInFile))
+    {
+        res = READXUVBLOCK_ERR_READ_IMG;
+    }
+    else if(image.data.empty())
+    {
+        res = READXUVBLOCK_ERR_IMG_EMPTY;
+    }
+    else
+    {
+        /* Get address of first and last word */
+        aInput.AddrFirst = image.data.begin()->first;
+        aInput.AddrLast = image.data.rbegin()->first;
+        /* copy image into vector from XUV image (contiguous bytes, BIG endian) */
+        aInput.block = ByteBlockFlattenU16(image, aInput.AddrFirst, aInput.AddrLast, 0xFF, gXuvBe);
+    }
+    return res;
+}
+
+/******************************************************************************
+@brief Calculate hash using SHA256 on the XUV image outputting hash into an XUV image.
+
+@param[out] aXuvImageHash   Output XUV image containing generated hash.
+@param[in]  aBlock          Input XUV image flattened into a contiguous block.
+*/
 void
-XuvImageHashSha256(xuv::image &aXuvImageHash, const xuv::image &aXuvImageIn,
-    unsigned int aAddrFirst, unsigned int aAddrLast)
+XuvImageHashSha256(xuv::image &aXuvImageHash, const xuv::ByteBlockType &aBlock)
 {
     FUNCTION_DEBUG_SENTRY;
-    securlib::HashType hash;
-    xuv::ByteBlockType block;
+    securlib::ImageDigest digest(securlib::DIGEST_SHA256);
+    securlib::ImageDigestsType digests;
 
-    /* copy app store into vector from XUV image (contiguous bytes, BIG endian) */
-    block = ByteBlockFlattenU16(aXuvImageIn, aAddrFirst, aAddrLast, 0xFF, gXuvBe);
-    (void) securlib::HashSha256(&hash, &block[0], block.size());
+    (void) digest.Update(&aBlock[0], aBlock.size());
+    (void) digest.Final(&digests);
     /* Push the hash into the XUV image. */
-    xuv::ByteBlockIncorporateU16(aXuvImageHash, 0, &hash.digest[0], &hash.digest[SHA256_DIGEST_LENGTH-1], gXuvBe);
+    xuv::ByteBlockIncorporateU16(aXuvImageHash, 0, &digests.sha256.digest[0], &digests.sha256.digest[SHA256_DIGEST_LENGTH-1], gXuvBe);
 }
 
 
@@ -907,44 +1105,44 @@ This function works on files.
 
 @param[in]  apInFile    Input XUV image.
 @param[in]  apOutFile   Output XUV image containing hash.
+@param[in]  apInput     Input XUV image already read, NULL to read apInFile.
 */
 enum {FXUVIMGHASH_SUCCESS, FXUVIMGHASH_ERR_READ_IMG, FXUVIMGHASH_ERR_IMG_EMPTY, FXUVIMGHASH_ERR_WRITE_IMG};
-int FXuvImageHashSha256(const char *apInFile, const char *apOutFile)
+int FXuvImageHashSha256(const char *apInFile, const char *apOutFile, const XuvBlock *apInput)
 {
     int res = FXUVIMGHASH_SUCCESS;
     FUNCTION_DEBUG_SENTRY_RET(int, res);
 
-    /* Read XUV file. */
-    xuv::image image;
-    if(xuv::READ_OK != xuv::Read(image, apInFile))
-    {
-        res = FXUVIMGHASH_ERR_READ_IMG;
-    }
-    else
+    /* Read XUV file, unless already read. */
+    XuvBlock input;
+    if(!apInput)
     {
-        if(image.data.empty())
+        switch(ReadXuvBlock(input, apInFile))
         {
+        case READXUVBLOCK_ERR_READ_IMG:
+            res = FXUVIMGHASH_ERR_READ_IMG;
+            break;
+        case READXUVBLOCK_ERR_IMG_EMPTY:
             res = FXUVIMGHASH_ERR_IMG_EMPTY;
+            break;
         }
-        else
-        {
-            /* Get address of first and last word */
-            unsigned int AddrFirst = image.data.begin()->first;
-            unsigned int AddrLast = image.data.rbegin()->first;
+        apInput = &input;
+    }
+    if(!res)
+    {
 #if 0
-            printf("AddrFirst %06X\n", AddrFirst);
-            printf("AddrLast %06X\n", AddrLast);
+        printf("AddrFirst %06X\n", apInput->AddrFirst);
+        printf("AddrLast %06X\n", apInput->AddrLast);
 #endif
 
-            /* Calculate the hash */
-            xuv::image hash;
-            XuvImageHashSha256(hash, image, AddrFirst, AddrLast);
+        /* Calculate the hash */
+        xuv::image hash;
+        XuvImageHashSha256(hash, apInput->block);
 
-            /* Write the output XUV image. */
-            if(xuv::WRITE_OK != xuv::Write(hash, apOutFile))
-            {
-                res = FXUVIMGHASH_ERR_WRITE_IMG;
-            }
+        /* Write the output XUV image. */
+        if(xuv::WRITE_OK != xuv::Write(hash, apOutFile))
+        {
+            res = FXUVIMGHASH_ERR_WRITE_IMG;
         }
     }
     return res;
@@ -954,27 +1152,19 @@ int FXuvImageHashSha256(const char *apInFile, const char *apOutFile)
 @brief Sign a message digest (hash) using RSA with PSS padding.
 
 @param[out] aXuvSignature   Output XUV image containing generated signature.
-@param[in]  aXuvImageIn     Input XUV image containing digest.
+@param[in]  aBlock          Input XUV image flattened into a contiguous block.
 @param[in]  pKey            Private key.
-@param[in]  aAddrFirst      Address of first word to be signed.
-@param[in]  aAddrLast       Address of last word to be signed.
 
 @note
-The image is expected to be a contiguous block. If not the gaps will default to
-0xFF.
-
 If the signing fails the output image will be empty.
 */
-void XuvImageSignRsaPss(xuv::image &aXuvSignature, const xuv::image &aXuvImageIn,
-    EVP_PKEY *pKey, unsigned int aAddrFirst, unsigned int aAddrLast)
+void XuvImageSignRsaPss(xuv::image &aXuvSignature, const xuv::ByteBlockType &aBlock, EVP_PKEY *pKey)
 {
     FUNCTION_DEBUG_SENTRY;
     const size_t siglen = 1024;
     size_t rsiglen = siglen;
     unsigned char sig[siglen];
-    /* copy image into vector from XUV image (contiguous bytes, BIG endian) */
-    xuv::ByteBlockType block = ByteBlockFlattenU16(aXuvImageIn, aAddrFirst, aAddrLast, 0xFF, gXuvBe);
-    if(OsslRsaPssSign(pKey, &block[0], block.size(), sig, &rsiglen) > 0)
+    if(OsslRsaPssSign(pKey, &aBlock[0], aBlock.size(), sig, &rsiglen) > 0)
     {
         if(rsiglen <= siglen)
         {
@@ -986,13 +1176,17 @@ void XuvImageSignRsaPss(xuv::image &aXuvSignature, const xuv::image &aXuvImageIn
 
 /******************************************************************************
 @brief Sign a message digest (hash) using RSA with PSS padding.
+
+@param[in]  apKeyFile   Private key file.
+@param[in]  apInFile    Input XUV image.
+@param[in]  apOutFile   Output XUV image containing signature.
+@param[in]  apInput     Input XUV image already read, NULL to read apInFile.
 */
 enum {FXUVIMGSIGN_SUCCESS = 0, FXUVIMGSIGN_ERR_READ_KEY, FXUVIMGSIGN_ERR_READ_IMG, FXUVIMGSIGN_ERR_IMG_EMPTY, FXUVIMGSIGN_ERR_WRITE_IMG, FXUVIMGSIGN_ERR_SIGN_IMG};
-int FXuvImageSignRsaPss(const char *apKeyFile, const char *apInFile, const char *apOutFile)
+int FXuvImageSignRsaPss(const char *apKeyFile, const char *apInFile, const char *apOutFile, const XuvBlock *apInput)
 {
     int res = FXUVIMGSIGN_SUCCESS;
     FUNCTION_DEBUG_SENTRY_RET(int, res);
-    xuv::image image;
     xuv::image signature;
 
     /* Read the private key */
@@ -1002,32 +1196,35 @@ int FXuvImageSignRsaPss(const char *apKeyFile, const char *apInFile, const char
         res = FXUVIMGSIGN_ERR_READ_KEY;
     }
 
-    /* Read XUV file. */
-    if(!res && xuv::READ_OK != xuv::Read(image, apInFile))
+    /* Read XUV file, unless already read. */
+    XuvBlock input;
+    if(!res && !apInput)
     {
-        res = FXUVIMGHASH_ERR_READ_IMG;
+        switch(ReadXuvBlock(input, apInFile))
+        {
+        case READXUVBLOCK_ERR_READ_IMG:
+            res = FXUVIMGSIGN_ERR_READ_IMG;
+            break;
+        case READXUVBLOCK_ERR_IMG_EMPTY:
+            res = FXUVIMGSIGN_ERR_IMG_EMPTY;
+            break;
+        }
+        apInput = &input;
     }
-    if(!res && !image.data.empty())
+    if(!res)
     {
-        /* Get address of first and last word. Having variables here make it easier to debug. */
-        unsigned int AddrFirst = image.data.begin()->first;
-        unsigned int AddrLast = image.data.rbegin()->first;
         /* Calculate the signature */
-        XuvImageSignRsaPss(signature, image, pKey, AddrFirst, AddrLast);
+        XuvImageSignRsaPss(signature, apInput->block, pKey);
         if(signature.data.empty())
         {
             res = FXUVIMGSIGN_ERR_SIGN_IMG;
         }
     }
-    else
-    {
-        res = FXUVIMGHASH_ERR_IMG_EMPTY;
-    }
 
     /* Write the output XUV image. */
     if(!res && xuv::WRITE_OK != xuv::Write(signature, apOutFile))
     {
-        res = FXUVIMGHASH_ERR_WRITE_IMG;
+        res = FXUVIMGSIGN_ERR_WRITE_IMG;
     }
 
     if(pKey)
@@ -1042,35 +1239,26 @@ int FXuvImageSignRsaPss(const char *apKeyFile, const char *apInFile, const char
 
 @param[in]  aAlgorithm      Algorithm (EVP_CIPHER). Shall be in CBC mode.
 @param[out] aXuvCbcMac      Output XUV image containing generated CBC-MAC.
-@param[in]  aXuvImageIn     Input XUV image containing digest.
+@param[in]  aBlock          Input XUV image flattened into a contiguous block.
 @param[in]  apKey           Key.
-@param[in]  aAddrFirst      Address of first word to be signed.
-@param[in]  aAddrLast       Address of last word to be signed.
 @param[in]  aPadding        Value to pass to EVP_CIPHER_CTX_set_padding().
 
 @note
-The image is expected to be a contiguous block. If not the gaps will default to
-0xFF.
-
 If the signing fails the output image will be empty.
 */
 void XuvImageCreateCbcMac(const EVP_CIPHER *aAlgorithm, xuv::image &aXuvCbcMac,
-    const xuv::image &aXuvImageIn, const unsigned char *apKey,
-    unsigned int aAddrFirst, unsigned int aAddrLast, int aPadding)
+    const xuv::ByteBlockType &aBlock, const unsigned char *apKey, int aPadding)
 {
     FUNCTION_DEBUG_SENTRY;
-    const int KEYSIZE = EVP_CIPHER_key_length(aAlgorithm);
-    unsigned char CbcMac[EVP_MAX_KEY_LENGTH];
+    securlib::ImageDigest digest(securlib::DIGEST_CBCMAC);
+    securlib::ImageDigestsType digests;
 
-    /* copy image into vector from XUV image (contiguous bytes, BIG endian) */
-    if(KEYSIZE <= EVP_MAX_KEY_LENGTH)
+    if(digest.SetCbcMacKey(aAlgorithm, apKey, aPadding) > 0 &&
+        digest.Update(&aBlock[0], aBlock.size()) > 0 &&
+        digest.Final(&digests) > 0 && digests.cbcMacSize > 0)
     {
-        xuv::ByteBlockType block = ByteBlockFlattenU16(aXuvImageIn, aAddrFirst, aAddrLast, 0xFF, gXuvBe);
-        if(OsslCbcMac(aAlgorithm, CbcMac, &block[0], block.size(), apKey, aPadding) > 0)
-        {
-            /* Push the CBC-MAC into the XUV image. */
-            xuv::ByteBlockIncorporateU16(aXuvCbcMac, 0, &CbcMac[0], &CbcMac[KEYSIZE-1], gXuvBe);
-        }
+        /* Push the CBC-MAC into the XUV image. */
+        xuv::ByteBlockIncorporateU16(aXuvCbcMac, 0, &digests.cbcMac[0], &digests.cbcMac[digests.cbcMacSize-1], gXuvBe);
     }
 }
 
@@ -1082,16 +1270,16 @@ void XuvImageCreateCbcMac(const EVP_CIPHER *aAlgorithm, xuv::image &aXuvCbcMac,
 @param[in]  apInFile        Input XUV image.
 @param[in]  apOutFile       Output XUV image containing hash.
 @param[in]  aPadding        Value to pass to EVP_CIPHER_CTX_set_padding().
+@param[in]  apInput         Input XUV image already read, NULL to read apInFile.
 */
 enum {FXUVIMGCBCMAC_SUCCESS = 0, FXUVIMGCBCMAC_ERR_READ_KEY, FXUVIMGCBCMAC_ERR_READ_IMG,
     FXUVIMGCBCMAC_ERR_IMG_EMPTY, FXUVIMGCBCMAC_ERR_WRITE_IMG, FXUVIMGCBCMAC_ERR_IMG_NOT_MULTIPLE,
     FXUVIMGCBCMAC_ERR_CBCMAC_IMG};
 int FXuvImageCreateCbcMac(const EVP_CIPHER *aAlgorithm, const char *apKeyFile,
-    const char *apInFile, const char *apOutFile, int aPadding)
+    const char *apInFile, const char *apOutFile, int aPadding, const XuvBlock *apInput)
 {
     int res = FXUVIMGCBCMAC_SUCCESS;
     FUNCTION_DEBUG_SENTRY_RET(int, res);
-    xuv::image image;
     xuv::image CbcMac;
 
     /* Read the key */
@@ -1105,39 +1293,39 @@ int FXuvImageCreateCbcMac(const EVP_CIPHER *aAlgorithm, const char *apKeyFile,
     }
     securlib::reverse8BitBytes(AuthKey.key, sizeof(AuthKey.key));
 
-    /* Read XUV file. */
-    if(!res && xuv::READ_OK != xuv::Read(image, apInFile))
+    /* Read XUV file, unless already read. */
+    XuvBlock input;
+    if(!res && !apInput)
     {
-        res = FXUVIMGCBCMAC_ERR_READ_IMG;
+        switch(ReadXuvBlock(input, apInFile))
+        {
+        case READXUVBLOCK_ERR_READ_IMG:
+            res = FXUVIMGCBCMAC_ERR_READ_IMG;
+            break;
+        case READXUVBLOCK_ERR_IMG_EMPTY:
+            res = FXUVIMGCBCMAC_ERR_IMG_EMPTY;
+            break;
+        }
+        apInput = &input;
     }
     if(!res)
     {
-        if(!image.data.empty())
+        /* image size in bytes */
+        size_t ImageSize = apInput->block.size();
+        size_t BlockSize = EVP_CIPHER_block_size(aAlgorithm);
+        if((ImageSize % BlockSize) == 0)
         {
-            /* Get address of first and last word. Having variables here make it easier to debug. */
-            unsigned int AddrFirst = image.data.begin()->first;
-            unsigned int AddrLast = image.data.rbegin()->first;
-            /* image size in bytes */
-            size_t ImageSize = (AddrLast - AddrFirst + 1) * 2;
-            size_t BlockSize = EVP_CIPHER_block_size(aAlgorithm);
-            if((ImageSize % BlockSize) == 0)
-            {
-                /* Calculate the CBC-MAC */
-                XuvImageCreateCbcMac(aAlgorithm, CbcMac, image, AuthKey.key, AddrFirst, AddrLast, aPadding);
-                if(CbcMac.data.empty())
-                {
-                    res = FXUVIMGCBCMAC_ERR_CBCMAC_IMG;
-                }
-            }
-            else
+            /* Calculate the CBC-MAC */
+            XuvImageCreateCbcMac(aAlgorithm, CbcMac, apInput->block, AuthKey.key, aPadding);
+            if(CbcMac.data.empty())
             {
-                /* Image size is not a multiple of block size */
-                res = FXUVIMGCBCMAC_ERR_IMG_NOT_MULTIPLE;
+                res = FXUVIMGCBCMAC_ERR_CBCMAC_IMG;
             }
         }
         else
         {
-            res = FXUVIMGCBCMAC_ERR_IMG_EMPTY;
+            /* Image size is not a multiple of block size */
+            res = FXUVIMGCBCMAC_ERR_IMG_NOT_MULTIPLE;
         }
     }
 
@@ -1154,11 +1342,10 @@ int FXuvImageCreateCbcMac(const EVP_CIPHER *aAlgorithm, const char *apKeyFile,
 @brief Encrypt XUV image with given AES-128 with custom CTR mode.
 
 @param[out] aXuvImageOut    Encrypted output XUV image.
-@param[in]  aXuvImageIn     Input XUV image containing digest.
+@param[in]  aBlock          Input XUV image flattened into a contiguous block.
 @param[in]  apKey           Key for encryption. Shall be EVP_CIPHER_key_length(aType).
 @param[in]  apIv            Initialisation vector. Shall be EVP_CIPHER_iv_length(aType).
-@param[in]  aAddrFirst      Address of first word to be signed.
-@param[in]  aAddrLast       Address of last word to be signed.
+@param[in]  aAddrFirst      Address of first word of the block.
 @param[in]  aAddress        Address in the flash device.
 
 @return Success or error code.
@@ -1172,25 +1359,20 @@ code for each function.
 @note
 The output image will be upto a block larger than input image.
 
-The image is expected to be a contiguous block. If not the gaps will default to
-0xFF.
-
 If the encryption fails the output image will be empty.
 */
-int XuvImageEncryptAes128Cctr(xuv::image &aXuvImageOut, const xuv::image &aXuvImageIn,
+int XuvImageEncryptAes128Cctr(xuv::image &aXuvImageOut, const xuv::ByteBlockType &aBlock,
     const unsigned char *apKey, const unsigned char *apIv,
-    unsigned int aAddrFirst, unsigned int aAddrLast, unsigned int aAddress)
+    unsigned int aAddrFirst, unsigned int aAddress)
 {
     int res = 0; /* default to failure (to match OpenSSL error for these functions) */
     FUNCTION_DEBUG_SENTRY_RET(int, res);
     size_t size;
-    /* copy image into vector from XUV image (contiguous bytes, BIG endian) */
-    xuv::ByteBlockType block = ByteBlockFlattenU16(aXuvImageIn, aAddrFirst, aAddrLast, 0xFF, gXuvBe);
     /* Create output buffer to receive encrypted image. */
-    size = block.size() + EVP_MAX_BLOCK_LENGTH;
+    size = aBlock.size() + EVP_MAX_BLOCK_LENGTH;
     xuv::ByteBlockType DataOut(size);
     /* Encrypt the application image. */
-    if((res = OsslEncryptAes128Cctr(&DataOut[0], &size, &block[0], block.size(), apKey, apIv, aAddress)) > 0)
+    if((res = OsslEncryptAes128Cctr(&DataOut[0], &size, &aBlock[0], aBlock.size(), apKey, apIv, aAddress)) > 0)
     {
         if(!DataOut.empty())
         {
@@ -1213,6 +1395,7 @@ int XuvImageEncryptAes128Cctr(xuv::image &aXuvImageOut, const xuv::image &aXuvIm
 @param[in]  apInFile        Input XUV image.
 @param[in]  apOutFile       Output XUV image.
 @param[in]  aAddress        Address in the flash device.
+@param[in]  apInput         Input XUV image already read, NULL to read apInFile.
 
 @return Success or error code.
 @retval FXUVIMGENC_SUCCESS          
@@ -1226,11 +1409,10 @@ int XuvImageEncryptAes128Cctr(xuv::image &aXuvImageOut, const xuv::image &aXuvIm
 enum {FXUVIMGENC_SUCCESS = 0, FXUVIMGENC_ERR_READ_KEY, FXUVIMGENC_ERR_READ_IV, FXUVIMGENC_ERR_READ_IMG,
     FXUVIMGENC_ERR_IMG_EMPTY, FXUVIMGENC_ERR_WRITE_IMG, FXUVIMGENC_ERR_ENCRYPT_IMG};
 int FXuvImageEncryptAes128Cctr(const char *apKeyFile, const char *apIvFile,
-    const char *apInFile, const char *apOutFile, unsigned int aAddress)
+    const char *apInFile, const char *apOutFile, unsigned int aAddress, const XuvBlock *apInput)
 {
     int res = FXUVIMGENC_SUCCESS;
     FUNCTION_DEBUG_SENTRY_RET(int, res);
-    xuv::image image;
     xuv::image imgout;
     securlib::Aes128KeyType key = {{0}};
     securlib::Aes128KeyType iv = {{0}};
@@ -1250,30 +1432,27 @@ int FXuvImageEncryptAes128Cctr(const char *apKeyFile, const char *apIvFile,
         }
     }
 
-    /* Read XUV file. */
-    if(!res)
+    /* Read XUV file, unless already read. */
+    XuvBlock input;
+    if(!res && !apInput)
     {
-        if(xuv::READ_OK != xuv::Read(image, apInFile))
+        switch(ReadXuvBlock(input, apInFile))
         {
+        case READXUVBLOCK_ERR_READ_IMG:
             res = FXUVIMGENC_ERR_READ_IMG;
+            break;
+        case READXUVBLOCK_ERR_IMG_EMPTY:
+            res = FXUVIMGENC_ERR_IMG_EMPTY;
+            break;
         }
+        apInput = &input;
     }
     if(!res)
     {
-        if(!image.data.empty())
+        /* Encrypt the image */
+        if(XuvImageEncryptAes128Cctr(imgout, apInput->block, key.key, iv.key, apInput->AddrFirst, aAddress) != 1 || imgout.data.empty())
         {
-            /* Get address of first and last word. Having variables here make it easier to debug. */
-            unsigned int AddrFirst = image.data.begin()->first;
-            unsigned int AddrLast = image.data.rbegin()->first;
-            /* Calculate the CBC-MAC */
-            if(XuvImageEncryptAes128Cctr(imgout, image, key.key, iv.key, AddrFirst, AddrLast, aAddress) != 1 || imgout.data.empty())
-            {
-                res = FXUVIMGENC_ERR_ENCRYPT_IMG;
-            }
-        }
-        else
-        {
-            res = FXUVIMGENC_ERR_IMG_EMPTY;
+            res = FXUVIMGENC_ERR_ENCRYPT_IMG;
         }
     }
 
@@ -1289,6 +1468,43 @@ int FXuvImageEncryptAes128Cctr(const char *apKeyFile, const char *apIvFile,
     return res;
 }
 
+/******************************************************************************
+@brief Convert an XUV image between the text and binary XUV formats.
+This function works on files.
+
+@param[in]  apInFile    Input XUV image, in either format.
+@param[in]  apOutFile   Output XUV image, binary if named with xuv::BINARY_EXTENSION.
+
+@note
+A binary output is stamped with the input, so naming it as the input with
+xuv::BINARY_EXTENSION appended makes it the sidecar of the input.
+*/
+enum {FXUVCONVERT_SUCCESS, FXUVCONVERT_ERR_READ_IMG, FXUVCONVERT_ERR_WRITE_IMG};
+int FXuvConvert(const char *apInFile, const char *apOutFile)
+{
+    int res = FXUVCONVERT_SUCCESS;
+    FUNCTION_DEBUG_SENTRY_RET(int, res);
+
+    /* Read XUV file. */
+    xuv::image image;
+    if(xuv::READ_OK != xuv::Read(image, apInFile))
+    {
+        res = FXUVCONVERT_ERR_READ_IMG;
+    }
+    else if(xuv::IsBinaryFilename(apOutFile))
+    {
+        if(xuv::WRITE_OK != xuv::WriteBinary(image, apOutFile, apInFile))
+        {
+            res = FXUVCONVERT_ERR_WRITE_IMG;
+        }
+    }
+    else if(xuv::WRITE_OK != xuv::Write(image, apOutFile))
+    {
+        res = FXUVCONVERT_ERR_WRITE_IMG;
+    }
+    return res;
+}
+
 /******************************************************************************
 @brief Convert hexadecimal string to BIGNUM and report errors to user.
 @param[in]  aCmdLine    The command line object to use for outputting errors.
@@ -1804,6 +2020,23 @@ int CreateAntiReplayWrappedKeyBundle(const char *apKeyIn, const char *apBundleOu
 
 // ***************************************************************************
 
+int XuvConvertProcessCmd(CCmdLine &cmdline)
+{
+    int res = FXuvConvert(CmdLineParams.InFile.c_str(), CmdLineParams.OutFile.c_str());
+    switch(res)
+    {
+    case FXUVCONVERT_SUCCESS:
+        break;
+    case FXUVCONVERT_ERR_READ_IMG:
+        cmdline.OutputErrorAndFailMessages("Reading XUV file " + CmdLineParams.InFile);
+        break;
+    case FXUVCONVERT_ERR_WRITE_IMG:
+        cmdline.OutputErrorAndFailMessages("Writing XUV file " + CmdLineParams.OutFile);
+        break;
+    }
+    return (FXUVCONVERT_SUCCESS == res) ? EXIT_SUCCESS: EXIT_FAILURE;
+}
+
 int UeProcessCmd(CCmdLine &cmdline)
 {
     int res = EXIT_SUCCESS;
@@ -1860,6 +2093,9 @@ int UeProcessCmd(CCmdLine &cmdline)
             res = (FSECUREAPPSTOREIMG_SUCCESS == res) ? EXIT_SUCCESS: EXIT_FAILURE;
         }
         break;
+    case OP_XUVCONVERT:
+        res = XuvConvertProcessCmd(cmdline);
+        break;
     default:
         /* Should not arrive here unless there a programming error. */
         cmdline.OutputErrorAndFailMessages("Unexpected operation error");
@@ -1868,30 +2104,20 @@ int UeProcessCmd(CCmdLine &cmdline)
     return res;
 }
 
-int HydProcessCmd(CCmdLine &cmdline)
+/******************************************************************************
+@brief Process a command on an XUV image.
+
+@param[in]  cmdline     The command line object to use for outputting errors.
+@param[in]  apInput     Input XUV image already read, NULL to read the input file.
+*/
+int HydProcessXuvCmd(CCmdLine &cmdline, const XuvBlock *apInput)
 {
     int res = EXIT_SUCCESS;
     FUNCTION_DEBUG_SENTRY_RET(int, res);
-    if(CmdLineParams.endian == EN_DEFAULT)
-    {
-        const char *pEndian = getenv(ENV_SECURITYCMD_XUVE); /* XUV endianness L or B */
-        gXuvBe = !(pEndian && strlen(pEndian) == 1 && tolower(pEndian[0]) =='l');
-    }
-    else
-    {
-        gXuvBe = (CmdLineParams.endian != EN_U16LE);
-    }
-    if(!cmdline.IsQuiet() &&
-        OP_PEMTODFUKEY != CmdLineParams.Command && OP_KEYGEN_UNLOCK != CmdLineParams.Command &&
-        OP_WRAP_KEY != CmdLineParams.Command && OP_WRAP_KEY_AR != CmdLineParams.Command &&
-        OP_KEYGEN_RSA != CmdLineParams.Command && OP_SCRAMBLEASPK != CmdLineParams.Command)
-    {   /* only applicable to XUV files */
-        printf("U16%s endian mode (for XUV files)\n", gXuvBe? "BE": "LE");
-    }
     switch (CmdLineParams.Command)
     {
     case OP_HASH:
-        switch((res = FXuvImageHashSha256(CmdLineParams.InFile.c_str(), CmdLineParams.OutFile.c_str())))
+        switch((res = FXuvImageHashSha256(CmdLineParams.InFile.c_str(), CmdLineParams.OutFile.c_str(), apInput)))
         {
         case FXUVIMGHASH_SUCCESS:
             break;
@@ -1910,7 +2136,7 @@ int HydProcessCmd(CCmdLine &cmdline)
 
     case OP_SIGN:
         res = FXuvImageSignRsaPss(CmdLineParams.SignKeyFile.c_str(), CmdLineParams.InFile.c_str(),
-            CmdLineParams.OutFile.c_str());
+            CmdLineParams.OutFile.c_str(), apInput);
         switch(res)
         {
         case FXUVIMGSIGN_SUCCESS:
@@ -1936,7 +2162,7 @@ int HydProcessCmd(CCmdLine &cmdline)
 
     case OP_CBCMAC:
         res = FXuvImageCreateCbcMac(EVP_aes_128_cbc(), CmdLineParams.EncrKeyFile.c_str(),
-            CmdLineParams.InFile.c_str(), CmdLineParams.OutFile.c_str(), 0);
+            CmdLineParams.InFile.c_str(), CmdLineParams.OutFile.c_str(), 0, apInput);
         switch(res)
         {
         case FXUVIMGCBCMAC_SUCCESS:
@@ -1975,7 +2201,8 @@ int HydProcessCmd(CCmdLine &cmdline)
     case OP_ENCRYPT:
         res = FXuvImageEncryptAes128Cctr(CmdLineParams.EncrKeyFile.c_str(),
             CmdLineParams.SignKeyFile.c_str(),
-            CmdLineParams.InFile.c_str(), CmdLineParams.OutFile.c_str(), (unsigned int)CmdLineParams.U64Address);
+            CmdLineParams.InFile.c_str(), CmdLineParams.OutFile.c_str(), (unsigned int)CmdLineParams.U64Address,
+            apInput);
         switch(res)
         {
         case FXUVIMGENC_SUCCESS:
@@ -2011,6 +2238,88 @@ int HydProcessCmd(CCmdLine &cmdline)
         res = (FXUVIMGENC_SUCCESS == res) ? EXIT_SUCCESS: EXIT_FAILURE;
         break;
 
+    default:
+        /* Should not arrive here unless there a programming error. */
+        cmdline.OutputErrorAndFailMessages("Unexpected operation error");
+        res = EXIT_FAILURE;
+        break;
+    }
+    return res;
+}
+
+/******************************************************************************
+@brief Process the pipeline command, reading the input XUV image once.
+
+Each stage runs as its command would on its own, on the same image. The
+pipeline stops at the first stage that fails.
+*/
+int HydProcessPipeline(CCmdLine &cmdline)
+{
+    int res = EXIT_SUCCESS;
+    FUNCTION_DEBUG_SENTRY_RET(int, res);
+
+    XuvBlock input;
+    switch(ReadXuvBlock(input, CmdLineParams.InFile.c_str()))
+    {
+    case READXUVBLOCK_SUCCESS:
+        break;
+    case READXUVBLOCK_ERR_READ_IMG:
+        cmdline.OutputErrorAndFailMessages("Reading XUV file " + CmdLineParams.InFile);
+        res = EXIT_FAILURE;
+        break;
+    case READXUVBLOCK_ERR_IMG_EMPTY:
+        cmdline.OutputErrorAndFailMessages("No data in XUV file " + CmdLineParams.InFile);
+        res = EXIT_FAILURE;
+        break;
+    }
+
+    for(std::vector<PipelineStage>::const_iterator stage = CmdLineParams.Pipeline.begin();
+        EXIT_SUCCESS == res && stage != CmdLineParams.Pipeline.end(); ++stage)
+    {
+        CmdLineParams.Command = stage->Command;
+        CmdLineParams.OutFile = stage->OutFile;
+        CmdLineParams.SignKeyFile = stage->SignKeyFile;
+        CmdLineParams.EncrKeyFile = stage->EncrKeyFile;
+        CmdLineParams.U64Address = stage->U64Address;
+        res = HydProcessXuvCmd(cmdline, &input);
+    }
+    return res;
+}
+
+int HydProcessCmd(CCmdLine &cmdline)
+{
+    int res = EXIT_SUCCESS;
+    FUNCTION_DEBUG_SENTRY_RET(int, res);
+    if(CmdLineParams.endian == EN_DEFAULT)
+    {
+        const char *pEndian = getenv(ENV_SECURITYCMD_XUVE); /* XUV endianness L or B */
+        gXuvBe = !(pEndian && strlen(pEndian) == 1 && tolower(pEndian[0]) =='l');
+    }
+    else
+    {
+        gXuvBe = (CmdLineParams.endian != EN_U16LE);
+    }
+    if(!cmdline.IsQuiet() &&
+        OP_PEMTODFUKEY != CmdLineParams.Command && OP_KEYGEN_UNLOCK != CmdLineParams.Command &&
+        OP_WRAP_KEY != CmdLineParams.Command && OP_WRAP_KEY_AR != CmdLineParams.Command &&
+        OP_KEYGEN_RSA != CmdLineParams.Command && OP_SCRAMBLEASPK != CmdLineParams.Command &&
+        OP_XUVCONVERT != CmdLineParams.Command)
+    {   /* only applicable to XUV files, other than converting them */
+        printf("U16%s endian mode (for XUV files)\n", gXuvBe? "BE": "LE");
+    }
+    switch (CmdLineParams.Command)
+    {
+    case OP_HASH:
+    case OP_SIGN:
+    case OP_CBCMAC:
+    case OP_ENCRYPT:
+        res = HydProcessXuvCmd(cmdline, NULL);
+        break;
+
+    case OP_PIPELINE:
+        res = HydProcessPipeline(cmdline);
+        break;
+
     case OP_KEYGEN_RSA:
         if(OsslRsaGenKeyPairFiles(CmdLineParams.KeySize, CmdLineParams.PubExp,
             CmdLineParams.PrvKeyFile.c_str(), CmdLineParams.PubKeyFile.c_str()) < 1)
@@ -2162,6 +2471,10 @@ int HydProcessCmd(CCmdLine &cmdline)
         res = (KEYBUNDLEAR_SUCCESS == res) ? EXIT_SUCCESS : EXIT_FAILURE;
         break;
 
+    case OP_XUVCONVERT:
+        res = XuvConvertProcessCmd(cmdline);
+        break;
+
     default:
         /* Should not arrive here unless there a programming error. */
         cmdline.OutputErrorAndFailMessages("Unexpected operation error");
@@ -2205,6 +2518,10 @@ int main(int argc, char** argv)
     }
     else
     {
+        /* Write binary sidecars of output XUV files for later commands */
+        const char *pSidecar = getenv(ENV_SECURITYCMD_XUVB);
+        xuv::SetWriteSidecar(pSidecar && strlen(pSidecar) == 1 && pSidecar[0] == '1');
+
         switch(CmdLineParams.product)
         {
         case PR_UE:
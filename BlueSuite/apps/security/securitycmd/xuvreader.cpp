@@ -20,15 +20,886 @@
  *  read. If data is deleted then the comments at the same address will not be
  *  output.
  *
+ *  The image may also be held in a binary xuv file, read without parsing
+ *  text. A binary file named as a xuv file with ".xuvb" appended is a sidecar,
+ *  read in its place while it is stamped with the size and modification time
+ *  of the xuv file, so chained operations parse the text only once.
+ *
  ******************************************************************************/
 
+#include <algorithm>
+#include <ctype.h>
 #include <fstream>
 #include <sstream>
+#include <string.h>
 #include "xuvreader.h"
 
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
 namespace xuv
 {
 
+namespace
+{
+    /* Value of each character as a hex digit, -1 if it is not one. */
+    const signed char HEX_DIGIT_VALUES[256] =
+    {
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+         0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+        -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+    };
+
+    /* Whether words are held most significant byte first */
+    inline bool IsHostBigEndian()
+    {
+        const WordType one = 1;
+        return 0 == *reinterpret_cast<const unsigned char *>(&one);
+    }
+
+    /* Copy aCount words from apSrc to apDest swapping the bytes of each */
+    inline void SwapWordBytes(void *apDest, const void *apSrc, size_t aCount)
+    {
+        unsigned char *pDest = static_cast<unsigned char *>(apDest);
+        const unsigned char *pSrc = static_cast<const unsigned char *>(apSrc);
+        for(size_t i = 0; i < aCount; ++i, pDest += 2, pSrc += 2)
+        {
+            pDest[0] = pSrc[1];
+            pDest[1] = pSrc[0];
+        }
+    }
+
+    /* Orders an address before the segments starting after it */
+    inline bool BaseIsAfter(AddrType aAddr, const ImageData::Segment &aSegment)
+    {
+        return aAddr < aSegment.base;
+    }
+
+    /* Most hex digits in an address or value, more must be leading zeros. */
+    const int MAX_HEX_DIGITS = 8;
+
+    inline bool IsBlank(char aChar)
+    {
+        return ' ' == aChar || '\t' == aChar;
+    }
+
+    /* Whitespace as skipped by the stream parser in the "C" locale. */
+    inline bool IsSpace(char aChar)
+    {
+        return IsBlank(aChar) || ('\n' <= aChar && aChar <= '\r');
+    }
+
+    /*****************************************************************
+    @brief Read a hex number of up to MAX_HEX_DIGITS digits.
+
+    @param[in out] apPos    Position in the line, moved past the digits.
+    @param[in] apEnd        End of the line.
+    @param[out] aValue      to receive the number.
+
+    @returns true if there were between 1 and MAX_HEX_DIGITS digits.
+    */
+    inline bool ParseHex(const char *&apPos, const char *apEnd, unsigned int &aValue)
+    {
+        const char *first = apPos;
+        unsigned int value = 0;
+        int digit;
+        while(apPos < apEnd && (digit = HEX_DIGIT_VALUES[static_cast<unsigned char>(*apPos)]) >= 0)
+        {
+            value = (value << 4) | static_cast<unsigned int>(digit);
+            ++apPos;
+        }
+        aValue = value;
+        return apPos != first && apPos - first <= MAX_HEX_DIGITS;
+    }
+
+    /*****************************************************************
+    @brief Extract address and value from a line of xuv held in memory.
+
+    Lines in the usual form, "@AAAAAA   DDDD" with any blanks around, are
+    parsed directly. Any other line starting with @ is passed to ParseXuvLine,
+    so the rarer forms it accepts and its errors are unchanged.
+
+    @param[in] apLine       Start of the line.
+    @param[in] apEnd        End of the line, excluding the newline.
+    @param[out] aAddress    to receive first value in line.
+    @param[out] aValue      to receive second value in line.
+
+    @returns As ParseXuvLine.
+    */
+    ParseXuvLineStatus ParseXuvRecord(const char *apLine, const char *apEnd, AddrType &aAddress, DataType &aValue)
+    {
+        const char *p = apLine;
+        while(p < apEnd && IsSpace(*p))
+        {
+            ++p;
+        }
+        if(p == apEnd || '@' != *p)
+        {
+            return PARSE_COMMENT;
+        }
+        ++p;
+
+        if(ParseHex(p, apEnd, aAddress) && p < apEnd && IsBlank(*p))
+        {
+            while(p < apEnd && IsBlank(*p))
+            {
+                ++p;
+            }
+            if(ParseHex(p, apEnd, aValue))
+            {
+                while(p < apEnd && IsSpace(*p))
+                {
+                    ++p;
+                }
+                if(p == apEnd)
+                {
+                    return PARSE_OK;
+                }
+            }
+        }
+        return ParseXuvLine(std::string(apLine, apEnd), aAddress, aValue);
+    }
+
+    /* Upper case hex digits of each byte value, two per byte */
+    const char HEX_BYTE_DIGITS[] =
+        "000102030405060708090A0B0C0D0E0F"
+        "101112131415161718191A1B1C1D1E1F"
+        "202122232425262728292A2B2C2D2E2F"
+        "303132333435363738393A3B3C3D3E3F"
+        "404142434445464748494A4B4C4D4E4F"
+        "505152535455565758595A5B5C5D5E5F"
+        "606162636465666768696A6B6C6D6E6F"
+        "707172737475767778797A7B7C7D7E7F"
+        "808182838485868788898A8B8C8D8E8F"
+        "909192939495969798999A9B9C9D9E9F"
+        "A0A1A2A3A4A5A6A7A8A9AAABACADAEAF"
+        "B0B1B2B3B4B5B6B7B8B9BABBBCBDBEBF"
+        "C0C1C2C3C4C5C6C7C8C9CACBCCCDCECF"
+        "D0D1D2D3D4D5D6D7D8D9DADBDCDDDEDF"
+        "E0E1E2E3E4E5E6E7E8E9EAEBECEDEEEF"
+        "F0F1F2F3F4F5F6F7F8F9FAFBFCFDFEFF";
+
+    /* Longest data line written, '@', address, blanks, value and newline */
+    const size_t MAX_RECORD_LENGTH = 1 + MAX_HEX_DIGITS + 3 + MAX_HEX_DIGITS + 1;
+
+    /* Size of the buffer lines are formatted into before writing */
+    const size_t WRITE_BUFFER_SIZE = 1024 * 1024;
+
+    /*****************************************************************
+    @brief Format a number in upper case hex, as printf "%0*X".
+
+    @param[out] apPos       Where to write the digits.
+    @param[in] aValue       The number.
+    @param[in] aMinDigits   Least number of digits, padded with leading zeros.
+
+    @returns Position after the digits.
+    */
+    inline char *FormatHex(char *apPos, unsigned int aValue, int aMinDigits)
+    {
+        int digits = aMinDigits;
+        while(digits < MAX_HEX_DIGITS && (aValue >> (4 * digits)))
+        {
+            ++digits;
+        }
+        char *pEnd = apPos + digits;
+        char *p = pEnd;
+        for(; p - apPos >= 2; aValue >>= 8)
+        {
+            p -= 2;
+            memcpy(p, &HEX_BYTE_DIGITS[2 * (aValue & 0xFF)], 2);
+        }
+        if(p != apPos)
+        {
+            *apPos = HEX_BYTE_DIGITS[2 * (aValue & 0xF) + 1];
+        }
+        return pEnd;
+    }
+
+    /*****************************************************************
+    @brief Buffered writes to a file, passed on to it in large blocks.
+    */
+    class BufferedWriter
+    {
+    public:
+        explicit BufferedWriter(FILE *apFile)
+            : mpFile(apFile), mBuffer(WRITE_BUFFER_SIZE), mUsed(0), mFailed(false)
+        {
+        }
+
+        /* Space for at least aLength characters, to be followed by Commit */
+        char *Reserve(size_t aLength)
+        {
+            if(mBuffer.size() - mUsed < aLength)
+            {
+                Flush();
+            }
+            return &mBuffer[mUsed];
+        }
+
+        /* Keep the characters written from Reserve up to apEnd */
+        void Commit(const char *apEnd)
+        {
+            mUsed = apEnd - &mBuffer[0];
+        }
+
+        void Append(const char *apData, size_t aLength)
+        {
+            if(mBuffer.size() - mUsed < aLength)
+            {
+                Flush();
+                if(mBuffer.size() < aLength)
+                {
+                    WriteFile(apData, aLength);
+                    return;
+                }
+            }
+            memcpy(&mBuffer[mUsed], apData, aLength);
+            mUsed += aLength;
+        }
+
+        /* Write out the buffer, returns false if any write failed */
+        bool Flush()
+        {
+            if(mUsed)
+            {
+                WriteFile(&mBuffer[0], mUsed);
+                mUsed = 0;
+            }
+            return !mFailed;
+        }
+
+    private:
+        void WriteFile(const char *apData, size_t aLength)
+        {
+            if(fwrite(apData, 1, aLength, mpFile) != aLength)
+            {
+                mFailed = true;
+            }
+        }
+
+        FILE *mpFile;
+        std::vector<char> mBuffer;
+        size_t mUsed;
+        bool mFailed;
+    };
+
+    /* Append a comment as printf "%s" would, up to any null character */
+    inline void AppendComment(BufferedWriter &aWriter, const std::string &aComment)
+    {
+        aWriter.Append(aComment.c_str(), strlen(aComment.c_str()));
+    }
+
+    /*****************************************************************
+    @brief Read only mapping of a file into memory.
+    */
+    class MappedFile
+    {
+    public:
+        MappedFile() : mpData(NULL), mSize(0)
+#ifdef _WIN32
+            , mFile(INVALID_HANDLE_VALUE), mMapping(NULL)
+#endif
+        {
+        }
+
+        ~MappedFile()
+        {
+#ifdef _WIN32
+            if(mpData)
+            {
+                UnmapViewOfFile(mpData);
+            }
+            if(mMapping)
+            {
+                CloseHandle(mMapping);
+            }
+            if(INVALID_HANDLE_VALUE != mFile)
+            {
+                CloseHandle(mFile);
+            }
+#else
+            if(mpData)
+            {
+                munmap(const_cast<char *>(mpData), mSize);
+            }
+#endif
+        }
+
+        /*****************************************************************
+        @brief Map a file. An empty file is mapped as no data.
+
+        @param[in] aFilename    Filename of the file.
+
+        @returns false if the file could not be opened or mapped.
+        */
+        bool Open(const char *aFilename)
+        {
+            bool result = false;
+#ifdef _WIN32
+            mFile = CreateFileA(aFilename, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+            LARGE_INTEGER size;
+            if(INVALID_HANDLE_VALUE != mFile && GetFileSizeEx(mFile, &size))
+            {
+                mSize = static_cast<size_t>(size.QuadPart);
+                if(0 == mSize)
+                {
+                    result = true;
+                }
+                else if(NULL != (mMapping = CreateFileMapping(mFile, NULL, PAGE_READONLY, 0, 0, NULL)))
+                {
+                    mpData = static_cast<const char *>(MapViewOfFile(mMapping, FILE_MAP_READ, 0, 0, 0));
+                    result = (NULL != mpData);
+                }
+            }
+#else
+            int fd = open(aFilename, O_RDONLY);
+            struct stat fileStat;
+            if(-1 != fd && 0 == fstat(fd, &fileStat))
+            {
+                mSize = static_cast<size_t>(fileStat.st_size);
+                if(0 == mSize)
+                {
+                    result = true;
+                }
+                else
+                {
+                    void *pMap = mmap(NULL, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+                    if(MAP_FAILED != pMap)
+                    {
+                        madvise(pMap, mSize, MADV_SEQUENTIAL);
+                        mpData = static_cast<const char *>(pMap);
+                        result = true;
+                    }
+                }
+            }
+            /* The mapping remains valid once the descriptor is closed */
+            if(-1 != fd)
+            {
+                close(fd);
+            }
+#endif
+            return result;
+        }
+
+        const char *Data() const { return mpData; }
+        size_t Size() const { return mSize; }
+
+    private:
+        MappedFile(const MappedFile &);
+        MappedFile &operator=(const MappedFile &);
+
+        const char *mpData;
+        size_t mSize;
+#ifdef _WIN32
+        HANDLE mFile;
+        HANDLE mMapping;
+#endif
+    };
+
+    /*
+    Binary xuv file layout. All numbers are little endian.
+
+    Header of BINARY_HEADER_SIZE bytes:
+        BINARY_MAGIC, version, flags, number of segments, number of wide
+        values, number of comments and length of the tail comment (32 bits
+        each), then the number of words, and the size and modification time
+        of the xuv file the file was made from (64 bits each).
+    Followed by:
+        the segment table, the base address and number of words of each,
+        the wide value table, the address and value of each,
+        the comment table, the address and length of each (all 32 bits),
+        the words of each segment in turn (16 bits each),
+        the text of each comment in turn, then the tail comment.
+    */
+
+    /* Start of a binary xuv file, which xuv text never starts with */
+    const char BINARY_MAGIC[8] = {'\x89', 'X', 'U', 'V', '\r', '\n', '\x1A', '\n'};
+    const unsigned int BINARY_VERSION = 1;
+    /* Set when the file is stamped with the xuv file it was made from */
+    const unsigned int BINARY_FLAG_STAMPED = 0x1;
+
+    /* Offsets of the header fields */
+    const size_t BINARY_VERSION_OFFSET = 8;
+    const size_t BINARY_FLAGS_OFFSET = 12;
+    const size_t BINARY_SEGMENTS_OFFSET = 16;
+    const size_t BINARY_WIDE_OFFSET = 20;
+    const size_t BINARY_COMMENTS_OFFSET = 24;
+    const size_t BINARY_TAIL_OFFSET = 28;
+    const size_t BINARY_WORDS_OFFSET = 32;
+    const size_t BINARY_SOURCE_SIZE_OFFSET = 40;
+    const size_t BINARY_SOURCE_TIME_OFFSET = 48;
+    const size_t BINARY_HEADER_SIZE = 56;
+
+    /* Size of an entry of the segment, wide value and comment tables */
+    const size_t BINARY_ENTRY_SIZE = 8;
+
+    /* Whether a sidecar is written alongside each xuv file written */
+    bool gWriteSidecar = false;
+
+    inline unsigned long long GetLittleEndian(const unsigned char *apSrc, int aBytes)
+    {
+        unsigned long long value = 0;
+        while(aBytes--)
+        {
+            value = (value << 8) | apSrc[aBytes];
+        }
+        return value;
+    }
+
+    inline void PutLittleEndian(unsigned char *apDest, unsigned long long aValue, int aBytes)
+    {
+        for(int i = 0; i < aBytes; ++i, aValue >>= 8)
+        {
+            apDest[i] = static_cast<unsigned char>(aValue);
+        }
+    }
+
+    /* An entry of the segment, wide value or comment tables */
+    inline void AppendEntry(BufferedWriter &aWriter, unsigned long long aFirst, unsigned long long aSecond)
+    {
+        unsigned char entry[BINARY_ENTRY_SIZE];
+        PutLittleEndian(entry, aFirst, 4);
+        PutLittleEndian(entry + 4, aSecond, 4);
+        aWriter.Append(reinterpret_cast<const char *>(entry), sizeof entry);
+    }
+
+    /* Size and modification time of a file, as held by a sidecar */
+    struct FileStamp
+    {
+        unsigned long long size;
+        unsigned long long time;
+    };
+
+    /*****************************************************************
+    @brief Get the size and modification time of a file.
+
+    @param[in] aFilename    Filename of the file.
+    @param[out] aStamp      to receive the size and time.
+
+    @returns false if the file could not be found.
+    */
+    bool GetFileStamp(const char *aFilename, FileStamp &aStamp)
+    {
+#ifdef _WIN32
+        WIN32_FILE_ATTRIBUTE_DATA attributes;
+        if(!GetFileAttributesExA(aFilename, GetFileExInfoStandard, &attributes))
+        {
+            return false;
+        }
+        aStamp.size = (static_cast<unsigned long long>(attributes.nFileSizeHigh) << 32) | attributes.nFileSizeLow;
+        aStamp.time = (static_cast<unsigned long long>(attributes.ftLastWriteTime.dwHighDateTime) << 32)
+                      | attributes.ftLastWriteTime.dwLowDateTime;
+#else
+        struct stat fileStat;
+        if(0 != stat(aFilename, &fileStat))
+        {
+            return false;
+        }
+        aStamp.size = static_cast<unsigned long long>(fileStat.st_size);
+        aStamp.time = static_cast<unsigned long long>(fileStat.st_mtim.tv_sec) * 1000000000ULL
+                      + static_cast<unsigned long long>(fileStat.st_mtim.tv_nsec);
+#endif
+        return true;
+    }
+
+    /*****************************************************************
+    @brief Read a binary xuv file held in memory.
+
+    @param[out] aXuv        image struct containing xuv image
+    @param[in] apData       The file contents.
+    @param[in] aSize        Size of the file.
+    @param[in] apSource     Stamp the file must carry, NULL to accept any.
+
+    @returns
+        READ_SYNTAX     Not a valid binary xuv file, or not stamped with apSource.
+        READ_OK         File read successfully.
+    */
+    ReadStatus ParseBinary(image &aXuv, const char *apData, size_t aSize, const FileStamp *apSource)
+    {
+        /* Ensure aXuv is empty*/
+        aXuv.data.clear();
+        aXuv.comments.clear();
+        aXuv.TailComment.clear();
+
+        const unsigned char *pHeader = reinterpret_cast<const unsigned char *>(apData);
+        if(aSize < BINARY_HEADER_SIZE || memcmp(pHeader, BINARY_MAGIC, sizeof BINARY_MAGIC)
+           || BINARY_VERSION != GetLittleEndian(pHeader + BINARY_VERSION_OFFSET, 4))
+        {
+            return READ_SYNTAX;
+        }
+        if(apSource && !((GetLittleEndian(pHeader + BINARY_FLAGS_OFFSET, 4) & BINARY_FLAG_STAMPED)
+                         && apSource->size == GetLittleEndian(pHeader + BINARY_SOURCE_SIZE_OFFSET, 8)
+                         && apSource->time == GetLittleEndian(pHeader + BINARY_SOURCE_TIME_OFFSET, 8)))
+        {
+            return READ_SYNTAX;
+        }
+        const unsigned long long segmentCount = GetLittleEndian(pHeader + BINARY_SEGMENTS_OFFSET, 4);
+        const unsigned long long wideCount = GetLittleEndian(pHeader + BINARY_WIDE_OFFSET, 4);
+        const unsigned long long commentCount = GetLittleEndian(pHeader + BINARY_COMMENTS_OFFSET, 4);
+        const unsigned long long tailLength = GetLittleEndian(pHeader + BINARY_TAIL_OFFSET, 4);
+        const unsigned long long wordCount = GetLittleEndian(pHeader + BINARY_WORDS_OFFSET, 8);
+
+        /* The tables, words and text must fill the file exactly */
+        const unsigned long long available = aSize - BINARY_HEADER_SIZE;
+        const unsigned long long tableSize = BINARY_ENTRY_SIZE * (segmentCount + wideCount + commentCount);
+        if(tableSize > available || wordCount > (available - tableSize) / 2)
+        {
+            return READ_SYNTAX;
+        }
+        const unsigned char *pSegment = pHeader + BINARY_HEADER_SIZE;
+        const unsigned char *pWide = pSegment + BINARY_ENTRY_SIZE * segmentCount;
+        const unsigned char *pComment = pWide + BINARY_ENTRY_SIZE * wideCount;
+        const char *pWords = apData + BINARY_HEADER_SIZE + tableSize;
+        const char *pText = pWords + 2 * wordCount;
+        unsigned long long textLength = tailLength;
+        for(unsigned long long i = 0; i < commentCount; ++i)
+        {
+            textLength += GetLittleEndian(pComment + BINARY_ENTRY_SIZE * i + 4, 4);
+        }
+        if(textLength != available - tableSize - 2 * wordCount)
+        {
+            return READ_SYNTAX;
+        }
+
+        /* Segments must be in address order and apart, as ImageData holds them */
+        std::vector<WordType> words;
+        unsigned long long wordsLeft = wordCount;
+        unsigned long long next = 0;
+        for(unsigned long long i = 0; i < segmentCount; ++i, pSegment += BINARY_ENTRY_SIZE)
+        {
+            const unsigned long long base = GetLittleEndian(pSegment, 4);
+            const unsigned long long count = GetLittleEndian(pSegment + 4, 4);
+            if(!count || count > wordsLeft || base < next || base + count > 0x100000000ULL)
+            {
+                return READ_SYNTAX;
+            }
+            const WordType *pSegmentWords = reinterpret_cast<const WordType *>(pWords);
+            if(IsHostBigEndian() || reinterpret_cast<size_t>(pWords) % sizeof(WordType))
+            {
+                words.resize(static_cast<size_t>(count));
+                if(IsHostBigEndian())
+                {
+                    SwapWordBytes(&words[0], pWords, static_cast<size_t>(count));
+                }
+                else
+                {
+                    memcpy(&words[0], pWords, static_cast<size_t>(2 * count));
+                }
+                pSegmentWords = &words[0];
+            }
+            aXuv.data.SetWords(static_cast<AddrType>(base), pSegmentWords, static_cast<size_t>(count));
+            pWords += 2 * count;
+            wordsLeft -= count;
+            next = base + count + 1;
+        }
+        if(wordsLeft)
+        {
+            return READ_SYNTAX;
+        }
+
+        for(unsigned long long i = 0; i < wideCount; ++i, pWide += BINARY_ENTRY_SIZE)
+        {
+            const AddrType addr = static_cast<AddrType>(GetLittleEndian(pWide, 4));
+            const DataType value = static_cast<DataType>(GetLittleEndian(pWide + 4, 4));
+            if(value <= 0xFFFF || !aXuv.data.count(addr) || aXuv.data.Get(addr) > 0xFFFF)
+            {
+                return READ_SYNTAX;
+            }
+            aXuv.data.Set(addr, value);
+        }
+
+        for(unsigned long long i = 0; i < commentCount; ++i, pComment += BINARY_ENTRY_SIZE)
+        {
+            const AddrType addr = static_cast<AddrType>(GetLittleEndian(pComment, 4));
+            const size_t length = static_cast<size_t>(GetLittleEndian(pComment + 4, 4));
+            if(!aXuv.comments.empty() && addr <= aXuv.comments.rbegin()->first)
+            {
+                return READ_SYNTAX;
+            }
+            aXuv.comments.insert(aXuv.comments.end(), std::make_pair(addr, std::string(pText, length)));
+            pText += length;
+        }
+        aXuv.TailComment.assign(pText, static_cast<size_t>(tailLength));
+        return READ_OK;
+    }
+} /* namespace */
+
+/*****************************************************************
+@brief Move to the pair at a position.
+
+@param[in] apData       The data iterated.
+@param[in] aSegment     Index of the segment, the number of segments for end.
+@param[in] aOffset      Offset of the word in the segment.
+*/
+ImageData::const_iterator::const_iterator(const ImageData *apData, size_t aSegment, size_t aOffset)
+    : mpData(apData), mSegment(aSegment), mOffset(aOffset)
+{
+    Load();
+}
+
+ImageData::const_iterator &ImageData::const_iterator::operator++()
+{
+    if(++mOffset == mpData->mSegments[mSegment].words.size())
+    {
+        ++mSegment;
+        mOffset = 0;
+    }
+    Load();
+    return *this;
+}
+
+/* Decrementing the first pair leaves it unchanged, as used for rend() */
+ImageData::const_iterator &ImageData::const_iterator::operator--()
+{
+    if(mOffset)
+    {
+        --mOffset;
+    }
+    else if(mSegment)
+    {
+        --mSegment;
+        mOffset = mpData->mSegments[mSegment].words.size() - 1;
+    }
+    Load();
+    return *this;
+}
+
+/*****************************************************************
+@brief Fetch the pair at the current position, unless at the end.
+*/
+void ImageData::const_iterator::Load()
+{
+    if(mSegment < mpData->mSegments.size())
+    {
+        const Segment &segment = mpData->mSegments[mSegment];
+        mValue.first = segment.base + static_cast<AddrType>(mOffset);
+        mValue.second = mpData->WordValue(segment, mOffset);
+    }
+}
+
+void ImageData::clear()
+{
+    mSegments.clear();
+    mWide.clear();
+    mSize = 0;
+}
+
+ImageData::const_iterator ImageData::find(AddrType aAddr) const
+{
+    const Segment *pSegment = FindSegment(aAddr);
+    if(!pSegment)
+    {
+        return end();
+    }
+    return const_iterator(this, pSegment - &mSegments.front(), aAddr - pSegment->base);
+}
+
+ImageData::const_reverse_iterator ImageData::rend() const
+{
+    return const_reverse_iterator(begin());
+}
+
+ImageData::Reference ImageData::operator[](AddrType aAddr)
+{
+    if(!FindSegment(aAddr))
+    {
+        Set(aAddr, 0);
+    }
+    return Reference(*this, aAddr);
+}
+
+bool ImageData::operator==(const ImageData &aOther) const
+{
+    if(mSize != aOther.mSize || mWide != aOther.mWide || mSegments.size() != aOther.mSegments.size())
+    {
+        return false;
+    }
+    for(size_t i = 0; i < mSegments.size(); ++i)
+    {
+        if(mSegments[i].base != aOther.mSegments[i].base || mSegments[i].words != aOther.mSegments[i].words)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+DataType ImageData::Get(AddrType aAddr) const
+{
+    const Segment *pSegment = FindSegment(aAddr);
+    return pSegment ? WordValue(*pSegment, aAddr - pSegment->base) : 0;
+}
+
+/*****************************************************************
+@brief Set the value at an address.
+
+Writes within a segment, or appending to the segment before, are done in
+place. Anything else, such as a word joining two segments, is done by SetWords.
+
+@param[in] aAddr        Address of the value.
+@param[in] aValue       The value.
+*/
+void ImageData::Set(AddrType aAddr, DataType aValue)
+{
+    const WordType word = static_cast<WordType>(aValue);
+    SegmentList::iterator next = mSegments.end();
+    /* Addresses are usually written in order, so try the last segment first */
+    if(mSegments.empty() || aAddr < mSegments.back().base)
+    {
+        next = std::upper_bound(mSegments.begin(), mSegments.end(), aAddr, BaseIsAfter);
+    }
+    Segment *pSegment = (next == mSegments.begin()) ? NULL : &*(next - 1);
+    const size_t offset = pSegment ? aAddr - pSegment->base : 0;
+
+    if(pSegment && offset < pSegment->words.size())
+    {
+        pSegment->words[offset] = word;
+    }
+    else if(pSegment && offset == pSegment->words.size()
+            && (next == mSegments.end() || next->base != aAddr + 1))
+    {
+        pSegment->words.push_back(word);
+        ++mSize;
+    }
+    else
+    {
+        SetWords(aAddr, &word, 1);
+    }
+
+    if(aValue > 0xFFFF)
+    {
+        mWide[aAddr] = aValue;
+    }
+    else if(!mWide.empty())
+    {
+        mWide.erase(aAddr);
+    }
+}
+
+/*****************************************************************
+@brief Set consecutive words, joining them to any segments they overlap or touch.
+
+@param[in] aDest        Address of the first word.
+@param[in] apWords      The words.
+@param[in] aCount       Number of words.
+*/
+void ImageData::SetWords(AddrType aDest, const WordType *apWords, size_t aCount)
+{
+    if(!aCount)
+    {
+        return;
+    }
+    /* End addresses may be one past the largest address */
+    typedef unsigned long long EndType;
+    const EndType dest = aDest;
+    const EndType destEnd = dest + aCount;
+
+    /* Segments from first up to stop overlap or touch the words */
+    SegmentList::iterator first = std::upper_bound(mSegments.begin(), mSegments.end(), aDest, BaseIsAfter);
+    if(first != mSegments.begin() && (first - 1)->base + static_cast<EndType>((first - 1)->words.size()) >= dest)
+    {
+        --first;
+    }
+    SegmentList::iterator stop = first;
+    while(stop != mSegments.end() && stop->base <= destEnd)
+    {
+        ++stop;
+    }
+
+    if(first == stop)
+    {
+        /* Filled in place, so the words are copied only once */
+        SegmentList::iterator segment = mSegments.insert(first, Segment());
+        segment->base = aDest;
+        segment->words.assign(apWords, apWords + aCount);
+        mSize += aCount;
+    }
+    else
+    {
+        /* Merge into the first segment, which may need to start earlier */
+        const EndType base = std::min(static_cast<EndType>(first->base), dest);
+        const EndType end = std::max((stop - 1)->base + static_cast<EndType>((stop - 1)->words.size()), destEnd);
+        for(SegmentList::iterator it = first; it != stop; ++it)
+        {
+            mSize -= it->words.size();
+        }
+        if(first->base != base)
+        {
+            std::vector<WordType> words(static_cast<size_t>(end - base));
+            std::copy(first->words.begin(), first->words.end(), words.begin() + static_cast<size_t>(first->base - base));
+            first->words.swap(words);
+            first->base = aDest;
+        }
+        else
+        {
+            first->words.resize(static_cast<size_t>(end - base));
+        }
+        for(SegmentList::iterator it = first + 1; it != stop; ++it)
+        {
+            std::copy(it->words.begin(), it->words.end(), first->words.begin() + static_cast<size_t>(it->base - base));
+        }
+        std::copy(apWords, apWords + aCount, first->words.begin() + static_cast<size_t>(dest - base));
+        mSize += first->words.size();
+        mSegments.erase(first + 1, stop);
+    }
+
+    if(!mWide.empty())
+    {
+        mWide.erase(mWide.lower_bound(aDest), mWide.upper_bound(static_cast<AddrType>(destEnd - 1)));
+    }
+}
+
+/*****************************************************************
+@brief Find the segment holding an address.
+
+@returns The segment, NULL if the address is absent.
+*/
+const ImageData::Segment *ImageData::FindSegment(AddrType aAddr) const
+{
+    SegmentList::const_iterator next = std::upper_bound(mSegments.begin(), mSegments.end(), aAddr, BaseIsAfter);
+    if(next == mSegments.begin())
+    {
+        return NULL;
+    }
+    const Segment &segment = *(next - 1);
+    return (aAddr - segment.base < segment.words.size()) ? &segment : NULL;
+}
+
+DataType ImageData::WordValue(const Segment &aSegment, size_t aOffset) const
+{
+    if(!mWide.empty())
+    {
+        std::map<AddrType, DataType>::const_iterator wide = mWide.find(aSegment.base + static_cast<AddrType>(aOffset));
+        if(wide != mWide.end())
+        {
+            return wide->second;
+        }
+    }
+    return aSegment.words[aOffset];
+}
+
 /*****************************************************************
 @brief Extract address and value from a line of xuv
 
@@ -89,21 +960,21 @@ ParseXuvLineStatus ParseXuvLine(const std::string &aLine, AddrType &aAddress, Da
 
 
 /*****************************************************************
-@brief Read a xuv file preserving comments.
+@brief Read xuv text held in memory preserving comments.
 
 @param[out] aXuv        image struct containing xuv image
-@param[in] aFilename    Filename of xuv file
+@param[in] apText       The xuv text.
+@param[in] aSize        Length of the text.
 
 @returns
-    READ_BADFILE    Error opening or reading file.
     READ_SYNTAX     Syntax error or address/data is too large.
-    READ_OK         File read successfully.
+    READ_OK         Text read successfully.
 
 @note
 Comments are considered to be line not starting with [[:blank:]]*@
 Data lines must not contain non-blanks after data
 */
-ReadStatus Read(image &aXuv, const char *aFilename)
+ReadStatus ReadText(image &aXuv, const char *apText, size_t aSize)
 {
     ReadStatus result = READ_OK;
     /* Ensure aXuv is empty*/
@@ -111,48 +982,116 @@ ReadStatus Read(image &aXuv, const char *aFilename)
     aXuv.comments.clear();
     aXuv.TailComment.clear();
 
-    /*
-    Open file. We use ifstream so we don't need to worry about line length
-    and buffer size.
-    */
-    std::ifstream infile(aFilename);
-    if(!infile.good())
-    {
-        return READ_BADFILE;
-    }
-    /* Iterate each line in file */
-    std::string line, comment;
-    while(std::getline(infile, line) && !result)
+    /* Iterate each line in text, the last need not end with a newline */
+    const char *end = apText + aSize;
+    std::string comment;
+    for(const char *line = apText; line < end && !result; )
     {
+        const char *eol = static_cast<const char *>(memchr(line, '\n', end - line));
+        if(!eol)
+        {
+            eol = end;
+        }
         AddrType addr;
         DataType data;
-        switch(ParseXuvLine(line, addr, data))
+        switch(ParseXuvRecord(line, eol, addr, data))
         {
         case PARSE_OK:
-            aXuv.data[addr] = data;
+            aXuv.data.Set(addr, data);
             if(comment.length())
             {
                 aXuv.comments[addr] = comment;
-                comment = "";
+                comment.clear();
             }
             break;
         case PARSE_COMMENT:
-            comment.append(line);
-            comment.append("\n");
+            {
+                const char *commentEnd = eol;
+#ifdef _WIN32
+                /* As read by a text mode stream, without the carriage return */
+                if(eol != end && commentEnd > line && '\r' == commentEnd[-1])
+                {
+                    --commentEnd;
+                }
+#endif
+                comment.append(line, commentEnd);
+                comment.append("\n");
+            }
             break;
         case PARSE_ERROR:
             result = READ_SYNTAX;
             break;
         }
+        line = eol + 1;
     }
     if(comment.length())
     {
         aXuv.TailComment = comment;
     }
-    infile.close();
     return result;
 }
 
+/*****************************************************************
+@brief Read a xuv file preserving comments.
+
+@param[out] aXuv        image struct containing xuv image
+@param[in] aFilename    Filename of xuv file
+
+@returns
+    READ_BADFILE    Error opening or reading file.
+    READ_SYNTAX     Syntax error or address/data is too large.
+    READ_OK         File read successfully.
+
+@note
+The file is mapped into memory and parsed in place by ReadText, or by
+ReadBinary if it is a binary xuv file. A sidecar stamped with the file is
+read instead, when present.
+*/
+ReadStatus Read(image &aXuv, const char *aFilename)
+{
+    FileStamp stamp;
+    if(GetFileStamp(aFilename, stamp))
+    {
+        MappedFile sidecar;
+        if(sidecar.Open((std::string(aFilename) + BINARY_EXTENSION).c_str())
+           && READ_OK == ParseBinary(aXuv, sidecar.Data(), sidecar.Size(), &stamp))
+        {
+            return READ_OK;
+        }
+    }
+
+    MappedFile file;
+    if(!file.Open(aFilename))
+    {
+        /* Ensure aXuv is empty*/
+        aXuv.data.clear();
+        aXuv.comments.clear();
+        aXuv.TailComment.clear();
+        return READ_BADFILE;
+    }
+    if(file.Size() >= sizeof BINARY_MAGIC && 0 == memcmp(file.Data(), BINARY_MAGIC, sizeof BINARY_MAGIC))
+    {
+        return ReadBinary(aXuv, file.Data(), file.Size());
+    }
+    return ReadText(aXuv, file.Data(), file.Size());
+}
+
+/*****************************************************************
+@brief Read a binary xuv file held in memory.
+
+@param[out] aXuv        image struct containing xuv image
+@param[in] apData       The file contents.
+@param[in] aSize        Size of the file.
+
+@returns
+    READ_SYNTAX     Not a valid binary xuv file.
+    READ_OK         File read successfully.
+*/
+ReadStatus ReadBinary(image &aXuv, const char *apData, size_t aSize)
+{
+    return ParseBinary(aXuv, apData, aSize, NULL);
+}
+
 /*****************************************************************
 @brief Write a xuv file preserving comments.
 
@@ -170,35 +1109,197 @@ Data lines must not contain non-blanks after data.
 @note
 Comments at addresses without corresponding data will not be written.
 
+@note
+A filename ending in BINARY_EXTENSION is written as a binary xuv file. Any
+sidecar of a xuv file is rewritten or removed, so it cannot go out of date.
+
 */
 WriteStatus Write(image &aXuv, const char *aFilename)
 {
+    if(IsBinaryFilename(aFilename))
+    {
+        return WriteBinary(aXuv, aFilename);
+    }
+
     /*
     Open file.
-    We use c functions for better formatting control.
+    Lines are formatted into a buffer written in large blocks, as printf
+    "@%06X   %04X\n" would format them. The file is opened in text mode so
+    newlines are written as before on Windows.
     */
     FILE *outfile = fopen(aFilename, "w");
     if(!outfile)
     {
         return WRITE_BADFILE;
     }
-    for(DataIterator di = aXuv.data.begin(); di != aXuv.data.end(); ++di)
+    BufferedWriter writer(outfile);
+    ConstCommentsIterator ci = aXuv.comments.begin();
+    for(ConstDataIterator di = aXuv.data.begin(); di != aXuv.data.end(); ++di)
     {
-        CommentsIterator ci = aXuv.comments.find(di->first);
-        if(ci != aXuv.comments.end())
+        /* Both are in address order, comments without data are skipped */
+        while(ci != aXuv.comments.end() && ci->first < di->first)
+        {
+            ++ci;
+        }
+        if(ci != aXuv.comments.end() && ci->first == di->first)
         {
-            fprintf(outfile, "%s", ci->second.c_str());
+            AppendComment(writer, ci->second);
         }
-        fprintf(outfile, "@%06X   %04X\n", di->first, di->second);
+        char *p = writer.Reserve(MAX_RECORD_LENGTH);
+        *p++ = '@';
+        p = FormatHex(p, di->first, 6);
+        memcpy(p, "   ", 3);
+        p = FormatHex(p + 3, di->second, 4);
+        *p++ = '\n';
+        writer.Commit(p);
     }
     if(aXuv.TailComment.length())
     {
-        fprintf(outfile, "%s", aXuv.TailComment.c_str());
+        AppendComment(writer, aXuv.TailComment);
+    }
+    bool written = writer.Flush();
+    if(fclose(outfile))
+    {
+        written = false;
+    }
+    if(!written)
+    {
+        return WRITE_BADFILE;
+    }
+
+    /* The sidecar is stamped once the file is complete */
+    const std::string sidecar = std::string(aFilename) + BINARY_EXTENSION;
+    if(!gWriteSidecar || WRITE_OK != WriteBinary(aXuv, sidecar.c_str(), aFilename))
+    {
+        remove(sidecar.c_str());
     }
-    fclose(outfile);
     return WRITE_OK;
 }
 
+/*****************************************************************
+@brief Check whether a filename is that of a binary xuv file.
+
+@param[in] aFilename    The filename.
+
+@returns true if the filename ends in BINARY_EXTENSION, in any case.
+*/
+bool IsBinaryFilename(const char *aFilename)
+{
+    const size_t length = strlen(aFilename);
+    const size_t extensionLength = sizeof BINARY_EXTENSION - 1;
+    if(length < extensionLength)
+    {
+        return false;
+    }
+    const char *pExtension = aFilename + length - extensionLength;
+    for(size_t i = 0; i < extensionLength; ++i)
+    {
+        if(tolower(static_cast<unsigned char>(pExtension[i])) != BINARY_EXTENSION[i])
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*****************************************************************
+@brief Write a binary xuv file.
+
+@param[in] aXuv             image struct containing xuv image
+@param[in] aFilename        Filename of binary xuv file
+@param[in] aSourceFilename  Filename of the xuv file to stamp the file with,
+                            so it may be read as its sidecar. NULL for none.
+
+@return
+    WRITE_BADFILE   Error opening or writing file, or aSourceFilename not found.
+    WRITE_OK        File written successfuly.
+
+@note
+Unlike Write, all the comments are kept, with or without data.
+*/
+WriteStatus WriteBinary(const image &aXuv, const char *aFilename, const char *aSourceFilename)
+{
+    FileStamp source = {0, 0};
+    if(aSourceFilename && !GetFileStamp(aSourceFilename, source))
+    {
+        return WRITE_BADFILE;
+    }
+    FILE *outfile = fopen(aFilename, "wb");
+    if(!outfile)
+    {
+        return WRITE_BADFILE;
+    }
+    const ImageData::SegmentList &segments = aXuv.data.Segments();
+    const std::map<AddrType, DataType> &wide = aXuv.data.WideValues();
+
+    unsigned char header[BINARY_HEADER_SIZE];
+    memcpy(header, BINARY_MAGIC, sizeof BINARY_MAGIC);
+    PutLittleEndian(header + BINARY_VERSION_OFFSET, BINARY_VERSION, 4);
+    PutLittleEndian(header + BINARY_FLAGS_OFFSET, aSourceFilename ? BINARY_FLAG_STAMPED : 0, 4);
+    PutLittleEndian(header + BINARY_SEGMENTS_OFFSET, segments.size(), 4);
+    PutLittleEndian(header + BINARY_WIDE_OFFSET, wide.size(), 4);
+    PutLittleEndian(header + BINARY_COMMENTS_OFFSET, aXuv.comments.size(), 4);
+    PutLittleEndian(header + BINARY_TAIL_OFFSET, aXuv.TailComment.size(), 4);
+    PutLittleEndian(header + BINARY_WORDS_OFFSET, aXuv.data.size(), 8);
+    PutLittleEndian(header + BINARY_SOURCE_SIZE_OFFSET, source.size, 8);
+    PutLittleEndian(header + BINARY_SOURCE_TIME_OFFSET, source.time, 8);
+
+    BufferedWriter writer(outfile);
+    writer.Append(reinterpret_cast<const char *>(header), sizeof header);
+    for(ImageData::SegmentList::const_iterator si = segments.begin(); si != segments.end(); ++si)
+    {
+        AppendEntry(writer, si->base, si->words.size());
+    }
+    for(std::map<AddrType, DataType>::const_iterator wi = wide.begin(); wi != wide.end(); ++wi)
+    {
+        AppendEntry(writer, wi->first, wi->second);
+    }
+    for(ConstCommentsIterator ci = aXuv.comments.begin(); ci != aXuv.comments.end(); ++ci)
+    {
+        AppendEntry(writer, ci->first, ci->second.size());
+    }
+    for(ImageData::SegmentList::const_iterator si = segments.begin(); si != segments.end(); ++si)
+    {
+        const WordType *pWord = &si->words[0];
+        if(!IsHostBigEndian())
+        {
+            writer.Append(reinterpret_cast<const char *>(pWord), 2 * si->words.size());
+            continue;
+        }
+        for(size_t left = si->words.size(); left; )
+        {
+            const size_t count = std::min(left, WRITE_BUFFER_SIZE / 2);
+            char *p = writer.Reserve(2 * count);
+            SwapWordBytes(p, pWord, count);
+            writer.Commit(p + 2 * count);
+            pWord += count;
+            left -= count;
+        }
+    }
+    for(ConstCommentsIterator ci = aXuv.comments.begin(); ci != aXuv.comments.end(); ++ci)
+    {
+        writer.Append(ci->second.data(), ci->second.size());
+    }
+    writer.Append(aXuv.TailComment.data(), aXuv.TailComment.size());
+
+    bool written = writer.Flush();
+    if(fclose(outfile))
+    {
+        written = false;
+    }
+    return written ? WRITE_OK : WRITE_BADFILE;
+}
+
+/*****************************************************************
+@brief Enable or disable writing a sidecar alongside each xuv file written.
+
+@param[in] aWriteSidecar    true to write sidecars.
+*/
+void SetWriteSidecar(bool aWriteSidecar)
+{
+    gWriteSidecar = aWriteSidecar;
+}
+
 /*****************************************************************
 @brief Extract a contiguous byte block of data from xuv image (big endian).
 
@@ -215,17 +1316,7 @@ Where data values are larger than 16-bits the upper bits will be ignored.
 */
 ByteBlockType ByteBlockFlattenU16BE(const image &aXuv, AddrType aFirst, AddrType aLast, unsigned char aFill)
 {
-    ByteBlockType block(2 * (aLast+1-aFirst), aFill);
-    for(AddrType ofs = 0, i = aFirst; i <= aLast; ++i, ofs += 2)
-    {
-        xuv::ConstDataIterator di = aXuv.data.find(i);
-        if (di != aXuv.data.end())
-        {
-            block[ofs] = (di->second >> 8) & 0xFF;
-            block[ofs + 1] = di->second & 0xFF;
-        }
-    }
-    return block;
+    return ByteBlockFlattenU16(aXuv, aFirst, aLast, aFill, true);
 }
 
 /*****************************************************************
@@ -243,17 +1334,7 @@ Where data values are larger than 16-bits the upper bits will be ignored.
 */
 ByteBlockType ByteBlockFlattenU16LE(const image &aXuv, AddrType aFirst, AddrType aLast, unsigned char aFill)
 {
-    ByteBlockType block(2 * (aLast+1-aFirst), aFill);
-    for(AddrType ofs = 0, i = aFirst; i <= aLast; ++i, ofs += 2)
-    {
-        xuv::ConstDataIterator di = aXuv.data.find(i);
-        if (di != aXuv.data.end())
-        {
-            block[ofs + 1] = (di->second >> 8) & 0xFF;
-            block[ofs] = di->second & 0xFF;
-        }
-    }
-    return block;
+    return ByteBlockFlattenU16(aXuv, aFirst, aLast, aFill, false);
 }
 
 /*****************************************************************
@@ -272,14 +1353,31 @@ Where data values are larger than 16-bits the upper bits will be ignored.
 */
 ByteBlockType ByteBlockFlattenU16(const image &aXuv, AddrType aFirst, AddrType aLast, unsigned char aFill, bool aBe)
 {
-    if(aBe)
+    ByteBlockType block(2 * (aLast+1-aFirst), aFill);
+    const ImageData::SegmentList &segments = aXuv.data.Segments();
+    /* Start from the segment holding or after aFirst */
+    ImageData::SegmentList::const_iterator si = std::upper_bound(segments.begin(), segments.end(), aFirst, BaseIsAfter);
+    if(si != segments.begin() && (si - 1)->Last() >= aFirst)
     {
-        return ByteBlockFlattenU16BE(aXuv, aFirst, aLast, aFill);
+        --si;
     }
-    else
+    for(; si != segments.end() && si->base <= aLast; ++si)
     {
-        return ByteBlockFlattenU16LE(aXuv, aFirst, aLast, aFill);
+        const AddrType first = std::max(si->base, aFirst);
+        const AddrType last = std::min(si->Last(), aLast);
+        const WordType *pWord = &si->words[first - si->base];
+        unsigned char *pByte = &block[2 * (first - aFirst)];
+        const size_t count = last - first + 1;
+        if(aBe == IsHostBigEndian())
+        {
+            memcpy(pByte, pWord, 2 * count);
+        }
+        else
+        {
+            SwapWordBytes(pByte, pWord, count);
+        }
     }
+    return block;
 }
 
 /*****************************************************************
@@ -295,11 +1393,7 @@ order into a xuv image.
 */
 void ByteBlockIncorporateU16BE(image &aXuv, AddrType aDest, unsigned char const *aFirst, unsigned char const *aLast)
 {
-    AddrType addr = aDest;
-    for(unsigned char const *p = aFirst; p <= aLast; ++addr, p += 2)
-    {
-        aXuv.data[addr] = (p[0] << 8) | p[1];
-    }
+    ByteBlockIncorporateU16(aXuv, aDest, aFirst, aLast, true);
 }
 
 /*****************************************************************
@@ -315,11 +1409,7 @@ order into a xuv image.
 */
 void ByteBlockIncorporateU16LE(image &aXuv, AddrType aDest, unsigned char const *aFirst, unsigned char const *aLast)
 {
-    AddrType addr = aDest;
-    for(unsigned char const *p = aFirst; p <= aLast; ++addr, p += 2)
-    {
-        aXuv.data[addr] = (p[1] << 8) | p[0];
-    }
+    ByteBlockIncorporateU16(aXuv, aDest, aFirst, aLast, false);
 }
 
 /*****************************************************************
@@ -336,14 +1426,21 @@ order into a xuv image.
 */
 void ByteBlockIncorporateU16(image &aXuv, AddrType aDest, unsigned char const *aFirst, unsigned char const *aLast, bool aBe)
 {
-    if(aBe)
+    if(aLast < aFirst)
+    {
+        return;
+    }
+    /* As many words as start at or before aLast */
+    std::vector<WordType> words((aLast - aFirst) / 2 + 1);
+    if(aBe == IsHostBigEndian())
     {
-        ByteBlockIncorporateU16BE(aXuv, aDest, aFirst, aLast);
+        memcpy(&words.front(), aFirst, 2 * words.size());
     }
     else
     {
-        ByteBlockIncorporateU16LE(aXuv, aDest, aFirst, aLast);
+        SwapWordBytes(&words.front(), aFirst, words.size());
     }
+    aXuv.data.SetWords(aDest, &words.front(), words.size());
 }
 
 } /* namespace xuv */
@@ -13,6 +13,7 @@
 #ifndef __XUV_READER_H__
 #define __XUV_READER_H__
 
+#include <cstddef>
 #include <vector>
 #include <string>
 #include <map>
@@ -23,22 +24,138 @@ namespace xuv
     /* Define base data types. */
     typedef unsigned int AddrType; /* type to store xuv address */
     typedef unsigned int DataType; /* type to store xuv data values */
+    typedef unsigned short WordType; /* type to store 16-bit xuv data values */
     typedef std::vector<unsigned char> ByteBlockType;
 
+    /**************************************************************************
+    @brief xuv image data
+
+    The (address, value) pairs of a xuv image held as sorted contiguous
+    segments, each a base address and the 16-bit words from there on. Segments
+    never overlap or touch, a word next to a segment is added to it and
+    segments it joins are merged. The rare values larger than 16 bits keep
+    their low 16 bits in the segment and the whole value in a sparse map.
+
+    The members named as those of std::map<AddrType, DataType> behave the same,
+    so code written for a map keeps working. Iterators are read only, values
+    are changed through operator[], Set or SetWords.
+    */
+    class ImageData
+    {
+    public:
+        /** A run of words at consecutive addresses. */
+        struct Segment
+        {
+            AddrType base;                  /* Address of the first word */
+            std::vector<WordType> words;    /* Words from base onwards */
+
+            AddrType Last() const { return base + static_cast<AddrType>(words.size() - 1); }
+        };
+        typedef std::vector<Segment> SegmentList;
+        typedef std::pair<AddrType, DataType> value_type;
+
+        /** Value at an address, as returned by operator[]. */
+        class Reference
+        {
+        public:
+            Reference(ImageData &aData, AddrType aAddr) : mData(aData), mAddr(aAddr) {}
+            operator DataType() const { return mData.Get(mAddr); }
+            Reference &operator=(DataType aValue) { mData.Set(mAddr, aValue); return *this; }
+            Reference &operator=(const Reference &aOther) { return *this = static_cast<DataType>(aOther); }
+        private:
+            ImageData &mData;
+            AddrType mAddr;
+        };
+
+        /** Iterator over the (address, value) pairs in address order. */
+        class const_iterator
+        {
+        public:
+            const_iterator() : mpData(NULL), mSegment(0), mOffset(0) {}
+            const_iterator(const ImageData *apData, size_t aSegment, size_t aOffset);
+            const value_type &operator*() const { return mValue; }
+            const value_type *operator->() const { return &mValue; }
+            const_iterator &operator++();
+            const_iterator &operator--();
+            const_iterator operator++(int) { const_iterator old(*this); ++*this; return old; }
+            const_iterator operator--(int) { const_iterator old(*this); --*this; return old; }
+            bool operator==(const const_iterator &aOther) const { return mSegment == aOther.mSegment && mOffset == aOther.mOffset; }
+            bool operator!=(const const_iterator &aOther) const { return !(*this == aOther); }
+        private:
+            void Load();
+            const ImageData *mpData;
+            size_t mSegment;
+            size_t mOffset;
+            value_type mValue;
+        };
+
+        /** Iterator over the (address, value) pairs in reverse address order. */
+        class const_reverse_iterator
+        {
+        public:
+            explicit const_reverse_iterator(const const_iterator &aBase) : mBase(aBase), mCurrent(aBase) { --mCurrent; }
+            const value_type &operator*() const { return *mCurrent; }
+            const value_type *operator->() const { return mCurrent.operator->(); }
+            const_reverse_iterator &operator++() { --mBase; --mCurrent; return *this; }
+            bool operator==(const const_reverse_iterator &aOther) const { return mBase == aOther.mBase; }
+            bool operator!=(const const_reverse_iterator &aOther) const { return !(*this == aOther); }
+            const_iterator base() const { return mBase; }
+        private:
+            const_iterator mBase;
+            const_iterator mCurrent;
+        };
+
+        ImageData() : mSize(0) {}
+
+        bool empty() const { return mSegments.empty(); }
+        size_t size() const { return mSize; }
+        void clear();
+        size_t count(AddrType aAddr) const { return NULL != FindSegment(aAddr); }
+        const_iterator find(AddrType aAddr) const;
+        const_iterator begin() const { return const_iterator(this, 0, 0); }
+        const_iterator end() const { return const_iterator(this, mSegments.size(), 0); }
+        const_reverse_iterator rbegin() const { return const_reverse_iterator(end()); }
+        const_reverse_iterator rend() const;
+        /* As std::map, an absent address is added with the value 0. */
+        Reference operator[](AddrType aAddr);
+        bool operator==(const ImageData &aOther) const;
+        bool operator!=(const ImageData &aOther) const { return !(*this == aOther); }
+
+        /** Value at an address, 0 if absent. */
+        DataType Get(AddrType aAddr) const;
+        /** Set the value at an address. */
+        void Set(AddrType aAddr, DataType aValue);
+        /** Set aCount consecutive words starting at aDest. */
+        void SetWords(AddrType aDest, const WordType *apWords, size_t aCount);
+        /** The segments in address order. */
+        const SegmentList &Segments() const { return mSegments; }
+        /** The values larger than 16 bits, by address. */
+        const std::map<AddrType, DataType> &WideValues() const { return mWide; }
+
+    private:
+        const Segment *FindSegment(AddrType aAddr) const;
+        DataType WordValue(const Segment &aSegment, size_t aOffset) const;
+
+        SegmentList mSegments;
+        std::map<AddrType, DataType> mWide;  /* Values larger than 16 bits */
+        size_t mSize;
+    };
+
     /**************************************************************************
     @brief xuv image struct
 
     This struct contains the xuv data along with comments.
 
-    Data is contained in a map since xuv file are not always contiguous data.
-    Comments are also contained in a map with the exception of comment following
+    Data is contained in segments of contiguous words since xuv file are not
+    always contiguous data.
+    Comments are contained in a map with the exception of comment following
     the last data line. Comments take the address of the following data line.
     The comment following the last data line is contained in the string TailComment.
     */
     struct image
     {
-        /** The xuv image data map containing (address, value) pairs. */
-        std::map<AddrType, DataType> data;
+        /** The xuv image data containing (address, value) pairs. */
+        ImageData data;
         /** The comments map containing (address, comment) pairs. */
         std::map<AddrType, std::string> comments;
         /** Comment lines that appear after last data line. */
@@ -46,8 +163,8 @@ namespace xuv
     };
 
     /** Define iterator types for xuv data and comment maps. */
-    typedef std::map<AddrType, DataType>::const_iterator ConstDataIterator;
-    typedef std::map<AddrType, DataType>::iterator DataIterator;
+    typedef ImageData::const_iterator ConstDataIterator;
+    typedef ImageData::const_iterator DataIterator;
     typedef std::map<AddrType, std::string>::const_iterator ConstCommentsIterator;
     typedef std::map<AddrType, std::string>::iterator CommentsIterator;
 
@@ -63,12 +180,39 @@ namespace xuv
     enum ReadStatus{READ_BADFILE= -2, READ_SYNTAX, READ_OK = 0};
     ReadStatus Read(image &aXuv, const char *aFilename);
 
+    /**************************************************************************
+    @brief Define function to read xuv text held in memory.
+    */
+    ReadStatus ReadText(image &aXuv, const char *apText, size_t aSize);
+
+    /**************************************************************************
+    @brief Define function to read a binary xuv file held in memory.
+    */
+    ReadStatus ReadBinary(image &aXuv, const char *apData, size_t aSize);
+
     /**************************************************************************
     @brief Define function to write xuv file.
     */
     enum WriteStatus{WRITE_BADFILE= -1, WRITE_OK = 0};
     WriteStatus Write(image &aXuv, const char *aFilename);
 
+    /**************************************************************************
+    @brief Define functions for binary xuv files.
+
+    A binary xuv file holds the same image as a xuv file, as tables of the
+    segments, words and comments, so it is loaded without parsing any text.
+    Read recognises a binary file by its header, Write uses the binary format
+    for files named with BINARY_EXTENSION. A binary file named as a xuv file
+    with BINARY_EXTENSION appended is a sidecar, read in place of the xuv file
+    while it is stamped with the size and modification time of the xuv file.
+    Write keeps the sidecar of a xuv file in step, writing it when enabled by
+    SetWriteSidecar and otherwise removing it.
+    */
+    const char BINARY_EXTENSION[] = ".xuvb";
+    bool IsBinaryFilename(const char *aFilename);
+    WriteStatus WriteBinary(const image &aXuv, const char *aFilename, const char *aSourceFilename = NULL);
+    void SetWriteSidecar(bool aWriteSidecar);
+
     /**************************************************************************
     @brief Define functions to extract a contiguous byte block.
 
@@ -33,6 +33,7 @@
 #define SECURLIB_EXPORT_ME
 #endif
 #include "securlib.h"
+#include "dfu/DFUEngine/CRC.h"
 #include "rsa/keyfile.h"
 #include "keyfile/keyfile.h"
 #include <common/types_t.h>
@@ -1048,4 +1049,190 @@ namespace securlib {
         return failure;
     }
 
+
+    ImageDigest::ImageDigest(unsigned aDigests)
+        : mDigests(aDigests), mRes(1), mCrc32(0xFFFFFFFF), mpCbcMacCtx(NULL), mDataSize(0)
+    {
+        FUNCTION_DEBUG_SENTRY;
+        memset(mCbcMac, 0, sizeof(mCbcMac));
+        if(mDigests & DIGEST_SHA256)
+        {
+            mRes = SHA256_Init(&mSha256);
+        }
+    }
+
+
+    ImageDigest::~ImageDigest()
+    {
+        FUNCTION_DEBUG_SENTRY;
+        if(mpCbcMacCtx)
+        {
+            EVP_CIPHER_CTX_free(mpCbcMacCtx);
+        }
+    }
+
+
+    int ImageDigest::SetCbcMacKey(const EVP_CIPHER *aType, const unsigned char *apKey, int aPadding)
+    {
+        int res = 0; /* default to failure (to match OpenSSL error for these functions) */
+        FUNCTION_DEBUG_SENTRY_RET(int, res);
+        const unsigned char iv[EVP_MAX_IV_LENGTH] = {0};
+
+        if((mDigests & DIGEST_CBCMAC) && !mpCbcMacCtx && EVP_CIPHER_mode(aType) == EVP_CIPH_CBC_MODE)
+        {
+            mpCbcMacCtx = EVP_CIPHER_CTX_new();
+            if(mpCbcMacCtx)
+            {
+                if((res = EVP_EncryptInit_ex(mpCbcMacCtx, aType, NULL, apKey, iv)))
+                {
+                    (void) EVP_CIPHER_CTX_set_padding(mpCbcMacCtx, aPadding);
+                }
+            }
+        }
+        mRes &= res;
+        return res;
+    }
+
+
+    int ImageDigest::Update(const void *apData, size_t aDataSize)
+    {
+        FUNCTION_DEBUG_SENTRY_RET(int, mRes);
+        const unsigned char *pData = static_cast<const unsigned char *>(apData);
+
+        if(mRes && (mDigests & DIGEST_CRC32))
+        {
+            CRC crc(mCrc32);
+            mCrc32 = crc(pData, aDataSize);
+        }
+        if(mRes && (mDigests & DIGEST_SHA256))
+        {
+            mRes = SHA256_Update(&mSha256, pData, aDataSize);
+        }
+        if(mRes && (mDigests & DIGEST_CBCMAC) && !mpCbcMacCtx)
+        {
+            /* No key set */
+            mRes = 0;
+        }
+        if(mRes && (mDigests & DIGEST_CBCMAC))
+        {
+            /* Only the last cipher block is kept, so encrypt through a small
+               scratch buffer rather than one the size of the data. */
+            const size_t SCRATCH_SIZE = 4096;
+            unsigned char scratch[SCRATCH_SIZE + EVP_MAX_BLOCK_LENGTH];
+            const int BLKSIZE = EVP_CIPHER_CTX_block_size(mpCbcMacCtx);
+
+            for(size_t i = 0; mRes && i < aDataSize; i += SCRATCH_SIZE)
+            {
+                size_t remainder = aDataSize - i;
+                int len = 0;
+                if(remainder > SCRATCH_SIZE)
+                {
+                    remainder = SCRATCH_SIZE;
+                }
+                mRes = EVP_EncryptUpdate(mpCbcMacCtx, scratch, &len, pData + i, static_cast<int>(remainder));
+                if(mRes && len >= BLKSIZE)
+                {
+                    memcpy(mCbcMac, &scratch[len - BLKSIZE], BLKSIZE);
+                }
+            }
+        }
+        mDataSize += aDataSize;
+        return mRes;
+    }
+
+
+    int ImageDigest::Final(ImageDigestsType *apDigests)
+    {
+        FUNCTION_DEBUG_SENTRY_RET(int, mRes);
+
+        memset(apDigests, 0, sizeof(*apDigests));
+        if(mRes && (mDigests & DIGEST_CRC32))
+        {
+            apDigests->crc32 = mCrc32;
+        }
+        if(mRes && (mDigests & DIGEST_SHA256))
+        {
+            mRes = SHA256_Final(apDigests->sha256.digest, &mSha256);
+        }
+        if(mRes && (mDigests & DIGEST_CBCMAC) && !mpCbcMacCtx)
+        {
+            /* No key set */
+            mRes = 0;
+        }
+        if(mRes && (mDigests & DIGEST_CBCMAC))
+        {
+            unsigned char block[EVP_MAX_BLOCK_LENGTH];
+            const int BLKSIZE = EVP_CIPHER_CTX_block_size(mpCbcMacCtx);
+            int len = 0;
+            if((mRes = EVP_EncryptFinal_ex(mpCbcMacCtx, block, &len)))
+            {
+                mRes = (len <= BLKSIZE);
+                if(len == BLKSIZE)
+                {
+                    memcpy(mCbcMac, block, BLKSIZE);
+                }
+                memcpy(apDigests->cbcMac, mCbcMac, BLKSIZE);
+                apDigests->cbcMacSize = BLKSIZE;
+            }
+        }
+        apDigests->dataSize = mDataSize;
+        return mRes;
+    }
+
+
+    bool DigestFile(ImageDigest &aDigest, const char *apFilename, size_t aTrailerSize,
+        std::vector<unsigned char> *apTrailer)
+    {
+        bool failure = false;
+        FUNCTION_DEBUG_SENTRY_RET(bool, failure);
+
+        FILE *pFile = fopen(apFilename, "rb");
+        if(!pFile)
+        {
+            failure = true;
+        }
+        else
+        {
+            std::vector<unsigned char> buffer(DIGEST_FILE_CHUNK_SIZE);
+            size_t dataLeft = 0;
+
+            fseek(pFile, 0, SEEK_END);
+            const long fileSize = ftell(pFile);
+            fseek(pFile, 0, SEEK_SET);
+            if(fileSize < 0 || static_cast<size_t>(fileSize) < aTrailerSize)
+            {
+                failure = true;
+            }
+            else
+            {
+                dataLeft = static_cast<size_t>(fileSize) - aTrailerSize;
+            }
+
+            while(!failure && dataLeft > 0)
+            {
+                const size_t chunkSize = (dataLeft < buffer.size() ? dataLeft : buffer.size());
+                if(fread(&buffer[0], 1, chunkSize, pFile) != chunkSize)
+                {
+                    failure = true;
+                }
+                else
+                {
+                    failure = (aDigest.Update(&buffer[0], chunkSize) != 1);
+                    dataLeft -= chunkSize;
+                }
+            }
+
+            if(!failure && apTrailer)
+            {
+                apTrailer->resize(aTrailerSize);
+                if(aTrailerSize > 0 && fread(&(*apTrailer)[0], 1, aTrailerSize, pFile) != aTrailerSize)
+                {
+                    failure = true;
+                }
+            }
+            fclose(pFile);
+        }
+        return failure;
+    }
+
 } /* namespace securlib */
@@ -571,6 +571,109 @@ namespace securlib {
     */
     SECURLIB_API bool WriteLeAes128KeysToBeFile(const Aes128KeysType& aKeys, const char *apFilename);
 
+    /* Digests calculated by ImageDigest, may be combined. */
+    const unsigned DIGEST_CRC32 = 0x01;     /* DFU file CRC (as DFUEngine CRC class) */
+    const unsigned DIGEST_SHA256 = 0x02;    /* As HashSha256 */
+    const unsigned DIGEST_CBCMAC = 0x04;    /* As OsslCbcMac */
+
+    /* Size of the buffer used by DigestFile */
+    const size_t DIGEST_FILE_CHUNK_SIZE = 64 * 1024;
+
+    /* Results of ImageDigest, only those digests requested are valid. */
+    typedef struct
+    {
+        uint32_t crc32;
+        HashType sha256;
+        unsigned char cbcMac[EVP_MAX_BLOCK_LENGTH];
+        size_t cbcMacSize;
+        uint64_t dataSize;
+    } ImageDigestsType;
+
+    /******************************************************************************
+    @brief Calculate several digests of the same data in a single pass.
+
+    Each block of data passed to Update is fed to every requested digest while
+    it is still in cache, so a large image need only be read once however many
+    digests are wanted. The results are identical to those of the equivalent
+    single digest functions.
+
+    @note
+    The DIGEST_CBCMAC key is set with SetCbcMacKey before the first Update.
+    Without it Update and Final fail.
+    */
+    class SECURLIB_API ImageDigest
+    {
+    public:
+        /******************************************************************************
+        @brief Constructor.
+
+        @param[in] aDigests     Digests to calculate (DIGEST_* values combined).
+        */
+        ImageDigest(unsigned aDigests);
+        ~ImageDigest();
+
+        /******************************************************************************
+        @brief Set the algorithm and key for DIGEST_CBCMAC.
+
+        @param[in] aType        Algorithm (EVP_CIPHER). Shall be in CBC mode.
+        @param[in] apKey        Key for encryption. Shall be EVP_CIPHER_key_length(aType).
+        @param[in] aPadding     Value to pass to EVP_CIPHER_CTX_set_padding().
+
+        @return Success or error code.
+        @retval 1   Success.
+        @retval 0   Failure.
+        */
+        int SetCbcMacKey(const EVP_CIPHER *aType, const unsigned char *apKey, int aPadding);
+
+        /******************************************************************************
+        @brief Add the next block of data to all of the digests.
+
+        @param[in] apData       Input data.
+        @param[in] aDataSize    Input data size.
+
+        @return Success or error code.
+        @retval 1   Success.
+        @retval 0   Failure (also returned for all later calls).
+        */
+        int Update(const void *apData, size_t aDataSize);
+
+        /******************************************************************************
+        @brief Finish the digests and get the results.
+
+        @param[out] apDigests   The results.
+
+        @return Success or error code.
+        @retval 1   Success.
+        @retval 0   Failure.
+        */
+        int Final(ImageDigestsType *apDigests);
+
+    private:
+        ImageDigest(const ImageDigest &);
+        ImageDigest &operator=(const ImageDigest &);
+
+        unsigned mDigests;
+        int mRes;
+        uint32_t mCrc32;
+        SHA256_CTX mSha256;
+        EVP_CIPHER_CTX *mpCbcMacCtx;
+        unsigned char mCbcMac[EVP_MAX_BLOCK_LENGTH];
+        uint64_t mDataSize;
+    };
+
+    /******************************************************************************
+    @brief Calculate digests of a file, reading it once in DIGEST_FILE_CHUNK_SIZE blocks.
+
+    @param[in,out] aDigest      Digest to update (Final is not called).
+    @param[in]  apFilename      Filename of the input file.
+    @param[in]  aTrailerSize    Number of bytes at the end of the file to exclude from the digests.
+    @param[out] apTrailer       If not NULL, receives the excluded bytes (e.g. a DFU suffix CRC).
+
+    @return true on failure
+    */
+    SECURLIB_API bool DigestFile(ImageDigest &aDigest, const char *apFilename,
+        size_t aTrailerSize = 0, std::vector<unsigned char> *apTrailer = NULL);
+
 } /* namespace securlib */
 
 #endif /* SECURLIB_H */
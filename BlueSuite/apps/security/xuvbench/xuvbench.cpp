@@ -0,0 +1,376 @@
+/*******************************************************************************
+ *
+ *  xuvbench.cpp
+ *
+ *  Copyright (c) 2021 Qualcomm Technologies International, Ltd.
+ *  All Rights Reserved.
+ *  Qualcomm Technologies International, Ltd. Confidential and Proprietary.
+ *
+ *  Benchmark of xuv::Read and xuv::Write against the stream based reader
+ *  and printf based writer they replaced, and of reading binary xuv files.
+ *
+ ******************************************************************************/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include <algorithm>
+#include <chrono>
+#include <iterator>
+#include <fstream>
+#include <string>
+
+#include "securitycmd/xuvreader.h"
+
+static const char *gpExeName = "xuvbench";
+
+/* Size of the generated xuv file in MB, followed by the size */
+static const char *OPTION_SIZE_STR = "-size";
+
+/* Number of times each reader reads the file, followed by the number */
+static const char *OPTION_REPEAT_STR = "-repeat";
+
+/* Ask for help */
+static const char *OPTION_HELP1_STR = "-help";
+static const char *OPTION_HELP2_STR = "-?";
+
+static const int XUVBENCH_SUCCESS = 0;
+static const int XUVBENCH_ERROR = 1;
+
+static const unsigned long DEFAULT_SIZE_MB = 100;
+static const unsigned long DEFAULT_REPEAT = 3;
+
+/* A comment is written before the data every COMMENT_INTERVAL lines */
+static const unsigned long COMMENT_INTERVAL = 4096;
+
+/* Bytes in a line of data as written by xuv::Write, "@AAAAAA   DDDD\n" */
+static const unsigned long LINE_LENGTH = 15;
+
+/*****************************************************************
+@brief Read a xuv file the way xuv::Read did, a line at a time from a
+       stream, each parsed by xuv::ParseXuvLine.
+*/
+static xuv::ReadStatus LegacyRead(xuv::image &aXuv, const char *aFilename)
+{
+    xuv::ReadStatus result = xuv::READ_OK;
+    aXuv.data.clear();
+    aXuv.comments.clear();
+    aXuv.TailComment.clear();
+
+    std::ifstream in(aFilename);
+    if(!in)
+    {
+        return xuv::READ_BADFILE;
+    }
+    std::string line;
+    std::string comment;
+    while(std::getline(in, line) && !result)
+    {
+        xuv::AddrType addr;
+        xuv::DataType data;
+        switch(xuv::ParseXuvLine(line, addr, data))
+        {
+        case xuv::PARSE_OK:
+            aXuv.data[addr] = data;
+            if(comment.length())
+            {
+                aXuv.comments[addr] = comment;
+                comment = "";
+            }
+            break;
+        case xuv::PARSE_COMMENT:
+            comment += line + "\n";
+            break;
+        case xuv::PARSE_ERROR:
+            result = xuv::READ_SYNTAX;
+            break;
+        }
+    }
+    if(comment.length())
+    {
+        aXuv.TailComment = comment;
+    }
+    return result;
+}
+
+/*****************************************************************
+@brief Write a xuv file the way xuv::Write did, printf for each line.
+*/
+static xuv::WriteStatus LegacyWrite(xuv::image &aXuv, const char *aFilename)
+{
+    FILE *outfile = fopen(aFilename, "w");
+    if(!outfile)
+    {
+        return xuv::WRITE_BADFILE;
+    }
+    for(xuv::ConstDataIterator di = aXuv.data.begin(); di != aXuv.data.end(); ++di)
+    {
+        xuv::ConstCommentsIterator ci = aXuv.comments.find(di->first);
+        if(ci != aXuv.comments.end())
+        {
+            fprintf(outfile, "%s", ci->second.c_str());
+        }
+        fprintf(outfile, "@%06X   %04X\n", di->first, di->second);
+    }
+    if(aXuv.TailComment.length())
+    {
+        fprintf(outfile, "%s", aXuv.TailComment.c_str());
+    }
+    fclose(outfile);
+    return xuv::WRITE_OK;
+}
+
+/*****************************************************************
+@brief Write a xuv file of about aSizeMb MB, with an occasional comment
+       and gap in the addresses.
+*/
+static bool WriteXuv(const char *aFilename, unsigned long aSizeMb)
+{
+    FILE *pFile = fopen(aFilename, "wb");
+    if(!pFile)
+    {
+        return false;
+    }
+    const unsigned long lines = aSizeMb * 1024 * 1024 / LINE_LENGTH;
+    unsigned long address = 0;
+    unsigned int value = 0x1234;
+    fprintf(pFile, "// xuvbench image, %lu lines\n", lines);
+    for(unsigned long i = 0; i < lines; ++i)
+    {
+        if(i && 0 == i % COMMENT_INTERVAL)
+        {
+            fprintf(pFile, "// block %lu\n", i / COMMENT_INTERVAL);
+            address += 0x100;
+        }
+        value = value * 1103515245 + 12345;
+        fprintf(pFile, "@%06lX   %04X\n", address & 0xFFFFFF, (value >> 16) & 0xFFFF);
+        ++address;
+    }
+    fprintf(pFile, "// end\n");
+    return 0 == fclose(pFile);
+}
+
+/*****************************************************************
+@brief Time aRepeat reads of a file, the image is left from the last.
+
+@returns Fastest read in milliseconds, negative if a read failed.
+*/
+static double TimeRead(xuv::ReadStatus (*apRead)(xuv::image &, const char *),
+                       const char *aFilename, unsigned long aRepeat, xuv::image &aXuv)
+{
+    double best = -1;
+    for(unsigned long i = 0; i < aRepeat; ++i)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if(apRead(aXuv, aFilename) != xuv::READ_OK)
+        {
+            return -1;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(best < 0 || ms < best)
+        {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+/*****************************************************************
+@brief Time aRepeat writes of an image to a file.
+
+@returns Fastest write in milliseconds, negative if a write failed.
+*/
+static double TimeWrite(xuv::WriteStatus (*apWrite)(xuv::image &, const char *),
+                        xuv::image &aXuv, const char *aFilename, unsigned long aRepeat)
+{
+    double best = -1;
+    for(unsigned long i = 0; i < aRepeat; ++i)
+    {
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        if(apWrite(aXuv, aFilename) != xuv::WRITE_OK)
+        {
+            return -1;
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if(best < 0 || ms < best)
+        {
+            best = ms;
+        }
+    }
+    return best;
+}
+
+/*****************************************************************
+@brief Check two files hold the same bytes.
+*/
+static bool FilesMatch(const char *aFilename1, const char *aFilename2)
+{
+    std::ifstream file1(aFilename1, std::ios::binary);
+    std::ifstream file2(aFilename2, std::ios::binary);
+    std::istreambuf_iterator<char> end;
+    return file1 && file2
+           && std::equal(std::istreambuf_iterator<char>(file1), end, std::istreambuf_iterator<char>(file2))
+           && file2.peek() == std::char_traits<char>::eof();
+}
+
+static bool ParseNumber(const char *aValueStr, unsigned long &aValue)
+{
+    char *pEnd;
+    aValue = strtoul(aValueStr, &pEnd, 10);
+    return *aValueStr && !*pEnd && aValue;
+}
+
+static void Usage()
+{
+    printf("Usage: %s [%s <MB>] [%s <count>] [<file.xuv>]\n", gpExeName, OPTION_SIZE_STR, OPTION_REPEAT_STR);
+    printf("\n");
+    printf("Times xuv::Read against the previous stream based reader, and checks both\n");
+    printf("read the same image. Then times xuv::Write against the previous printf based\n");
+    printf("writer, and checks both write the same bytes. Then times reading the image\n");
+    printf("from a binary xuv file against xuv::Read. Without a file, a xuv file of\n");
+    printf("the given size (default %lu MB) is generated in the current directory.\n", DEFAULT_SIZE_MB);
+    printf("Each read and write is done %lu times by default, the fastest is shown.\n", DEFAULT_REPEAT);
+    printf("Files written are removed afterwards.\n");
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned long sizeMb = DEFAULT_SIZE_MB;
+    unsigned long repeat = DEFAULT_REPEAT;
+    const char *filename = NULL;
+
+    for(int i = 1; i < argc; ++i)
+    {
+        if(!strcmp(argv[i], OPTION_HELP1_STR) || !strcmp(argv[i], OPTION_HELP2_STR))
+        {
+            Usage();
+            return XUVBENCH_SUCCESS;
+        }
+        else if(!strcmp(argv[i], OPTION_SIZE_STR) && i + 1 < argc)
+        {
+            if(!ParseNumber(argv[++i], sizeMb))
+            {
+                fprintf(stderr, "Invalid size \"%s\"\n", argv[i]);
+                return XUVBENCH_ERROR;
+            }
+        }
+        else if(!strcmp(argv[i], OPTION_REPEAT_STR) && i + 1 < argc)
+        {
+            if(!ParseNumber(argv[++i], repeat))
+            {
+                fprintf(stderr, "Invalid repeat count \"%s\"\n", argv[i]);
+                return XUVBENCH_ERROR;
+            }
+        }
+        else if('-' != argv[i][0] && !filename)
+        {
+            filename = argv[i];
+        }
+        else
+        {
+            fprintf(stderr, "Invalid option \"%s\"\n", argv[i]);
+            Usage();
+            return XUVBENCH_ERROR;
+        }
+    }
+
+    const bool generated = !filename;
+    if(generated)
+    {
+        filename = "xuvbench.xuv";
+        printf("Writing %lu MB to %s\n", sizeMb, filename);
+        if(!WriteXuv(filename, sizeMb))
+        {
+            fprintf(stderr, "Failed to write %s\n", filename);
+            return XUVBENCH_ERROR;
+        }
+    }
+
+    xuv::image legacy;
+    xuv::image current;
+    const double legacyMs = TimeRead(LegacyRead, filename, repeat, legacy);
+    const double currentMs = TimeRead(xuv::Read, filename, repeat, current);
+
+    int result = XUVBENCH_SUCCESS;
+    if(legacyMs < 0 || currentMs < 0)
+    {
+        fprintf(stderr, "Failed to read %s\n", filename);
+        result = XUVBENCH_ERROR;
+    }
+    else
+    {
+        const bool same = legacy.data == current.data
+                          && legacy.comments == current.comments
+                          && legacy.TailComment == current.TailComment;
+        printf("%lu words, %lu comments\n",
+               static_cast<unsigned long>(current.data.size()),
+               static_cast<unsigned long>(current.comments.size()));
+        printf("Stream reader  %10.1f ms\n", legacyMs);
+        printf("xuv::Read      %10.1f ms  (%.1fx)\n", currentMs, legacyMs / currentMs);
+        printf("Images %s\n", same ? "match" : "DIFFER");
+        if(!same)
+        {
+            result = XUVBENCH_ERROR;
+        }
+    }
+
+    if(XUVBENCH_SUCCESS == result)
+    {
+        const char *legacyFilename = "xuvbench_legacy.xuv";
+        const char *currentFilename = "xuvbench_write.xuv";
+        const double legacyWriteMs = TimeWrite(LegacyWrite, current, legacyFilename, repeat);
+        const double currentWriteMs = TimeWrite(xuv::Write, current, currentFilename, repeat);
+        if(legacyWriteMs < 0 || currentWriteMs < 0)
+        {
+            fprintf(stderr, "Failed to write %s or %s\n", legacyFilename, currentFilename);
+            result = XUVBENCH_ERROR;
+        }
+        else
+        {
+            const bool same = FilesMatch(legacyFilename, currentFilename);
+            printf("printf writer  %10.1f ms\n", legacyWriteMs);
+            printf("xuv::Write     %10.1f ms  (%.1fx)\n", currentWriteMs, legacyWriteMs / currentWriteMs);
+            printf("Files %s\n", same ? "match" : "DIFFER");
+            if(!same)
+            {
+                result = XUVBENCH_ERROR;
+            }
+        }
+        remove(legacyFilename);
+        remove(currentFilename);
+    }
+
+    if(XUVBENCH_SUCCESS == result)
+    {
+        const std::string binaryFilename = std::string("xuvbench") + xuv::BINARY_EXTENSION;
+        xuv::image binary;
+        const double binaryWriteMs = TimeWrite(xuv::Write, current, binaryFilename.c_str(), repeat);
+        const double binaryMs = (binaryWriteMs < 0) ? -1 : TimeRead(xuv::Read, binaryFilename.c_str(), repeat, binary);
+        if(binaryMs < 0)
+        {
+            fprintf(stderr, "Failed to write or read %s\n", binaryFilename.c_str());
+            result = XUVBENCH_ERROR;
+        }
+        else
+        {
+            const bool same = binary.data == current.data
+                              && binary.comments == current.comments
+                              && binary.TailComment == current.TailComment;
+            printf("Binary write   %10.1f ms\n", binaryWriteMs);
+            printf("Binary read    %10.1f ms  (%.1fx)\n", binaryMs, currentMs / binaryMs);
+            printf("Images %s\n", same ? "match" : "DIFFER");
+            if(!same)
+            {
+                result = XUVBENCH_ERROR;
+            }
+        }
+        remove(binaryFilename.c_str());
+    }
+
+    if(generated)
+    {
+        remove(filename);
+    }
+    return result;
+}